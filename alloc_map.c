@@ -16,6 +16,7 @@ struct alloc_map
 {
   void * start_addr;
   size_t word_size;
+  size_t word_shift;
   size_t map_size;
   uint8_t bits[];
 };
@@ -24,16 +25,14 @@ struct alloc_map
 size_t
 alloc_map_mem_size_needed(size_t word_size, size_t block_size)
 {
-  return ((block_size/word_size)+2*sizeof(size_t)+sizeof(void*)+1);
+  return ((block_size/word_size)+3*sizeof(size_t)+sizeof(void*)+1);
 }
 
 
 void 
 alloc_map_create(alloc_map_t *alloc_map, void *start_addr, size_t word_size, size_t block_size)
 {
-  alloc_map->start_addr = start_addr;
-  alloc_map->word_size = word_size;
-  alloc_map->map_size = (block_size/word_size);
+  alloc_map_create_zeroed(alloc_map, start_addr, word_size, block_size);
   for(size_t i = 0; i <= (alloc_map->map_size); ++i)
     {
       alloc_map->bits[i] = 0;
@@ -41,12 +40,28 @@ alloc_map_create(alloc_map_t *alloc_map, void *start_addr, size_t word_size, siz
 }
 
 
+void 
+alloc_map_create_zeroed(alloc_map_t *alloc_map, void *start_addr, size_t word_size, size_t block_size)
+{
+  assert(word_size > 0 && (word_size & (word_size - 1)) == 0);
+  alloc_map->start_addr = start_addr;
+  alloc_map->word_size = word_size;
+  alloc_map->word_shift = 0;
+  while((1UL << alloc_map->word_shift) < word_size)
+    {
+      ++alloc_map->word_shift;
+    }
+  alloc_map->map_size = (block_size/word_size);
+}
+
+
 static size_t 
 alloc_map_check_offset(alloc_map_t *alloc_map, void *ptr){
+  // A pointer below start_addr wraps around to a huge offset that is
+  // caught by the map size compare
   size_t mem_offset = (size_t)ptr - (size_t)alloc_map->start_addr;
-  if(((mem_offset % (alloc_map->word_size)) == 0) && 
-     (alloc_map->map_size > (mem_offset/alloc_map->word_size)) &&
-     ((size_t)ptr >= (size_t)alloc_map->start_addr))
+  if(((mem_offset & (alloc_map->word_size - 1)) == 0) && 
+     (alloc_map->map_size > (mem_offset >> alloc_map->word_shift)))
     {
       return mem_offset;
     }
@@ -65,7 +80,7 @@ alloc_map_ptr_used(alloc_map_t *alloc_map, void *ptr)
     {
       return false;
     }
-  return alloc_map->bits[mem_offset / alloc_map->word_size] & On(mem_offset % alloc_map->word_size);
+  return alloc_map->bits[mem_offset >> alloc_map->word_shift] & On(0);
 }
 
 
@@ -80,15 +95,51 @@ alloc_map_set(alloc_map_t *alloc_map, void *ptr, bool state)
     }
   if(state)
     {
-      alloc_map->bits[mem_offset / alloc_map->word_size] |= On(mem_offset % alloc_map->word_size);
+      alloc_map->bits[mem_offset >> alloc_map->word_shift] |= On(0);
     }
   else
     {
-      alloc_map->bits[mem_offset / alloc_map->word_size] &= Off(mem_offset % alloc_map->word_size);
+      alloc_map->bits[mem_offset >> alloc_map->word_shift] &= Off(0);
+    }
+  return true;
+}
+
+
+bool
+alloc_map_set_n(alloc_map_t *alloc_map, void *ptr, size_t stride, size_t count, bool state)
+{
+  if(count == 0) return true;
+  size_t first_offset = alloc_map_check_offset(alloc_map, ptr);
+  size_t last_offset = alloc_map_check_offset(alloc_map, (char *) ptr + stride * (count - 1));
+  if(first_offset == (size_t)-1 || last_offset == (size_t)-1
+     || (count > 1 && (stride == 0 || stride % alloc_map->word_size != 0)))
+    {
+      assert(false && "Memory address out of scope (ALLOCMAPSETN)");
+      return false;
+    }
+  size_t step = count > 1 ? stride >> alloc_map->word_shift : 1;
+  size_t end = last_offset >> alloc_map->word_shift;
+  for(size_t i = first_offset >> alloc_map->word_shift; i <= end; i += step)
+    {
+      if(state)
+        {
+          alloc_map->bits[i] |= On(0);
+        }
+      else
+        {
+          alloc_map->bits[i] &= Off(0);
+        }
     }
   return true;
 }
 
+
+uint8_t *
+alloc_map_get_bits(alloc_map_t *alloc_map)
+{
+  return alloc_map->bits;
+}
+
 /*
 static void
 alloc_map_print_in_use(alloc_map_t *alloc_map)
@@ -19,6 +19,7 @@
 #ifndef __alloc_map__
 #define __alloc_map__
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 
@@ -40,7 +41,7 @@ typedef struct alloc_map alloc_map_t;
  *  @param start_addr the starting address for the memory block the
  *         allocation map represents.
  *  @param word_size the size of the words which the memory block is
- *         divided into.
+ *         divided into, a power of two.
  *  @param block_size the size in bytes of the memory block the map is
  *         going to represent
  *  
@@ -48,6 +49,25 @@ typedef struct alloc_map alloc_map_t;
 void 
 alloc_map_create(alloc_map_t *alloc_map, void *start_addr, size_t word_size, size_t block_size);
 
+/**
+ *  @brief Creates an allocation map in memory that is already zero.
+ *
+ *  Works like alloc_map_create() but does not clear the map, so the
+ *  memory is not touched. Use it for fresh anonymous mappings.
+ *
+ *  @param alloc_map the adress where the allocation map is to be created,
+ *         with alloc_map_mem_size_needed() bytes of zeroes.
+ *  @param start_addr the starting address for the memory block the
+ *         allocation map represents.
+ *  @param word_size the size of the words which the memory block is
+ *         divided into, a power of two.
+ *  @param block_size the size in bytes of the memory block the map is
+ *         going to represent
+ */
+void 
+alloc_map_create_zeroed(alloc_map_t *alloc_map, void *start_addr, size_t word_size, size_t block_size);
+
+
 /**
  *  @brief Gets the size needed for an allocation map.
  *
@@ -88,4 +108,39 @@ alloc_map_ptr_used(alloc_map_t *alloc_map, void *ptr);
 bool 
 alloc_map_set(alloc_map_t *alloc_map, void *ptr, bool state);
 
+
+/**
+ *  @brief Flags @p count addresses spaced @p stride bytes apart.
+ *
+ *  Equivalent to calling alloc_map_set() for @p ptr, @p ptr + @p stride
+ *  and so on, but only checks the bounds of the first and last address.
+ *
+ *  @param alloc_map pointer to the alloc map
+ *  @param ptr the first pointer to set
+ *  @param stride the distance in bytes between the pointers, a multiple
+ *         of the word size
+ *  @param count the number of pointers to set
+ *  @param state the value to set
+ *
+ *  @return true if all pointers were set, false if any is out of scope
+ *          in which case none is set
+ */
+bool
+alloc_map_set_n(alloc_map_t *alloc_map, void *ptr, size_t stride, size_t count, bool state);
+
+
+/**
+ *  @brief Gets the bytes the allocation map is stored in.
+ *
+ *  Byte i describes the word at start_addr + i * word_size and has its
+ *  lowest bit set when an object starts there. This is meant for
+ *  allocation fast paths that flag an address without a function call.
+ *
+ *  @param alloc_map pointer to the alloc map
+ *
+ *  @return pointer to the first byte of the map
+ */
+uint8_t *
+alloc_map_get_bits(alloc_map_t *alloc_map);
+
 #endif
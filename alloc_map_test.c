@@ -13,6 +13,7 @@ struct alloc_map
 {
   void * start_addr;
   size_t word_size;
+  size_t word_shift;
   size_t map_size;
   uint8_t bits[];
 };
@@ -32,6 +33,7 @@ test_alloc_map_create()
   
   //checks creation and values in the struct
   CU_ASSERT(alloc_map_create_alloc_map->word_size == 4);
+  CU_ASSERT(alloc_map_create_alloc_map->word_shift == 2);
   CU_ASSERT(alloc_map_create_alloc_map->start_addr == start_addr);
   CU_ASSERT(alloc_map_create_alloc_map->map_size == 256);
   
@@ -65,6 +67,25 @@ test_alloc_map_sets()
   free(alloc_map);
 }
 
+
+void
+test_alloc_map_create_zeroed()
+{
+  size_t block_size = 64 * sizeof(size_t);
+  size_t *start_addr = malloc(block_size);
+  alloc_map_t *alloc_map = calloc(1, alloc_map_mem_size_needed(sizeof(size_t), block_size));
+  alloc_map_create_zeroed(alloc_map, start_addr, sizeof(size_t), block_size);
+
+  CU_ASSERT(alloc_map->word_shift == 3);
+  CU_ASSERT(alloc_map->map_size == 64);
+  CU_ASSERT_FALSE(alloc_map_ptr_used(alloc_map, &start_addr[10]));
+  CU_ASSERT_TRUE(alloc_map_set(alloc_map, &start_addr[63], true));
+  CU_ASSERT_TRUE(alloc_map_ptr_used(alloc_map, &start_addr[63]));
+
+  free(start_addr);
+  free(alloc_map);
+}
+
 void
 test_alloc_map_sets_edge()
 {
@@ -118,6 +139,65 @@ test_alloc_map_sets_edge()
   free(alloc_map);
 }
 
+void
+test_alloc_map_get_bits()
+{
+  int type_size = sizeof(size_t);
+  typedef size_t type_t;
+  int block_size = 64;
+  size_t i = (block_size*type_size);
+  type_t *start_addr = malloc(i*sizeof(type_t));
+  alloc_map_t *alloc_map = malloc(alloc_map_mem_size_needed(type_size, i));
+  alloc_map_create(alloc_map, start_addr,type_size, i);
+
+  uint8_t *bits = alloc_map_get_bits(alloc_map);
+  CU_ASSERT(bits == alloc_map->bits);
+
+  bits[3] |= 1;
+  CU_ASSERT_TRUE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[3])));
+  alloc_map_set(alloc_map, (void *)&(start_addr[3]), false);
+  CU_ASSERT(bits[3] == 0);
+
+  free(start_addr);
+  free(alloc_map);
+}
+
+void
+test_alloc_map_set_n()
+{
+  int type_size = sizeof(size_t);
+  typedef size_t type_t;
+  int block_size = 64;
+  size_t i = (block_size*type_size);
+  type_t *start_addr = malloc(i*sizeof(type_t));
+  alloc_map_t *alloc_map = malloc(alloc_map_mem_size_needed(type_size, i));
+  alloc_map_create(alloc_map, start_addr,type_size, i);
+
+  CU_ASSERT_TRUE(alloc_map_set_n(alloc_map, (void *)&(start_addr[2]), 3 * type_size, 5, true));
+  for(int j = 0; j < block_size; ++j)
+    {
+      bool expected = j >= 2 && j <= 14 && (j - 2) % 3 == 0;
+      CU_ASSERT(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[j])) == expected);
+    }
+
+  CU_ASSERT_TRUE(alloc_map_set_n(alloc_map, (void *)&(start_addr[5]), 3 * type_size, 2, false));
+  CU_ASSERT_TRUE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[2])));
+  CU_ASSERT_FALSE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[5])));
+  CU_ASSERT_FALSE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[8])));
+  CU_ASSERT_TRUE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[11])));
+
+  // Last address out of scope sets nothing
+  CU_ASSERT_FALSE(alloc_map_set_n(alloc_map, (void *)&(start_addr[60]), type_size, 5, true));
+  CU_ASSERT_FALSE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[60])));
+
+  // Zero count is a no-op
+  CU_ASSERT_TRUE(alloc_map_set_n(alloc_map, (void *)&(start_addr[0]), type_size, 0, true));
+  CU_ASSERT_FALSE(alloc_map_ptr_used(alloc_map, (void *)&(start_addr[0])));
+
+  free(start_addr);
+  free(alloc_map);
+}
+
 
 int
 main (int argc, char *argv[])
@@ -137,6 +217,12 @@ main (int argc, char *argv[])
        (CU_add_test(suite1, "test_alloc_map_sets()", test_alloc_map_sets) == NULL)
        ||
        (CU_add_test(suite1, "test_alloc_map_sets_edge()", test_alloc_map_sets_edge) == NULL)
+       ||
+       (CU_add_test(suite1, "test_alloc_map_get_bits()", test_alloc_map_get_bits) == NULL)
+       ||
+       (CU_add_test(suite1, "test_alloc_map_set_n()", test_alloc_map_set_n) == NULL)
+       ||
+       (CU_add_test(suite1, "test_alloc_map_create_zeroed()", test_alloc_map_create_zeroed) == NULL)
       )
     {
       CU_cleanup_registry();
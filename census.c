@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "census.h"
+
+#define MIN_CAPACITY 64
+
+
+struct census
+{
+  size_t count;
+  size_t capacity;          /**< entries that fit in @p entries */
+  h_census_entry_t *entries;
+  size_t index_capacity;    /**< always a power of two */
+  size_t *index;            /**< the entry number + 1 of every slot, 0 if free */
+};
+
+
+/*============================================================================
+ *                             ENTRY TABLE
+ *===========================================================================*/
+
+static uint64_t
+hash_entry(enum h_layout_kind kind, const char *layout)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t) kind;
+  for(const char *c = layout; *c != '\0'; ++c)
+    {
+      hash = (hash ^ (uint64_t) (unsigned char) *c) * 0x100000001b3ULL;
+    }
+  return hash * 0x9E3779B97F4A7C15ULL;
+}
+
+
+/// The index uses linear probing, the slot of an entry that is not in
+/// the table is the free slot it would be put in
+static size_t
+find_slot(census_t *census, enum h_layout_kind kind, const char *layout)
+{
+  size_t mask = census->index_capacity - 1;
+  size_t slot = (size_t) (hash_entry(kind, layout) >> 32) & mask;
+  while(census->index[slot] != 0)
+    {
+      h_census_entry_t *entry = &census->entries[census->index[slot] - 1];
+      if(entry->kind == (uint64_t) kind && strcmp(entry->layout, layout) == 0) break;
+      slot = (slot + 1) & mask;
+    }
+  return slot;
+}
+
+
+static bool
+grow_index(census_t *census)
+{
+  size_t *old_index = census->index;
+  size_t *index = calloc(census->index_capacity * 2, sizeof(size_t));
+  if(index == NULL) return false;
+
+  census->index = index;
+  census->index_capacity *= 2;
+  for(size_t i = 0; i < census->count; ++i)
+    {
+      h_census_entry_t *entry = &census->entries[i];
+      census->index[find_slot(census, (enum h_layout_kind) entry->kind, entry->layout)] = i + 1;
+    }
+  free(old_index);
+  return true;
+}
+
+
+static h_census_entry_t *
+find_or_insert(census_t *census, enum h_layout_kind kind, const char *layout)
+{
+  size_t slot = find_slot(census, kind, layout);
+  if(census->index[slot] != 0) return &census->entries[census->index[slot] - 1];
+
+  if(census->count == census->capacity)
+    {
+      h_census_entry_t *entries = realloc(census->entries,
+                                          census->capacity * 2 * sizeof(h_census_entry_t));
+      if(entries == NULL) return NULL;
+      census->entries = entries;
+      census->capacity *= 2;
+    }
+  if((census->count + 1) * 2 > census->index_capacity)
+    {
+      if(!grow_index(census)) return NULL;
+      slot = find_slot(census, kind, layout);
+    }
+
+  h_census_entry_t *entry = &census->entries[census->count];
+  memset(entry, 0, sizeof(h_census_entry_t));
+  entry->kind = (uint64_t) kind;
+  strncpy(entry->layout, layout, H_CENSUS_LAYOUT_MAX - 1);
+  census->index[slot] = ++census->count;
+  return entry;
+}
+
+
+/*============================================================================
+ *                             COUNTING
+ *===========================================================================*/
+
+census_t *
+census_create(void)
+{
+  census_t *census = malloc(sizeof(census_t));
+  if(census == NULL) return NULL;
+  census->entries = malloc(MIN_CAPACITY * sizeof(h_census_entry_t));
+  census->index = calloc(MIN_CAPACITY * 2, sizeof(size_t));
+  if(census->entries == NULL || census->index == NULL)
+    {
+      census_delete(census);
+      return NULL;
+    }
+  census->count = 0;
+  census->capacity = MIN_CAPACITY;
+  census->index_capacity = MIN_CAPACITY * 2;
+  return census;
+}
+
+
+void
+census_delete(census_t *census)
+{
+  if(census == NULL) return;
+  free(census->entries);
+  free(census->index);
+  free(census);
+}
+
+
+void
+census_begin(census_t *census)
+{
+  assert(census != NULL);
+  census->count = 0;
+  memset(census->index, 0, census->index_capacity * sizeof(size_t));
+}
+
+
+bool
+census_add(census_t *census, enum h_layout_kind kind, const char *layout, size_t bytes,
+           bool pinned)
+{
+  assert(census != NULL);
+  assert(layout != NULL);
+  h_census_entry_t *entry = find_or_insert(census, kind, layout);
+  if(entry == NULL) return false;
+  if(pinned)
+    {
+      entry->pinned_objects += 1;
+      entry->pinned_bytes += bytes;
+    }
+  else
+    {
+      entry->objects += 1;
+      entry->bytes += bytes;
+    }
+  return true;
+}
+
+
+static int
+compare_entries(const void *a, const void *b)
+{
+  const h_census_entry_t *x = a;
+  const h_census_entry_t *y = b;
+  uint64_t x_bytes = x->bytes + x->pinned_bytes;
+  uint64_t y_bytes = y->bytes + y->pinned_bytes;
+  return (x_bytes < y_bytes) - (x_bytes > y_bytes);
+}
+
+
+void
+census_end(census_t *census)
+{
+  assert(census != NULL);
+  // The index is rebuilt by the next census_begin(), nothing is added
+  // in between
+  qsort(census->entries, census->count, sizeof(h_census_entry_t), compare_entries);
+}
+
+
+size_t
+census_entries(census_t *census)
+{
+  assert(census != NULL);
+  return census->count;
+}
+
+
+const h_census_entry_t *
+census_entry(census_t *census, size_t index)
+{
+  assert(census != NULL);
+  return index < census->count ? &census->entries[index] : NULL;
+}
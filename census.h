@@ -0,0 +1,92 @@
+/**
+ *  @file  census.h
+ *  @brief The live object census taken by the collections after
+ *         h_census_start().
+ *
+ *  A census counts objects and bytes per header kind and layout. Every
+ *  collection begins a new census, adds the objects it copies and the
+ *  objects on the pages it leaves pinned, and ends it, after which the
+ *  entries are sorted by their bytes and can be read until the next
+ *  collection begins.
+ */
+
+#ifndef __census__
+#define __census__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "gc.h"
+
+
+typedef struct census census_t;
+
+
+/**
+ *  @brief Creates an empty census.
+ *
+ *  @return the new census or NULL if memory cannot be allocated
+ */
+census_t *
+census_create(void);
+
+
+/**
+ *  @brief Deletes a census.
+ *
+ *  @param  census the census, may be NULL
+ */
+void
+census_delete(census_t *census);
+
+
+/**
+ *  @brief Throws away the entries to count a new collection.
+ */
+void
+census_begin(census_t *census);
+
+
+/**
+ *  @brief Counts one object.
+ *
+ *  @param  census the census
+ *  @param  kind how the header of the object describes its layout
+ *  @param  layout the layout of the object, empty for raw data
+ *  @param  bytes the size of the object
+ *  @param  pinned true if the object is on a pinned page
+ *  @return false if memory for a new entry cannot be allocated
+ */
+bool
+census_add(census_t *census, enum h_layout_kind kind, const char *layout, size_t bytes,
+           bool pinned);
+
+
+/**
+ *  @brief Sorts the entries by their bytes and pinned bytes together,
+ *         largest first.
+ */
+void
+census_end(census_t *census);
+
+
+/**
+ *  @brief Gets the number of entries.
+ */
+size_t
+census_entries(census_t *census);
+
+
+/**
+ *  @brief Gets an entry.
+ *
+ *  @param  census the census
+ *  @param  index the number of the entry
+ *  @return the entry or NULL if there is no such entry
+ */
+const h_census_entry_t *
+census_entry(census_t *census, size_t index);
+
+
+#endif
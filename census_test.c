@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "census.h"
+
+
+/*============================================================================
+ *                             COUNTING TESTING SUITE
+ *===========================================================================*/
+
+void
+test_census_empty()
+{
+  census_t *census = census_create();
+  CU_ASSERT(census != NULL);
+  CU_ASSERT(census_entries(census) == 0);
+  CU_ASSERT(census_entry(census, 0) == NULL);
+  census_begin(census);
+  census_end(census);
+  CU_ASSERT(census_entries(census) == 0);
+  census_delete(census);
+  census_delete(NULL);
+}
+
+void
+test_census_add()
+{
+  census_t *census = census_create();
+  census_begin(census);
+  CU_ASSERT(census_add(census, H_LAYOUT_BIT_VECTOR, "**i", 32, false));
+  CU_ASSERT(census_add(census, H_LAYOUT_BIT_VECTOR, "**i", 32, false));
+  CU_ASSERT(census_add(census, H_LAYOUT_BIT_VECTOR, "**i", 32, true));
+  CU_ASSERT(census_add(census, H_LAYOUT_RAW, "", 48, false));
+  census_end(census);
+
+  CU_ASSERT(census_entries(census) == 2);
+  const h_census_entry_t *entry = census_entry(census, 0);
+  CU_ASSERT(entry->kind == H_LAYOUT_BIT_VECTOR);
+  CU_ASSERT(strcmp(entry->layout, "**i") == 0);
+  CU_ASSERT(entry->objects == 2);
+  CU_ASSERT(entry->bytes == 64);
+  CU_ASSERT(entry->pinned_objects == 1);
+  CU_ASSERT(entry->pinned_bytes == 32);
+  entry = census_entry(census, 1);
+  CU_ASSERT(entry->kind == H_LAYOUT_RAW);
+  CU_ASSERT(entry->objects == 1);
+  CU_ASSERT(entry->bytes == 48);
+  census_delete(census);
+}
+
+void
+test_census_kinds()
+{
+  census_t *census = census_create();
+  census_begin(census);
+
+  // The same layout described by different headers is counted apart
+  census_add(census, H_LAYOUT_BIT_VECTOR, "*i", 24, false);
+  census_add(census, H_LAYOUT_FORMAT_STRING, "*i", 24, false);
+  census_add(census, H_LAYOUT_ARRAY, "*i", 248, false);
+  census_end(census);
+
+  CU_ASSERT(census_entries(census) == 3);
+  CU_ASSERT(census_entry(census, 0)->kind == H_LAYOUT_ARRAY);
+  CU_ASSERT(census_entry(census, 1)->objects == 1);
+  CU_ASSERT(census_entry(census, 2)->objects == 1);
+  census_delete(census);
+}
+
+
+/*============================================================================
+ *                             CYCLES TESTING SUITE
+ *===========================================================================*/
+
+void
+test_census_sorted()
+{
+  census_t *census = census_create();
+  const size_t count = 1000;
+  char layout[16];
+
+  census_begin(census);
+  for(size_t i = 0; i < count; ++i)
+    {
+      snprintf(layout, sizeof(layout), "%zu*", i + 1);
+      for(size_t n = 0; n <= i % 7; ++n)
+        {
+          CU_ASSERT(census_add(census, H_LAYOUT_FORMAT_STRING, layout, 8 * (i + 2), n % 2 == 1));
+        }
+    }
+  census_end(census);
+  CU_ASSERT(census_entries(census) == count);
+
+  bool sorted = true;
+  uint64_t objects = 0;
+  for(size_t i = 0; i < count; ++i)
+    {
+      const h_census_entry_t *entry = census_entry(census, i);
+      objects += entry->objects + entry->pinned_objects;
+      if(i == 0) continue;
+      const h_census_entry_t *before = census_entry(census, i - 1);
+      sorted = sorted
+        && before->bytes + before->pinned_bytes >= entry->bytes + entry->pinned_bytes;
+    }
+  CU_ASSERT(sorted);
+  CU_ASSERT(objects == (count / 7) * 28 + 21);
+  census_delete(census);
+}
+
+void
+test_census_begin_again()
+{
+  census_t *census = census_create();
+  census_begin(census);
+  census_add(census, H_LAYOUT_RAW, "", 16, false);
+  census_add(census, H_LAYOUT_BIT_VECTOR, "*", 16, false);
+  census_add(census, H_LAYOUT_BIT_VECTOR, "*", 16, false);
+  census_end(census);
+
+  census_begin(census);
+  CU_ASSERT(census_entries(census) == 0);
+  census_add(census, H_LAYOUT_RAW, "", 16, false);
+  census_end(census);
+  CU_ASSERT(census_entries(census) == 1);
+  CU_ASSERT(census_entry(census, 0)->objects == 1);
+  census_delete(census);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_counting = NULL;
+  CU_pSuite suite_cycles = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_counting = CU_add_suite("Tests counting objects", NULL, NULL);
+  if (suite_counting == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_counting
+                            , "empty census"
+                            , test_census_empty) )
+       || (NULL == CU_add_test(suite_counting
+                               , "objects and pinned objects"
+                               , test_census_add) )
+       || (NULL == CU_add_test(suite_counting
+                               , "header kinds"
+                               , test_census_kinds) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_cycles = CU_add_suite("Tests census cycles", NULL, NULL);
+  if (suite_cycles == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_cycles
+                            , "sorted by bytes"
+                            , test_census_sorted) )
+       || (NULL == CU_add_test(suite_cycles
+                               , "a new cycle starts empty"
+                               , test_census_begin_again) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
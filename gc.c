@@ -1,4 +1,5 @@
 //#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -7,11 +8,22 @@
 #include <assert.h>
 #include <string.h>
 #include <malloc.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <time.h>
+#include <execinfo.h>
 
 #include "header.h"
 #include "stack_search.h"
 #include "header_hidden.h"
 #include "alloc_map.h"
+#include "gc_trace.h"
+#include "shared_stats.h"
+#include "snapshot.h"
+#include "recorder.h"
+#include "profiler.h"
+#include "census.h"
+#include "retention.h"
 
 #include <errno.h>
 #include "gc.h"
@@ -21,8 +33,27 @@
 
 #define HEADER_SIZE 8
 #define WORD_SIZE 8
-#define PAGE_SIZE 2048
+#define PAGE_SIZE H_PAGE_SIZE
+#define PAGE_SHIFT 11
 #define SMALLEST_ALLOC_SIZE 16
+#define GROWTH_FACTOR 2
+#define RELEASE_AFTER_COLLECTIONS 4
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define ALLOC_RATE_WINDOW_NS 1000000000ULL
+#define ALLOC_RATE_MIN_SAMPLE_NS 1000000ULL
+#define SNAPSHOT_BUFFER_SIZE 4096
+#define PROFILE_SKIP 2 /**< profile_object() and the allocation function */
+#define SOFT_REF_THRESHOLD 0.9f
+
+#ifdef MADV_FREE
+#define IDLE_RELEASE_ADVICE MADV_FREE
+#else
+#define IDLE_RELEASE_ADVICE MADV_DONTNEED
+#endif
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
 
 /*
 #include <setjmp.h>
@@ -31,6 +62,12 @@
   if (setjmp(env)) abort();                     \
 */
 
+#define Trace(h, kind, phase, arg)                                      \
+  do {                                                                  \
+    if((h)->trace != NULL)                                              \
+      trace_record((h)->trace, kind, phase, time_ns(), arg);            \
+  } while(0)
+
 #define Get_stack_top(ptr) do {size_t dummy = 0xDEADBEEF; ptr = &dummy;} while(0);
 
 /*============================================================================
@@ -38,23 +75,23 @@
  *===========================================================================*/
 
 /**
- *  @brief Creates an array of pages 
+ *  @brief Creates page descriptors for a range of pages
  *          
- *  @param  memory pointer to the start of the allocated memory
- *  @param  start_of_pages pointer to the start of the memory area where the pages will be stored
+ *  @param  memory pointer to the start of the heap memory
+ *  @param  descriptors pointer to the memory area where all page descriptors are stored
+ *  @param  first the index of the first page to create
  *  @param  number_of_pages the number of pages to be created
  *  @param  page_size the size of each page
- *  @param  h pointer to the heap struct 
+ *  @param  h the heap whose page table is filled in
  */
-void 
-create_pages(void *memory, page_t *start_of_pages, int number_of_pages, size_t page_size, heap_t *h)
+void
+create_pages(void *memory, page_t *descriptors, size_t first, size_t number_of_pages, size_t page_size, heap_t *h)
 {
-  for (int i = 0; i < number_of_pages; ++i) 
+  for (size_t i = first; i < first + number_of_pages; ++i) 
     {
       unsigned long page_start =  (unsigned long) memory + (i * page_size);
-      *start_of_pages = ( (page_t) {(void *) page_start, (void *)page_start, page_size, PASSIVE} );
-      h->pages[i] = start_of_pages;
-      ++start_of_pages;
+      descriptors[i] = ( (page_t) {(void *) page_start, (void *)page_start, page_size, PASSIVE, 0, 0, false} );
+      h->pages[i] = &descriptors[i];
     }
 } 
 
@@ -122,766 +159,2853 @@ page_set_type(page_t *page, page_type_t type)
   page->type = type;
 }
 
+size_t
+page_get_size_class(page_t *page)
+{
+  return page->size_class;
+}
+
+void
+page_set_size_class(page_t *page, size_t size_class)
+{
+  page->size_class = size_class;
+}
+
+/**
+ *  @brief Marks a page as passive since collection @p collection
+ *
+ *  The page memory is in use again, so it has to be released anew.
+ */
+void
+page_set_idle_since(page_t *page, size_t collection)
+{
+  page->idle_since = collection;
+  page->released = false;
+}
+
 /*============================================================================
- *                             HEAP FUNCTIONS
+ *                             ALLOCATION CURSORS
  *===========================================================================*/
 
-heap_t *
-h_init(size_t bytes, bool unsafe_stack, float gc_threshold)
+/**
+ *  @brief Makes @p page the page the fast path of @p size_class bumps into
+ *
+ *  @param  h a pointer to the heap
+ *  @param  size_class the size class of the cursor
+ *  @param  page the new current page of the size class
+ */
+void
+cursor_set(heap_t *h, size_t size_class, page_t *page)
 {
-  assert(bytes >= PAGE_SIZE*2);
-  if(!(bytes >= PAGE_SIZE*2)) return NULL;
-  assert(bytes % PAGE_SIZE == 0);
-  if(!(bytes % PAGE_SIZE == 0)) return NULL;
-  assert(0 < gc_threshold && gc_threshold <= 1);
-  if(!(0 < gc_threshold && gc_threshold <= 1)) return NULL;
-
-  size_t number_of_pages = (bytes / PAGE_SIZE);
-  
+  h->fast.cursors[size_class].bump = &page->bump;
+  h->fast.cursors[size_class].end = page_get_end(page);
+}
 
-  size_t heap_struct_size = sizeof(void*) + sizeof(alloc_map_t *) + sizeof(size_t)
-                            + sizeof(bool)  + sizeof(float)  + sizeof(size_t) 
-                            + (sizeof(void *) * (number_of_pages) );
-  if(heap_struct_size % WORD_SIZE != 0)
+/**
+ *  @brief Detaches all cursors from their pages so the fast path fails
+ *
+ *  @param  h a pointer to the heap
+ */
+void
+cursors_reset(heap_t *h)
+{
+  for(size_t i = 0; i < NUMBER_OF_SIZE_CLASSES; ++i)
     {
-      heap_struct_size += (WORD_SIZE - heap_struct_size % WORD_SIZE);
+      h->fast.cursors[i].bump = &h->fast.no_page;
+      h->fast.cursors[i].end = NULL;
     }
-  
-  size_t alloc_map_size = alloc_map_mem_size_needed(WORD_SIZE, bytes);
-  size_t pages_size = (sizeof(page_t) * number_of_pages);
-  void *ptr_to_allocated_space = malloc(heap_struct_size + bytes + alloc_map_size + pages_size);
+}
 
-  
-  if(ptr_to_allocated_space == NULL)
+/**
+ *  @brief Recalculates how much the fast path may allocate before the
+ *         gc threshold is reached
+ *
+ *  Must be called whenever used memory changes outside of the fast path.
+ *
+ *  @param  h a pointer to the heap
+ */
+void
+update_headroom(heap_t *h)
+{
+  // The fast path only lowers the headroom, what it lost is what it allocated
+  h->bytes_allocated += h->headroom_base - h->fast.headroom;
+  size_t threshold_bytes = (size_t) ((double) h->gc_threshold * (double) h->size);
+  size_t used = h_used(h);
+  h->fast.headroom = threshold_bytes > used ? threshold_bytes - used : 0;
+  // Allocations are recorded in the slow path, so the fast path is closed
+  if(h->recorder != NULL) h->fast.headroom = 0;
+  // and the allocation that reaches the next sample takes the slow path
+  if(h->profiler != NULL)
     {
-      return NULL;
+      uint64_t next = profiler_next(h->profiler);
+      size_t until = next > h->bytes_allocated ? next - h->bytes_allocated - 1 : 0;
+      if(until < h->fast.headroom) h->fast.headroom = until;
     }
-
-  heap_t *heap = ptr_to_allocated_space;
-  heap->memory = (void *) ((size_t) ptr_to_allocated_space + heap_struct_size);
-  heap->alloc_map = (alloc_map_t *) ( (size_t) heap->memory + bytes);
-  heap->size = bytes;
-  heap->unsafe_stack = unsafe_stack;
-  heap->gc_threshold = gc_threshold;
-  heap->number_of_pages = number_of_pages;
-
-  alloc_map_create(heap->alloc_map, heap->memory, WORD_SIZE, bytes);
-  
-  void *start_of_pages = (void *) ((size_t) heap->alloc_map + alloc_map_size);
-  create_pages(heap->memory, start_of_pages, number_of_pages, PAGE_SIZE, heap);
-  return heap;
+  h->headroom_base = h->fast.headroom;
 }
 
 
-void *
-get_memory(heap_t *h) 
-{
-  return h->memory;
-}
+/*============================================================================
+ *                             VIRTUAL MEMORY
+ *===========================================================================*/
 
+/**
+ *  @brief Rounds @p bytes up to a multiple of @p multiple
+ */
 size_t
-heap_get_size(heap_t *h)
+round_up(size_t bytes, size_t multiple)
 {
-  return h->size;
+  if(bytes % multiple != 0)
+    {
+      bytes += multiple - bytes % multiple;
+    }
+  return bytes;
 }
 
+/**
+ *  @brief Rounds @p bytes up to the nearest power of two
+ */
 size_t
-heap_get_number_of_pages(heap_t *h)
+round_to_power_of_two(size_t bytes)
 {
-  return h->number_of_pages;
+  size_t power = 1;
+  while(power < bytes)
+    {
+      power <<= 1;
+    }
+  return power;
 }
 
-void
-h_delete(heap_t *h)
+/**
+ *  @brief Rounds @p bytes up to a multiple of the operating system page size
+ */
+size_t
+round_to_os_page(size_t bytes)
 {
-  assert(h != NULL);
-  if(h==NULL) return;
-  free(h);
+  return round_up(bytes, (size_t) sysconf(_SC_PAGESIZE));
 }
 
-
-void 
-h_delete_dbg(heap_t *h, void *dbg_value)
+/**
+ *  @brief Reserves @p bytes of address space where the address @p offset
+ *         bytes in is a multiple of @p alignment
+ *
+ *  More than needed is reserved and the unaligned ends are unmapped.
+ *
+ *  @param  bytes the size of the reservation, a multiple of the os page size
+ *  @param  alignment a power of two multiple of the os page size
+ *  @param  offset the offset into the reservation that is aligned, a
+ *          multiple of the os page size
+ *  @return the reservation, or NULL if it could not be made
+ */
+void *
+reserve_aligned(size_t bytes, size_t alignment, size_t offset)
 {
-  assert(h != NULL);
-  if(h==NULL) return;
-#ifdef SPARC
-  int dummy = 0;
-  void *stack_top = &dummy;
-#else
-  void *stack_top = __builtin_frame_address(0);
-#endif
-  size_t number_of_ptrs = get_number_of_ptrs_in_stack(h, stack_top);
-  void **array[number_of_ptrs];
-  size_t actual_nr_of_ptrs = 0;
-  actual_nr_of_ptrs = get_ptrs_from_stack(h, stack_top, array, number_of_ptrs);
-  for(size_t i = 0; i < actual_nr_of_ptrs; ++i)
+  char *mapping = mmap(NULL, bytes + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(mapping == MAP_FAILED)
     {
-      *array[i] = dbg_value;
+      return NULL;
     }
-  h_delete(h);
+
+  char *aligned = (char *) round_up((size_t) mapping + offset, alignment) - offset;
+  if(aligned > mapping)
+    {
+      munmap(mapping, aligned - mapping);
+    }
+  if(mapping + bytes + alignment > aligned + bytes)
+    {
+      munmap(aligned + bytes, (mapping + bytes + alignment) - (aligned + bytes));
+    }
+  return aligned;
 }
 
 /**
- *  @brief Recursively sets the status  of all active pointers in the heap
- *         to not found
+ *  @brief Makes reserved memory readable and writable
+ *
+ *  @param  start the start of the range, aligned to an os page
+ *  @param  bytes the size of the range
+ *  @return true if the memory could be committed
+ */
+bool
+commit_memory(void *start, size_t bytes)
+{
+  if(bytes == 0) return true;
+  return mprotect(start, round_to_os_page(bytes), PROT_READ | PROT_WRITE) == 0;
+}
+
+/**
+ *  @brief Commits more of the reserved heap memory
+ *
+ *  The new pages get their descriptors when they are first used.
  *
  *  @param  h a pointer to the heap
- *  @param  ptr a pointer to be searched recursively from
+ *  @param  new_size the wanted heap size, capped to the reservation
+ *  @return true if the heap grew
  */
-void
-reset_ptrs_to_not_found_heap_rec(heap_t *h, void *ptr)
+bool
+heap_grow(heap_t *h, size_t new_size)
 {
-  if(get_header_type(ptr) != STRUCT_REP)
-    {
-      return;
-    }
-  else 
+  if(new_size > h->max_size) new_size = h->max_size;
+  new_size -= new_size % PAGE_SIZE;
+  if(new_size <= h->size) return false;
+
+  size_t committed = round_up(h->size, h->commit_unit);
+  size_t to_commit = round_up(new_size, h->commit_unit);
+  if(to_commit > committed
+     && !commit_memory((char *) h->memory + committed, to_commit - committed))
     {
-      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
-      void **array[num_ptrs];
-      bool success = get_pointers_in_struct(ptr, array);
-      if(!success) return;
-      header_set_ptr_to_not_found(ptr);
-      
-      for(size_t i = 0; i < num_ptrs; ++i)
-        {
-          if(alloc_map_ptr_used(h->alloc_map, *array[i])
-             && header_ptr_already_found(*array[i]))
-            {
-              reset_ptrs_to_not_found_heap_rec(h, *array[i]);
-            }
-        }
+      return false;
     }
+
+  h->number_of_pages = new_size / PAGE_SIZE;
+  h->size = new_size;
+  update_headroom(h);
+  return true;
 }
 
 /**
- *  @brief Sets all data on the heap to not found
+ *  @brief Grows the heap when a collection left too little free memory
  *
- *  @param h the heap to set all active data to not found
- *  @param original_top the top of the stack
+ *  The growth policy is to multiply the size by GROWTH_FACTOR until the
+ *  live data and the coming allocation use at most half of the memory
+ *  allowed by the gc threshold, so that the next collection is not due
+ *  right away.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  bytes the size of the allocation that triggered the collection
+ *  @return true if the heap grew
  */
-void
-reset_ptrs_to_not_found(heap_t *h, void *original_top)
+bool
+grow_heap_if_needed(heap_t *h, size_t bytes)
 {
-  void *stack_top = original_top;
-  void *stack_bottom = (void *)*environ;
-  void *heap_start = h->memory;
-  void *heap_end = (h->memory + h->size);
-  void **pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
+  if(h->size >= h->max_size) return false;
 
-  while (pointer != NULL)
+  size_t wanted = h_used(h) + bytes;
+  size_t new_size = h->size;
+  while(new_size < h->max_size
+        && (double) wanted > (double) h->gc_threshold * (double) new_size / 2)
     {
-      if(alloc_map_ptr_used(h->alloc_map, *pointer))
-        {
-          reset_ptrs_to_not_found_heap_rec(h, *pointer);
-        }
-      pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
+      new_size *= GROWTH_FACTOR;
     }
+  return heap_grow(h, new_size);
 }
+
+
 /**
- *  @brief Sets all data on the heap to not found from an array
+ *  @brief Tells the os that whole os pages in a range are not needed
  *
- *  @param array the array to go through to get to the data
- *  @param size the size of @p array
+ *  @param  start the start of the range
+ *  @param  bytes the size of the range
+ *  @param  advice MADV_DONTNEED or MADV_FREE
+ *  @param  released where the number of bytes released is written
+ *  @return false if the os refused, true otherwise
  */
-void
-reset_ptrs_to_not_found_array(void **array[], size_t size)
+bool
+release_memory(void *start, size_t bytes, int advice, size_t *released)
 {
-  for(size_t i = 0; i < size; ++i)
-    {
-      void **current_ptr = array[i];
-      if(current_ptr != NULL && get_header_type(*current_ptr) == STRUCT_REP)
-        {
-          header_set_ptr_to_not_found(*current_ptr);
-        }
-    }
+  size_t os_page_size = (size_t) sysconf(_SC_PAGESIZE);
+  size_t first = round_to_os_page((size_t) start);
+  size_t last = ((size_t) start + bytes) - ((size_t) start + bytes) % os_page_size;
+  *released = 0;
+  if(last <= first) return true;
+  if(madvise((void *) first, last - first, advice) != 0) return false;
+  *released = last - first;
+  return true;
 }
 
 /**
- *  @brief Recursively gets the number of all active pointers in the heap 
- *
- *  @param  h a pointer to the heap
- *  @param  ptr a pointer to be searched recursively from
- *
- *  @return the number of all active pointers in the heap 
+ *  @brief Checks if a page has been passive for at least @p min_idle collections
  */
-size_t
-get_number_of_active_heap_ptrs_rec(heap_t *h, void *ptr)
+bool
+page_is_idle(heap_t *h, page_t *page, size_t min_idle)
 {
-  if(get_header_type(ptr) != STRUCT_REP)
-    {
-      return 0;
-    }
-  else 
-    {
-      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
-      size_t result = 0;
-      void **array[num_ptrs];
-      bool success = get_pointers_in_struct(ptr, array);
-      header_set_ptr_to_found(ptr);
-      if(!success) return 0;
-      
-      for(size_t i = 0; i < num_ptrs; ++i)
-        {
-          if(alloc_map_ptr_used(h->alloc_map, *array[i]))
-            {
-              ++result;
-              if(!header_ptr_already_found(*array[i]))
-                {
-                  result += get_number_of_active_heap_ptrs_rec(h, *array[i]);
-                }
-            }
-        }
-      return result;
-    }
+  return page->type == PASSIVE && h->collections - page->idle_since >= min_idle;
 }
 
 /**
- *  @brief Gets the number of active pointers on the stack and in the heap 
+ *  @brief Returns the memory of idle passive pages to the os
  *
- *  @param  h a pointer to the heap
- *  @param  original_top the top of the stack to search
+ *  Consecutive idle pages are released with one madvise call. Runs where
+ *  every page is already released are skipped. The pages of a run are
+ *  only marked released when the call succeeds, so a failed run is tried
+ *  again the next time.
  *
- *  @return the number of pointer found on stack and the heap
+ *  @param  h a pointer to the heap
+ *  @param  min_idle the number of collections a page must have been passive
+ *  @param  advice MADV_DONTNEED or MADV_FREE
+ *  @return the number of bytes released
  */
 size_t
-get_number_of_active_ptrs(heap_t *h, void *original_top)
+release_idle_pages(heap_t *h, size_t min_idle, int advice)
 {
-  void *stack_top = original_top;
-  void *stack_bottom = (void *)*environ;
-  void *heap_start = h->memory;
-  void *heap_end = (void *)((size_t)h->memory + (size_t)h->size);
-  void **pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
-
+  size_t released = 0;
   size_t i = 0;
-  while (pointer != NULL)
+  while(i < h->pages_created)
     {
-      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+      if(!page_is_idle(h, h->pages[i], min_idle))
         {
-          i += 1;
-          i += get_number_of_active_heap_ptrs_rec(h, *pointer);
+          ++i;
+          continue;
+        }
+
+      size_t run_start = i;
+      bool needs_release = false;
+      for(; i < h->pages_created && page_is_idle(h, h->pages[i], min_idle); ++i)
+        {
+          needs_release = needs_release || !h->pages[i]->released;
+        }
+      size_t run_released = 0;
+      if(needs_release && release_memory(h->pages[run_start]->start,
+                                         (i - run_start) * PAGE_SIZE, advice,
+                                         &run_released))
+        {
+          for(size_t j = run_start; j < i; ++j) h->pages[j]->released = true;
+          released += run_released;
         }
-      pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
     }
-  reset_ptrs_to_not_found(h, original_top);
-  return i;
+  return released;
 }
 
+
+/*============================================================================
+ *                             STATISTICS
+ *===========================================================================*/
+
 /**
- *  @brief Recursively gets all the active pointers in the heap and puts them into an array
- *
- *  @param  h a pointer to the heap
- *  @param  ptr a pointer to be searched recursively from
- *  @param  array an array of double pointers 
- *  @param  index where in the array to put found pointers
+ *  @brief Reads a monotonic clock
  *
+ *  @return the time in nanoseconds
+ */
+uint64_t
+time_ns(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+}
+
+/**
+ *  @brief Adds the counters of @p cycle to @p total
  */
 void
-get_active_heap_ptrs_rec(heap_t *h, void *ptr, void **array[], size_t *index)
+gc_stats_add(h_gc_stats_t *total, h_gc_stats_t *cycle)
 {
-  if(get_header_type(ptr) != STRUCT_REP)
+  total->collections += cycle->collections;
+  total->bytes_copied += cycle->bytes_copied;
+  total->objects_copied += cycle->objects_copied;
+  total->pages_evacuated += cycle->pages_evacuated;
+  total->pinned_pages += cycle->pinned_pages;
+  total->stack_roots += cycle->stack_roots;
+  total->false_roots += cycle->false_roots;
+  total->refs_cleared += cycle->refs_cleared;
+  total->root_scan_ns += cycle->root_scan_ns;
+  total->trace_ns += cycle->trace_ns;
+  total->copy_ns += cycle->copy_ns;
+  total->page_reset_ns += cycle->page_reset_ns;
+}
+
+/**
+ *  @brief Returns the bytes allocated on a heap since it was created
+ *
+ *  Bump allocations are counted without touching the fast path: it
+ *  lowers the headroom by every byte it allocates.
+ */
+size_t
+allocated_bytes(heap_t *h)
+{
+  return h->bytes_allocated + (h->headroom_base - h->fast.headroom);
+}
+
+/**
+ *  @brief Updates the moving allocation rate of a heap
+ *
+ *  The rate since the last sample is weighed in by how long ago that
+ *  sample was compared to ALLOC_RATE_WINDOW_NS, so older rates fade out
+ *  over about a second. Samples closer than ALLOC_RATE_MIN_SAMPLE_NS to
+ *  the last one are skipped.
+ *
+ *  @param  h a pointer to the heap
+ */
+void
+alloc_rate_sample(heap_t *h)
+{
+  uint64_t now = time_ns();
+  uint64_t elapsed = now - h->rate_sample_ns;
+  if(elapsed < ALLOC_RATE_MIN_SAMPLE_NS) return;
+
+  size_t allocated = allocated_bytes(h);
+  double rate = (double) (allocated - h->rate_sample_bytes) * 1e9 / (double) elapsed;
+  if(h->alloc_rate == 0.0)
     {
-      return;
+      h->alloc_rate = rate;
     }
-  else 
+  else
     {
-      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
-      if(num_ptrs == 0) return;
-      void **temp_array[num_ptrs];
-      bool success = get_pointers_in_struct(ptr, temp_array);
-      if(!success) return;
-      header_set_ptr_to_found(ptr);
-      size_t num_valid_ptrs = 0;
-      void ***sub_array =  &(array[*index]);
-      for(size_t i = 0; i < num_ptrs; ++i)
-        {
-          if(alloc_map_ptr_used(h->alloc_map, *temp_array[i]))
-            {
-              array[*index] = temp_array[i];
-              *index += 1;
-              ++num_valid_ptrs;
-            }
-        }
-      
-      for(size_t i = 0; i < num_valid_ptrs; ++i)
-        {
-          if(!header_ptr_already_found(*sub_array[i]))
-            {
-              get_active_heap_ptrs_rec(h, *sub_array[i], array, index);
-            }
-        }
+      double weight = (double) elapsed / (double) (elapsed + ALLOC_RATE_WINDOW_NS);
+      h->alloc_rate += weight * (rate - h->alloc_rate);
     }
+  h->rate_sample_ns = now;
+  h->rate_sample_bytes = allocated;
 }
 
 /**
- *  @brief Gets all the active pointers on the stack and in the heap and puts them into an array
+ *  @brief Writes the current statistics of a heap to its shared segment
  *
- *  @param  h a pointer to the heap
- *  @param  original_top the top of the stack to search
- *  @param  array an array of double pointers 
- *  @param  array_size the size of the array
+ *  Does nothing unless the heap publishes its statistics.
  *
- *  @return the number of pointer found on stack and the heap
+ *  @param  h a pointer to the heap
  */
-size_t
-get_active_ptrs(heap_t *h, void *original_top, void **array[], size_t array_size)
+void
+publish_stats(heap_t *h)
 {
-  for(size_t i = 0; i < array_size; ++i) array[i] = NULL;
+  shared_stats_t *out = h->published;
+  if(out == NULL) return;
 
-  size_t num_stack_ptrs = get_ptrs_from_stack(h, original_top, array, array_size);
-  size_t index = num_stack_ptrs;
-  for(size_t i = 0; i < num_stack_ptrs; ++i)
+  size_t active = 0;
+  size_t unsafe = 0;
+  size_t released = 0;
+  for(size_t i = 0; i < h->pages_created; ++i)
     {
-      get_active_heap_ptrs_rec(h, *array[i], array, &index);
+      page_type_t type = page_get_type(h->pages[i]);
+      if(type == ACTIVE) ++active;
+      if(type == UNSAFE) ++unsafe;
+      // The flag is only cleared when a page goes passive again
+      if(type == PASSIVE && h->pages[i]->released) ++released;
     }
-  reset_ptrs_to_not_found_array(array, array_size);
-  return num_stack_ptrs;
+
+  h_gc_stats_t *total = &h->stats.total;
+  shared_stats_begin_write(out);
+  out->updated_ns = time_ns();
+  out->size = h->size;
+  out->used = h_used(h);
+  out->avail = h_avail(h);
+  out->pages = h->number_of_pages;
+  out->passive_pages = number_of_passive_pages(h);
+  out->active_pages = active;
+  out->unsafe_pages = unsafe;
+  out->released_pages = released;
+  out->collections = total->collections;
+  out->bytes_copied = total->bytes_copied;
+  out->gc_ns = total->root_scan_ns + total->trace_ns + total->copy_ns + total->page_reset_ns;
+  out->last_pause_ns = h->last_pause_ns;
+  out->p99_pause_ns = histogram_percentile(&h->pauses, 99.0);
+  out->max_pause_ns = h->pauses.max;
+  out->allocated = allocated_bytes(h);
+  out->alloc_rate = h->alloc_rate;
+  shared_stats_end_write(out);
 }
 
 
+/*============================================================================
+ *                             RECORDING
+ *===========================================================================*/
+
 /**
- *  @brief Gets the number of pointer found on stack
+ *  @brief Gives a new object an id and records its allocation
  *
  *  @param  h a pointer to the heap
- *  @param  original_top the top of the stack to search
+ *  @param  data the data of the object
+ */
+void
+record_object(heap_t *h, void *data)
+{
+  bool is_struct = get_header_type(data) == STRUCT_REP;
+  size_t slots = is_struct ? get_number_of_pointers_in_struct(data) : 0;
+  uint64_t id = recorder_add(h->recorder, data, slots);
+  if(id == 0) return;
+
+  record_t record;
+  record.tag = RECORD_ALLOC;
+  record.id = id;
+  get_layout(data, record.layout, sizeof(record.layout));
+  if(get_array_length(data) > 0)
+    {
+      record.kind = RECORD_ARRAY;
+      record.size = get_array_length(data);
+    }
+  else if(record.layout[0] != '\0')
+    {
+      record.kind = RECORD_STRUCT;
+      record.size = 0;
+    }
+  else
+    {
+      record.kind = RECORD_RAW;
+      record.size = get_existing_data_size(data);
+    }
+  recorder_write(h->recorder, &record);
+}
+
+/**
+ *  @brief Records that an object got a new size and maybe a new address
+ */
+void
+record_resize(heap_t *h, void *from, void *to, size_t bytes)
+{
+  recorder_move(h->recorder, from, to);
+  record_t record = { .tag = RECORD_RESIZE, .id = recorder_id(h->recorder, to), .size = bytes };
+  if(record.id != 0) recorder_write(h->recorder, &record);
+}
+
+/**
+ *  @brief Starts recording a collection and marks the objects found from
+ *         the stack
  *
- *  @return the number of pointer found on stack
+ *  @param  h a pointer to the heap
+ *  @param  array the stack words pointing at objects
+ *  @param  array_size the number of stack words
  */
-size_t
-get_number_of_ptrs_in_stack(heap_t *h, void *original_top)
+void
+record_roots(heap_t *h, void **array[], size_t array_size)
 {
- 
-  void *stack_top = original_top;
-  void *stack_bottom = (void *)*environ;
-  void *heap_start = h->memory;
-  void *heap_end = (void *)((size_t)h->memory + (size_t)h->size);
-  void **pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
+  recorder_begin_collection(h->recorder);
+  for(size_t i = 0; i < array_size; ++i)
+    {
+      recorder_mark_root(h->recorder, *array[i]);
+    }
+}
 
-  size_t i = 0;
-  while (pointer != NULL)
+/**
+ *  @brief Records the pointer fields of an object that changed since
+ *         the last collection
+ */
+void
+record_stores(heap_t *h, void *data)
+{
+  if(get_header_type(data) != STRUCT_REP) return;
+  size_t slots = get_number_of_pointers_in_struct(data);
+  uint64_t id = recorder_id(h->recorder, data);
+  if(slots == 0 || id == 0) return;
+
+  void **pointer_slots[slots];
+  if(!get_pointers_in_struct(data, pointer_slots)) return;
+  for(size_t i = 0; i < slots; ++i)
     {
-      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+      void *target = *pointer_slots[i];
+      uint64_t target_id = alloc_map_ptr_used(h->alloc_map, target)
+        ? recorder_id(h->recorder, target) : 0;
+      if(!recorder_set_target(h->recorder, data, i, target_id)) continue;
+
+      record_t record =
         {
-          i += 1;
+          .tag = RECORD_STORE
+          , .id = id
+          , .offset = (uint64_t) ((char *) pointer_slots[i] - (char *) data)
+          , .target = target_id
+        };
+      recorder_write(h->recorder, &record);
+    }
+}
+
+/**
+ *  @brief Records what a collection left on the heap
+ *
+ *  Every object left on the heap is marked alive, objects that were
+ *  allocated without being recorded get their allocation recorded now.
+ *  Then the pointer fields that changed are recorded and the recorder
+ *  writes the deaths, root changes and the collection.
+ *
+ *  @param  h a pointer to the heap
+ */
+void
+record_collection(heap_t *h)
+{
+  for(int pass = 0; pass < 2; ++pass)
+    {
+      for(size_t page_nr = 0; page_nr < h->pages_created; ++page_nr)
+        {
+          page_t *page = h->pages[page_nr];
+          if(page_get_type(page) == PASSIVE) continue;
+
+          char *end = page_get_bump(page);
+          char *data = (char *) page_get_start(page) + HEADER_SIZE;
+          while(data < end)
+            {
+              if(!alloc_map_ptr_used(h->alloc_map, data))
+                {
+                  data += WORD_SIZE;
+                  continue;
+                }
+              if(pass == 0 && !recorder_mark_live(h->recorder, data))
+                {
+                  record_object(h, data);
+                  recorder_mark_live(h->recorder, data);
+                }
+              else if(pass == 1)
+                {
+                  record_stores(h, data);
+                }
+              data += round_alloc_size(get_existing_size(data));
+            }
         }
-      pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
     }
-  return i;
+  recorder_end_collection(h->recorder, h->collections);
 }
 
 
+/*============================================================================
+ *                             PROFILING
+ *===========================================================================*/
+
 /**
- *  @brief Puts the pointers found on the stack in an array
+ *  @brief Samples an allocation if it reached the next sample of the profiler
  *
- *  @param  h a pointer to the heap
- *  @param  original_top the top of the stack to search
- *  @param  array an empty array of double pointers 
- *  @param  array_size the size of the array 
+ *  The backtrace starts in the caller of the allocation function, the
+ *  @p skip innermost frames are this function and the allocation functions.
  *
- *  @return the number of pointer found on stack
+ *  @param  h a pointer to the heap
+ *  @param  data the data of the allocated object
+ *  @param  skip the number of frames to leave out of the backtrace
  */
-size_t
-get_ptrs_from_stack(heap_t *h, void *original_top, void **array[], size_t array_size)
+void
+profile_object(heap_t *h, void *data, size_t skip)
 {
-  void *stack_top = original_top;
-  void *stack_bottom = (void *)*environ;
-  void *heap_start = h->memory;
-  void *heap_end = (void *)((size_t)h->memory + (size_t)h->size);
+  size_t allocated = allocated_bytes(h);
+  if(allocated < profiler_next(h->profiler)) return;
 
-  void **pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
+  void *frames[PROFILER_MAX_DEPTH + PROFILE_SKIP + 1];
+  int depth = backtrace(frames, PROFILER_MAX_DEPTH + (int) skip);
+  if(depth < (int) skip) depth = (int) skip;
 
-  size_t i = 0;
-  while (pointer != NULL)
-    {
-      if(alloc_map_ptr_used(h->alloc_map, *pointer))
-        {       
-          assert(i < array_size && "There are more ptrs in stack than we thought!");
-          array[i] = pointer;
+  char layout[PROFILER_LAYOUT_MAX];
+  get_layout(data, layout, sizeof(layout) - 2);
+  if(get_array_length(data) > 0) strcat(layout, "[]");
 
-          i += 1;
-        }
-      pointer = stack_find_next_ptr(&stack_bottom, stack_top, heap_start, heap_end);
-    } 
-  //assert(i == array_size && "There are less ptrs in stack than we thought!"); 
-  return i;  
+  size_t bytes = round_alloc_size(get_existing_size(data));
+  profiler_sample(h->profiler, allocated, bytes, layout, frames + skip, (size_t) depth - skip);
+  update_headroom(h);
 }
 
-int
-get_ptr_page(heap_t *h, void * ptr)
+
+/*============================================================================
+ *                             CENSUS
+ *===========================================================================*/
+
+/**
+ *  @brief Counts an object in the census of the current collection
+ *
+ *  @param  h a pointer to the heap
+ *  @param  data the data of the object
+ *  @param  pinned true if the object is on a pinned page
+ */
+void
+count_live_object(heap_t *h, void *data, bool pinned)
 {
-  return (int) ( (size_t)ptr - (size_t)h->memory ) / PAGE_SIZE;
+  char layout[H_CENSUS_LAYOUT_MAX];
+  get_layout(data, layout, sizeof(layout));
+  census_add(h->census, get_layout_kind(data), layout,
+             round_alloc_size(get_existing_size(data)), pinned);
 }
 
-
-int
-find_next_active_page(heap_t *h, size_t index)
+/**
+ *  @brief Counts every object on the pages that an unsafe stack pinned
+ *
+ *  @param  h a pointer to the heap
+ */
+void
+count_pinned_objects(heap_t *h)
 {
-  for(int i = index; i < (int)h->number_of_pages; ++i)
+  for(size_t page_nr = 0; page_nr < h->pages_created; ++page_nr)
     {
-      if(h->pages[i]->type == ACTIVE)
+      page_t *page = h->pages[page_nr];
+      if(page_get_type(page) != UNSAFE) continue;
+
+      char *end = page_get_bump(page);
+      char *data = (char *) page_get_start(page) + HEADER_SIZE;
+      while(data < end)
         {
-          return i; 
+          if(!alloc_map_ptr_used(h->alloc_map, data))
+            {
+              data += WORD_SIZE;
+              continue;
+            }
+          count_live_object(h, data, true);
+          data += round_alloc_size(get_existing_size(data));
         }
     }
-  return -1;
 }
 
+
+/*============================================================================
+ *                             RETENTION
+ *===========================================================================*/
+
+/**
+ *  @brief Lists the objects on the pages in use in address order
+ *
+ *  @param  h a pointer to the heap
+ *  @param  objects where the objects are written, NULL to only count them
+ *  @return the number of objects
+ */
 size_t
-number_of_passive_pages(heap_t *h)
+list_heap_objects(heap_t *h, void **objects)
 {
-  size_t count = 0; 
-  for(int i =0; i < (int)h->number_of_pages; ++i)
+  size_t count = 0;
+  for(size_t page_nr = 0; page_nr < h->pages_created; ++page_nr)
     {
-      if(h->pages[i]->type == PASSIVE)
+      page_t *page = h->pages[page_nr];
+      if(page_get_type(page) == PASSIVE) continue;
+
+      char *end = page_get_bump(page);
+      char *data = (char *) page_get_start(page) + HEADER_SIZE;
+      while(data < end)
         {
-          count += 1;
+          if(!alloc_map_ptr_used(h->alloc_map, data))
+            {
+              data += WORD_SIZE;
+              continue;
+            }
+          if(objects != NULL) objects[count] = data;
+          ++count;
+          data += round_alloc_size(get_existing_size(data));
         }
     }
   return count;
 }
 
-page_t *
-find_first_passive_page(heap_t *h)
+/**
+ *  @brief Finds an object in a list made by list_heap_objects()
+ *
+ *  @return the index of the object, RETENTION_NONE if @p ptr does not
+ *          point to the start of an object
+ */
+size_t
+find_heap_object(void **objects, size_t count, void *ptr)
 {
-  for(int i =0; i < (int)h->number_of_pages; ++i)
+  size_t low = 0;
+  size_t high = count;
+  while(low < high)
     {
-      if(h->pages[i]->type == PASSIVE)
+      size_t middle = low + (high - low) / 2;
+      if((char *) objects[middle] < (char *) ptr)
         {
-          return h->pages[i]; 
+          low = middle + 1;
+        }
+      else
+        {
+          high = middle;
         }
     }
-  return NULL;
+  return low < count && objects[low] == ptr ? low : RETENTION_NONE;
 }
 
-
+/**
+ *  @brief Builds the graph of the pointers between the objects
+ *
+ *  The pointers are found from the headers like the collector finds
+ *  them, pointers to anything but an object get RETENTION_NONE.
+ *
+ *  @param  objects the objects listed by list_heap_objects()
+ *  @param  count the number of objects
+ *  @param  first the first edge of every object, @p count + 1 entries
+ *  @param  targets set to the edges, to be freed by the caller
+ *  @param  sizes the size of every object
+ *  @return false if memory cannot be allocated
+ */
 bool
-run_gc_if_above_threshold(heap_t *h, size_t bytes) //Bra namn ???
+build_object_graph(void **objects, size_t count, size_t *first, size_t **targets, uint64_t *sizes)
 {
-  if(((float)h_used(h)+bytes)/(float)h->size > h->gc_threshold)
-    {  
-      size_t cleaned = h_gc(h);
-      if (cleaned == 0)
+  size_t edges = 0;
+  for(size_t i = 0; i < count; ++i)
+    {
+      first[i] = edges;
+      sizes[i] = round_alloc_size(get_existing_size(objects[i]));
+      if(get_header_type(objects[i]) == STRUCT_REP)
         {
-          return true;
+          edges += get_number_of_pointers_in_struct(objects[i]);
         }
-      else if(((float)h_used(h)+bytes)/(float)h->size > h->gc_threshold)
+    }
+  first[count] = edges;
+
+  *targets = malloc((edges > 0 ? edges : 1) * sizeof(size_t));
+  if(*targets == NULL) return false;
+  for(size_t i = 0; i < count; ++i)
+    {
+      size_t slots = first[i + 1] - first[i];
+      if(slots == 0) continue;
+      void **pointer_slots[slots];
+      get_pointers_in_struct(objects[i], pointer_slots);
+      for(size_t j = 0; j < slots; ++j)
         {
-          return true;
-        }   
+          (*targets)[first[i] + j] = find_heap_object(objects, count, *pointer_slots[j]);
+        }
     }
-  return false;
+  return true;
 }
 
-
 /**
- *  @brief Allocates bytes amount of data on the heap
- *
- *  The function will garbage collect if the heap will reach the threshold after allocation, 
- *  or if only one passive page remains.  
+ *  @brief Finds the objects that the stack points to
  *
  *  @param  h a pointer to the heap
- *  @param  bytes the size of the data (including header) to be allocated
- *  @return a pointer to the allocated data if successful or NULL otherwise 
+ *  @param  objects the objects listed by list_heap_objects()
+ *  @param  count the number of objects
+ *  @param  root_count set to the number of roots found
+ *  @return the indexes of the objects, a stack slot each, to be freed
+ *          by the caller, or NULL if memory cannot be allocated
  */
-void *
-h_alloc(heap_t * h, size_t bytes)
+size_t *
+find_stack_roots(heap_t *h, void **objects, size_t count, size_t *root_count)
 {
-  if (run_gc_if_above_threshold(h, bytes))
-    {
-      return NULL;
-    }
+  size_t capacity = 64;
+  size_t *roots = malloc(capacity * sizeof(size_t));
+  if(roots == NULL) return NULL;
+  *root_count = 0;
 
-  if(bytes < SMALLEST_ALLOC_SIZE)
+#ifdef SPARC
+  int dummy = 0;
+  void *stack_top = &dummy;
+#else
+  void *stack_top = __builtin_frame_address(0);
+#endif
+  void *stack_bottom = (void *) *environ;
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, h->memory, h->heap_mask);
+  while(pointer != NULL)
     {
-      bytes = SMALLEST_ALLOC_SIZE;
+      size_t root = find_heap_object(objects, count, *pointer);
+      if(root != RETENTION_NONE && *root_count == capacity)
+        {
+          size_t *more = realloc(roots, capacity * 2 * sizeof(size_t));
+          if(more == NULL)
+            {
+              free(roots);
+              return NULL;
+            }
+          roots = more;
+          capacity *= 2;
+        }
+      if(root != RETENTION_NONE) roots[(*root_count)++] = root;
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, h->memory, h->heap_mask);
     }
+  return roots;
+}
 
-  if(bytes % WORD_SIZE != 0)
+/**
+ *  @brief Picks the objects that retain the most, largest first
+ *
+ *  @param  result the dominators found for the objects
+ *  @param  count the number of objects
+ *  @param  chosen where the indexes of the objects are written
+ *  @param  k the size of @p chosen
+ *  @return the number of objects picked
+ */
+size_t
+choose_largest(retention_t *result, size_t count, size_t *chosen, size_t k)
+{
+  size_t picked = 0;
+  for(size_t i = 0; i < count; ++i)
+    {
+      if(result->retained[i] == 0) continue;
+      if(picked == k && result->retained[chosen[k - 1]] >= result->retained[i]) continue;
+
+      // Insertion keeps the earlier object first when they retain the same
+      size_t position = picked < k ? picked++ : k - 1;
+      while(position > 0 && result->retained[chosen[position - 1]] < result->retained[i])
+        {
+          chosen[position] = chosen[position - 1];
+          --position;
+        }
+      chosen[position] = i;
+    }
+  return picked;
+}
+
+/**
+ *  @brief Fills in an entry of h_retention_report()
+ *
+ *  @param  entry the entry
+ *  @param  objects the objects of the graph
+ *  @param  sizes the sizes of the objects
+ *  @param  result the dominators found for the graph
+ *  @param  index the object of the entry
+ */
+void
+fill_retained(h_retained_t *entry, void **objects, uint64_t *sizes, retention_t *result,
+              size_t index)
+{
+  memset(entry, 0, sizeof(h_retained_t));
+  entry->object = objects[index];
+  entry->kind = get_layout_kind(objects[index]);
+  entry->size = sizes[index];
+  entry->retained = result->retained[index];
+  entry->retained_objects = result->retained_objects[index];
+  get_layout(objects[index], entry->layout, sizeof(entry->layout));
+
+  for(size_t node = index; node != RETENTION_ROOT; node = result->parent[node])
+    {
+      ++entry->depth;
+    }
+  entry->path_length = entry->depth < H_RETENTION_PATH_MAX ? entry->depth : H_RETENTION_PATH_MAX;
+  size_t node = index;
+  for(size_t i = entry->path_length; i-- > 0;)
+    {
+      entry->path[i] = objects[node];
+      node = result->parent[node];
+    }
+}
+
+
+/*============================================================================
+ *                             REFERENCES
+ *===========================================================================*/
+
+/**
+ *  @brief Checks if a reference is followed like a pointer this collection
+ *
+ *  Soft references are followed while the heap is used below the soft
+ *  reference threshold, weak references never.
+ */
+bool
+ref_is_strong(heap_t *h, h_ref_t *ref)
+{
+  return ref->soft && h->soft_refs_strong
+    && alloc_map_ptr_used(h->alloc_map, ref->referent);
+}
+
+static int
+compare_refs(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) (*(h_ref_t **) a)->referent;
+  uintptr_t y = (uintptr_t) (*(h_ref_t **) b)->referent;
+  return (x > y) - (x < y);
+}
+
+/**
+ *  @brief Finds the references that are not followed and whose referents
+ *         are on pages being evacuated
+ *
+ *  @param  h a pointer to the heap
+ *  @param  pending where the references are written sorted by referent,
+ *          NULL to only count them
+ *  @return the number of references
+ */
+size_t
+find_pending_refs(heap_t *h, h_ref_t *pending[])
+{
+  size_t count = 0;
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(ref->referent == NULL || ref_is_strong(h, ref)) continue;
+      if(page_get_type(h->pages[get_ptr_page(h, ref->referent)]) != TRANSITION) continue;
+      if(pending != NULL) pending[count] = ref;
+      ++count;
+    }
+  if(pending != NULL) qsort(pending, count, sizeof(h_ref_t *), compare_refs);
+  return count;
+}
+
+/**
+ *  @brief Moves or clears the references to a page that has been evacuated
+ *
+ *  A referent that was copied has left its forwarding address behind,
+ *  any other referent on the page is garbage. Must be called before the
+ *  page is reset.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  page_nr the page
+ *  @param  pending the references found by find_pending_refs()
+ *  @param  count the number of references
+ *  @param  next the first reference that may be on the page
+ *  @return the first reference past the page
+ */
+size_t
+process_pending_refs(heap_t *h, size_t page_nr, h_ref_t *pending[], size_t count, size_t next)
+{
+  for(; next < count && get_ptr_page(h, pending[next]->referent) <= (int) page_nr; ++next)
+    {
+      h_ref_t *ref = pending[next];
+      if(get_header_type(ref->referent) == FORWARDING_ADDR)
+        {
+          ref->referent = get_forwarding_address(ref->referent);
+        }
+      else
+        {
+          ref->referent = NULL;
+          h->stats.last.refs_cleared += 1;
+        }
+    }
+  return next;
+}
+
+/**
+ *  @brief Creates a reference and links it into the heap
+ */
+h_ref_t *
+ref_create(heap_t *h, void *referent, bool soft)
+{
+  assert(h != NULL);
+  if(h == NULL || !alloc_map_ptr_used(h->alloc_map, referent)) return NULL;
+  h_ref_t *ref = malloc(sizeof(h_ref_t));
+  if(ref == NULL) return NULL;
+  ref->referent = referent;
+  ref->soft = soft;
+  ref->prev = NULL;
+  ref->next = h->refs;
+  if(h->refs != NULL) h->refs->prev = ref;
+  h->refs = ref;
+  return ref;
+}
+
+
+/*============================================================================
+ *                             HEAP FUNCTIONS
+ *===========================================================================*/
+
+/**
+ *  @brief Creates a heap that reserves @p max_bytes and commits @p bytes
+ *
+ *  Everything is placed in one anonymous mapping: the heap struct and
+ *  page table, the heap memory, the alloc map and the page descriptors.
+ *  The metadata covers the whole reservation, only the heap memory past
+ *  @p bytes is left inaccessible until the heap grows.
+ *
+ *  Nothing is written per page: the mapping is zero filled so the alloc
+ *  map starts out cleared, and page descriptors are created in order when
+ *  a passive page is first needed. Pages past pages_created are passive
+ *  and empty.
+ *
+ *  The heap memory is reserved at its maximum size rounded up to a power
+ *  of two and starts at a multiple of that size. A pointer is then in the
+ *  reserved heap memory exactly when masking it with heap_mask gives the
+ *  start of the heap, and the page index is a mask and a shift. Only the
+ *  first max_size bytes are ever committed, and the alloc map decides if
+ *  an address in the heap is an object.
+ *
+ *  With H_HUGE_PAGES the heap memory is committed in whole huge pages and
+ *  the kernel is asked to back it with transparent huge pages.
+ */
+heap_t *
+heap_create(size_t bytes, size_t max_bytes, bool unsafe_stack, float gc_threshold, unsigned options)
+{
+  assert(bytes >= PAGE_SIZE*2);
+  if(!(bytes >= PAGE_SIZE*2)) return NULL;
+  assert(bytes % PAGE_SIZE == 0);
+  if(!(bytes % PAGE_SIZE == 0)) return NULL;
+  assert(max_bytes >= bytes && max_bytes % PAGE_SIZE == 0);
+  if(!(max_bytes >= bytes && max_bytes % PAGE_SIZE == 0)) return NULL;
+  assert(0 < gc_threshold && gc_threshold <= 1);
+  if(!(0 < gc_threshold && gc_threshold <= 1)) return NULL;
+
+  size_t commit_unit = (size_t) sysconf(_SC_PAGESIZE);
+  if(options & H_HUGE_PAGES)
+    {
+      commit_unit = HUGE_PAGE_SIZE;
+    }
+
+  size_t max_pages = max_bytes / PAGE_SIZE;
+  size_t heap_struct_size = round_to_os_page(sizeof(heap_t) + sizeof(void *) * max_pages);
+  // The heap memory fills its aligned block, so the metadata after it is
+  // outside the block and the mask test is exact
+  size_t memory_size = round_to_power_of_two(round_up(max_bytes, commit_unit));
+  size_t alloc_map_size = alloc_map_mem_size_needed(WORD_SIZE, max_bytes);
+  if(alloc_map_size % WORD_SIZE != 0)
+    {
+      alloc_map_size += WORD_SIZE - alloc_map_size % WORD_SIZE;
+    }
+  size_t metadata_size = round_to_os_page(alloc_map_size + sizeof(page_t) * max_pages);
+  size_t mapped_size = heap_struct_size + memory_size + metadata_size;
+
+  size_t alignment = memory_size;
+  char *mapping = reserve_aligned(mapped_size, alignment, heap_struct_size);
+  if(mapping == NULL)
+    {
+      return NULL;
+    }
+
+  void *memory = mapping + heap_struct_size;
+  void *metadata = (char *) memory + memory_size;
+  if(!commit_memory(mapping, heap_struct_size)
+     || !commit_memory(memory, round_up(bytes, commit_unit))
+     || !commit_memory(metadata, metadata_size))
+    {
+      munmap(mapping, mapped_size);
+      return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+  if(options & H_HUGE_PAGES)
+    {
+      // Without transparent huge pages the heap works with normal pages
+      madvise(memory, memory_size, MADV_HUGEPAGE);
+    }
+#endif
+
+  heap_t *heap = (heap_t *) mapping;
+  heap->memory = memory;
+  heap->alloc_map = metadata;
+  heap->size = 0;
+  heap->max_size = max_bytes;
+  heap->mapped_size = mapped_size;
+  heap->commit_unit = commit_unit;
+  heap->heap_mask = ~(uintptr_t) (alignment - 1);
+  heap->unsafe_stack = unsafe_stack;
+  heap->gc_threshold = gc_threshold;
+  heap->number_of_pages = 0;
+  heap->collections = 0;
+  memset(&heap->stats, 0, sizeof(h_stats_t));
+  heap->trace = NULL;
+  heap->trace_alloc_interval = 0;
+  heap->trace_alloc_count = 0;
+  histogram_clear(&heap->pauses);
+  heap->bytes_allocated = 0;
+  heap->headroom_base = 0;
+  heap->rate_sample_ns = time_ns();
+  heap->rate_sample_bytes = 0;
+  heap->alloc_rate = 0.0;
+  heap->published = NULL;
+  heap->recorder = NULL;
+  heap->profiler = NULL;
+  heap->census = NULL;
+  heap->refs = NULL;
+  heap->soft_ref_threshold = SOFT_REF_THRESHOLD;
+  heap->soft_refs_strong = false;
+  heap->published_name[0] = '\0';
+  heap->last_pause_ns = 0;
+  for(size_t i = 0; i < NUMBER_OF_SIZE_CLASSES; ++i)
+    {
+      heap->class_pages[i] = NULL;
+    }
+
+  alloc_map_create_zeroed(heap->alloc_map, heap->memory, WORD_SIZE, max_bytes);
+
+  heap->descriptors = (page_t *) ((char *) metadata + alloc_map_size);
+  heap->pages_created = 0;
+  heap->number_of_pages = bytes / PAGE_SIZE;
+  heap->size = bytes;
+
+  heap->fast.no_page = NULL;
+  heap->fast.map_bits = alloc_map_get_bits(heap->alloc_map);
+  heap->fast.map_start = heap->memory;
+  heap->fast.headroom = 0;
+  cursors_reset(heap);
+  update_headroom(heap);
+  return heap;
+}
+
+
+heap_t *
+h_init(size_t bytes, bool unsafe_stack, float gc_threshold)
+{
+  return heap_create(bytes, bytes, unsafe_stack, gc_threshold, 0);
+}
+
+
+heap_t *
+h_init_growable(size_t bytes, size_t max_bytes, bool unsafe_stack, float gc_threshold)
+{
+  return heap_create(bytes, max_bytes, unsafe_stack, gc_threshold, 0);
+}
+
+
+heap_t *
+h_init_with_options(size_t bytes, size_t max_bytes, bool unsafe_stack, float gc_threshold, unsigned options)
+{
+  return heap_create(bytes, max_bytes, unsafe_stack, gc_threshold, options);
+}
+
+
+void *
+get_memory(heap_t *h) 
+{
+  return h->memory;
+}
+
+size_t
+heap_get_size(heap_t *h)
+{
+  return h->size;
+}
+
+size_t
+heap_get_number_of_pages(heap_t *h)
+{
+  return h->number_of_pages;
+}
+
+void
+h_delete(heap_t *h)
+{
+  assert(h != NULL);
+  if(h==NULL) return;
+  trace_buffer_delete(h->trace);
+  h_publish_stop(h);
+  h_record_stop(h);
+  h_profile_stop(h);
+  h_census_stop(h);
+  while(h->refs != NULL)
+    {
+      h_ref_delete(h, h->refs);
+    }
+  munmap(h, h->mapped_size);
+}
+
+
+void 
+h_delete_dbg(heap_t *h, void *dbg_value)
+{
+  assert(h != NULL);
+  if(h==NULL) return;
+#ifdef SPARC
+  int dummy = 0;
+  void *stack_top = &dummy;
+#else
+  void *stack_top = __builtin_frame_address(0);
+#endif
+  size_t number_of_ptrs = get_number_of_ptrs_in_stack(h, stack_top);
+  void **array[number_of_ptrs];
+  size_t actual_nr_of_ptrs = 0;
+  actual_nr_of_ptrs = get_ptrs_from_stack(h, stack_top, array, number_of_ptrs);
+  for(size_t i = 0; i < actual_nr_of_ptrs; ++i)
+    {
+      *array[i] = dbg_value;
+    }
+  h_delete(h);
+}
+
+/**
+ *  @brief Recursively sets the status  of all active pointers in the heap
+ *         to not found
+ *
+ *  @param  h a pointer to the heap
+ *  @param  ptr a pointer to be searched recursively from
+ */
+void
+reset_ptrs_to_not_found_heap_rec(heap_t *h, void *ptr)
+{
+  if(get_header_type(ptr) != STRUCT_REP)
+    {
+      return;
+    }
+  else 
+    {
+      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
+      void **array[num_ptrs];
+      bool success = get_pointers_in_struct(ptr, array);
+      if(!success) return;
+      header_set_ptr_to_not_found(ptr);
+      
+      for(size_t i = 0; i < num_ptrs; ++i)
+        {
+          if(alloc_map_ptr_used(h->alloc_map, *array[i])
+             && header_ptr_already_found(*array[i]))
+            {
+              reset_ptrs_to_not_found_heap_rec(h, *array[i]);
+            }
+        }
+    }
+}
+
+/**
+ *  @brief Sets all data on the heap to not found
+ *
+ *  @param h the heap to set all active data to not found
+ *  @param original_top the top of the stack
+ */
+void
+reset_ptrs_to_not_found(heap_t *h, void *original_top)
+{
+  void *stack_top = original_top;
+  void *stack_bottom = (void *)*environ;
+  void *heap_start = h->memory;
+  uintptr_t heap_mask = h->heap_mask;
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+
+  while (pointer != NULL)
+    {
+      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+        {
+          reset_ptrs_to_not_found_heap_rec(h, *pointer);
+        }
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+    }
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(ref_is_strong(h, ref)) reset_ptrs_to_not_found_heap_rec(h, ref->referent);
+    }
+}
+/**
+ *  @brief Sets all data on the heap to not found from an array
+ *
+ *  @param array the array to go through to get to the data
+ *  @param size the size of @p array
+ */
+void
+reset_ptrs_to_not_found_array(void **array[], size_t size)
+{
+  for(size_t i = 0; i < size; ++i)
+    {
+      void **current_ptr = array[i];
+      if(current_ptr != NULL && get_header_type(*current_ptr) == STRUCT_REP)
+        {
+          header_set_ptr_to_not_found(*current_ptr);
+        }
+    }
+}
+
+/**
+ *  @brief Recursively gets the number of all active pointers in the heap 
+ *
+ *  @param  h a pointer to the heap
+ *  @param  ptr a pointer to be searched recursively from
+ *
+ *  @return the number of all active pointers in the heap 
+ */
+size_t
+get_number_of_active_heap_ptrs_rec(heap_t *h, void *ptr)
+{
+  if(get_header_type(ptr) != STRUCT_REP)
+    {
+      return 0;
+    }
+  else 
+    {
+      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
+      size_t result = 0;
+      void **array[num_ptrs];
+      bool success = get_pointers_in_struct(ptr, array);
+      header_set_ptr_to_found(ptr);
+      if(!success) return 0;
+      
+      for(size_t i = 0; i < num_ptrs; ++i)
+        {
+          if(alloc_map_ptr_used(h->alloc_map, *array[i]))
+            {
+              ++result;
+              if(!header_ptr_already_found(*array[i]))
+                {
+                  result += get_number_of_active_heap_ptrs_rec(h, *array[i]);
+                }
+            }
+        }
+      return result;
+    }
+}
+
+/**
+ *  @brief Gets the number of active pointers on the stack and in the heap 
+ *
+ *  @param  h a pointer to the heap
+ *  @param  original_top the top of the stack to search
+ *
+ *  @return the number of pointer found on stack and the heap
+ */
+size_t
+get_number_of_active_ptrs(heap_t *h, void *original_top)
+{
+  void *stack_top = original_top;
+  void *stack_bottom = (void *)*environ;
+  void *heap_start = h->memory;
+  uintptr_t heap_mask = h->heap_mask;
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+
+  size_t i = 0;
+  while (pointer != NULL)
+    {
+      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+        {
+          i += 1;
+          i += get_number_of_active_heap_ptrs_rec(h, *pointer);
+        }
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+    }
+  // Soft references that are followed are roots after the stack
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(!ref_is_strong(h, ref)) continue;
+      i += 1;
+      i += get_number_of_active_heap_ptrs_rec(h, ref->referent);
+    }
+  reset_ptrs_to_not_found(h, original_top);
+  return i;
+}
+
+/**
+ *  @brief Recursively gets all the active pointers in the heap and puts them into an array
+ *
+ *  @param  h a pointer to the heap
+ *  @param  ptr a pointer to be searched recursively from
+ *  @param  array an array of double pointers 
+ *  @param  index where in the array to put found pointers
+ *
+ */
+void
+get_active_heap_ptrs_rec(heap_t *h, void *ptr, void **array[], size_t *index)
+{
+  if(get_header_type(ptr) != STRUCT_REP)
+    {
+      return;
+    }
+  else 
+    {
+      size_t num_ptrs = get_number_of_pointers_in_struct(ptr);
+      if(num_ptrs == 0) return;
+      void **temp_array[num_ptrs];
+      bool success = get_pointers_in_struct(ptr, temp_array);
+      if(!success) return;
+      header_set_ptr_to_found(ptr);
+      size_t num_valid_ptrs = 0;
+      void ***sub_array =  &(array[*index]);
+      for(size_t i = 0; i < num_ptrs; ++i)
+        {
+          if(alloc_map_ptr_used(h->alloc_map, *temp_array[i]))
+            {
+              array[*index] = temp_array[i];
+              *index += 1;
+              ++num_valid_ptrs;
+            }
+        }
+      
+      for(size_t i = 0; i < num_valid_ptrs; ++i)
+        {
+          if(!header_ptr_already_found(*sub_array[i]))
+            {
+              get_active_heap_ptrs_rec(h, *sub_array[i], array, index);
+            }
+        }
+    }
+}
+
+/**
+ *  @brief Adds every pointer reachable from the roots at the start of an array
+ *
+ *  The roots are the @p num_stack_ptrs first slots of @p array and the
+ *  soft references that are followed.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  array an array of double pointers
+ *  @param  array_size the size of the array
+ *  @param  num_stack_ptrs the number of stack slots at the start of @p array
+ */
+void
+trace_from_roots(heap_t *h, void **array[], size_t array_size, size_t num_stack_ptrs)
+{
+  size_t index = num_stack_ptrs;
+  for(size_t i = 0; i < num_stack_ptrs; ++i)
+    {
+      get_active_heap_ptrs_rec(h, *array[i], array, &index);
+    }
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(!ref_is_strong(h, ref)) continue;
+      array[index++] = &ref->referent;
+      get_active_heap_ptrs_rec(h, ref->referent, array, &index);
+    }
+  reset_ptrs_to_not_found_array(array, array_size);
+}
+
+/**
+ *  @brief Gets all the active pointers on the stack and in the heap and puts them into an array
+ *
+ *  @param  h a pointer to the heap
+ *  @param  original_top the top of the stack to search
+ *  @param  array an array of double pointers 
+ *  @param  array_size the size of the array
+ *
+ *  @return the number of pointer found on stack and the heap
+ */
+size_t
+get_active_ptrs(heap_t *h, void *original_top, void **array[], size_t array_size)
+{
+  for(size_t i = 0; i < array_size; ++i) array[i] = NULL;
+
+  uint64_t start = time_ns();
+  Trace(h, TRACE_ROOT_SCAN, TRACE_BEGIN, 0);
+  size_t num_stack_ptrs = get_ptrs_from_stack(h, original_top, array, array_size);
+  Trace(h, TRACE_ROOT_SCAN, TRACE_END, num_stack_ptrs);
+  h->stats.last.root_scan_ns += time_ns() - start;
+  trace_from_roots(h, array, array_size, num_stack_ptrs);
+  return num_stack_ptrs;
+}
+
+
+/**
+ *  @brief Gets the number of pointer found on stack
+ *
+ *  @param  h a pointer to the heap
+ *  @param  original_top the top of the stack to search
+ *
+ *  @return the number of pointer found on stack
+ */
+size_t
+get_number_of_ptrs_in_stack(heap_t *h, void *original_top)
+{
+ 
+  void *stack_top = original_top;
+  void *stack_bottom = (void *)*environ;
+  void *heap_start = h->memory;
+  uintptr_t heap_mask = h->heap_mask;
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+
+  size_t i = 0;
+  while (pointer != NULL)
+    {
+      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+        {
+          i += 1;
+        }
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+    }
+  return i;
+}
+
+
+/**
+ *  @brief Puts the pointers found on the stack in an array
+ *
+ *  @param  h a pointer to the heap
+ *  @param  original_top the top of the stack to search
+ *  @param  array an empty array of double pointers 
+ *  @param  array_size the size of the array 
+ *
+ *  @return the number of pointer found on stack
+ */
+size_t
+get_ptrs_from_stack(heap_t *h, void *original_top, void **array[], size_t array_size)
+{
+  void *stack_top = original_top;
+  void *stack_bottom = (void *)*environ;
+  void *heap_start = h->memory;
+  uintptr_t heap_mask = h->heap_mask;
+
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+
+  size_t i = 0;
+  while (pointer != NULL)
+    {
+      if(alloc_map_ptr_used(h->alloc_map, *pointer))
+        {       
+          assert(i < array_size && "There are more ptrs in stack than we thought!");
+          array[i] = pointer;
+
+          i += 1;
+        }
+      else
+        {
+          h->stats.last.false_roots += 1;
+        }
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+    } 
+  //assert(i == array_size && "There are less ptrs in stack than we thought!"); 
+  return i;  
+}
+
+int
+get_ptr_page(heap_t *h, void * ptr)
+{
+  return (int) (((uintptr_t)ptr & ~h->heap_mask) >> PAGE_SHIFT);
+}
+
+
+int
+find_next_active_page(heap_t *h, size_t index)
+{
+  for(int i = index; i < (int)h->pages_created; ++i)
+    {
+      if(h->pages[i]->type == ACTIVE)
+        {
+          return i; 
+        }
+    }
+  return -1;
+}
+
+size_t
+number_of_passive_pages(heap_t *h)
+{
+  size_t count = 0; 
+  for(int i =0; i < (int)h->pages_created; ++i)
+    {
+      if(h->pages[i]->type == PASSIVE)
+        {
+          count += 1;
+        }
+    }
+  return count + (h->number_of_pages - h->pages_created);
+}
+
+page_t *
+find_first_passive_page(heap_t *h)
+{
+  for(int i =0; i < (int)h->pages_created; ++i)
+    {
+      if(h->pages[i]->type == PASSIVE)
+        {
+          return h->pages[i]; 
+        }
+    }
+  if(h->pages_created < h->number_of_pages)
+    {
+      create_pages(h->memory, h->descriptors, h->pages_created, 1, PAGE_SIZE, h);
+      return h->pages[h->pages_created++];
+    }
+  return NULL;
+}
+
+
+bool
+run_gc_if_above_threshold(heap_t *h, size_t bytes) //Bra namn ???
+{
+  if(((float)h_used(h)+bytes)/(float)h->size > h->gc_threshold)
+    {  
+      size_t cleaned = h_gc(h);
+      bool grown = grow_heap_if_needed(h, bytes);
+      if (cleaned == 0 && !grown)
+        {
+          return true;
+        }
+      else if(((float)h_used(h)+bytes)/(float)h->size > h->gc_threshold)
+        {
+          return true;
+        }   
+    }
+  return false;
+}
+
+
+/**
+ *  @brief Rounds an allocation size up to what is actually taken from a page
+ *
+ *  @param  bytes the size of the allocation (including header)
+ *  @return @p bytes rounded up to a multiple of WORD_SIZE and at least
+ *          SMALLEST_ALLOC_SIZE
+ */
+size_t
+round_alloc_size(size_t bytes)
+{
+  if(bytes < SMALLEST_ALLOC_SIZE)
+    {
+      bytes = SMALLEST_ALLOC_SIZE;
+    }
+
+  if(bytes % WORD_SIZE != 0)
+    {
+      bytes += WORD_SIZE - (bytes % WORD_SIZE);
+    }
+  return bytes;
+}
+
+
+/**
+ *  @brief Gets the size class an allocation of @p bytes belongs to
+ *
+ *  Size class n serves allocations of at most SMALLEST_ALLOC_SIZE << n bytes,
+ *  the last class serves everything up to PAGE_SIZE. The computation is
+ *  shared with the inlined fast path in gc.h.
+ *
+ *  @param  bytes the size of the allocation (including header)
+ *  @return the size class of @p bytes
+ */
+size_t
+get_size_class(size_t bytes)
+{
+  return h_size_class(bytes);
+}
+
+
+page_t *
+find_active_page_with_room(heap_t *h, size_t bytes)
+{
+  int index_next_act = find_next_active_page(h, 0);
+  while (index_next_act >= 0) 
+    {
+      if (page_get_avail(h->pages[index_next_act]) > bytes)
+        {
+          return h->pages[index_next_act];
+        }
+      index_next_act = find_next_active_page(h, index_next_act + 1);
+    }
+  return NULL;
+}
+
+
+/**
+ *  @brief Finds a page to bump allocate @p bytes in for a size class
+ *
+ *  The current page of the size class is used if it has room. Otherwise
+ *  a passive page is made the new current page of the class. When no
+ *  passive page can be taken, any active page with room is used so that
+ *  small heaps are not exhausted by the segregation.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  size_class the size class of the allocation
+ *  @param  bytes the size of the allocation (including header)
+ *  @param  passive_reserve the number of passive pages that must be left
+ *  @return the page to allocate in or NULL if there is none
+ */
+page_t *
+page_for_size_class(heap_t *h, size_t size_class, size_t bytes, size_t passive_reserve)
+{
+  page_t *page = h->class_pages[size_class];
+  if(page != NULL
+     && page_get_type(page) == ACTIVE
+     && page_get_size_class(page) == size_class
+     && page_get_avail(page) > bytes)
+    {
+      return page;
+    }
+
+  if(number_of_passive_pages(h) > passive_reserve)
+    {
+      page = find_first_passive_page(h);
+      page_set_type(page, ACTIVE);
+      page_set_size_class(page, size_class);
+      h->class_pages[size_class] = page;
+      cursor_set(h, size_class, page);
+      return page;
+    }
+
+  return find_active_page_with_room(h, bytes);
+}
+
+
+/**
+ *  @brief Makes an empty page that was taken for a size class passive again
+ *
+ *  @param  h a pointer to the heap
+ *  @param  page the page, nothing may have been allocated on it
+ */
+void
+page_give_back(heap_t *h, page_t *page)
+{
+  assert(page_get_used(page) == 0);
+  size_t size_class = page_get_size_class(page);
+  if(h->class_pages[size_class] == page)
+    {
+      h->class_pages[size_class] = NULL;
+      h->fast.cursors[size_class].bump = &h->fast.no_page;
+      h->fast.cursors[size_class].end = NULL;
+    }
+  page_set_type(page, PASSIVE);
+  page_set_idle_since(page, h->collections);
+}
+
+
+/**
+ *  @brief Allocates bytes amount of data on the heap
+ *
+ *  The function will garbage collect if the heap will reach the threshold after allocation, 
+ *  or if only one passive page remains. Allocations that fit the current page of their
+ *  size class without reaching the threshold are bumped without any of these checks.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  bytes the size of the data (including header) to be allocated
+ *  @return a pointer to the allocated data if successful or NULL otherwise 
+ */
+void *
+h_alloc(heap_t * h, size_t bytes)
+{
+  size_t requested = bytes;
+  bytes = round_alloc_size(bytes);
+
+  void *bumped = h_alloc_bump(h, bytes);
+  if(bumped != NULL)
+    {
+      return bumped;
+    }
+
+  if(h->trace_alloc_interval != 0
+     && ++h->trace_alloc_count % h->trace_alloc_interval == 0)
+    {
+      Trace(h, TRACE_ALLOC_SLOW, TRACE_INSTANT, bytes);
+    }
+
+  if (run_gc_if_above_threshold(h, requested))
+    {
+      return NULL;
+    }
+
+  size_t size_class = get_size_class(bytes);
+  page_t *page_to_write_to = page_for_size_class(h, size_class, bytes, 1);
+  if(page_to_write_to == NULL) 
+    {
+      bool not_cleaned_enough = run_gc_if_above_threshold(h, bytes);
+      if(not_cleaned_enough)
+        {
+          return NULL;
+        }
+      page_to_write_to = page_for_size_class(h, size_class, bytes, 1);
+      if(page_to_write_to == NULL && heap_grow(h, h->size * GROWTH_FACTOR))
+        {
+          page_to_write_to = page_for_size_class(h, size_class, bytes, 1);
+        }
+      if(page_to_write_to == NULL)
+        {
+          return NULL;
+        }
+    }
+
+  void *page_bump = page_get_bump(page_to_write_to);
+  void * ptr_to_write_to = page_bump;
+  page_move_bump(page_to_write_to, bytes);
+  h->bytes_allocated += bytes;
+  update_headroom(h);
+  return ptr_to_write_to; 
+}
+
+
+void *
+h_alloc_struct(heap_t * h, char * layout)
+{
+  assert(h != NULL);
+  assert(layout != NULL);
+  assert(*layout != '\0');
+  if(h == NULL || layout == NULL || *layout == '\0') return NULL;
+  
+  size_t size = get_struct_size(layout);
+  assert(size <= PAGE_SIZE);
+  assert(size > 0);
+  if(size > PAGE_SIZE || size == 0) return NULL;
+ 
+  void * ptr = h_alloc(h, size);
+  if (ptr == NULL) return NULL;
+  
+  void * return_ptr = create_struct_header(h, layout, ptr);
+  alloc_map_set(h->alloc_map, return_ptr, true); 
+  if(h->recorder != NULL) record_object(h, return_ptr);
+  if(h->profiler != NULL) profile_object(h, return_ptr, PROFILE_SKIP);
+  return return_ptr;
+}
+
+
+void *
+h_alloc_data(heap_t * h, size_t bytes)
+{
+  assert(bytes > 0);
+  assert(h != NULL);
+  if(h == NULL || bytes == 0) return NULL;
+  
+  size_t size = get_data_size(bytes);
+  assert(size <= PAGE_SIZE);
+  assert(size > 0);
+  if(size > PAGE_SIZE || size == 0) return NULL;
+  void * ptr = h_alloc(h, size);
+  if (ptr == NULL) return NULL;
+  
+  void * return_ptr = create_data_header(bytes, ptr);
+  alloc_map_set(h->alloc_map, return_ptr, true); 
+  if(h->recorder != NULL) record_object(h, return_ptr);
+  if(h->profiler != NULL) profile_object(h, return_ptr, PROFILE_SKIP);
+  return return_ptr;
+}
+
+
+void *
+h_alloc_array(heap_t *h, char *element_layout, size_t count)
+{
+  assert(h != NULL);
+  assert(element_layout != NULL);
+  if(h == NULL || element_layout == NULL) return NULL;
+
+  size_t size = get_array_size(element_layout, count);
+  if(size > PAGE_SIZE || size == 0) return NULL;
+
+  void *ptr = h_alloc(h, size);
+  if (ptr == NULL) return NULL;
+
+  void *return_ptr = create_array_header(element_layout, count, ptr);
+  memset(return_ptr, 0, size - HEADER_SIZE);
+  alloc_map_set(h->alloc_map, return_ptr, true);
+  if(h->recorder != NULL) record_object(h, return_ptr);
+  if(h->profiler != NULL) profile_object(h, return_ptr, PROFILE_SKIP);
+  return return_ptr;
+}
+
+
+void **
+h_alloc_ptr_array(heap_t *h, size_t count)
+{
+  return h_alloc_array(h, "*", count);
+}
+
+
+size_t
+h_array_length(void *array)
+{
+  return get_array_length(array);
+}
+
+
+void *
+h_realloc(heap_t *h, void *ptr, size_t new_bytes)
+{
+  assert(h != NULL);
+  if(h == NULL || new_bytes == 0) return NULL;
+  if(ptr == NULL) return h_alloc_data(h, new_bytes);
+  if(!alloc_map_ptr_used(h->alloc_map, ptr)) return NULL;
+
+  // The new header is worked out on a copy so that nothing changes
+  // if the object cannot be resized
+  void *header_copy[2] = { *(void **) ((char *) ptr - HEADER_SIZE), NULL };
+  if(!resize_header(&header_copy[1], new_bytes)) return NULL;
+
+  size_t old_data_size = get_existing_data_size(ptr);
+  size_t new_size = get_existing_size(&header_copy[1]);
+  if(new_size > PAGE_SIZE) return NULL;
+  bool zero_new_data = get_header_type(ptr) == STRUCT_REP;
+
+  page_t *page = h->pages[get_ptr_page(h, ptr)];
+  char *header = (char *) ptr - HEADER_SIZE;
+  size_t old_alloc_size = round_alloc_size(old_data_size + HEADER_SIZE);
+  size_t new_alloc_size = round_alloc_size(new_size);
+  bool last_in_page = header + old_alloc_size == (char *) page_get_bump(page);
+
+  if(new_alloc_size <= old_alloc_size)
+    {
+      if(last_in_page)
+        {
+          page_move_bump(page, -(int) (old_alloc_size - new_alloc_size));
+        }
+      *(void **) header = header_copy[0];
+      update_headroom(h);
+      if(h->recorder != NULL) record_resize(h, ptr, ptr, new_bytes);
+      return ptr;
+    }
+
+  size_t growth = new_alloc_size - old_alloc_size;
+  if(last_in_page
+     && page_get_type(page) == ACTIVE
+     && page_get_avail(page) > growth
+     && growth <= h->fast.headroom)
+    {
+      page_move_bump(page, growth);
+      h->bytes_allocated += growth;
+      *(void **) header = header_copy[0];
+      if(zero_new_data) memset((char *) ptr + old_data_size, 0, new_size - HEADER_SIZE - old_data_size);
+      update_headroom(h);
+      if(h->recorder != NULL) record_resize(h, ptr, ptr, new_bytes);
+      return ptr;
+    }
+
+  // Kept in memory so that the stack search updates it if h_alloc collects
+  void * volatile old_ptr = ptr;
+  char *new_header = h_alloc(h, new_size);
+  if(new_header == NULL) return NULL;
+  ptr = old_ptr;
+
+  *(void **) new_header = header_copy[0];
+  void *new_ptr = new_header + HEADER_SIZE;
+  size_t new_data_size = new_size - HEADER_SIZE;
+  memcpy(new_ptr, ptr, old_data_size < new_data_size ? old_data_size : new_data_size);
+  if(zero_new_data && new_data_size > old_data_size)
+    {
+      memset((char *) new_ptr + old_data_size, 0, new_data_size - old_data_size);
+    }
+  alloc_map_set(h->alloc_map, new_ptr, true);
+  alloc_map_set(h->alloc_map, ptr, false);
+  // The old copy is no object any more, so references follow the new one
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(ref->referent == ptr) ref->referent = new_ptr;
+    }
+  if(h->recorder != NULL) record_resize(h, ptr, new_ptr, new_bytes);
+  return new_ptr;
+}
+
+
+/**
+ *  @brief Allocates @p n objects of @p bytes with identical headers
+ *
+ *  The gc threshold is checked once for the whole batch and no collection
+ *  is run while the batch is allocated, since @p out might not be visible
+ *  to the stack search. Each page is filled with as many objects as fit,
+ *  headers are written in a loop and the alloc map is set in one go per page.
+ *
+ *  @param  h a pointer to the heap
+ *  @param  bytes the size of each object (including header)
+ *  @param  header the header word to give every object
+ *  @param  n the number of objects
+ *  @param  out array of size @p n to put the allocated objects in
+ *  @return the number of objects allocated
+ */
+size_t
+h_alloc_n(heap_t *h, size_t bytes, void *header, size_t n, void *out[])
+{
+  size_t size = round_alloc_size(bytes);
+  if(n > SIZE_MAX / size || run_gc_if_above_threshold(h, size * n))
+    {
+      return 0;
+    }
+
+  size_t size_class = get_size_class(size);
+  size_t allocated = 0;
+  while(allocated < n)
+    {
+      page_t *page = page_for_size_class(h, size_class, size, 1);
+      if(page == NULL) break;
+
+      // As in h_alloc() an empty page takes an object of its whole size,
+      // a page in use keeps its last byte free
+      size_t avail = page_get_avail(page);
+      size_t fits = page_get_used(page) == 0 && avail == size ? 1 : (avail - 1) / size;
+      if(fits == 0)
+        {
+          if(page_get_used(page) == 0) page_give_back(h, page);
+          break;
+        }
+      size_t count = n - allocated < fits ? n - allocated : fits;
+      char *ptr = page_get_bump(page);
+      page_move_bump(page, count * size);
+      h->bytes_allocated += count * size;
+
+      alloc_map_set_n(h->alloc_map, ptr + HEADER_SIZE, size, count, true);
+      for(size_t i = 0; i < count; ++i)
+        {
+          *(void **) ptr = header;
+          out[allocated] = ptr + HEADER_SIZE;
+          ++allocated;
+          ptr += size;
+        }
+    }
+  update_headroom(h);
+  for(size_t i = 0; h->recorder != NULL && i < allocated; ++i)
+    {
+      record_object(h, out[i]);
+    }
+  for(size_t i = 0; h->profiler != NULL && i < allocated; ++i)
+    {
+      profile_object(h, out[i], PROFILE_SKIP + 1);
+    }
+  return allocated;
+}
+
+
+size_t
+h_alloc_struct_n(heap_t *h, char *layout, size_t n, void *out[])
+{
+  assert(h != NULL);
+  assert(layout != NULL);
+  assert(out != NULL);
+  if(h == NULL || layout == NULL || *layout == '\0' || out == NULL || n == 0) return 0;
+
+  size_t size = get_struct_size(layout);
+  assert(size <= PAGE_SIZE);
+  if(size > PAGE_SIZE || size == 0) return 0;
+
+  void *header = NULL;
+  if(create_struct_header(h, layout, &header) == NULL) return 0;
+  return h_alloc_n(h, size, header, n, out);
+}
+
+
+size_t
+h_alloc_data_n(heap_t *h, size_t bytes, size_t n, void *out[])
+{
+  assert(h != NULL);
+  assert(out != NULL);
+  if(h == NULL || bytes == 0 || out == NULL || n == 0) return 0;
+
+  size_t size = get_data_size(bytes);
+  assert(size <= PAGE_SIZE);
+  if(size > PAGE_SIZE || size == 0) return 0;
+
+  void *header = NULL;
+  create_data_header(bytes, &header);
+  return h_alloc_n(h, size, header, n, out);
+}
+
+
+/**
+ *  @brief reallocates data from one page to another
+ *
+ *  @param  h a pointer to the heap
+ *  @param  ptr_to_data a pointer to the data (without header) to be reallocated
+ *
+ *  @return a pointer to the reallocaded data
+ */
+void *
+h_alloc_raw(heap_t *h, void *ptr_to_data)
+{
+  assert(ptr_to_data != NULL);
+  size_t raw_size = round_alloc_size(get_existing_size(ptr_to_data));
+  page_t *page_to_write_to = page_for_size_class(h, get_size_class(raw_size), raw_size, 0);
+
+  void *page_bump = page_get_bump(page_to_write_to);
+  void * ptr_to_write_to = page_bump;
+  page_move_bump(page_to_write_to, raw_size);
+
+  size_t data_size = get_existing_data_size(ptr_to_data);
+  void *ptr_to_moved_data = copy_header(ptr_to_data, ptr_to_write_to);
+  forward_header(ptr_to_data, ptr_to_moved_data);
+
+  void * return_ptr = memcpy(ptr_to_moved_data, ptr_to_data, data_size);
+  alloc_map_set(h->alloc_map, return_ptr, true); 
+  alloc_map_set(h->alloc_map, ptr_to_data, false); 
+  h->stats.last.objects_copied += 1;
+  h->stats.last.bytes_copied += raw_size;
+  return return_ptr;
+}
+
+
+void
+set_active_to_transition(heap_t *h)
+{
+  for(int i =0; i < (int)h->pages_created; ++i)
+    {
+      if(h->pages[i]->type == ACTIVE)
+        {
+          h->pages[i]->type = TRANSITION;
+        }
+    }
+}
+
+
+/**
+ *  @brief Reallocates pointers from a reallocated struct  
+ *
+ *  If a pointer in the array is within the range the offset is added to it 
+ *  to give it the correct address
+ *
+ *  @param array an array of double pointers to addresses on the heap
+ *  @param start_index the index of the array where to start forwarding
+ *  @param array_size the size of the array
+ *  @param ptr_to_original_data a pointer to the original data address 
+ *  @param ptr_to_new_data a pointer to the new data address
+ */
+void
+forward_internal_array_ptrs_with_offset(void **array[], 
+                                        size_t start_index,
+                                        size_t array_size,
+                                        void *ptr_to_original_data,
+                                        void *ptr_to_new_data)
+{
+  long offset = (long) ptr_to_new_data - (long) ptr_to_original_data;
+  void **lower_range = ptr_to_original_data;
+  void **upper_range = (void *) ((unsigned long) lower_range + get_existing_data_size(ptr_to_new_data));
+  
+  for(size_t index = start_index; index < array_size; ++index)
+    {
+      if(lower_range <= array[index] && array[index] < upper_range)
+        {
+          array[index] = (void *)((long) array[index] + offset);
+        }
+    }
+}
+
+size_t 
+h_gc(heap_t *h)
+{
+  return h_gc_dbg(h, SAFE_STACK);
+}
+
+void
+set_unsafe_pages(heap_t *h, void **array[], size_t array_size)
+{
+  for(size_t i = 0; i < array_size; ++i)
+    {
+      if((alloc_map_ptr_used(h->alloc_map, *array[i])))
+        {
+          int index = get_ptr_page(h, *array[i]);
+          if(h->pages[index]->type == TRANSITION)
+            {
+              h->pages[index]->type = UNSAFE;
+              h->stats.last.pinned_pages += 1;
+            }
+        }
+    }
+}
+
+void
+set_unsafe_pages_to_active(heap_t *h)
+{
+  for(int i =0; i < (int)h->pages_created; ++i)
+    {
+      if(h->pages[i]->type == UNSAFE)
+        { 
+          h->pages[i]->type = ACTIVE;
+        }
+    }
+}
+
+
+size_t 
+h_gc_dbg(heap_t *h, bool unsafe_stack)
+{
+  assert(h != NULL);
+  if(h == NULL) return 0;
+  //Dump_registers();
+
+  uint64_t pause_start = time_ns();
+  alloc_rate_sample(h);
+  size_t used_before_gc = h_used(h);
+  h_gc_stats_t *stats = &h->stats.last;
+  memset(stats, 0, sizeof(h_gc_stats_t));
+  stats->collections = 1;
+  h->soft_refs_strong = used_before_gc < h->soft_ref_threshold * h->size;
+  set_active_to_transition(h);
+  cursors_reset(h);
+  if(h->census != NULL) census_begin(h->census);
+#ifdef SPARC
+  int dummy = 0;
+  void *stack_top = &dummy;
+#else
+  void *stack_top = __builtin_frame_address(0);
+#endif
+  Trace(h, TRACE_GC, TRACE_BEGIN, used_before_gc);
+  uint64_t phase_start = time_ns();
+  Trace(h, TRACE_TRACE, TRACE_BEGIN, 0);
+  size_t num_active_ptrs = get_number_of_active_ptrs(h, stack_top);
+  void **array_of_found_ptrs[num_active_ptrs];
+  size_t num_stack_ptrs = get_active_ptrs(h, stack_top,  array_of_found_ptrs, num_active_ptrs);
+  Trace(h, TRACE_TRACE, TRACE_END, num_active_ptrs);
+  stats->trace_ns = time_ns() - phase_start - stats->root_scan_ns;
+  stats->stack_roots = num_stack_ptrs;
+  if(h->recorder != NULL) record_roots(h, array_of_found_ptrs, num_stack_ptrs);
+
+  phase_start = time_ns();
+  if(unsafe_stack == UNSAFE_STACK)
+    {
+      Trace(h, TRACE_PIN, TRACE_BEGIN, 0);
+      set_unsafe_pages(h, array_of_found_ptrs, num_stack_ptrs);
+      Trace(h, TRACE_PIN, TRACE_END, stats->pinned_pages);
+    }
+  stats->root_scan_ns += time_ns() - phase_start;
+
+  size_t num_pending_refs = find_pending_refs(h, NULL);
+  h_ref_t *pending_refs[num_pending_refs > 0 ? num_pending_refs : 1];
+  find_pending_refs(h, pending_refs);
+  size_t next_pending_ref = 0;
+
+  phase_start = time_ns();
+  Trace(h, TRACE_COPY, TRACE_BEGIN, 0);
+  for(size_t page_nr = 0; page_nr < h->pages_created; ++page_nr)
+    {
+      if (page_get_type(h->pages[page_nr]) == TRANSITION)
+        {
+          for(size_t ptr_index = 0; ptr_index < num_active_ptrs
+                && array_of_found_ptrs[ptr_index] != NULL; ++ptr_index)
+            {
+              void *ptr_to_original_data = *array_of_found_ptrs[ptr_index];
+              if (get_ptr_page(h, ptr_to_original_data) == (int) page_nr) 
+                {
+                  void *ptr_to_new_data = NULL;
+                  if(get_header_type(ptr_to_original_data) == FORWARDING_ADDR)
+                    {
+                      ptr_to_new_data = get_forwarding_address(ptr_to_original_data);
+                    }
+                  else
+                    {
+                      ptr_to_new_data = h_alloc_raw(h, *array_of_found_ptrs[ptr_index]);
+                      if(h->recorder != NULL)
+                        {
+                          recorder_move(h->recorder, ptr_to_original_data, ptr_to_new_data);
+                        }
+                      if(h->census != NULL) count_live_object(h, ptr_to_new_data, false);
+                      if(get_header_type(ptr_to_new_data) == STRUCT_REP)
+                        {
+                          forward_internal_array_ptrs_with_offset(array_of_found_ptrs,
+                                                                  ptr_index, 
+                                                                  num_active_ptrs, 
+                                                                  ptr_to_original_data,
+                                                                  ptr_to_new_data);
+                        }
+                    }
+                  *array_of_found_ptrs[ptr_index] = ptr_to_new_data;
+                }
+            }
+          next_pending_ref = process_pending_refs(h, page_nr, pending_refs,
+                                                  num_pending_refs, next_pending_ref);
+          uint64_t reset_start = time_ns();
+          // The objects that were not copied die with the page
+          page_t *page = h->pages[page_nr];
+          size_t words = ((char *) page_get_bump(page) - (char *) page_get_start(page)) / WORD_SIZE;
+          if(words > 0) alloc_map_set_n(h->alloc_map, page_get_start(page), WORD_SIZE, words, false);
+          page_set_type(h->pages[page_nr], PASSIVE);
+          page_reset(h->pages[page_nr]);
+          page_set_idle_since(h->pages[page_nr], h->collections);
+          stats->pages_evacuated += 1;
+          stats->page_reset_ns += time_ns() - reset_start;
+        }
+    }
+  Trace(h, TRACE_COPY, TRACE_END, stats->bytes_copied);
+  stats->copy_ns = time_ns() - phase_start - stats->page_reset_ns;
+
+  phase_start = time_ns();
+  Trace(h, TRACE_PAGE_RESET, TRACE_BEGIN, 0);
+  if(h->census != NULL)
+    {
+      count_pinned_objects(h);
+      census_end(h->census);
+    }
+  set_unsafe_pages_to_active(h);
+  update_headroom(h);
+  ++h->collections;
+  release_idle_pages(h, RELEASE_AFTER_COLLECTIONS, IDLE_RELEASE_ADVICE);
+  Trace(h, TRACE_PAGE_RESET, TRACE_END, stats->pages_evacuated);
+  stats->page_reset_ns += time_ns() - phase_start;
+  gc_stats_add(&h->stats.total, stats);
+
+  size_t used_after_gc = h_used(h);
+  size_t collected = used_before_gc - used_after_gc;
+  h->last_pause_ns = time_ns() - pause_start;
+  histogram_record(&h->pauses, h->last_pause_ns);
+  publish_stats(h);
+  Trace(h, TRACE_GC, TRACE_END, collected);
+  if(h->recorder != NULL) record_collection(h);
+  return collected;
+}
+
+
+void
+h_stats(heap_t *h, h_stats_t *stats)
+{
+  assert(h != NULL);
+  assert(stats != NULL);
+  if(h == NULL || stats == NULL) return;
+  *stats = h->stats;
+}
+
+
+void
+h_pauses(heap_t *h, h_pauses_t *pauses)
+{
+  assert(h != NULL);
+  assert(pauses != NULL);
+  if(h == NULL || pauses == NULL) return;
+
+  histogram_t *histogram = &h->pauses;
+  pauses->count = histogram->count;
+  pauses->min_ns = histogram->min;
+  pauses->max_ns = histogram->max;
+  pauses->mean_ns = histogram_mean(histogram);
+  pauses->total_ns = histogram->sum;
+  pauses->p50_ns = histogram_percentile(histogram, 50.0);
+  pauses->p90_ns = histogram_percentile(histogram, 90.0);
+  pauses->p99_ns = histogram_percentile(histogram, 99.0);
+  pauses->p999_ns = histogram_percentile(histogram, 99.9);
+}
+
+
+uint64_t
+h_pause_percentile(heap_t *h, double percentile)
+{
+  assert(h != NULL);
+  if(h == NULL) return 0;
+  return histogram_percentile(&h->pauses, percentile);
+}
+
+
+double
+h_alloc_rate(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return 0.0;
+  alloc_rate_sample(h);
+  return h->alloc_rate;
+}
+
+
+size_t
+h_allocated(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return 0;
+  return allocated_bytes(h);
+}
+
+
+bool
+h_publish_start(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return false;
+  if(h->published != NULL) return true;
+
+  static unsigned heap_number = 0;
+  snprintf(h->published_name, SHARED_STATS_NAME_LENGTH, "/%s%ld-%u",
+           SHARED_STATS_PREFIX, (long) getpid(), heap_number++);
+  h->published = shared_stats_create(h->published_name);
+  if(h->published == NULL) return false;
+  publish_stats(h);
+  return true;
+}
+
+
+void
+h_publish_stop(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL || h->published == NULL) return;
+  shared_stats_delete(h->published, h->published_name);
+  h->published = NULL;
+  h->published_name[0] = '\0';
+}
+
+
+void
+h_publish(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return;
+  alloc_rate_sample(h);
+  publish_stats(h);
+}
+
+
+const char *
+h_publish_name(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL || h->published == NULL) return NULL;
+  return h->published_name;
+}
+
+
+bool
+h_trace_start(heap_t *h, size_t capacity, size_t alloc_sample_interval)
+{
+  assert(h != NULL);
+  if(h == NULL || capacity == 0) return false;
+
+  trace_buffer_t *buffer = trace_buffer_create(capacity);
+  if(buffer == NULL) return false;
+  trace_buffer_delete(h->trace);
+  h->trace = buffer;
+  h->trace_alloc_interval = alloc_sample_interval;
+  h->trace_alloc_count = 0;
+  return true;
+}
+
+
+void
+h_trace_stop(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return;
+  trace_buffer_delete(h->trace);
+  h->trace = NULL;
+  h->trace_alloc_interval = 0;
+}
+
+
+bool
+h_trace_export_chrome(heap_t *h, FILE *out)
+{
+  assert(h != NULL);
+  if(h == NULL || h->trace == NULL) return false;
+  return trace_export_chrome(h->trace, out, (long) getpid());
+}
+
+
+bool
+h_trace_export_text(heap_t *h, FILE *out)
+{
+  assert(h != NULL);
+  if(h == NULL || h->trace == NULL) return false;
+  return trace_export_text(h->trace, out, (long) getpid());
+}
+
+
+bool
+h_profile_start(heap_t *h, size_t interval)
+{
+  assert(h != NULL);
+  if(h == NULL || interval == 0) return false;
+
+  profiler_t *profiler = profiler_create(interval, allocated_bytes(h));
+  if(profiler == NULL) return false;
+  profiler_delete(h->profiler);
+  h->profiler = profiler;
+  update_headroom(h);
+  return true;
+}
+
+
+void
+h_profile_stop(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return;
+  profiler_delete(h->profiler);
+  h->profiler = NULL;
+  update_headroom(h);
+}
+
+
+bool
+h_profile_export_pprof(heap_t *h, FILE *out)
+{
+  assert(h != NULL);
+  if(h == NULL || h->profiler == NULL) return false;
+  return profiler_export_pprof(h->profiler, out);
+}
+
+
+bool
+h_profile_export_folded(heap_t *h, FILE *out)
+{
+  assert(h != NULL);
+  if(h == NULL || h->profiler == NULL) return false;
+  return profiler_export_folded(h->profiler, out);
+}
+
+
+bool
+h_census_start(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return false;
+  if(h->census != NULL) return true;
+  h->census = census_create();
+  return h->census != NULL;
+}
+
+
+void
+h_census_stop(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return;
+  census_delete(h->census);
+  h->census = NULL;
+}
+
+
+size_t
+h_census(heap_t *h, h_census_entry_t *entries, size_t max)
+{
+  assert(h != NULL);
+  if(h == NULL || h->census == NULL) return 0;
+  size_t count = census_entries(h->census);
+  for(size_t i = 0; i < count && i < max && entries != NULL; ++i)
     {
-      bytes += WORD_SIZE - (bytes % WORD_SIZE);
+      entries[i] = *census_entry(h->census, i);
     }
+  return count;
+}
 
-  int index_next_act = find_next_active_page(h, 0);
-  page_t *page_to_write_to;
-  while (index_next_act >= 0) 
+
+size_t
+h_retention_report(heap_t *h, h_retained_t *top, size_t k)
+{
+  assert(h != NULL);
+  if(h == NULL || top == NULL || k == 0) return 0;
+
+  size_t count = list_heap_objects(h, NULL);
+  size_t nodes = count > 0 ? count : 1;
+  void **objects = malloc(nodes * sizeof(void *));
+  size_t *first = malloc((count + 1) * sizeof(size_t));
+  size_t *targets = NULL;
+  uint64_t *sizes = malloc(nodes * sizeof(uint64_t));
+  size_t *roots = NULL;
+  size_t root_count = 0;
+  size_t *chosen = malloc(k * sizeof(size_t));
+  retention_t result;
+  result.idom = malloc(nodes * sizeof(size_t));
+  result.parent = malloc(nodes * sizeof(size_t));
+  result.retained = malloc(nodes * sizeof(uint64_t));
+  result.retained_objects = malloc(nodes * sizeof(uint64_t));
+  bool ok = objects != NULL && first != NULL && sizes != NULL && chosen != NULL
+    && result.idom != NULL && result.parent != NULL
+    && result.retained != NULL && result.retained_objects != NULL;
+
+  if(ok) list_heap_objects(h, objects);
+  ok = ok && build_object_graph(objects, count, first, &targets, sizes);
+  ok = ok && (roots = find_stack_roots(h, objects, count, &root_count)) != NULL;
+  if(ok)
     {
-      if ( page_get_avail(h->pages[index_next_act])> bytes)
-        {
-          page_to_write_to = h->pages[index_next_act];
-          break;
-        }
-      else 
-        {
-          index_next_act = find_next_active_page(h, index_next_act + 1);
-        }      
+      retention_graph_t graph = { count, first, targets, sizes, root_count, roots };
+      ok = retention_compute(&graph, &result);
     }
-
-  if(index_next_act < 0) 
+  size_t written = ok ? choose_largest(&result, count, chosen, k) : 0;
+  for(size_t i = 0; i < written; ++i)
     {
-      if (number_of_passive_pages(h) <= 1)
-        {
-          bool not_cleaned_enough = run_gc_if_above_threshold(h, bytes);
-          if(not_cleaned_enough)
-            {
-              return NULL;
-            }
-          else if (number_of_passive_pages(h) <= 1)
-            {
-              return NULL;
-            }        
-        }
-      page_to_write_to = find_first_passive_page(h);
-      page_to_write_to->type = ACTIVE;
+      fill_retained(&top[i], objects, sizes, &result, chosen[i]);
     }
 
-  
-  void *page_bump = page_get_bump(page_to_write_to);
-  void * ptr_to_write_to = page_bump;
-  page_move_bump(page_to_write_to, bytes);
-  return ptr_to_write_to; 
+  free(objects);
+  free(first);
+  free(targets);
+  free(sizes);
+  free(roots);
+  free(chosen);
+  free(result.idom);
+  free(result.parent);
+  free(result.retained);
+  free(result.retained_objects);
+  return written;
 }
 
 
-void *
-h_alloc_struct(heap_t * h, char * layout)
+h_ref_t *
+h_weak_ref(heap_t *h, void *referent)
 {
-  assert(h != NULL);
-  assert(layout != NULL);
-  assert(*layout != '\0');
-  if(h == NULL || layout == NULL || *layout == '\0') return NULL;
-  
-  size_t size = get_struct_size(layout);
-  assert(size <= PAGE_SIZE);
-  assert(size > 0);
-  if(size > PAGE_SIZE || size == 0) return NULL;
- 
-  void * ptr = h_alloc(h, size);
-  if (ptr == NULL) return NULL;
-  
-  void * return_ptr = create_struct_header(h, layout, ptr);
-  alloc_map_set(h->alloc_map, return_ptr, true); 
-  return return_ptr;
+  return ref_create(h, referent, false);
 }
 
 
-void *
-h_alloc_data(heap_t * h, size_t bytes)
+h_ref_t *
+h_soft_ref(heap_t *h, void *referent)
+{
+  return ref_create(h, referent, true);
+}
+
+
+void
+h_soft_ref_threshold(heap_t *h, float occupancy)
 {
-  assert(bytes > 0);
   assert(h != NULL);
-  if(h == NULL || bytes == 0) return NULL;
-  
-  size_t size = get_data_size(bytes);
-  assert(size <= PAGE_SIZE);
-  assert(size > 0);
-  if(size > PAGE_SIZE || size == 0) return NULL;
-  void * ptr = h_alloc(h, size);
-  if (ptr == NULL) return NULL;
-  
-  void * return_ptr = create_data_header(bytes, ptr);
-  alloc_map_set(h->alloc_map, return_ptr, true); 
-  return return_ptr;
+  if(h == NULL) return;
+  h->soft_ref_threshold = occupancy;
 }
 
 
-/**
- *  @brief reallocates data from one page to another
- *
- *  @param  h a pointer to the heap
- *  @param  ptr_to_data a pointer to the data (without header) to be reallocated
- *
- *  @return a pointer to the reallocaded data
- */
 void *
-h_alloc_raw(heap_t *h, void *ptr_to_data)
+h_ref_get(h_ref_t *ref)
 {
-  assert(ptr_to_data != NULL);
-  size_t raw_size = get_existing_size(ptr_to_data);
-  if(raw_size < SMALLEST_ALLOC_SIZE)
-    {
-      raw_size = SMALLEST_ALLOC_SIZE;
-    }
-  if(raw_size % WORD_SIZE != 0)
-    {
-      raw_size += WORD_SIZE - (raw_size % WORD_SIZE);
-    }
-  int index_next_act = find_next_active_page(h, 0);
-  page_t *page_to_write_to;
-  while (index_next_act >= 0) 
+  assert(ref != NULL);
+  if(ref == NULL) return NULL;
+  return ref->referent;
+}
+
+
+void
+h_ref_delete(heap_t *h, h_ref_t *ref)
+{
+  assert(h != NULL);
+  if(h == NULL || ref == NULL) return;
+  if(ref->prev != NULL)
     {
-      if ( page_get_avail(h->pages[index_next_act])> raw_size)
-        {
-          page_to_write_to = h->pages[index_next_act];
-          break;
-        }
-      else 
-        {
-          index_next_act = find_next_active_page(h, index_next_act + 1);
-        }
+      ref->prev->next = ref->next;
     }
-  if(index_next_act < 0) 
+  else
     {
-      page_to_write_to = find_first_passive_page(h);
-      page_to_write_to->type = ACTIVE;
+      h->refs = ref->next;
     }
- 
-  void *page_bump = page_get_bump(page_to_write_to);
-  void * ptr_to_write_to = page_bump;
-  page_move_bump(page_to_write_to, raw_size);
+  if(ref->next != NULL) ref->next->prev = ref->prev;
+  free(ref);
+}
 
-  size_t data_size = get_existing_data_size(ptr_to_data);
-  void *ptr_to_moved_data = copy_header(ptr_to_data, ptr_to_write_to);
-  forward_header(ptr_to_data, ptr_to_moved_data);
 
-  void * return_ptr = memcpy(ptr_to_moved_data, ptr_to_data, data_size);
-  alloc_map_set(h->alloc_map, return_ptr, true); 
-  alloc_map_set(h->alloc_map, ptr_to_data, false); 
-  return return_ptr;
+bool
+h_record_start(heap_t *h, int fd)
+{
+  assert(h != NULL);
+  if(h == NULL || fd < 0 || h->recorder != NULL) return false;
+
+  recording_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.page_size = PAGE_SIZE;
+  header.heap_size = h->size;
+  header.gc_threshold = h->gc_threshold;
+  header.unsafe_stack = h->unsafe_stack;
+  h->recorder = recorder_create(fd, &header);
+  if(h->recorder == NULL) return false;
+  update_headroom(h);
+  return true;
 }
 
 
-void
-set_active_to_transition(heap_t *h)
+bool
+h_record_stop(heap_t *h)
 {
-  for(int i =0; i < (int)h->number_of_pages; ++i)
-    {
-      if(h->pages[i]->type == ACTIVE)
-        {
-          h->pages[i]->type = TRANSITION;
-        }
-    }
+  assert(h != NULL);
+  if(h == NULL || h->recorder == NULL) return false;
+
+  bool ok = recorder_finish(h->recorder);
+  h->recorder = NULL;
+  update_headroom(h);
+  return ok;
 }
 
 
+/*============================================================================
+ *                             SNAPSHOT
+ *===========================================================================*/
+
+typedef struct snapshot_writer snapshot_writer_t;
+
+struct snapshot_writer
+{
+  int fd;
+  bool ok;
+  size_t used;
+  char buffer[SNAPSHOT_BUFFER_SIZE];
+};
+
 /**
- *  @brief Reallocates pointers from a reallocated struct  
- *
- *  If a pointer in the array is within the range the offset is added to it 
- *  to give it the correct address
- *
- *  @param array an array of double pointers to addresses on the heap
- *  @param start_index the index of the array where to start forwarding
- *  @param array_size the size of the array
- *  @param ptr_to_original_data a pointer to the original data address 
- *  @param ptr_to_new_data a pointer to the new data address
+ *  @brief Writes the buffered bytes of a snapshot to its file
  */
 void
-forward_internal_array_ptrs_with_offset(void **array[], 
-                                        size_t start_index,
-                                        size_t array_size,
-                                        void *ptr_to_original_data,
-                                        void *ptr_to_new_data)
+snapshot_flush(snapshot_writer_t *writer)
 {
-  long offset = (long) ptr_to_new_data - (long) ptr_to_original_data;
-  void **lower_range = ptr_to_original_data;
-  void **upper_range = (void *) ((unsigned long) lower_range + get_existing_data_size(ptr_to_new_data));
-  
-  for(size_t index = start_index; index < array_size; ++index)
+  size_t written = 0;
+  while(writer->ok && written < writer->used)
     {
-      if(lower_range <= array[index] && array[index] < upper_range)
+      ssize_t result = write(writer->fd, writer->buffer + written, writer->used - written);
+      if(result < 0 && errno == EINTR) continue;
+      if(result <= 0)
         {
-          array[index] = (void *)((long) array[index] + offset);
+          writer->ok = false;
+        }
+      else
+        {
+          written += (size_t) result;
         }
     }
+  writer->used = 0;
 }
 
-size_t 
-h_gc(heap_t *h)
-{
-  return h_gc_dbg(h, SAFE_STACK);
-}
-
+/**
+ *  @brief Adds @p bytes bytes to a snapshot
+ */
 void
-set_unsafe_pages(heap_t *h, void **array[], size_t array_size)
+snapshot_write(snapshot_writer_t *writer, const void *data, size_t bytes)
 {
-  for(size_t i = 0; i < array_size; ++i)
+  const char *from = data;
+  while(bytes > 0 && writer->ok)
     {
-      if((alloc_map_ptr_used(h->alloc_map, *array[i])))
-        {
-          int index = get_ptr_page(h, *array[i]);
-          if(h->pages[index]->type == TRANSITION)
-            {
-              h->pages[index]->type = UNSAFE;
-            }
-        }
+      if(writer->used == SNAPSHOT_BUFFER_SIZE) snapshot_flush(writer);
+      size_t room = SNAPSHOT_BUFFER_SIZE - writer->used;
+      size_t chunk = bytes < room ? bytes : room;
+      memcpy(writer->buffer + writer->used, from, chunk);
+      writer->used += chunk;
+      from += chunk;
+      bytes -= chunk;
     }
 }
 
-void
-set_unsafe_pages_to_active(heap_t *h)
+/**
+ *  @brief Writes the record of one object to a snapshot
+ *
+ *  @param  writer the snapshot
+ *  @param  data the data of the object
+ *  @return the size of the object including its header
+ */
+size_t
+snapshot_write_object(snapshot_writer_t *writer, void *data)
 {
-  for(int i =0; i < (int)h->number_of_pages; ++i)
+  uint8_t tag = SNAPSHOT_OBJECT;
+  uint64_t address = (uint64_t) (uintptr_t) data;
+  uint64_t size = round_alloc_size(get_existing_size(data));
+  bool is_struct = get_header_type(data) == STRUCT_REP;
+  uint8_t kind = get_array_length(data) > 0 ? SNAPSHOT_ARRAY
+    : is_struct ? SNAPSHOT_STRUCT : SNAPSHOT_RAW;
+
+  char layout[SNAPSHOT_LAYOUT_MAX];
+  size_t layout_length = get_layout(data, layout, sizeof(layout));
+  uint16_t stored_length = layout_length < sizeof(layout) ? layout_length : sizeof(layout) - 1;
+
+  size_t slots = is_struct ? get_number_of_pointers_in_struct(data) : 0;
+  void **pointer_slots[slots > 0 ? slots : 1];
+  if(slots > 0) get_pointers_in_struct(data, pointer_slots);
+  uint32_t count = 0;
+  for(size_t i = 0; i < slots; ++i)
     {
-      if(h->pages[i]->type == UNSAFE)
-        { 
-          h->pages[i]->type = ACTIVE;
-        }
+      if(*pointer_slots[i] != NULL) ++count;
     }
+
+  snapshot_write(writer, &tag, sizeof(tag));
+  snapshot_write(writer, &address, sizeof(address));
+  snapshot_write(writer, &size, sizeof(size));
+  snapshot_write(writer, &kind, sizeof(kind));
+  snapshot_write(writer, &stored_length, sizeof(stored_length));
+  snapshot_write(writer, layout, stored_length);
+  snapshot_write(writer, &count, sizeof(count));
+  for(size_t i = 0; i < slots; ++i)
+    {
+      uint64_t pointer = (uint64_t) (uintptr_t) *pointer_slots[i];
+      if(pointer != 0) snapshot_write(writer, &pointer, sizeof(pointer));
+    }
+  return size;
 }
 
 
-size_t 
-h_gc_dbg(heap_t *h, bool unsafe_stack)
+static int
+compare_addresses(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t) *(void * const *) a;
+  uintptr_t y = (uintptr_t) *(void * const *) b;
+  return (x > y) - (x < y);
+}
+
+
+bool
+h_snapshot(heap_t *h, int fd)
 {
   assert(h != NULL);
-  if(h == NULL) return 0;
-  //Dump_registers();
+  if(h == NULL || fd < 0) return false;
+
+  snapshot_writer_t *writer = malloc(sizeof(snapshot_writer_t));
+  if(writer == NULL) return false;
+  writer->fd = fd;
+  writer->ok = true;
+  writer->used = 0;
+
+  snapshot_header_t header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+  header.version = SNAPSHOT_VERSION;
+  header.pointer_size = sizeof(void *);
+  header.heap_start = (uint64_t) (uintptr_t) h->memory;
+  header.heap_size = h->size;
+  header.collections = h->collections;
+  snapshot_write(writer, &header, sizeof(header));
 
-  size_t used_before_gc = h_used(h);
-  set_active_to_transition(h);
 #ifdef SPARC
   int dummy = 0;
   void *stack_top = &dummy;
 #else
   void *stack_top = __builtin_frame_address(0);
 #endif
+  // The objects are found as a collection finds them, without its stats
+  size_t false_roots = h->stats.last.false_roots;
   size_t num_active_ptrs = get_number_of_active_ptrs(h, stack_top);
-  void **array_of_found_ptrs[num_active_ptrs];
-  size_t num_stack_ptrs = get_active_ptrs(h, stack_top,  array_of_found_ptrs, num_active_ptrs);
-  if(unsafe_stack == UNSAFE_STACK)
+  void ***found = malloc((num_active_ptrs > 0 ? num_active_ptrs : 1) * sizeof(void **));
+  void **live = malloc((num_active_ptrs > 0 ? num_active_ptrs : 1) * sizeof(void *));
+  if(found == NULL || live == NULL)
     {
-      set_unsafe_pages(h, array_of_found_ptrs, num_stack_ptrs);
+      free(found);
+      free(live);
+      free(writer);
+      return false;
     }
+  for(size_t i = 0; i < num_active_ptrs; ++i) found[i] = NULL;
+  size_t num_stack_ptrs = get_ptrs_from_stack(h, stack_top, found, num_active_ptrs);
+  trace_from_roots(h, found, num_active_ptrs, num_stack_ptrs);
+  h->stats.last.false_roots = false_roots;
 
-  for(size_t page_nr = 0; page_nr < h->number_of_pages; ++page_nr)
+  size_t live_count = 0;
+  for(size_t i = 0; i < num_active_ptrs && found[i] != NULL; ++i)
     {
-      if (page_get_type(h->pages[page_nr]) == TRANSITION)
-        {
-          for(size_t ptr_index = 0; ptr_index < num_active_ptrs
-                && array_of_found_ptrs[ptr_index] != NULL; ++ptr_index)
-            {
-              void *ptr_to_original_data = *array_of_found_ptrs[ptr_index];
-              if (get_ptr_page(h, ptr_to_original_data) == (int) page_nr) 
-                {
-                  void *ptr_to_new_data = NULL;
-                  if(get_header_type(ptr_to_original_data) == FORWARDING_ADDR)
-                    {
-                      ptr_to_new_data = get_forwarding_address(ptr_to_original_data);
-                    }
-                  else
-                    {
-                      ptr_to_new_data = h_alloc_raw(h, *array_of_found_ptrs[ptr_index]);
-                      if(get_header_type(ptr_to_new_data) == STRUCT_REP)
-                        {
-                          forward_internal_array_ptrs_with_offset(array_of_found_ptrs,
-                                                                  ptr_index, 
-                                                                  num_active_ptrs, 
-                                                                  ptr_to_original_data,
-                                                                  ptr_to_new_data);
-                        }
-                    }
-                  *array_of_found_ptrs[ptr_index] = ptr_to_new_data;
-                }
-            }
-          page_set_type(h->pages[page_nr], PASSIVE);
-          page_reset(h->pages[page_nr]);
-        }
+      live[live_count++] = *found[i];
     }
-  set_unsafe_pages_to_active(h);
-  size_t used_after_gc = h_used(h);
-  size_t collected = used_before_gc - used_after_gc;
-  return collected;
+  qsort(live, live_count, sizeof(void *), compare_addresses);
+  for(size_t i = 0; i < live_count; ++i)
+    {
+      if(i > 0 && live[i] == live[i - 1]) continue;
+      snapshot_write_object(writer, live[i]);
+    }
+
+  for(size_t i = 0; i < num_stack_ptrs; ++i)
+    {
+      uint8_t tag = SNAPSHOT_ROOT;
+      uint64_t address = (uint64_t) (uintptr_t) *found[i];
+      snapshot_write(writer, &tag, sizeof(tag));
+      snapshot_write(writer, &address, sizeof(address));
+    }
+  for(h_ref_t *ref = h->refs; ref != NULL; ref = ref->next)
+    {
+      if(!ref_is_strong(h, ref) || ref->referent == NULL) continue;
+      uint8_t tag = SNAPSHOT_ROOT;
+      uint64_t address = (uint64_t) (uintptr_t) ref->referent;
+      snapshot_write(writer, &tag, sizeof(tag));
+      snapshot_write(writer, &address, sizeof(address));
+    }
+  free(found);
+  free(live);
+
+  uint8_t end_tag = SNAPSHOT_END;
+  snapshot_write(writer, &end_tag, sizeof(end_tag));
+  snapshot_flush(writer);
+  bool ok = writer->ok;
+  free(writer);
+  return ok;
+}
+
+
+size_t
+h_trim(heap_t *h)
+{
+  assert(h != NULL);
+  if(h == NULL) return 0;
+  return release_idle_pages(h, 0, MADV_DONTNEED);
 }
 
 
@@ -891,12 +3015,12 @@ h_avail(heap_t *h)
   assert(h != NULL);
   if(h == NULL) return 0;
   size_t avail = 0;
-  int number_of_pages = h->number_of_pages;
+  int number_of_pages = h->pages_created;
   for (int i = 0; i < number_of_pages; i++) 
     {
       avail += page_get_avail(h->pages[i]);  
     }
-  return avail;
+  return avail + (h->number_of_pages - h->pages_created) * PAGE_SIZE;
 }
 
 
@@ -906,7 +3030,7 @@ h_used(heap_t *h)
   assert(h != NULL);
   if(h == NULL) return 0;
   size_t used = 0;
-  int number_of_pages = h->number_of_pages;
+  int number_of_pages = h->pages_created;
   for (int i = 0; i < number_of_pages; i++) 
     {
       used += page_get_used(h->pages[i]);  
@@ -935,6 +3059,7 @@ h_strdup(heap_t *h, char *str)
     {
       size_t str_len = strlen(str) + 1;
       char *result = h_alloc_data(h, (str_len) * sizeof(char));
+      if(result == NULL) return NULL;
       strncpy(result, str, str_len);
       return result;
     }
@@ -12,6 +12,7 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #ifndef __gc__
@@ -20,6 +21,9 @@
 #define UNSAFE_STACK true
 #define SAFE_STACK false
 
+/** Option for h_init_with_options(): back the heap with huge pages */
+#define H_HUGE_PAGES 1U
+
 #pragma pack(1)
 
 /**
@@ -45,6 +49,46 @@ heap_t *
 h_init(size_t bytes, bool unsafe_stack, float gc_threshold);
 
 
+/**
+ *  @brief Create a new heap of @p bytes that can grow to @p max_bytes.
+ *
+ *  Address space for @p max_bytes is reserved up front but only
+ *  @p bytes is backed by memory. When a collection leaves the heap too
+ *  full the heap grows, at least doubling, instead of failing
+ *  allocations. Pointers into the heap stay valid when it grows.
+ *
+ *  @param  bytes the initial size of the heap in bytes
+ *  @param  max_bytes the largest size the heap may grow to
+ *  @param  unsafe_stack true if pointers on the stack are to be
+ *          considered unsafe pointers
+ *  @param  gc_threshold the memory pressure at which gc should be triggered
+ *          (1.0 = full memory)
+ *  @return the new heap or NULL if memory cannot be reserved
+ */
+heap_t *
+h_init_growable(size_t bytes, size_t max_bytes, bool unsafe_stack, float gc_threshold);
+
+
+/**
+ *  @brief Create a new heap as h_init_growable() with extra options.
+ *
+ *  With H_HUGE_PAGES the heap memory is aligned to 2 MB and grows in
+ *  steps of 2 MB, and the kernel is asked to back it with transparent
+ *  huge pages. If the kernel has no huge pages the heap uses normal pages.
+ *
+ *  @param  bytes the initial size of the heap in bytes
+ *  @param  max_bytes the largest size the heap may grow to
+ *  @param  unsafe_stack true if pointers on the stack are to be
+ *          considered unsafe pointers
+ *  @param  gc_threshold the memory pressure at which gc should be triggered
+ *          (1.0 = full memory)
+ *  @param  options zero or more options, such as H_HUGE_PAGES, or:ed together
+ *  @return the new heap or NULL if memory cannot be reserved
+ */
+heap_t *
+h_init_with_options(size_t bytes, size_t max_bytes, bool unsafe_stack, float gc_threshold, unsigned options);
+
+
 /**
  *  @brief Delete a heap.
  *
@@ -104,6 +148,105 @@ void *
 h_alloc_data(heap_t *h, size_t bytes);
 
 
+/**
+ *  @brief Allocate an array of @p count elements with a given format string.
+ *
+ *  The element count is kept in the header, so arrays of any length up to
+ *  a page are allocated and traced without copying a format string to the
+ *  heap. The elements are zeroed.
+ *
+ *  @param  h the heap
+ *  @param  element_layout the format string of one element, see
+ *          h_alloc_struct(). It may describe at most 24 fields where 'l'
+ *          and 'd' count as two.
+ *  @param  count the number of elements, at least 1
+ *  @return the newly allocated array or NULL if it cannot be allocated
+ */
+void *
+h_alloc_array(heap_t *h, char *element_layout, size_t count);
+
+
+/**
+ *  @brief Allocate an array of @p count pointers.
+ *
+ *  Same as h_alloc_array(@p h, "*", @p count).
+ *
+ *  @param  h the heap
+ *  @param  count the number of pointers, at least 1
+ *  @return the newly allocated array or NULL if it cannot be allocated
+ */
+void **
+h_alloc_ptr_array(heap_t *h, size_t count);
+
+
+/**
+ *  @brief Returns the number of elements of an array.
+ *
+ *  @param  array an array allocated with h_alloc_array() or
+ *          h_alloc_ptr_array()
+ *  @return the number of elements in @p array, 0 if @p array is not an array
+ */
+size_t
+h_array_length(void *array);
+
+
+/**
+ *  @brief Resize an object allocated with h_alloc_data() or an array.
+ *
+ *  If @p ptr is the latest allocation in its page and the page has room
+ *  the object grows in place by moving the page bump. Otherwise a new
+ *  object is allocated and the contents copied, the old object must not
+ *  be used after that. Weak and soft references to it are moved to the
+ *  new object. Shrinking is always done in place. New array elements are
+ *  zeroed, new raw data is not.
+ *
+ *  @param  h the heap
+ *  @param  ptr the object to resize, NULL to allocate as with h_alloc_data()
+ *  @param  new_bytes the new size in bytes, for arrays a multiple of the
+ *          element size
+ *  @return the resized object, or NULL if @p ptr is not a raw data object
+ *          or array of @p h, or the new size cannot be allocated. @p ptr
+ *          is left untouched when NULL is returned.
+ */
+void *
+h_realloc(heap_t *h, void *ptr, size_t new_bytes);
+
+
+/**
+ *  @brief Allocate @p n objects on a heap with the same format string.
+ *
+ *  Cheaper than @p n calls to h_alloc_struct() since the header is only
+ *  created once and the gc threshold is only checked once. No garbage
+ *  collection is run after the first object has been allocated.
+ *
+ *  @param  h the heap
+ *  @param  layout the format string, see h_alloc_struct()
+ *  @param  n the number of objects to allocate
+ *  @param  out array of size @p n where the new objects are placed
+ *  @return the number of objects allocated, less than @p n if the heap
+ *          ran out of memory
+ */
+size_t
+h_alloc_struct_n(heap_t *h, char *layout, size_t n, void *out[]);
+
+
+/**
+ *  @brief Allocate @p n objects on a heap with the same size.
+ *
+ *  Works like h_alloc_struct_n() but for objects allocated as with
+ *  h_alloc_data().
+ *
+ *  @param  h the heap
+ *  @param  bytes the size in bytes of each object
+ *  @param  n the number of objects to allocate
+ *  @param  out array of size @p n where the new objects are placed
+ *  @return the number of objects allocated, less than @p n if the heap
+ *          ran out of memory
+ */
+size_t
+h_alloc_data_n(heap_t *h, size_t bytes, size_t n, void *out[]);
+
+
 /**
  *  @brief Manually trigger garbage collection.
  *
@@ -134,6 +277,526 @@ size_t
 h_gc_dbg(heap_t *h, bool unsafe_stack);
 
 
+/**
+ *  @brief Return the memory of all passive pages to the operating system.
+ *
+ *  Pages that stay passive for a few collections are returned
+ *  automatically, this returns them at once. The heap size is not
+ *  changed, the memory is given back when the pages are used again.
+ *
+ *  @param  h the heap
+ *  @return the number of bytes returned to the operating system
+ */
+size_t
+h_trim(heap_t *h);
+
+
+/**
+ *  @brief Counters for garbage collections.
+ *
+ *  Times are in nanoseconds. The root scan is the search of the stack
+ *  for roots and the pinning of pages, the trace covers both passes over
+ *  the live objects, the copy is the evacuation and the page reset is
+ *  the resetting of evacuated pages and the release of idle pages.
+ */
+typedef struct h_gc_stats h_gc_stats_t;
+
+struct h_gc_stats
+{
+  size_t collections;
+  size_t bytes_copied;
+  size_t objects_copied;
+  size_t pages_evacuated;
+  size_t pinned_pages;
+  size_t stack_roots;
+  size_t false_roots;      /**< stack words into the heap that are not objects */
+  size_t refs_cleared;     /**< weak and soft references cleared */
+  uint64_t root_scan_ns;
+  uint64_t trace_ns;
+  uint64_t copy_ns;
+  uint64_t page_reset_ns;
+};
+
+/**
+ *  @brief Garbage collection statistics of a heap.
+ */
+typedef struct h_stats h_stats_t;
+
+struct h_stats
+{
+  h_gc_stats_t total;      /**< summed over all collections */
+  h_gc_stats_t last;       /**< the latest collection only */
+};
+
+
+/**
+ *  @brief Read the garbage collection statistics of a heap.
+ *
+ *  @param  h the heap
+ *  @param  stats where the statistics are written
+ */
+void
+h_stats(heap_t *h, h_stats_t *stats);
+
+
+/**
+ *  @brief The distribution of garbage collection pauses of a heap.
+ *
+ *  Pauses are the wall time of each call to h_gc() or h_gc_dbg() in
+ *  nanoseconds. The percentiles come from a histogram with about 3%
+ *  resolution and are never larger than @p max_ns.
+ */
+typedef struct h_pauses h_pauses_t;
+
+struct h_pauses
+{
+  uint64_t count;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t mean_ns;
+  uint64_t total_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+  uint64_t p999_ns;
+};
+
+
+/**
+ *  @brief Read the pause distribution of a heap.
+ *
+ *  @param  h the heap
+ *  @param  pauses where the distribution is written
+ */
+void
+h_pauses(heap_t *h, h_pauses_t *pauses);
+
+
+/**
+ *  @brief Return the pause time at a percentile.
+ *
+ *  @param  h the heap
+ *  @param  percentile the percentile, 0.0 to 100.0
+ *  @return the pause in nanoseconds, 0 if the heap has not collected
+ */
+uint64_t
+h_pause_percentile(heap_t *h, double percentile);
+
+
+/**
+ *  @brief Return the moving allocation rate of a heap.
+ *
+ *  The rate is sampled at every collection and call to this function
+ *  and is averaged over about the last second. Copies made by the
+ *  garbage collector are not counted.
+ *
+ *  @param  h the heap
+ *  @return the allocation rate in bytes per second
+ */
+double
+h_alloc_rate(heap_t *h);
+
+
+/**
+ *  @brief Return the bytes allocated on a heap since it was created.
+ *
+ *  Sizes include headers and padding.
+ *
+ *  @param  h the heap
+ *  @return the bytes allocated
+ */
+size_t
+h_allocated(heap_t *h);
+
+
+/**
+ *  @brief Start publishing the statistics of a heap in shared memory.
+ *
+ *  The heap creates a POSIX shared memory segment named
+ *  "/gc-<pid>-<n>" and updates it after every collection and every
+ *  call to h_publish(). The gctop tool in tools/ lists all published
+ *  heaps on the host. The segment is removed by h_publish_stop() and
+ *  h_delete().
+ *
+ *  @param  h the heap
+ *  @return true if the heap publishes its statistics
+ */
+bool
+h_publish_start(heap_t *h);
+
+
+/**
+ *  @brief Stop publishing and remove the shared memory segment.
+ *
+ *  @param  h the heap
+ */
+void
+h_publish_stop(heap_t *h);
+
+
+/**
+ *  @brief Update the published statistics now.
+ *
+ *  Collections update the statistics, this is for programs that
+ *  want used bytes and the allocation rate to be fresh between them.
+ *
+ *  @param  h the heap
+ */
+void
+h_publish(heap_t *h);
+
+
+/**
+ *  @brief Return the name of the shared memory segment of a heap.
+ *
+ *  @param  h the heap
+ *  @return the name or NULL if the heap does not publish its statistics
+ */
+const char *
+h_publish_name(heap_t *h);
+
+
+/**
+ *  @brief Write a snapshot of the objects on a heap to a file.
+ *
+ *  The heap is traced from the roots as a collection would, without
+ *  moving anything, and every object found is written with its address,
+ *  size, kind, layout and the values of its pointer fields, followed by
+ *  the roots. Objects that have died since the last collection are left
+ *  out. The format is described in snapshot.h and the gcsnap tool in
+ *  tools/ summarizes snapshots.
+ *
+ *  @param  h the heap
+ *  @param  fd an open file descriptor to write to
+ *  @return true if the whole snapshot was written
+ */
+bool
+h_snapshot(heap_t *h, int fd);
+
+
+/**
+ *  @brief Start recording the allocations of a heap to a file.
+ *
+ *  Every allocation is recorded with its size and layout. Pointer
+ *  fields, stack roots and deaths are recorded after each collection by
+ *  comparing the heap with what was recorded before, so a store that is
+ *  overwritten before the next collection is never seen. The inlined
+ *  fast path is turned off while recording. The format is described in
+ *  recorder.h and the gcreplay tool in tools/ replays recordings.
+ *
+ *  @param  h the heap
+ *  @param  fd an open file descriptor to write to
+ *  @return true if recording started
+ */
+bool
+h_record_start(heap_t *h, int fd);
+
+
+/**
+ *  @brief Stop recording and write the end of the recording.
+ *
+ *  The file descriptor is not closed.
+ *
+ *  @param  h the heap
+ *  @return true if the whole recording was written
+ */
+bool
+h_record_stop(heap_t *h);
+
+
+/**
+ *  @brief Start recording garbage collection events.
+ *
+ *  Every collection records begin and end events for the whole
+ *  collection and for each phase into a ring buffer that keeps the
+ *  latest @p capacity events. When tracing is off the heap does not
+ *  read the clock for events at all.
+ *
+ *  @param  h the heap
+ *  @param  capacity the number of events kept
+ *  @param  alloc_sample_interval record every n:th allocation that takes
+ *          the slow path, 0 to record no allocations
+ *  @return true if tracing started, false if the buffer cannot be allocated
+ */
+bool
+h_trace_start(heap_t *h, size_t capacity, size_t alloc_sample_interval);
+
+
+/**
+ *  @brief Stop recording events and free the recorded events.
+ *
+ *  @param  h the heap
+ */
+void
+h_trace_stop(heap_t *h);
+
+
+/**
+ *  @brief Write the recorded events as Chrome trace JSON.
+ *
+ *  The output can be opened in chrome://tracing or Perfetto.
+ *
+ *  @param  h the heap
+ *  @param  out the stream to write to
+ *  @return true if the events were written, false if tracing is off
+ */
+bool
+h_trace_export_chrome(heap_t *h, FILE *out);
+
+
+/**
+ *  @brief Write the recorded events as text in the style of `perf script`.
+ *
+ *  @param  h the heap
+ *  @param  out the stream to write to
+ *  @return true if the events were written, false if tracing is off
+ */
+bool
+h_trace_export_text(heap_t *h, FILE *out);
+
+
+/**
+ *  @brief Start sampling the allocation sites of a heap.
+ *
+ *  Every time another @p interval bytes have been allocated the
+ *  allocation that reaches the interval is sampled with its backtrace,
+ *  size and layout, and the samples are summed per site. The inlined
+ *  fast path stays on and is left only for the sampled allocations.
+ *  Starting again throws away the samples taken so far. The profile is
+ *  described in profiler.h.
+ *
+ *  @param  h the heap
+ *  @param  interval the bytes allocated between two samples
+ *  @return true if profiling started
+ */
+bool
+h_profile_start(heap_t *h, size_t interval);
+
+
+/**
+ *  @brief Stop sampling and throw away the samples.
+ *
+ *  @param  h the heap
+ */
+void
+h_profile_stop(heap_t *h);
+
+
+/**
+ *  @brief Write the sampled sites as a legacy pprof heap profile.
+ *
+ *  Read it with `pprof -sample_index=alloc_space <program> <profile>`.
+ *
+ *  @param  h the heap
+ *  @param  out the stream to write to
+ *  @return true if the profile was written, false if profiling is off
+ */
+bool
+h_profile_export_pprof(heap_t *h, FILE *out);
+
+
+/**
+ *  @brief Write the sampled sites as folded stacks for flame graphs.
+ *
+ *  @param  h the heap
+ *  @param  out the stream to write to
+ *  @return true if the stacks were written, false if profiling is off
+ */
+bool
+h_profile_export_folded(heap_t *h, FILE *out);
+
+
+/**
+ *  @brief How the header of an object describes its layout.
+ */
+enum h_layout_kind
+  {
+    H_LAYOUT_RAW              /**< raw data without pointers */
+    , H_LAYOUT_BIT_VECTOR     /**< a struct described by a bit vector */
+    , H_LAYOUT_FORMAT_STRING  /**< a struct described by a format string */
+    , H_LAYOUT_ARRAY          /**< an array of structs */
+  };
+
+#define H_CENSUS_LAYOUT_MAX 64 /**< longer layouts are cut to 63 chars */
+
+/**
+ *  @brief The live objects of one layout found by the latest collection.
+ *
+ *  Pinned objects are the objects on pages that an unsafe stack kept in
+ *  place. Those pages are not evacuated, so every object on them is
+ *  counted, also the ones that are garbage.
+ */
+typedef struct h_census_entry h_census_entry_t;
+
+struct h_census_entry
+{
+  uint64_t kind;            /**< an enum h_layout_kind */
+  uint64_t objects;         /**< objects copied by the collection */
+  uint64_t bytes;           /**< their sizes, headers included */
+  uint64_t pinned_objects;
+  uint64_t pinned_bytes;
+  char layout[H_CENSUS_LAYOUT_MAX]; /**< the element layout of arrays, empty for raw data */
+};
+
+
+/**
+ *  @brief Start counting the live objects of every collection.
+ *
+ *  While the census is on, every collection counts the objects it
+ *  copies and the objects on pinned pages per header kind and layout,
+ *  like `jmap -histo`. The counts of the latest collection are read
+ *  with h_census().
+ *
+ *  @param  h the heap
+ *  @return true if the census is on
+ */
+bool
+h_census_start(heap_t *h);
+
+
+/**
+ *  @brief Stop counting live objects and throw away the counts.
+ *
+ *  @param  h the heap
+ */
+void
+h_census_stop(heap_t *h);
+
+
+/**
+ *  @brief Read the live objects counted by the latest collection.
+ *
+ *  The entries are sorted by their bytes and pinned bytes together,
+ *  largest first.
+ *
+ *  @param  h the heap
+ *  @param  entries where at most @p max entries are written
+ *  @param  max the size of @p entries
+ *  @return the number of entries of the latest collection, which is
+ *          more than @p max if they did not all fit, 0 if the census is
+ *          off or no collection has run since it started
+ */
+size_t
+h_census(heap_t *h, h_census_entry_t *entries, size_t max);
+
+
+#define H_RETENTION_PATH_MAX 16 /**< longer root paths lose their root end */
+
+/**
+ *  @brief An object and the objects that only it keeps alive.
+ */
+typedef struct h_retained h_retained_t;
+
+struct h_retained
+{
+  void *object;
+  uint64_t kind;             /**< an enum h_layout_kind */
+  uint64_t size;             /**< the size of the object, header included */
+  uint64_t retained;         /**< the bytes freed if it became garbage */
+  uint64_t retained_objects; /**< the objects freed if it became garbage */
+  uint64_t depth;            /**< the objects on the shortest path from the stack */
+  uint64_t path_length;      /**< the objects in @p path */
+  void *path[H_RETENTION_PATH_MAX]; /**< the path, ending with @p object */
+  char layout[H_CENSUS_LAYOUT_MAX];
+};
+
+
+/**
+ *  @brief Find the objects that keep the most memory alive.
+ *
+ *  The live objects are found from the stack like the collector finds
+ *  them and their dominator tree gives how much each object retains:
+ *  itself and every object only reachable through it. For every one of
+ *  the @p k largest the shortest path of pointers from the stack is
+ *  given, its first object held by the stack unless the path is longer
+ *  than H_RETENTION_PATH_MAX (see h_retained_t::depth). Nothing is
+ *  collected or moved.
+ *
+ *  @param  h the heap
+ *  @param  top where the objects are written, largest retained first
+ *  @param  k the size of @p top
+ *  @return the number of objects written, at most @p k
+ */
+size_t
+h_retention_report(heap_t *h, h_retained_t *top, size_t k);
+
+
+/**
+ *  @brief A reference that does not keep its referent alive.
+ */
+typedef struct h_ref h_ref_t;
+
+
+/**
+ *  @brief Create a weak reference.
+ *
+ *  The collector does not follow weak references. When a collection
+ *  finds no other path to the referent the reference is cleared, else
+ *  it is moved along with the referent. The reference itself is not on
+ *  the heap and lives until h_ref_delete() or h_delete().
+ *
+ *  @param  h the heap
+ *  @param  referent an object on @p h
+ *  @return the reference or NULL if @p referent is not an object on
+ *          @p h or memory cannot be allocated
+ */
+h_ref_t *
+h_weak_ref(heap_t *h, void *referent);
+
+
+/**
+ *  @brief Create a soft reference.
+ *
+ *  A soft reference keeps its referent alive until a collection starts
+ *  with the heap used above the soft reference threshold, then it is
+ *  treated like a weak reference. This suits caches that may hold
+ *  their entries until memory runs short.
+ *
+ *  @param  h the heap
+ *  @param  referent an object on @p h
+ *  @return the reference or NULL if @p referent is not an object on
+ *          @p h or memory cannot be allocated
+ */
+h_ref_t *
+h_soft_ref(heap_t *h, void *referent);
+
+
+/**
+ *  @brief Set how much of the heap is used before soft references are
+ *         cleared.
+ *
+ *  The default is 0.9. A threshold of 0 clears soft references in every
+ *  collection, above 1 they are never cleared.
+ *
+ *  @param  h the heap
+ *  @param  occupancy the used part of the heap when a collection starts
+ */
+void
+h_soft_ref_threshold(heap_t *h, float occupancy);
+
+
+/**
+ *  @brief Get the referent of a reference.
+ *
+ *  Keeping the returned pointer on the stack keeps the referent alive.
+ *
+ *  @param  ref the reference
+ *  @return the referent or NULL if the reference has been cleared
+ */
+void *
+h_ref_get(h_ref_t *ref);
+
+
+/**
+ *  @brief Delete a reference, the referent is left as it is.
+ *
+ *  @param  h the heap of the reference
+ *  @param  ref the reference, may be NULL
+ */
+void
+h_ref_delete(heap_t *h, h_ref_t *ref);
+
+
 
 /**
  *  @brief Returns the available free memory.
@@ -180,4 +843,137 @@ h_size(heap_t *h);
 char *
 h_strdup(heap_t *h, char *str);
 
+
+/*============================================================================
+ *                             ALLOCATION FAST PATH
+ *===========================================================================*/
+
+#define H_NUMBER_OF_SIZE_CLASSES 8
+#define H_PAGE_SIZE 2048
+#define H_WORD_SIZE 8
+#define H_HEADER_SIZE 8
+#define H_SMALLEST_ALLOC_SIZE 16
+#define H_RAW_DATA_BITS 2UL
+
+/**
+ *  @brief A bump allocation cursor into the current page of a size class.
+ *
+ *  @p bump points at the bump pointer of the page so that the page and the
+ *  cursor never disagree. An unused cursor points at a NULL bump with a
+ *  NULL @p end, which makes every allocation attempt fail.
+ */
+typedef struct h_alloc_cursor h_alloc_cursor_t;
+
+struct h_alloc_cursor
+{
+  void **bump;
+  void *end;
+};
+
+/**
+ *  @brief The part of the heap read by the inlined allocation fast path.
+ *
+ *  This is always the first member of the heap, so a heap_t pointer can be
+ *  used as a pointer to it. Nothing in here is to be modified outside of
+ *  the functions in this file.
+ */
+typedef struct h_alloc_fast h_alloc_fast_t;
+
+struct h_alloc_fast
+{
+  h_alloc_cursor_t cursors[H_NUMBER_OF_SIZE_CLASSES];
+  size_t headroom;   /**< bytes left before gc_threshold is reached */
+  uint8_t *map_bits; /**< the bytes of the allocation map */
+  void *map_start;   /**< the address described by the first map byte */
+  void *no_page;     /**< the NULL bump unused cursors point at */
+};
+
+
+/**
+ *  @brief Gets the size class of an allocation of @p bytes (header included).
+ *
+ *  Size class n serves allocations of at most H_SMALLEST_ALLOC_SIZE << n
+ *  bytes, the last class serves everything up to H_PAGE_SIZE.
+ *
+ *  @param  bytes the rounded size of the allocation
+ *  @return the size class of @p bytes
+ */
+static inline size_t
+h_size_class(size_t bytes)
+{
+  if(bytes <= H_SMALLEST_ALLOC_SIZE) return 0;
+#ifdef SPARC
+  size_t size_class = 0;
+  size_t class_size = H_SMALLEST_ALLOC_SIZE;
+  while(class_size < bytes && size_class < H_NUMBER_OF_SIZE_CLASSES - 1)
+    {
+      class_size <<= 1;
+      ++size_class;
+    }
+  return size_class;
+#else
+  size_t size_class = (sizeof(long) * 8 - __builtin_clzl(bytes - 1)) - 4;
+  return size_class < H_NUMBER_OF_SIZE_CLASSES ? size_class : H_NUMBER_OF_SIZE_CLASSES - 1;
+#endif
+}
+
+
+/**
+ *  @brief Bumps @p size bytes out of the current page of their size class.
+ *
+ *  Succeeds only if the page has room and the allocation does not take
+ *  the heap past its gc threshold. The alloc map and header are *not*
+ *  written.
+ *
+ *  @param  h the heap
+ *  @param  size the rounded size of the allocation (header included)
+ *  @return the address to put the header at, or NULL if the slow path
+ *          has to be taken
+ */
+static inline void *
+h_alloc_bump(heap_t *h, size_t size)
+{
+  h_alloc_fast_t *fast = (h_alloc_fast_t *) h;
+  h_alloc_cursor_t *cursor = &fast->cursors[h_size_class(size)];
+  char *bump = *cursor->bump;
+  if(size < (size_t)((char *) cursor->end - bump) && size <= fast->headroom)
+    {
+      *cursor->bump = bump + size;
+      fast->headroom -= size;
+      return bump;
+    }
+  return NULL;
+}
+
+
+/**
+ *  @brief Allocate a new object on a heap with a given size, inlined.
+ *
+ *  Behaves exactly like h_alloc_data(). When the current page of the size
+ *  class has room and the gc threshold is not reached the allocation is
+ *  one bounds check, a pointer bump and a header store, otherwise
+ *  h_alloc_data() is called.
+ *
+ *  @param  h the heap
+ *  @param  bytes the size in bytes
+ *  @return the newly allocated object
+ */
+static inline void *
+h_alloc_data_fast(heap_t *h, size_t bytes)
+{
+  if(h == NULL || bytes == 0 || bytes > H_PAGE_SIZE) return h_alloc_data(h, bytes);
+
+  size_t size = (bytes + H_HEADER_SIZE + H_WORD_SIZE - 1) & ~(size_t)(H_WORD_SIZE - 1);
+  if(size < H_SMALLEST_ALLOC_SIZE) size = H_SMALLEST_ALLOC_SIZE;
+
+  char *header = h_alloc_bump(h, size);
+  if(header == NULL) return h_alloc_data(h, bytes);
+
+  h_alloc_fast_t *fast = (h_alloc_fast_t *) h;
+  *(unsigned long *) header = (bytes << 2UL) | H_RAW_DATA_BITS;
+  char *data = header + H_HEADER_SIZE;
+  fast->map_bits[(size_t)(data - (char *) fast->map_start) / H_WORD_SIZE] |= 1;
+  return data;
+}
+
 #endif
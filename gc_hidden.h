@@ -16,6 +16,12 @@
 
 #include "gc.h"
 #include "alloc_map.h"
+#include "gc_trace.h"
+#include "histogram.h"
+#include "shared_stats.h"
+#include "recorder.h"
+#include "profiler.h"
+#include "census.h"
 
 #ifndef __gc_hidden__
 #define __gc_hidden__
@@ -24,6 +30,8 @@
 
 extern char **environ;
 
+#define NUMBER_OF_SIZE_CLASSES H_NUMBER_OF_SIZE_CLASSES
+
 typedef struct page page_t;
 typedef enum page_type page_type_t;
 
@@ -42,17 +50,57 @@ struct page
   void * bump;
   size_t size;
   page_type_t type;
+  size_t size_class;
+  size_t idle_since;
+  bool released;
+};
+
+
+struct h_ref
+{
+  void *referent;
+  bool soft;
+  h_ref_t *prev;
+  h_ref_t *next;
 };
 
 
 struct heap
 {
+  h_alloc_fast_t fast;
   void *memory;
   alloc_map_t *alloc_map;
   size_t size;
+  size_t max_size;
+  size_t mapped_size;
+  size_t commit_unit;
+  uintptr_t heap_mask;
   bool unsafe_stack;
   float gc_threshold;
   size_t number_of_pages;
+  size_t pages_created;
+  page_t *descriptors;
+  size_t collections;
+  h_stats_t stats;
+  trace_buffer_t *trace;
+  size_t trace_alloc_interval;
+  size_t trace_alloc_count;
+  histogram_t pauses;
+  size_t bytes_allocated;   /**< allocated before the last update_headroom() */
+  size_t headroom_base;     /**< fast.headroom after the last update_headroom() */
+  uint64_t rate_sample_ns;
+  size_t rate_sample_bytes;
+  double alloc_rate;
+  uint64_t last_pause_ns;
+  shared_stats_t *published;
+  char published_name[SHARED_STATS_NAME_LENGTH];
+  recorder_t *recorder;
+  profiler_t *profiler;
+  census_t *census;
+  h_ref_t *refs;
+  float soft_ref_threshold;
+  bool soft_refs_strong;    /**< true if the current collection keeps soft referents */
+  page_t *class_pages[NUMBER_OF_SIZE_CLASSES];
   page_t *pages[];
 };
 
@@ -67,6 +115,24 @@ get_ptr_page(heap_t *h, void * ptr);
 size_t
 page_get_used(page_t *p);
 
+size_t
+page_get_size_class(page_t *page);
+
+size_t
+get_size_class(size_t bytes);
+
+size_t
+round_alloc_size(size_t bytes);
+
+bool
+heap_grow(heap_t *h, size_t new_size);
+
+size_t
+release_idle_pages(heap_t *h, size_t min_idle, int advice);
+
+size_t
+number_of_passive_pages(heap_t *h);
+
 void *
 get_memory(heap_t *h);
 
@@ -88,6 +154,9 @@ get_ptrs_from_stack(heap_t *h, void *original_top, void **array[], size_t array_
 size_t
 get_number_of_active_ptrs(heap_t *h, void *original_top);
 
+void
+trace_from_roots(heap_t *h, void **array[], size_t array_size, size_t num_stack_ptrs);
+
 size_t
 get_active_ptrs(heap_t *h, void *original_top, void **array[], size_t array_size);
 
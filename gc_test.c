@@ -1,10 +1,13 @@
+#define _DEFAULT_SOURCE // nanosleep
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
 #include "gc.h"
 #include "gc_hidden.h"
+#include "snapshot.h"
 #include "header.h"
 
 #include <CUnit/CUnit.h>
@@ -67,6 +70,20 @@ back_up_ptr(void *ptr)
   return alloced_ptr;
 }
 
+/**
+ *  @brief Zeroes the stack below the caller
+ *
+ *  Frames of earlier calls leave heap addresses behind where the collector
+ *  searches the stack, which would make the objects they point to roots.
+ */
+void __attribute__((noinline))
+test_clear_stack()
+{
+  volatile char stack[8192];
+  memset((char *) stack, 0, sizeof(stack));
+}
+
+
 /*============================================================================
  *                             h_init TESTING SUITE
  *===========================================================================*/
@@ -178,6 +195,18 @@ test_h_init_success()
   h_delete(h);
 }
 
+void
+test_h_init_mask_is_exact()
+{
+  // Three pages are not a power of two, so the block is larger than the heap
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 3, SAFE_STACK, 0.5);
+  uintptr_t start = (uintptr_t) h->memory;
+  CU_ASSERT(((start + h->max_size - 1) & h->heap_mask) == start);
+  CU_ASSERT(((uintptr_t) h->alloc_map & h->heap_mask) != start);
+  CU_ASSERT(((start - 1) & h->heap_mask) != start);
+  h_delete(h);
+}
+
 /*============================================================================
  *                      h_delete/h_delete_dbg TESTING SUITE
  *===========================================================================*/
@@ -587,6 +616,20 @@ test_h_gc_dbg_null_heap_ptr()
   CU_ASSERT(cleaned == 0);
 }
 
+void
+test_h_gc_garbage_leaves_alloc_map()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  // The address is hidden from the stack search so that the object dies
+  const uintptr_t mask = 0x5555555555555555UL;
+  uintptr_t hidden = (uintptr_t) h_alloc_struct(h, TEST_LINK_FORMAT_STR) ^ mask;
+  h_gc(h);
+
+  // A word on the stack that points at the dead object is not an object
+  CU_ASSERT_FALSE(alloc_map_ptr_used(h->alloc_map, (void *) (hidden ^ mask)));
+  h_delete(h);
+}
+
 void
 test_h_gc_dbg_no_garbage()
 {
@@ -855,188 +898,2014 @@ test_h_size_smallest()
 
 
 /*============================================================================
- *                             Old school TESTING SUITE
+ *                             Size class TESTING SUITE
  *===========================================================================*/
 
 void
-test_h_alloc ()
+test_size_class_boundaries()
 {
-  int test_size = 6144;
-  heap_t *test_h_alloc_heap = h_init(test_size, true, 1);
+  CU_ASSERT(get_size_class(1) == 0);
+  CU_ASSERT(get_size_class(16) == 0);
+  CU_ASSERT(get_size_class(17) == 1);
+  CU_ASSERT(get_size_class(32) == 1);
+  CU_ASSERT(get_size_class(1024) == 6);
+  CU_ASSERT(get_size_class(1025) == NUMBER_OF_SIZE_CLASSES - 1);
+  CU_ASSERT(get_size_class(2048) == NUMBER_OF_SIZE_CLASSES - 1);
+}
 
-  void * ptr1 = h_alloc_struct(test_h_alloc_heap, "i");
-  write_int_to_heap(ptr1, 6);
+void
+test_size_class_small_objects_share_page()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  void *first = h_alloc_data(h, sizeof(int));
+  void *big = h_alloc_data(h, 1000);
+  void *second = h_alloc_data(h, sizeof(int));
+  CU_ASSERT(first != NULL && big != NULL && second != NULL);
+  CU_ASSERT(get_ptr_page(h, first) == get_ptr_page(h, second));
+  CU_ASSERT(get_ptr_page(h, first) != get_ptr_page(h, big));
+  CU_ASSERT((char *)second - (char *)first == 16);
+  h_delete(h);
+}
 
-  void * ptr2 = h_alloc_struct(test_h_alloc_heap, "i");
-  write_int_to_heap(ptr2, 9);
+void
+test_size_class_tiny_objects_pack_densely()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  h_alloc_data(h, 200);
+  size_t used_before = h_used(h);
+  for(int i = 0; i < 100; ++i)
+    {
+      h_alloc_data(h, sizeof(int));
+    }
+  CU_ASSERT(h_used(h) - used_before == 100 * 16);
+  h_delete(h);
+}
 
-  void * ptr4 = h_alloc_data(test_h_alloc_heap, 2040);
+void
+test_size_class_small_heap_mixes_classes()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  void *small = h_alloc_data(h, sizeof(int));
+  void *struct_ptr = h_alloc_struct(h, TEST_STRUCT_FORMAT_STR);
+  CU_ASSERT(small != NULL);
+  CU_ASSERT(struct_ptr != NULL);
+  CU_ASSERT(get_ptr_page(h, small) == get_ptr_page(h, struct_ptr));
+  h_delete(h);
+}
 
-  void * ptr5 = h_alloc_struct(test_h_alloc_heap, "i*i");
-  struct test_struct ts = ( (struct test_struct) {1, 'c', &ptr5, 3, 2}); 
-  *(struct test_struct *)ptr5 = ts;
-  
+void
+test_size_class_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  int *small = h_alloc_data(h, sizeof(int));
+  *small = 42;
+  char *big = h_alloc_data(h, 1000);
+  big[0] = 'a';
+  h_gc(h);
+  CU_ASSERT(*small == 42);
+  CU_ASSERT(big[0] == 'a');
+  CU_ASSERT(get_ptr_page(h, small) != get_ptr_page(h, big));
+  int *after = h_alloc_data(h, sizeof(int));
+  CU_ASSERT(get_ptr_page(h, small) == get_ptr_page(h, after));
+  h_delete(h);
+}
 
-  void * ptr3 = h_alloc_struct(test_h_alloc_heap, "*");
-  void * test_pointer = malloc(10);
-  write_pointer_to_heap(&ptr3, test_pointer);
 
-  CU_ASSERT(*(int *)ptr1 == 6);
-  CU_ASSERT(*(int *)ptr2 == 9);
-  CU_ASSERT_PTR_EQUAL(test_pointer, ptr3);
-  CU_ASSERT(ptr4 != NULL);
-  CU_ASSERT(ptr5 != NULL);
+/*============================================================================
+ *                             h_alloc_data_fast TESTING SUITE
+ *===========================================================================*/
 
-  h_delete(test_h_alloc_heap);
-  free(test_pointer);
+void
+test_h_alloc_data_fast_null_heap()
+{
+  void *data_ptr = h_alloc_data_fast(NULL, sizeof(int));
+  CU_ASSERT(data_ptr == NULL);
 }
 
-extern char **environ;
+void
+test_h_alloc_data_fast_zero_bytes()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  void *data_ptr = h_alloc_data_fast(h, 0);
+  CU_ASSERT(data_ptr == NULL);
+  h_delete(h);
+}
 
 void
-test_get_ptr_page()
+test_h_alloc_data_fast_too_big_for_page()
 {
-  int test_size = 6144;
-  heap_t *test_h_alloc_heap = h_init(test_size, true, 1); 
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  size_t used_before = h_used(h);
+  void *data_ptr = h_alloc_data_fast(h, 2049);
+  CU_ASSERT(data_ptr == NULL);
+  CU_ASSERT(used_before == h_used(h));
+  h_delete(h);
+}
 
-  void * ptr1 = h_alloc_struct(test_h_alloc_heap, "i");
-  write_int_to_heap(ptr1, 6);
+void
+test_h_alloc_data_fast_same_as_slow()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  void *first = h_alloc_data_fast(h, 5);
+  size_t used_after_first = h_used(h);
+  void *second = h_alloc_data_fast(h, 5);
+  void *third = h_alloc_data(h, 5);
+  CU_ASSERT(first != NULL && second != NULL && third != NULL);
+  CU_ASSERT((char *)second - (char *)first == 16);
+  CU_ASSERT((char *)third - (char *)second == 16);
+  CU_ASSERT(h_used(h) == 3 * used_after_first);
+  CU_ASSERT(get_header_type(second) == RAW_DATA);
+  CU_ASSERT(get_existing_data_size(second) == 5);
+  h_delete(h);
+}
 
-  CU_ASSERT(get_ptr_page(test_h_alloc_heap, ptr1) != -1);
-  h_delete(test_h_alloc_heap);
+void
+test_h_alloc_data_fast_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  h_alloc_data_fast(h, sizeof(int));
+  int *data_ptr = h_alloc_data_fast(h, sizeof(int));
+  *data_ptr = 17;
+  void **original_ptr = back_up_ptr(data_ptr);
+
+  size_t cleaned = h_gc(h);
+  CU_ASSERT(cleaned == 16);
+  CU_ASSERT(data_ptr != *original_ptr);
+  CU_ASSERT(*data_ptr == 17);
+  free(original_ptr);
+  h_delete(h);
 }
 
 void
-test_h_alloc_threshold ()
+test_h_alloc_data_fast_threshold()
 {
-  int test_size = 6144;
-  heap_t *test_h_alloc_heap = h_init(test_size, true, 0.3);
+  heap_t *h = h_init(6144, SAFE_STACK, 0.3);
 
-  void *ptr1 = h_alloc_data(test_h_alloc_heap, 5);
-  void *ptr2 = h_alloc_data(test_h_alloc_heap, 1990);
+  void *ptr1 = h_alloc_data_fast(h, 5);
+  void *ptr2 = h_alloc_data_fast(h, 1990);
 
   CU_ASSERT(ptr1 != NULL);
   CU_ASSERT(ptr2 == NULL);
-  
-  h_delete(test_h_alloc_heap);
 
-  heap_t *test_h_alloc_heap_passive = h_init(test_size, true, 1);
-  void *ptr3 = h_alloc_data(test_h_alloc_heap_passive, 2000);
-  void *ptr4 = h_alloc_data(test_h_alloc_heap_passive, 2000);
-  void *ptr5 = h_alloc_data(test_h_alloc_heap_passive, 2000);
+  for(int i = 0; i < 100; ++i)
+    {
+      CU_ASSERT(h_alloc_data_fast(h, 100) != NULL);
+      CU_ASSERT((float) h_used(h) / h_size(h) <= 0.3);
+    }
+  h_delete(h);
+}
 
-  CU_ASSERT(ptr3 != NULL);
-  CU_ASSERT(ptr4 != NULL);
-  CU_ASSERT(ptr5 == NULL);
-  
-  h_delete(test_h_alloc_heap_passive);
+
+/*============================================================================
+ *                     h_alloc_struct_n/h_alloc_data_n TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_alloc_n_null_heap()
+{
+  void *out[4];
+  CU_ASSERT(h_alloc_struct_n(NULL, TEST_LINK_FORMAT_STR, 4, out) == 0);
+  CU_ASSERT(h_alloc_data_n(NULL, sizeof(int), 4, out) == 0);
+}
+
+void
+test_h_alloc_n_zero_objects()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  void *out[1];
+  size_t used_before = h_used(h);
+  CU_ASSERT(h_alloc_struct_n(h, TEST_LINK_FORMAT_STR, 0, out) == 0);
+  CU_ASSERT(h_alloc_data_n(h, sizeof(int), 0, out) == 0);
+  CU_ASSERT(h_alloc_data_n(h, 0, 1, out) == 0);
+  CU_ASSERT(used_before == h_used(h));
+  h_delete(h);
 }
 
+void
+test_h_alloc_struct_n_invalid_str()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  void *out[4];
+  size_t used_before = h_used(h);
+  CU_ASSERT(h_alloc_struct_n(h, "asd", 4, out) == 0);
+  CU_ASSERT(h_alloc_struct_n(h, "2049c", 4, out) == 0);
+  CU_ASSERT(used_before == h_used(h));
+  h_delete(h);
+}
 
+void
+test_h_alloc_struct_n_valid_str()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  void *out[10];
+  CU_ASSERT(h_alloc_struct_n(h, TEST_LINK_FORMAT_STR, 10, out) == 10);
+  CU_ASSERT(h_used(h) == 10 * 24);
+  for(int i = 0; i < 10; ++i)
+    {
+      CU_ASSERT(get_header_type(out[i]) == STRUCT_REP);
+      CU_ASSERT(get_number_of_pointers_in_struct(out[i]) == 1);
+      if(i > 0) CU_ASSERT((char *)out[i] - (char *)out[i - 1] == 24);
+    }
+  h_delete(h);
+}
 
+void
+test_h_alloc_data_n_spans_pages()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  void **out = calloc(300, sizeof(void *));
+  CU_ASSERT(h_alloc_data_n(h, sizeof(int), 300, out) == 300);
+  CU_ASSERT(h_used(h) == 300 * 16);
+  CU_ASSERT(get_ptr_page(h, out[0]) != get_ptr_page(h, out[299]));
+  for(int i = 0; i < 300; ++i)
+    {
+      CU_ASSERT(get_header_type(out[i]) == RAW_DATA);
+      CU_ASSERT(get_existing_data_size(out[i]) == sizeof(int));
+    }
+  free(out);
+  h_delete(h);
+}
 
-/*============================================================================
- *                             Main Testing Function
- *===========================================================================*/
-int
-main (void)
+void
+test_h_alloc_data_n_out_of_memory()
 {
-  CU_pSuite suite1 = NULL;
-  CU_pSuite suite_h_init = NULL;
-  CU_pSuite suite_h_delete = NULL;
-  CU_pSuite suite_h_alloc_struct = NULL;
-  CU_pSuite suite_h_alloc_data = NULL;
-  CU_pSuite suite_h_gc = NULL;
-  CU_pSuite suite_h_avail = NULL;
-  CU_pSuite suite_h_used = NULL;
-  CU_pSuite suite_h_size = NULL;
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  void **out = calloc(200, sizeof(void *));
+  size_t allocated = h_alloc_data_n(h, sizeof(int), 200, out);
+  CU_ASSERT(allocated == 127);
+  CU_ASSERT(h_used(h) == 127 * 16);
+  free(out);
+  h_delete(h);
+}
 
-  if (CU_initialize_registry() != CUE_SUCCESS)
+void
+test_h_alloc_n_page_sized()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 8, SAFE_STACK, 1);
+  void *out[15];
+  CU_ASSERT(h_alloc_data_n(h, H_PAGE_SIZE - 8, 4, out) == 4);
+  CU_ASSERT(h_used(h) == 4 * H_PAGE_SIZE);
+  for(int i = 1; i < 4; ++i)
     {
-      return CU_get_error();
+      CU_ASSERT(get_ptr_page(h, out[i - 1]) != get_ptr_page(h, out[i]));
     }
+  // The layout is too long for a bit vector and is kept on the heap
+  CU_ASSERT(h_alloc_struct_n(h, "255*", 4, out) == 4);
+  CU_ASSERT(h_used(h) == 8 * H_PAGE_SIZE + 16);
 
+  // The pages left are still usable one object at a time
+  CU_ASSERT(h_alloc_data(h, H_PAGE_SIZE - 8) != NULL);
+  CU_ASSERT(h_used(h) == 9 * H_PAGE_SIZE + 16);
+  h_delete(h);
 
-  // ********************* h_init SUITE ******************  //
-  suite_h_init = CU_add_suite("Tests function h_init()", NULL, NULL);
-  if (suite_h_init == NULL) {
-    CU_cleanup_registry();
-    return CU_get_error();
-  }
+  // Every page but the one kept for collections is filled
+  h = h_init(SMALLEST_HEAP_SIZE * 8, SAFE_STACK, 1);
+  CU_ASSERT(h_alloc_data_n(h, H_PAGE_SIZE - 8, 15, out) == 15);
+  CU_ASSERT(number_of_passive_pages(h) == 1);
+  h_delete(h);
+}
 
-  if ( (NULL == CU_add_test(suite_h_init
-                            , "size 0"
-                            , test_h_init_size_zero) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size 1"
-                               , test_h_init_size_one) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size 8"
-                               , test_h_init_size_eight) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size 2047"
-                               , test_h_init_size_2047) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "one below smallest"
-                               , test_h_init_size_one_below_smallest) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "one above smallest"
-                               , test_h_init_size_one_above_smallest) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size odd"
-                               , test_h_init_size_odd) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size max"
-                               , test_h_init_size_max) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "size one below max"
-                               , test_h_init_size_one_below_max) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "threshold zero"
-                               , test_h_init_threshold_zero) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "threshold negative"
-                               , test_h_init_threshold_negative) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "threshold above 1"
-                               , test_h_init_threshold_larger_than_one) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "threshold close to edge"
-                               , test_h_init_threshold_close_to_edge) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "threshold edge"
-                               , test_h_init_threshold_edge) )
-       || (NULL == CU_add_test(suite_h_init
-                               , "success"
-                               , test_h_init_success) )
-       
-    )
+void
+test_h_alloc_struct_n_linked_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  test_link_t *links[5];
+  CU_ASSERT(h_alloc_struct_n(h, TEST_LINK_FORMAT_STR, 5, (void **) links) == 5);
+  for(int i = 0; i < 5; ++i)
     {
-      CU_cleanup_registry();
-      return CU_get_error();
+      links[i]->next = i < 4 ? links[i + 1] : NULL;
+      links[i]->value = i;
     }
+  test_link_t *first = links[0];
+  for(int i = 1; i < 5; ++i) links[i] = NULL;
+  h_alloc_data(h, sizeof(int));
 
-  // ********************* h_delete SUITE ******************  //
-  suite_h_delete = CU_add_suite("Tests function h_delete() and h_delete_dbg()",
-                                NULL, NULL);
-  if (suite_h_delete == NULL) {
-    CU_cleanup_registry();
-    return CU_get_error();
-  }
+  size_t cleaned = h_gc(h);
+  CU_ASSERT(cleaned == 16);
+  int expected = 0;
+  for(test_link_t *cursor = first; cursor != NULL; cursor = cursor->next)
+    {
+      CU_ASSERT(cursor->value == expected);
+      ++expected;
+    }
+  CU_ASSERT(expected == 5);
+  h_delete(h);
+}
 
-  if ( (NULL == CU_add_test(suite_h_delete
-                            , "null heap ptr"
-                            , test_h_delete_null_ptr) ) ||
-       (NULL == CU_add_test(suite_h_delete
-                               , "dbg null heap ptr"
-                               , test_h_delete_dbg_null_ptr) ) ||
-       (NULL == CU_add_test(suite_h_delete
-                               , "null dbg value"
-                               , test_h_delete_dbg_null_value) )
-       || (NULL == CU_add_test(suite_h_delete
-                               , "other dbg value"
-                               , test_h_delete_dbg_other_value) )
-       || (NULL == CU_add_test(suite_h_delete
+
+/*============================================================================
+ *                             h_alloc_array TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_alloc_array_invalid()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.5);
+  size_t used_before = h_used(h);
+  CU_ASSERT(h_alloc_array(NULL, "*", 1) == NULL);
+  CU_ASSERT(h_alloc_array(h, NULL, 1) == NULL);
+  CU_ASSERT(h_alloc_array(h, "*", 0) == NULL);
+  CU_ASSERT(h_alloc_array(h, "asd", 1) == NULL);
+  CU_ASSERT(h_alloc_ptr_array(h, 256) == NULL);
+  CU_ASSERT(used_before == h_used(h));
+  CU_ASSERT(h_array_length(NULL) == 0);
+  h_delete(h);
+}
+
+void
+test_h_alloc_ptr_array_no_format_string()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 2, SAFE_STACK, 1);
+  void **array = h_alloc_ptr_array(h, 250);
+  CU_ASSERT(array != NULL);
+  CU_ASSERT(h_array_length(array) == 250);
+  CU_ASSERT(h_used(h) == 250 * sizeof(void *) + 8);
+  for(int i = 0; i < 250; ++i)
+    {
+      CU_ASSERT(array[i] == NULL);
+    }
+  h_delete(h);
+}
+
+void
+test_h_alloc_ptr_array_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  int **array = (int **) h_alloc_ptr_array(h, 100);
+  for(int i = 0; i < 100; ++i)
+    {
+      if(i % 2 == 0)
+        {
+          array[i] = h_alloc_data(h, sizeof(int));
+          *array[i] = i;
+        }
+      else
+        {
+          h_alloc_data(h, sizeof(int));
+        }
+    }
+
+  size_t cleaned = h_gc(h);
+  CU_ASSERT(cleaned == 50 * 16);
+  CU_ASSERT(h_array_length(array) == 100);
+  for(int i = 0; i < 100; ++i)
+    {
+      if(i % 2 == 0) CU_ASSERT(*array[i] == i);
+      else CU_ASSERT(array[i] == NULL);
+    }
+  h_delete(h);
+}
+
+void
+test_h_alloc_array_of_structs_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  test_link_t *links = h_alloc_array(h, TEST_LINK_FORMAT_STR, 10);
+  CU_ASSERT(links != NULL);
+  for(int i = 0; i < 10; ++i)
+    {
+      links[i].value = i;
+      links[i].next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      links[i].next->value = 10 + i;
+      links[i].next->next = NULL;
+    }
+  h_alloc_data(h, sizeof(int));
+
+  size_t cleaned = h_gc(h);
+  CU_ASSERT(cleaned == 16);
+  for(int i = 0; i < 10; ++i)
+    {
+      CU_ASSERT(links[i].value == i);
+      CU_ASSERT(links[i].next->value == 10 + i);
+    }
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_realloc TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_realloc_invalid()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  void *structure = h_alloc_struct(h, "**");
+  void *array = h_alloc_array(h, "ii", 2);
+  size_t used_before = h_used(h);
+  CU_ASSERT(h_realloc(h, structure, 32) == NULL);
+  CU_ASSERT(h_realloc(h, array, 12) == NULL);
+  CU_ASSERT(h_realloc(h, array, 0) == NULL);
+  CU_ASSERT(h_realloc(h, (char *) array + 8, 16) == NULL);
+  CU_ASSERT(h_realloc(h, array, 4096) == NULL);
+  CU_ASSERT(h_array_length(array) == 2);
+  CU_ASSERT(used_before == h_used(h));
+  h_delete(h);
+}
+
+void
+test_h_realloc_null_allocates()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  void *data = h_realloc(h, NULL, 20);
+  CU_ASSERT(data != NULL);
+  CU_ASSERT(h_used(h) == 32);
+  h_delete(h);
+}
+
+void
+test_h_realloc_grows_in_place()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  char *data = h_alloc_data(h, 16);
+  strcpy(data, "in place");
+  char *grown = h_realloc(h, data, 200);
+  CU_ASSERT(grown == data);
+  CU_ASSERT(strcmp(grown, "in place") == 0);
+  CU_ASSERT(h_used(h) == 208);
+
+  char *shrunk = h_realloc(h, grown, 40);
+  CU_ASSERT(shrunk == data);
+  CU_ASSERT(h_used(h) == 48);
+  h_delete(h);
+}
+
+void
+test_h_realloc_copies_when_not_last()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  char *data = h_alloc_data(h, 16);
+  strcpy(data, "copied");
+  void *next = h_alloc_data(h, 16);
+  CU_ASSERT(next != NULL);
+
+  char *grown = h_realloc(h, data, 100);
+  CU_ASSERT(grown != NULL);
+  CU_ASSERT(grown != data);
+  CU_ASSERT(strcmp(grown, "copied") == 0);
+  CU_ASSERT(alloc_map_ptr_used(h->alloc_map, data) == false);
+  CU_ASSERT(alloc_map_ptr_used(h->alloc_map, grown));
+  h_delete(h);
+}
+
+void
+test_h_realloc_array_zeroes_new_elements()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  long *array = h_alloc_array(h, "l", 2);
+  array[0] = 1;
+  array[1] = 2;
+  h_alloc_data(h, 8);
+  array = h_realloc(h, array, 8 * sizeof(long));
+  CU_ASSERT(array != NULL);
+  CU_ASSERT(h_array_length(array) == 8);
+  CU_ASSERT(array[0] == 1);
+  CU_ASSERT(array[1] == 2);
+  for(int i = 2; i < 8; ++i)
+    {
+      CU_ASSERT(array[i] == 0);
+    }
+  h_delete(h);
+}
+
+void
+test_h_realloc_survives_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  void **array = h_alloc_ptr_array(h, 2);
+  array[0] = h_alloc_data(h, sizeof(int));
+  *(int *) array[0] = 42;
+  array = h_realloc(h, array, 64 * sizeof(void *));
+  CU_ASSERT(array != NULL);
+  array[63] = h_alloc_data(h, sizeof(int));
+  *(int *) array[63] = 43;
+
+  h_gc(h);
+  CU_ASSERT(h_array_length(array) == 64);
+  CU_ASSERT(*(int *) array[0] == 42);
+  CU_ASSERT(*(int *) array[63] == 43);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_init_growable TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_init_growable_invalid()
+{
+  CU_ASSERT(h_init_growable(SMALLEST_HEAP_SIZE * 2, SMALLEST_HEAP_SIZE, SAFE_STACK, 1) == NULL);
+  CU_ASSERT(h_init_growable(SMALLEST_HEAP_SIZE, SMALLEST_HEAP_SIZE * 2 + 1, SAFE_STACK, 1) == NULL);
+  CU_ASSERT(h_init_growable(0, SMALLEST_HEAP_SIZE, SAFE_STACK, 1) == NULL);
+}
+
+void
+test_h_init_growable_starts_small()
+{
+  size_t max = 1024 * SMALLEST_HEAP_SIZE;
+  heap_t *h = h_init_growable(SMALLEST_HEAP_SIZE, max, SAFE_STACK, 0.5);
+  CU_ASSERT(h != NULL);
+  CU_ASSERT(h_size(h) == SMALLEST_HEAP_SIZE);
+  CU_ASSERT(heap_get_number_of_pages(h) == SMALLEST_HEAP_SIZE / 2048);
+  h_delete(h);
+}
+
+void
+test_h_init_growable_grows_with_live_data()
+{
+  size_t max = 256 * SMALLEST_HEAP_SIZE;
+  heap_t *h = h_init_growable(SMALLEST_HEAP_SIZE, max, SAFE_STACK, 0.5);
+  test_link_t *list = NULL;
+  for(int i = 0; i < 2000; ++i)
+    {
+      test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      CU_ASSERT(link != NULL);
+      if(link == NULL) break;
+      link->value = i;
+      link->next = list;
+      list = link;
+    }
+
+  CU_ASSERT(h_size(h) > SMALLEST_HEAP_SIZE);
+  CU_ASSERT(h_size(h) <= max);
+  CU_ASSERT(heap_get_number_of_pages(h) == h_size(h) / 2048);
+  for(int i = 1999; i >= 0 && list != NULL; --i)
+    {
+      CU_ASSERT(list->value == i);
+      list = list->next;
+    }
+  CU_ASSERT(list == NULL);
+  h_delete(h);
+}
+
+void
+test_h_init_growable_stops_at_max()
+{
+  size_t max = 8 * SMALLEST_HEAP_SIZE;
+  heap_t *h = h_init_growable(SMALLEST_HEAP_SIZE, max, SAFE_STACK, 1);
+  test_link_t *list = NULL;
+  test_link_t *link = NULL;
+  do
+    {
+      link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      if(link != NULL)
+        {
+          link->next = list;
+          list = link;
+        }
+    }
+  while(link != NULL);
+  CU_ASSERT(h_size(h) == max);
+  h_delete(h);
+}
+
+void
+test_heap_grow()
+{
+  heap_t *h = h_init_growable(SMALLEST_HEAP_SIZE, SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  char *data = h_alloc_data(h, 100);
+  strcpy(data, "kept");
+  CU_ASSERT(heap_grow(h, SMALLEST_HEAP_SIZE * 3));
+  CU_ASSERT(h_size(h) == SMALLEST_HEAP_SIZE * 3);
+  CU_ASSERT(strcmp(data, "kept") == 0);
+  CU_ASSERT(heap_grow(h, SMALLEST_HEAP_SIZE * 100));
+  CU_ASSERT(h_size(h) == SMALLEST_HEAP_SIZE * 4);
+  CU_ASSERT_FALSE(heap_grow(h, SMALLEST_HEAP_SIZE * 100));
+  CU_ASSERT(h_avail(h) == SMALLEST_HEAP_SIZE * 4 - h_used(h));
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_trim TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_trim_releases_passive_pages()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  for(int i = 0; i < 30; ++i)
+    {
+      memset(h_alloc_data(h, 1000), 1, 1000);
+    }
+  h_gc(h);
+  size_t released = h_trim(h);
+  CU_ASSERT(released > 0);
+  CU_ASSERT(released <= SMALLEST_HEAP_SIZE * 16);
+  CU_ASSERT(h_trim(h) == 0);
+  CU_ASSERT(h_size(h) == SMALLEST_HEAP_SIZE * 16);
+  h_delete(h);
+}
+
+void
+test_h_trim_keeps_live_data()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  char *data = h_alloc_data(h, 1000);
+  strcpy(data, "still here");
+  h_trim(h);
+  CU_ASSERT(strcmp(data, "still here") == 0);
+
+  char *more = h_alloc_data(h, 2000);
+  CU_ASSERT(more != NULL);
+  memset(more, 7, 2000);
+  CU_ASSERT(more[1999] == 7);
+  h_delete(h);
+}
+
+void
+test_h_trim_page_reused_after_release()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  for(int i = 0; i < 4; ++i)
+    {
+      h_alloc_data(h, 1000);
+    }
+  h_gc(h);
+  CU_ASSERT(h_trim(h) > 0);
+  char *data = h_alloc_data(h, 1000);
+  memset(data, 3, 1000);
+  CU_ASSERT(data[999] == 3);
+  h_gc(h);
+  CU_ASSERT(data[0] == 3);
+  CU_ASSERT(data[999] == 3);
+  h_delete(h);
+}
+
+void
+test_h_trim_retries_failed_release()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  for(int i = 0; i < 4; ++i)
+    {
+      h_alloc_data(h, 1000);
+    }
+  h_gc(h);
+  // An advice the os does not know makes madvise fail
+  CU_ASSERT(release_idle_pages(h, 0, -1) == 0);
+  for(size_t i = 0; i < h->pages_created; ++i)
+    {
+      CU_ASSERT_FALSE(h->pages[i]->released);
+    }
+  CU_ASSERT(h_trim(h) > 0);
+  CU_ASSERT(h_trim(h) == 0);
+  h_delete(h);
+}
+
+void
+test_idle_pages_released_after_collections()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  for(int i = 0; i < 8; ++i)
+    {
+      h_gc(h);
+    }
+  CU_ASSERT(h_trim(h) == 0);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_init_with_options TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_init_huge_pages_aligned()
+{
+  heap_t *h = h_init_with_options(SMALLEST_HEAP_SIZE, 8 * 1024 * 1024, SAFE_STACK, 0.5, H_HUGE_PAGES);
+  CU_ASSERT(h != NULL);
+  CU_ASSERT((size_t) get_memory(h) % (2 * 1024 * 1024) == 0);
+  CU_ASSERT(h_size(h) == SMALLEST_HEAP_SIZE);
+  h_delete(h);
+}
+
+void
+test_h_init_huge_pages_grows()
+{
+  heap_t *h = h_init_with_options(SMALLEST_HEAP_SIZE, 4 * 1024 * 1024, SAFE_STACK, 1, H_HUGE_PAGES);
+  test_link_t *list = NULL;
+  for(int i = 0; i < 10000; ++i)
+    {
+      test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      CU_ASSERT(link != NULL);
+      if(link == NULL) break;
+      link->value = i;
+      link->next = list;
+      list = link;
+    }
+  CU_ASSERT(h_size(h) >= 10000 * 24);
+  for(int i = 9999; i >= 0 && list != NULL; --i)
+    {
+      CU_ASSERT(list->value == i);
+      list = list->next;
+    }
+  h_delete(h);
+}
+
+void
+test_h_init_aligned_to_power_of_two()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 3, SAFE_STACK, 1);
+  CU_ASSERT((size_t) get_memory(h) % (SMALLEST_HEAP_SIZE * 4) == 0);
+  CU_ASSERT(get_ptr_page(h, (char *) get_memory(h) + SMALLEST_HEAP_SIZE * 3 - 1) == 5);
+
+  heap_t *g = h_init_growable(SMALLEST_HEAP_SIZE, SMALLEST_HEAP_SIZE * 1000, SAFE_STACK, 1);
+  CU_ASSERT((size_t) get_memory(g) % (SMALLEST_HEAP_SIZE * 1024) == 0);
+  h_delete(g);
+  h_delete(h);
+}
+
+void
+test_h_init_lazy_pages()
+{
+  size_t size = 1024UL * 1024 * 1024;
+  heap_t *h = h_init(size, SAFE_STACK, 0.5);
+  CU_ASSERT(h != NULL);
+  CU_ASSERT(h->pages_created == 0);
+  CU_ASSERT(h_avail(h) == size);
+  CU_ASSERT(h_used(h) == 0);
+
+  void *data = h_alloc_data(h, 100);
+  CU_ASSERT(data != NULL);
+  CU_ASSERT(h->pages_created == 1);
+  CU_ASSERT(h_avail(h) + h_used(h) == size);
+  h_delete(h);
+}
+
+void
+test_h_init_without_options()
+{
+  heap_t *h = h_init_with_options(SMALLEST_HEAP_SIZE, SMALLEST_HEAP_SIZE, SAFE_STACK, 1, 0);
+  CU_ASSERT(h != NULL);
+  CU_ASSERT(h_alloc_data(h, 100) != NULL);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_stats TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_stats_new_heap()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 1);
+  h_stats_t stats;
+  h_stats(h, &stats);
+  CU_ASSERT(stats.total.collections == 0);
+  CU_ASSERT(stats.total.bytes_copied == 0);
+  CU_ASSERT(stats.last.collections == 0);
+  h_delete(h);
+}
+
+void
+test_h_stats_counts_copies()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  test_link_t *first = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next->next = NULL;
+  h_gc(h);
+
+  h_stats_t stats;
+  h_stats(h, &stats);
+  CU_ASSERT(stats.last.collections == 1);
+  CU_ASSERT(stats.last.objects_copied >= 2);
+  CU_ASSERT(stats.last.bytes_copied >= 2 * 24);
+  CU_ASSERT(stats.last.bytes_copied == 24 * stats.last.objects_copied);
+  CU_ASSERT(stats.last.pages_evacuated >= 1);
+  CU_ASSERT(stats.last.stack_roots >= 1);
+  CU_ASSERT(stats.last.pinned_pages == 0);
+
+  h_gc(h);
+  h_stats_t after;
+  h_stats(h, &after);
+  CU_ASSERT(after.total.collections == 2);
+  CU_ASSERT(after.total.objects_copied
+            == stats.last.objects_copied + after.last.objects_copied);
+  CU_ASSERT(after.total.trace_ns >= after.last.trace_ns);
+  h_delete(h);
+}
+
+void
+test_h_stats_pinned_and_false_roots()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, UNSAFE_STACK, 1);
+  char *data = h_alloc_data(h, 64);
+  char * volatile inside = data + 8;
+  h_gc_dbg(h, UNSAFE_STACK);
+
+  h_stats_t stats;
+  h_stats(h, &stats);
+  CU_ASSERT(stats.last.pinned_pages == 1);
+  CU_ASSERT(stats.last.objects_copied == 0);
+  CU_ASSERT(stats.last.false_roots >= 1);
+  CU_ASSERT(inside == data + 8);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_trace TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Exports the trace of @p h to a temporary file and reads it back
+ */
+char *
+trace_to_string(heap_t *h, bool chrome)
+{
+  FILE *file = tmpfile();
+  bool written = chrome ? h_trace_export_chrome(h, file) : h_trace_export_text(h, file);
+  CU_ASSERT(written);
+  long size = ftell(file);
+  rewind(file);
+  char *text = calloc(size + 1, 1);
+  CU_ASSERT(fread(text, 1, size, file) == (size_t) size);
+  fclose(file);
+  return text;
+}
+
+void
+test_h_trace_off()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  h_gc(h);
+  CU_ASSERT_FALSE(h_trace_export_chrome(h, stdout));
+  CU_ASSERT_FALSE(h_trace_export_text(h, stdout));
+  CU_ASSERT_FALSE(h_trace_start(h, 0, 0));
+  h_delete(h);
+}
+
+void
+test_h_trace_gc_phases()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  CU_ASSERT(h_trace_start(h, 64, 0));
+  test_link_t *first = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next = NULL;
+  h_gc(h);
+
+  char *text = trace_to_string(h, false);
+  CU_ASSERT(strstr(text, "gc:gc_begin") != NULL);
+  CU_ASSERT(strstr(text, "gc:root_scan_begin") != NULL);
+  CU_ASSERT(strstr(text, "gc:trace_end") != NULL);
+  CU_ASSERT(strstr(text, "gc:copy_end: arg=24") != NULL);
+  CU_ASSERT(strstr(text, "gc:page_reset_end") != NULL);
+  CU_ASSERT(strstr(text, "gc:gc_end") != NULL);
+  CU_ASSERT(strstr(text, "gc:gc_begin") < strstr(text, "gc:gc_end"));
+  CU_ASSERT(strstr(text, "gc:alloc_slow") == NULL);
+  free(text);
+
+  text = trace_to_string(h, true);
+  CU_ASSERT(strstr(text, "\"name\":\"copy\",\"cat\":\"gc\",\"ph\":\"E\"") != NULL);
+  free(text);
+
+  // Pinning the pages of the roots is its own span after the one root scan
+  h_trace_stop(h);
+  CU_ASSERT(h_trace_start(h, 64, 0));
+  h_gc_dbg(h, UNSAFE_STACK);
+  text = trace_to_string(h, false);
+  char *root_scan = strstr(text, "gc:root_scan_begin");
+  CU_ASSERT(root_scan != NULL);
+  CU_ASSERT(root_scan != NULL && strstr(root_scan + 1, "gc:root_scan_begin") == NULL);
+  CU_ASSERT(strstr(text, "gc:pin_begin") != NULL);
+  CU_ASSERT(strstr(text, "gc:trace_end") < strstr(text, "gc:pin_end"));
+  free(text);
+
+  h_trace_stop(h);
+  CU_ASSERT_FALSE(h_trace_export_text(h, stdout));
+  h_delete(h);
+}
+
+void
+test_h_trace_alloc_samples()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 8, SAFE_STACK, 1);
+  CU_ASSERT(h_trace_start(h, 1024, 1));
+  for(int i = 0; i < 200; ++i)
+    {
+      h_alloc_data(h, 512);
+    }
+
+  char *text = trace_to_string(h, false);
+  CU_ASSERT(strstr(text, "gc:alloc_slow: arg=") != NULL);
+  free(text);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_pauses TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_pauses_recorded()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  h_pauses_t pauses;
+  h_pauses(h, &pauses);
+  CU_ASSERT(pauses.count == 0);
+  CU_ASSERT(h_pause_percentile(h, 99.0) == 0);
+
+  for(int i = 0; i < 10; ++i)
+    {
+      h_gc(h);
+    }
+  h_pauses(h, &pauses);
+  CU_ASSERT(pauses.count == 10);
+  CU_ASSERT(pauses.min_ns > 0);
+  CU_ASSERT(pauses.min_ns <= pauses.p50_ns);
+  CU_ASSERT(pauses.p50_ns <= pauses.p90_ns);
+  CU_ASSERT(pauses.p90_ns <= pauses.p99_ns);
+  CU_ASSERT(pauses.p99_ns <= pauses.p999_ns);
+  CU_ASSERT(pauses.p999_ns <= pauses.max_ns);
+  CU_ASSERT(pauses.mean_ns >= pauses.min_ns && pauses.mean_ns <= pauses.max_ns);
+  CU_ASSERT(pauses.total_ns >= pauses.max_ns);
+  CU_ASSERT(h_pause_percentile(h, 100.0) == pauses.max_ns);
+  h_delete(h);
+}
+
+void
+test_h_allocated_counts_bump_paths()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 8, SAFE_STACK, 1);
+  CU_ASSERT(h_allocated(h) == 0);
+
+  h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  CU_ASSERT(h_allocated(h) == 24);
+  for(int i = 0; i < 10; ++i)
+    {
+      h_alloc_data_fast(h, 16);
+    }
+  CU_ASSERT(h_allocated(h) == 24 + 10 * 24);
+
+  // Copies made by the collector are not allocations
+  size_t before = h_allocated(h);
+  h_gc(h);
+  CU_ASSERT(h_allocated(h) == before);
+  h_delete(h);
+}
+
+void
+test_h_alloc_rate()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 8, SAFE_STACK, 1);
+  struct timespec pause = { 0, 2000000 };
+  nanosleep(&pause, NULL);
+  CU_ASSERT(h_alloc_rate(h) == 0.0);
+
+  for(int i = 0; i < 100; ++i)
+    {
+      h_alloc_data(h, 64);
+    }
+  nanosleep(&pause, NULL);
+  double rate = h_alloc_rate(h);
+  CU_ASSERT(rate > 0.0);
+  // 7200 bytes in at least 2 ms
+  CU_ASSERT(rate <= 7200 / 0.002);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_publish TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_publish_off()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  CU_ASSERT(h_publish_name(h) == NULL);
+  h_publish(h);
+  h_publish_stop(h);
+  h_delete(h);
+}
+
+void
+test_h_publish_after_gc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  CU_ASSERT(h_publish_start(h));
+  const char *name = h_publish_name(h);
+  CU_ASSERT(name != NULL);
+  if(name == NULL)
+    {
+      h_delete(h);
+      return;
+    }
+  char saved_name[SHARED_STATS_NAME_LENGTH];
+  strcpy(saved_name, name);
+
+  shared_stats_t *reader = shared_stats_open(saved_name);
+  CU_ASSERT(reader != NULL);
+  shared_stats_t copy;
+  CU_ASSERT(shared_stats_read(reader, &copy));
+  CU_ASSERT(copy.size == h_size(h));
+  CU_ASSERT(copy.collections == 0);
+
+  test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next = NULL;
+  h_gc(h);
+  CU_ASSERT(shared_stats_read(reader, &copy));
+  CU_ASSERT(copy.collections == 1);
+  CU_ASSERT(copy.used == h_used(h));
+  CU_ASSERT(copy.avail == h_avail(h));
+  CU_ASSERT(copy.active_pages >= 1);
+  CU_ASSERT(copy.active_pages + copy.passive_pages + copy.unsafe_pages == copy.pages);
+  CU_ASSERT(copy.last_pause_ns > 0);
+  CU_ASSERT(copy.allocated == 24);
+
+  h_delete(h);
+  shared_stats_close(reader);
+  CU_ASSERT(shared_stats_open(saved_name) == NULL);
+}
+
+void
+test_h_publish_released_pages()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  CU_ASSERT(h_publish_start(h));
+  const char *name = h_publish_name(h);
+  if(name == NULL)
+    {
+      h_delete(h);
+      return;
+    }
+  shared_stats_t *reader = shared_stats_open(name);
+  CU_ASSERT(reader != NULL);
+  // Stale addresses left here by the previous test would be roots
+  shared_stats_t copy;
+  memset(&copy, 0, sizeof(copy));
+  char * volatile data = NULL;
+  // Pages that a stale root keeps are not released, the others are
+  for(int i = 0; i < 16; ++i)
+    {
+      h_alloc_data(h, 1000);
+    }
+  test_clear_stack();
+  h_gc(h);
+  CU_ASSERT(h_trim(h) > 0);
+  h_publish(h);
+  CU_ASSERT(shared_stats_read(reader, &copy));
+  uint64_t released = copy.released_pages;
+  CU_ASSERT(released > 0);
+
+  // A released page that is taken for allocation is no longer released
+  data = h_alloc_data(h, 1000);
+  memset(data, 1, 1000);
+  h_publish(h);
+  CU_ASSERT(shared_stats_read(reader, &copy));
+  CU_ASSERT(copy.released_pages == released - 1);
+
+  h_delete(h);
+  shared_stats_close(reader);
+}
+
+
+/*============================================================================
+ *                             h_snapshot TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Reads the next record of a snapshot, returns its tag
+ */
+char
+read_snapshot_record(FILE *file, uint64_t *address, uint64_t *size, char *layout,
+                     uint32_t *pointer_count, uint64_t *pointers)
+{
+  uint8_t tag = 0;
+  if(fread(&tag, 1, 1, file) != 1) return 0;
+  if(tag == SNAPSHOT_ROOT)
+    {
+      CU_ASSERT(fread(address, sizeof(uint64_t), 1, file) == 1);
+    }
+  else if(tag == SNAPSHOT_OBJECT)
+    {
+      uint8_t kind;
+      uint16_t layout_length;
+      CU_ASSERT(fread(address, sizeof(uint64_t), 1, file) == 1);
+      CU_ASSERT(fread(size, sizeof(uint64_t), 1, file) == 1);
+      CU_ASSERT(fread(&kind, 1, 1, file) == 1);
+      CU_ASSERT(fread(&layout_length, sizeof(uint16_t), 1, file) == 1);
+      CU_ASSERT(fread(layout, 1, layout_length, file) == layout_length);
+      layout[layout_length] = '\0';
+      CU_ASSERT(fread(pointer_count, sizeof(uint32_t), 1, file) == 1);
+      CU_ASSERT(fread(pointers, sizeof(uint64_t), *pointer_count, file) == *pointer_count);
+    }
+  return (char) tag;
+}
+
+void
+test_h_snapshot_objects_and_roots()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  test_link_t * volatile first = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next->next = NULL;
+  char * volatile data = h_alloc_data(h, 40);
+
+  FILE *file = tmpfile();
+  CU_ASSERT(h_snapshot(h, fileno(file)));
+  rewind(file);
+
+  snapshot_header_t header;
+  CU_ASSERT(fread(&header, sizeof(header), 1, file) == 1);
+  CU_ASSERT(memcmp(header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0);
+  CU_ASSERT(header.version == SNAPSHOT_VERSION);
+  CU_ASSERT(header.heap_size == h_size(h));
+
+  size_t objects = 0;
+  bool first_seen = false;
+  bool data_seen = false;
+  bool root_seen = false;
+  uint64_t address, size, pointers[8];
+  uint32_t pointer_count;
+  char layout[SNAPSHOT_LAYOUT_MAX];
+  char tag;
+  while((tag = read_snapshot_record(file, &address, &size, layout, &pointer_count, pointers))
+        == SNAPSHOT_OBJECT || tag == SNAPSHOT_ROOT)
+    {
+      if(tag == SNAPSHOT_ROOT)
+        {
+          if(address == (uintptr_t) first) root_seen = true;
+          continue;
+        }
+      ++objects;
+      if(address == (uintptr_t) first)
+        {
+          first_seen = true;
+          CU_ASSERT(size == 24);
+          CU_ASSERT(pointer_count == 1);
+          CU_ASSERT(pointers[0] == (uintptr_t) first->next);
+          CU_ASSERT(strcmp(layout, "*i") == 0);
+        }
+      if(address == (uintptr_t) data)
+        {
+          data_seen = true;
+          CU_ASSERT(size == 48);
+          CU_ASSERT(pointer_count == 0);
+          CU_ASSERT(strcmp(layout, "") == 0);
+        }
+    }
+  CU_ASSERT(tag == SNAPSHOT_END);
+  CU_ASSERT(objects == 3);
+  CU_ASSERT(first_seen);
+  CU_ASSERT(data_seen);
+  CU_ASSERT(root_seen);
+  fclose(file);
+  h_delete(h);
+}
+
+/**
+ *  @brief Allocates a link that nothing points to
+ *
+ *  @return the address of the link xored with @p mask
+ */
+uintptr_t __attribute__((noinline))
+test_alloc_hidden(heap_t *h, uintptr_t mask)
+{
+  return (uintptr_t) h_alloc_struct(h, TEST_LINK_FORMAT_STR) ^ mask;
+}
+
+void
+test_h_snapshot_leaves_out_garbage()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  test_link_t * volatile live = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  live->next = NULL;
+  // The address is hidden from the stack search so that the object is dead
+  const uintptr_t mask = 0x5555555555555555UL;
+  volatile uintptr_t hidden = test_alloc_hidden(h, mask);
+  // Stale addresses left here by the previous test would be roots
+  uint64_t address = 0, size = 0, pointers[8];
+  memset(pointers, 0, sizeof(pointers));
+  uint32_t pointer_count = 0;
+  char layout[SNAPSHOT_LAYOUT_MAX];
+  memset(layout, 0, sizeof(layout));
+  char tag;
+
+  FILE *file = tmpfile();
+  test_clear_stack();
+  CU_ASSERT(h_snapshot(h, fileno(file)));
+  rewind(file);
+  snapshot_header_t header;
+  CU_ASSERT(fread(&header, sizeof(header), 1, file) == 1);
+
+  size_t objects = 0;
+  bool live_seen = false;
+  bool dead_seen = false;
+  while((tag = read_snapshot_record(file, &address, &size, layout, &pointer_count, pointers))
+        == SNAPSHOT_OBJECT || tag == SNAPSHOT_ROOT)
+    {
+      if(tag == SNAPSHOT_ROOT) continue;
+      ++objects;
+      if(address == (uintptr_t) live) live_seen = true;
+      if(address == (hidden ^ mask)) dead_seen = true;
+    }
+  CU_ASSERT(tag == SNAPSHOT_END);
+  CU_ASSERT(objects == 1);
+  CU_ASSERT(live_seen);
+  CU_ASSERT_FALSE(dead_seen);
+
+  // The snapshot neither collects nor counts false roots
+  CU_ASSERT(h_used(h) == 48);
+  CU_ASSERT(h->stats.last.false_roots == 0);
+  fclose(file);
+  h_delete(h);
+}
+
+void
+test_h_snapshot_bad_fd()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  h_alloc_data(h, 40);
+  CU_ASSERT_FALSE(h_snapshot(h, -1));
+  FILE *read_only = fopen("/dev/null", "r");
+  CU_ASSERT_FALSE(h_snapshot(h, fileno(read_only)));
+  fclose(read_only);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_record TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_record_allocations()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  FILE *file = tmpfile();
+  CU_ASSERT(h_record_start(h, fileno(file)));
+  CU_ASSERT_FALSE(h_record_start(h, fileno(file)));
+
+  test_link_t * volatile first = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  char * volatile data = h_alloc_data(h, 40);
+  void ** volatile array = h_alloc_ptr_array(h, 3);
+  first->next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  first->next->next = NULL;
+  h_gc(h);
+  CU_ASSERT(h_record_stop(h));
+  CU_ASSERT_FALSE(h_record_stop(h));
+  rewind(file);
+
+  recording_header_t header;
+  CU_ASSERT(recording_read_header(file, &header));
+  CU_ASSERT(header.page_size == H_PAGE_SIZE);
+  CU_ASSERT(header.heap_size == h_size(h));
+
+  record_t record;
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_ALLOC && record.id == 1);
+  CU_ASSERT(record.kind == RECORD_STRUCT);
+  CU_ASSERT(strcmp(record.layout, TEST_LINK_FORMAT_STR) == 0);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_ALLOC && record.id == 2);
+  CU_ASSERT(record.kind == RECORD_RAW);
+  CU_ASSERT(record.size >= 40);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_ALLOC && record.id == 3);
+  CU_ASSERT(record.kind == RECORD_ARRAY);
+  CU_ASSERT(record.size == 3);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_ALLOC && record.id == 4);
+
+  bool stored = false;
+  bool rooted = false;
+  while(recording_read(file, &record) && record.tag != RECORD_COLLECTION)
+    {
+      if(record.tag == RECORD_STORE && record.id == 1)
+        {
+          stored = record.offset == 0 && record.target == 4;
+        }
+      if(record.tag == RECORD_ROOT && record.id == 1) rooted = true;
+      CU_ASSERT(record.tag != RECORD_DEATH);
+    }
+  CU_ASSERT(stored);
+  CU_ASSERT(rooted);
+  CU_ASSERT(record.id == 1);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_END);
+
+  CU_ASSERT(data != NULL && array != NULL);
+  fclose(file);
+  h_delete(h);
+}
+
+void
+test_h_record_deaths()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  FILE *file = tmpfile();
+  CU_ASSERT(h_record_start(h, fileno(file)));
+  for(int i = 0; i < 10; ++i)
+    {
+      CU_ASSERT(h_alloc_data_fast(h, 16) != NULL);
+    }
+  h_gc(h);
+  CU_ASSERT(h_record_stop(h));
+  h_gc(h);
+  rewind(file);
+
+  recording_header_t header;
+  CU_ASSERT(recording_read_header(file, &header));
+  int allocations = 0;
+  int deaths = 0;
+  record_t record;
+  while(recording_read(file, &record) && record.tag != RECORD_END)
+    {
+      if(record.tag == RECORD_ALLOC) ++allocations;
+      if(record.tag == RECORD_DEATH) ++deaths;
+    }
+  CU_ASSERT(allocations == 10);
+  CU_ASSERT(deaths >= 9);
+
+  fclose(file);
+  h_delete(h);
+}
+
+void
+test_h_record_bad_fd()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  CU_ASSERT_FALSE(h_record_start(h, -1));
+  CU_ASSERT_FALSE(h_record_stop(h));
+  FILE *read_only = fopen("/dev/null", "r");
+  CU_ASSERT(h_record_start(h, fileno(read_only)));
+  h_alloc_data(h, 40);
+  CU_ASSERT_FALSE(h_record_stop(h));
+  fclose(read_only);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_profile TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_profile_sites()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  CU_ASSERT_FALSE(h_profile_start(h, 0));
+  CU_ASSERT(h_profile_start(h, 1024));
+
+  for(int i = 0; i < 200; ++i)
+    {
+      CU_ASSERT(h_alloc_struct(h, TEST_LINK_FORMAT_STR) != NULL);
+      CU_ASSERT(h_alloc_data(h, 40) != NULL);
+    }
+
+  // Every byte allocated is stood for by a sample, except the bytes
+  // after the last sample
+  uint64_t estimated = 0;
+  bool links = false, data = false;
+  for(size_t i = 0; i < profiler_sites(h->profiler); ++i)
+    {
+      const profile_site_t *site = profiler_site(h->profiler, i);
+      estimated += site->estimated_bytes;
+      if(strcmp(site->layout, TEST_LINK_FORMAT_STR) == 0) links = true;
+      if(site->layout[0] == '\0') data = true;
+      CU_ASSERT(site->depth > 0);
+    }
+  CU_ASSERT(links && data);
+  CU_ASSERT(estimated <= h_allocated(h));
+  CU_ASSERT(estimated + 1024 > h_allocated(h));
+
+  h_profile_stop(h);
+  CU_ASSERT(h->profiler == NULL);
+  h_delete(h);
+}
+
+void
+test_h_profile_fast_path()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  CU_ASSERT(h_profile_start(h, 4096));
+
+  // The fast path is left exactly at every sample
+  for(int i = 0; i < 1024; ++i)
+    {
+      CU_ASSERT(h_alloc_data_fast(h, 24) != NULL);
+    }
+  CU_ASSERT(profiler_sites(h->profiler) == 1);
+  const profile_site_t *site = profiler_site(h->profiler, 0);
+  CU_ASSERT(site->samples == 1024 * 32 / 4096);
+  CU_ASSERT(site->estimated_bytes == site->samples * 4096);
+  CU_ASSERT(site->sampled_bytes == site->samples * 32);
+
+  // Starting again throws the samples away
+  CU_ASSERT(h_profile_start(h, 4096));
+  CU_ASSERT(profiler_sites(h->profiler) == 0);
+  h_delete(h);
+}
+
+void
+test_h_profile_export()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 4, SAFE_STACK, 1);
+  FILE *file = tmpfile();
+  CU_ASSERT_FALSE(h_profile_export_pprof(h, file));
+  CU_ASSERT_FALSE(h_profile_export_folded(h, file));
+
+  CU_ASSERT(h_profile_start(h, 64));
+  for(int i = 0; i < 10; ++i)
+    {
+      CU_ASSERT(h_alloc_ptr_array(h, 4) != NULL);
+    }
+  CU_ASSERT(h_profile_export_pprof(h, file));
+  CU_ASSERT(h_profile_export_folded(h, file));
+  long length = ftell(file);
+  rewind(file);
+  char *text = calloc((size_t) length + 1, 1);
+  CU_ASSERT(fread(text, 1, (size_t) length, file) == (size_t) length);
+  CU_ASSERT(strncmp(text, "heap profile: ", 14) == 0);
+  CU_ASSERT(strstr(text, ";[*[]] ") != NULL);
+
+  free(text);
+  fclose(file);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_census TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Finds the census entry of a kind and layout
+ */
+h_census_entry_t *
+test_census_find(h_census_entry_t *entries, size_t count, enum h_layout_kind kind,
+                 char *layout)
+{
+  for(size_t i = 0; i < count; ++i)
+    {
+      if(entries[i].kind == kind && strcmp(entries[i].layout, layout) == 0) return &entries[i];
+    }
+  return NULL;
+}
+
+void
+test_h_census_live()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  h_census_entry_t entries[16];
+  CU_ASSERT(h_census(h, entries, 16) == 0);
+  CU_ASSERT(h_census_start(h));
+  CU_ASSERT(h_census(h, entries, 16) == 0);
+
+  test_link_t * volatile first = NULL;
+  for(int i = 0; i < 10; ++i)
+    {
+      test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      link->next = first;
+      link->value = i;
+      first = link;
+      h_alloc_data(h, 100);
+    }
+  void ** volatile array = h_alloc_ptr_array(h, 3);
+  void * volatile wide = h_alloc_struct(h, "30*");
+  memset(wide, 0, 30 * sizeof(void *));
+  h_gc(h);
+
+  size_t count = h_census(h, entries, 16);
+  CU_ASSERT(count == 3);
+  h_census_entry_t *links = test_census_find(entries, count, H_LAYOUT_BIT_VECTOR,
+                                             TEST_LINK_FORMAT_STR);
+  h_census_entry_t *arrays = test_census_find(entries, count, H_LAYOUT_ARRAY, "*");
+  h_census_entry_t *wides = test_census_find(entries, count, H_LAYOUT_FORMAT_STRING, "30*");
+  CU_ASSERT(links != NULL && links->objects == 10
+            && links->bytes == 10 * 24);
+  CU_ASSERT(arrays != NULL && arrays->objects == 1);
+  CU_ASSERT(wides != NULL && wides->objects == 1 && wides->pinned_objects == 0);
+  CU_ASSERT(test_census_find(entries, count, H_LAYOUT_RAW, "") == NULL);
+  CU_ASSERT(entries[0].bytes >= entries[1].bytes && entries[1].bytes >= entries[2].bytes);
+
+  h_stats_t stats;
+  h_stats(h, &stats);
+  uint64_t objects = 0, bytes = 0;
+  for(size_t i = 0; i < count; ++i)
+    {
+      objects += entries[i].objects;
+      bytes += entries[i].bytes;
+    }
+  CU_ASSERT(objects == stats.last.objects_copied);
+  CU_ASSERT(bytes == stats.last.bytes_copied);
+
+  // Only the entries that fit are written
+  CU_ASSERT(h_census(h, entries, 1) == 3);
+  CU_ASSERT(first != NULL && array != NULL);
+
+  h_census_stop(h);
+  CU_ASSERT(h_census(h, entries, 16) == 0);
+  h_delete(h);
+}
+
+void
+test_h_census_pinned()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, UNSAFE_STACK, 1);
+  CU_ASSERT(h_census_start(h));
+  CU_ASSERT(h_census_start(h));
+
+  test_link_t * volatile link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next = NULL;
+  h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  h_gc_dbg(h, UNSAFE_STACK);
+
+  // The page of the link is pinned with the garbage next to it
+  h_census_entry_t entries[4];
+  size_t count = h_census(h, entries, 4);
+  h_census_entry_t *links = test_census_find(entries, count, H_LAYOUT_BIT_VECTOR,
+                                             TEST_LINK_FORMAT_STR);
+  CU_ASSERT(links != NULL && links->objects == 0);
+  CU_ASSERT(links != NULL && links->pinned_objects >= 2);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_retention_report TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Allocates a list with garbage between the links
+ *
+ *  @return the first link
+ */
+test_link_t * __attribute__((noinline))
+test_build_list(heap_t *h, int length)
+{
+  test_link_t *first = NULL;
+  for(int i = 0; i < length; ++i)
+    {
+      test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      link->next = first;
+      link->value = i;
+      first = link;
+      h_alloc_data(h, 100);
+    }
+  return first;
+}
+
+void
+test_h_retention_list()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  h_retained_t top[4];
+  memset(top, 0, sizeof(top));
+  CU_ASSERT(h_retention_report(h, top, 4) == 0);
+
+  test_link_t * volatile first = test_build_list(h, 10);
+  CU_ASSERT(h_retention_report(h, top, 0) == 0);
+  test_clear_stack();
+  CU_ASSERT(h_retention_report(h, top, 4) == 4);
+  CU_ASSERT(top[0].object == first);
+  CU_ASSERT(top[0].kind == H_LAYOUT_BIT_VECTOR);
+  CU_ASSERT(strcmp(top[0].layout, TEST_LINK_FORMAT_STR) == 0);
+  CU_ASSERT(top[0].size == 24);
+  CU_ASSERT(top[0].retained == 10 * 24);
+  CU_ASSERT(top[0].retained_objects == 10);
+  CU_ASSERT(top[0].depth == 1 && top[0].path_length == 1);
+  CU_ASSERT(top[0].path[0] == first);
+
+  // The rest of the list hangs from the first link
+  CU_ASSERT(top[1].object == first->next);
+  CU_ASSERT(top[1].retained == 9 * 24);
+  CU_ASSERT(top[1].depth == 2);
+  CU_ASSERT(top[1].path[0] == first && top[1].path[1] == first->next);
+  CU_ASSERT(top[3].retained == 7 * 24);
+  h_delete(h);
+}
+
+/**
+ *  @brief Allocates a holder of two objects that share their data
+ *
+ *  Everything but the holder is only reachable through it, as the
+ *  addresses are built in this frame, which the caller clears.
+ *
+ *  @return the holder
+ */
+void ** __attribute__((noinline))
+test_build_shared(heap_t *h)
+{
+  void **holder = h_alloc_struct(h, "2*");
+  holder[0] = h_alloc_struct(h, "*");
+  holder[1] = h_alloc_struct(h, "*");
+  *(void **) holder[0] = h_alloc_data(h, 1000);
+  *(void **) holder[1] = *(void **) holder[0];
+  return holder;
+}
+
+void
+test_h_retention_shared()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+
+  // Two objects share the data, so only the holder of both retains it
+  void ** volatile holder = test_build_shared(h);
+
+  h_retained_t top[8];
+  memset(top, 0, sizeof(top));
+  test_clear_stack();
+  size_t count = h_retention_report(h, top, 8);
+  CU_ASSERT(count == 4);
+  CU_ASSERT(top[0].object == holder);
+  CU_ASSERT(top[0].retained_objects == 4);
+  CU_ASSERT(top[0].retained == top[0].size + top[1].size + top[2].size + top[3].size);
+  CU_ASSERT(top[1].object == *(void **) holder[0]);
+  CU_ASSERT(top[1].kind == H_LAYOUT_RAW);
+  CU_ASSERT(top[1].retained_objects == 1);
+  CU_ASSERT(top[1].depth == 3);
+  CU_ASSERT(top[1].path[0] == holder && top[1].path[1] == holder[0]);
+  CU_ASSERT(top[2].retained_objects == 1 && top[3].retained_objects == 1);
+  h_delete(h);
+}
+
+void
+test_h_retention_long_path()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  test_link_t * volatile first = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  test_link_t *last = first;
+  for(int i = 1; i < H_RETENTION_PATH_MAX + 4; ++i)
+    {
+      last->next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+      last = last->next;
+    }
+  last->next = NULL;
+  uintptr_t mask = 0x5a5a5a5a;
+  uintptr_t hidden = (uintptr_t) last ^ mask;
+  last = NULL;
+
+  // Only the end of the path fits
+  h_retained_t top[H_RETENTION_PATH_MAX + 4];
+  memset(top, 0, sizeof(top));
+  test_clear_stack();
+  CU_ASSERT(h_retention_report(h, top, H_RETENTION_PATH_MAX + 4) == H_RETENTION_PATH_MAX + 4);
+  h_retained_t *end = &top[H_RETENTION_PATH_MAX + 3];
+  CU_ASSERT(end->object == (void *) (hidden ^ mask));
+  CU_ASSERT(end->depth == H_RETENTION_PATH_MAX + 4);
+  CU_ASSERT(end->path_length == H_RETENTION_PATH_MAX);
+  CU_ASSERT(end->path[H_RETENTION_PATH_MAX - 1] == end->object);
+  CU_ASSERT(end->path[0] == first->next->next->next->next);
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             h_ref TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Creates a reference to a new link that nothing else points to
+ */
+h_ref_t * __attribute__((noinline))
+test_ref_to_garbage(heap_t *h, bool soft, int value)
+{
+  test_link_t *link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next->next = NULL;
+  link->next->value = value + 1;
+  link->value = value;
+  return soft ? h_soft_ref(h, link) : h_weak_ref(h, link);
+}
+
+void
+test_h_weak_ref_cleared()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  h_stats_t stats;
+  memset(&stats, 0, sizeof(stats));
+  h_ref_t *ref = test_ref_to_garbage(h, false, 7);
+  CU_ASSERT(ref != NULL);
+  CU_ASSERT(h_ref_get(ref) != NULL);
+
+  test_clear_stack();
+  h_gc(h);
+  CU_ASSERT(h_ref_get(ref) == NULL);
+  h_stats(h, &stats);
+  CU_ASSERT(stats.last.refs_cleared == 1);
+
+  // A cleared reference stays cleared
+  h_gc(h);
+  CU_ASSERT(h_ref_get(ref) == NULL);
+  h_stats(h, &stats);
+  CU_ASSERT(stats.last.refs_cleared == 0);
+  CU_ASSERT(stats.total.refs_cleared == 1);
+  h_ref_delete(h, ref);
+  h_delete(h);
+}
+
+void
+test_h_weak_ref_moved()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  test_link_t * volatile link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next = NULL;
+  link->value = 42;
+  uintptr_t mask = 0x5a5a5a5a;
+  uintptr_t before = (uintptr_t) link ^ mask;
+  h_ref_t *ref = h_weak_ref(h, link);
+
+  h_gc(h);
+  CU_ASSERT((uintptr_t) link != (before ^ mask));
+  CU_ASSERT(h_ref_get(ref) == link);
+  CU_ASSERT(((test_link_t *) h_ref_get(ref))->value == 42);
+  h_delete(h);
+}
+
+void
+test_h_weak_ref_pinned()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, UNSAFE_STACK, 1);
+  test_link_t * volatile link = h_alloc_struct(h, TEST_LINK_FORMAT_STR);
+  link->next = NULL;
+  h_ref_t *ref = h_weak_ref(h, link);
+
+  h_gc_dbg(h, UNSAFE_STACK);
+  CU_ASSERT(h_ref_get(ref) == link);
+  h_delete(h);
+}
+
+void
+test_h_weak_ref_realloc()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  char * volatile data = h_alloc_data(h, 1000);
+  h_alloc_data(h, 900);
+  strcpy(data, "moved");
+  h_ref_t *ref = h_weak_ref(h, data);
+
+  // There is no room after the object, so it is copied to another page
+  char * volatile moved = h_realloc(h, data, 1500);
+  CU_ASSERT(moved != NULL);
+  CU_ASSERT((uintptr_t) moved / H_PAGE_SIZE != (uintptr_t) data / H_PAGE_SIZE);
+  CU_ASSERT(h_ref_get(ref) == moved);
+  data = NULL;
+
+  h_gc(h);
+  CU_ASSERT(h_ref_get(ref) == moved);
+  CU_ASSERT(moved != NULL && strcmp(moved, "moved") == 0);
+  // The next test's heap may be mapped at the same address
+  moved = NULL;
+  h_delete(h);
+}
+
+void
+test_h_soft_ref()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  h_ref_t *ref = test_ref_to_garbage(h, true, 3);
+
+  // The heap is nearly empty so the referent and what it points to live
+  test_clear_stack();
+  h_gc(h);
+  test_link_t *link = h_ref_get(ref);
+  CU_ASSERT(link != NULL);
+  CU_ASSERT(link != NULL && link->value == 3);
+  CU_ASSERT(link != NULL && link->next != NULL && link->next->value == 4);
+  link = NULL;
+
+  h_soft_ref_threshold(h, 0);
+  test_clear_stack();
+  h_gc(h);
+  CU_ASSERT(h_ref_get(ref) == NULL);
+  h_delete(h);
+}
+
+void
+test_h_ref_invalid()
+{
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE * 16, SAFE_STACK, 1);
+  char * volatile data = h_alloc_data(h, 64);
+  int outside = 0;
+  CU_ASSERT(h_weak_ref(h, NULL) == NULL);
+  CU_ASSERT(h_soft_ref(h, &outside) == NULL);
+  CU_ASSERT(h_weak_ref(h, data + 8) == NULL);
+
+  h_ref_t *first = h_weak_ref(h, data);
+  h_ref_t *middle = h_soft_ref(h, data);
+  h_ref_t *last = h_weak_ref(h, data);
+  h_ref_delete(h, middle);
+  h_ref_delete(h, NULL);
+  h_gc(h);
+  CU_ASSERT(h_ref_get(first) == data);
+  CU_ASSERT(h_ref_get(last) == data);
+  h_ref_delete(h, first);
+
+  // The heap deletes the references that are left
+  h_delete(h);
+}
+
+
+/*============================================================================
+ *                             Old school TESTING SUITE
+ *===========================================================================*/
+
+void
+test_h_alloc ()
+{
+  int test_size = 6144;
+  heap_t *test_h_alloc_heap = h_init(test_size, true, 1);
+
+  void * ptr1 = h_alloc_struct(test_h_alloc_heap, "i");
+  write_int_to_heap(ptr1, 6);
+
+  void * ptr2 = h_alloc_struct(test_h_alloc_heap, "i");
+  write_int_to_heap(ptr2, 9);
+
+  void * ptr4 = h_alloc_data(test_h_alloc_heap, 2040);
+
+  void * ptr5 = h_alloc_struct(test_h_alloc_heap, "i*i");
+  struct test_struct ts = ( (struct test_struct) {1, 'c', &ptr5, 3, 2}); 
+  *(struct test_struct *)ptr5 = ts;
+  
+
+  void * ptr3 = h_alloc_struct(test_h_alloc_heap, "*");
+  void * test_pointer = malloc(10);
+  write_pointer_to_heap(&ptr3, test_pointer);
+
+  CU_ASSERT(*(int *)ptr1 == 6);
+  CU_ASSERT(*(int *)ptr2 == 9);
+  CU_ASSERT_PTR_EQUAL(test_pointer, ptr3);
+  CU_ASSERT(ptr4 != NULL);
+  CU_ASSERT(ptr5 != NULL);
+
+  h_delete(test_h_alloc_heap);
+  free(test_pointer);
+}
+
+extern char **environ;
+
+void
+test_get_ptr_page()
+{
+  int test_size = 6144;
+  heap_t *test_h_alloc_heap = h_init(test_size, true, 1); 
+
+  void * ptr1 = h_alloc_struct(test_h_alloc_heap, "i");
+  write_int_to_heap(ptr1, 6);
+
+  CU_ASSERT(get_ptr_page(test_h_alloc_heap, ptr1) != -1);
+  h_delete(test_h_alloc_heap);
+}
+
+void
+test_h_alloc_threshold ()
+{
+  int test_size = 6144;
+  heap_t *test_h_alloc_heap = h_init(test_size, true, 0.3);
+
+  void *ptr1 = h_alloc_data(test_h_alloc_heap, 5);
+  void *ptr2 = h_alloc_data(test_h_alloc_heap, 1990);
+
+  CU_ASSERT(ptr1 != NULL);
+  CU_ASSERT(ptr2 == NULL);
+  
+  h_delete(test_h_alloc_heap);
+
+  heap_t *test_h_alloc_heap_passive = h_init(test_size, true, 1);
+  void *ptr3 = h_alloc_data(test_h_alloc_heap_passive, 2000);
+  void *ptr4 = h_alloc_data(test_h_alloc_heap_passive, 2000);
+  void *ptr5 = h_alloc_data(test_h_alloc_heap_passive, 2000);
+
+  CU_ASSERT(ptr3 != NULL);
+  CU_ASSERT(ptr4 != NULL);
+  CU_ASSERT(ptr5 == NULL);
+  
+  h_delete(test_h_alloc_heap_passive);
+}
+
+
+
+
+/*============================================================================
+ *                             Main Testing Function
+ *===========================================================================*/
+int
+main (void)
+{
+  CU_pSuite suite1 = NULL;
+  CU_pSuite suite_h_init = NULL;
+  CU_pSuite suite_h_delete = NULL;
+  CU_pSuite suite_h_alloc_struct = NULL;
+  CU_pSuite suite_h_alloc_data = NULL;
+  CU_pSuite suite_h_gc = NULL;
+  CU_pSuite suite_h_avail = NULL;
+  CU_pSuite suite_h_used = NULL;
+  CU_pSuite suite_h_size = NULL;
+  CU_pSuite suite_size_class = NULL;
+  CU_pSuite suite_h_alloc_data_fast = NULL;
+  CU_pSuite suite_h_alloc_n = NULL;
+  CU_pSuite suite_h_alloc_array = NULL;
+  CU_pSuite suite_h_realloc = NULL;
+  CU_pSuite suite_h_init_growable = NULL;
+  CU_pSuite suite_h_trim = NULL;
+  CU_pSuite suite_h_init_with_options = NULL;
+  CU_pSuite suite_h_stats = NULL;
+  CU_pSuite suite_h_trace = NULL;
+  CU_pSuite suite_h_pauses = NULL;
+  CU_pSuite suite_h_publish = NULL;
+  CU_pSuite suite_h_snapshot = NULL;
+  CU_pSuite suite_h_record = NULL;
+  CU_pSuite suite_h_profile = NULL;
+  CU_pSuite suite_h_census = NULL;
+  CU_pSuite suite_h_retention = NULL;
+  CU_pSuite suite_h_ref = NULL;
+
+  if (CU_initialize_registry() != CUE_SUCCESS)
+    {
+      return CU_get_error();
+    }
+
+
+  // ********************* h_init SUITE ******************  //
+  suite_h_init = CU_add_suite("Tests function h_init()", NULL, NULL);
+  if (suite_h_init == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_init
+                            , "size 0"
+                            , test_h_init_size_zero) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size 1"
+                               , test_h_init_size_one) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size 8"
+                               , test_h_init_size_eight) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size 2047"
+                               , test_h_init_size_2047) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "one below smallest"
+                               , test_h_init_size_one_below_smallest) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "one above smallest"
+                               , test_h_init_size_one_above_smallest) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size odd"
+                               , test_h_init_size_odd) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size max"
+                               , test_h_init_size_max) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "size one below max"
+                               , test_h_init_size_one_below_max) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "threshold zero"
+                               , test_h_init_threshold_zero) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "threshold negative"
+                               , test_h_init_threshold_negative) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "threshold above 1"
+                               , test_h_init_threshold_larger_than_one) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "threshold close to edge"
+                               , test_h_init_threshold_close_to_edge) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "threshold edge"
+                               , test_h_init_threshold_edge) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "success"
+                               , test_h_init_success) )
+       || (NULL == CU_add_test(suite_h_init
+                               , "heap mask is exact"
+                               , test_h_init_mask_is_exact) )
+       
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  // ********************* h_delete SUITE ******************  //
+  suite_h_delete = CU_add_suite("Tests function h_delete() and h_delete_dbg()",
+                                NULL, NULL);
+  if (suite_h_delete == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_delete
+                            , "null heap ptr"
+                            , test_h_delete_null_ptr) ) ||
+       (NULL == CU_add_test(suite_h_delete
+                               , "dbg null heap ptr"
+                               , test_h_delete_dbg_null_ptr) ) ||
+       (NULL == CU_add_test(suite_h_delete
+                               , "null dbg value"
+                               , test_h_delete_dbg_null_value) )
+       || (NULL == CU_add_test(suite_h_delete
+                               , "other dbg value"
+                               , test_h_delete_dbg_other_value) )
+       || (NULL == CU_add_test(suite_h_delete
                                , "multiple ptrs to same data"
                                , test_h_delete_dbg_multiple_ptrs_to_same_data) )
        || (NULL == CU_add_test(suite_h_delete
@@ -1161,7 +3030,10 @@ main (void)
                                , test_h_gc_dbg_only_garbage) ) ||
        (NULL == CU_add_test(suite_h_gc
                                , "dgb: null heap ptr"
-                               , test_h_gc_dbg_null_heap_ptr) )
+                               , test_h_gc_dbg_null_heap_ptr) ) ||
+       (NULL == CU_add_test(suite_h_gc
+                               , "garbage is removed from the alloc map"
+                               , test_h_gc_garbage_leaves_alloc_map) )
     )
     {
       CU_cleanup_registry();
@@ -1274,6 +3146,489 @@ main (void)
     }
 
   
+  // ********************* Size class SUITE ******************  //
+  suite_size_class = CU_add_suite("Tests size segregated allocation",
+                                  NULL, NULL);
+  if (suite_size_class == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_size_class
+                            , "class boundaries"
+                            , test_size_class_boundaries) )
+       || (NULL == CU_add_test(suite_size_class
+                               , "small objects share page"
+                               , test_size_class_small_objects_share_page) )
+       || (NULL == CU_add_test(suite_size_class
+                               , "tiny objects pack densely"
+                               , test_size_class_tiny_objects_pack_densely) )
+       || (NULL == CU_add_test(suite_size_class
+                               , "small heap mixes classes"
+                               , test_size_class_small_heap_mixes_classes) )
+       || (NULL == CU_add_test(suite_size_class
+                               , "classes survive gc"
+                               , test_size_class_survives_gc) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_alloc_data_fast SUITE ******************  //
+  suite_h_alloc_data_fast = CU_add_suite("Tests function h_alloc_data_fast()",
+                                         NULL, NULL);
+  if (suite_h_alloc_data_fast == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_alloc_data_fast
+                            , "null heap"
+                            , test_h_alloc_data_fast_null_heap) )
+       || (NULL == CU_add_test(suite_h_alloc_data_fast
+                               , "zero bytes"
+                               , test_h_alloc_data_fast_zero_bytes) )
+       || (NULL == CU_add_test(suite_h_alloc_data_fast
+                               , "too big for a page"
+                               , test_h_alloc_data_fast_too_big_for_page) )
+       || (NULL == CU_add_test(suite_h_alloc_data_fast
+                               , "same result as slow path"
+                               , test_h_alloc_data_fast_same_as_slow) )
+       || (NULL == CU_add_test(suite_h_alloc_data_fast
+                               , "survives gc"
+                               , test_h_alloc_data_fast_survives_gc) )
+       || (NULL == CU_add_test(suite_h_alloc_data_fast
+                               , "respects threshold"
+                               , test_h_alloc_data_fast_threshold) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_alloc_struct_n/h_alloc_data_n SUITE ******************  //
+  suite_h_alloc_n = CU_add_suite("Tests function h_alloc_struct_n() and h_alloc_data_n()",
+                                 NULL, NULL);
+  if (suite_h_alloc_n == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_alloc_n
+                            , "null heap"
+                            , test_h_alloc_n_null_heap) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "zero objects"
+                               , test_h_alloc_n_zero_objects) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "invalid format string"
+                               , test_h_alloc_struct_n_invalid_str) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "valid format string"
+                               , test_h_alloc_struct_n_valid_str) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "data spans pages"
+                               , test_h_alloc_data_n_spans_pages) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "out of memory"
+                               , test_h_alloc_data_n_out_of_memory) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "page sized objects"
+                               , test_h_alloc_n_page_sized) )
+       || (NULL == CU_add_test(suite_h_alloc_n
+                               , "linked structs survive gc"
+                               , test_h_alloc_struct_n_linked_survives_gc) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_alloc_array SUITE ******************  //
+  suite_h_alloc_array = CU_add_suite("Tests function h_alloc_array() and h_alloc_ptr_array()",
+                                     NULL, NULL);
+  if (suite_h_alloc_array == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_alloc_array
+                            , "invalid arrays"
+                            , test_h_alloc_array_invalid) )
+       || (NULL == CU_add_test(suite_h_alloc_array
+                               , "no format string on heap"
+                               , test_h_alloc_ptr_array_no_format_string) )
+       || (NULL == CU_add_test(suite_h_alloc_array
+                               , "pointer array survives gc"
+                               , test_h_alloc_ptr_array_survives_gc) )
+       || (NULL == CU_add_test(suite_h_alloc_array
+                               , "struct array survives gc"
+                               , test_h_alloc_array_of_structs_survives_gc) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_realloc SUITE ******************  //
+  suite_h_realloc = CU_add_suite("Tests function h_realloc()", NULL, NULL);
+  if (suite_h_realloc == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_realloc
+                            , "invalid objects and sizes"
+                            , test_h_realloc_invalid) )
+       || (NULL == CU_add_test(suite_h_realloc
+                               , "NULL allocates"
+                               , test_h_realloc_null_allocates) )
+       || (NULL == CU_add_test(suite_h_realloc
+                               , "grows and shrinks in place"
+                               , test_h_realloc_grows_in_place) )
+       || (NULL == CU_add_test(suite_h_realloc
+                               , "copies when not last in page"
+                               , test_h_realloc_copies_when_not_last) )
+       || (NULL == CU_add_test(suite_h_realloc
+                               , "new array elements are zeroed"
+                               , test_h_realloc_array_zeroes_new_elements) )
+       || (NULL == CU_add_test(suite_h_realloc
+                               , "resized array survives gc"
+                               , test_h_realloc_survives_gc) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_init_growable SUITE ******************  //
+  suite_h_init_growable = CU_add_suite("Tests function h_init_growable()", NULL, NULL);
+  if (suite_h_init_growable == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_init_growable
+                            , "invalid sizes"
+                            , test_h_init_growable_invalid) )
+       || (NULL == CU_add_test(suite_h_init_growable
+                               , "starts at initial size"
+                               , test_h_init_growable_starts_small) )
+       || (NULL == CU_add_test(suite_h_init_growable
+                               , "grows with live data"
+                               , test_h_init_growable_grows_with_live_data) )
+       || (NULL == CU_add_test(suite_h_init_growable
+                               , "stops at max size"
+                               , test_h_init_growable_stops_at_max) )
+       || (NULL == CU_add_test(suite_h_init_growable
+                               , "heap_grow()"
+                               , test_heap_grow) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_trim SUITE ******************  //
+  suite_h_trim = CU_add_suite("Tests function h_trim()", NULL, NULL);
+  if (suite_h_trim == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_trim
+                            , "releases passive pages"
+                            , test_h_trim_releases_passive_pages) )
+       || (NULL == CU_add_test(suite_h_trim
+                               , "keeps live data"
+                               , test_h_trim_keeps_live_data) )
+       || (NULL == CU_add_test(suite_h_trim
+                               , "released page is reused"
+                               , test_h_trim_page_reused_after_release) )
+       || (NULL == CU_add_test(suite_h_trim
+                               , "failed release is retried"
+                               , test_h_trim_retries_failed_release) )
+       || (NULL == CU_add_test(suite_h_trim
+                               , "idle pages released by collections"
+                               , test_idle_pages_released_after_collections) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_init_with_options SUITE ******************  //
+  suite_h_init_with_options = CU_add_suite("Tests function h_init_with_options()", NULL, NULL);
+  if (suite_h_init_with_options == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_init_with_options
+                            , "huge page heap is aligned"
+                            , test_h_init_huge_pages_aligned) )
+       || (NULL == CU_add_test(suite_h_init_with_options
+                               , "huge page heap grows"
+                               , test_h_init_huge_pages_grows) )
+       || (NULL == CU_add_test(suite_h_init_with_options
+                               , "heap aligned to power of two"
+                               , test_h_init_aligned_to_power_of_two) )
+       || (NULL == CU_add_test(suite_h_init_with_options
+                               , "pages are created on first use"
+                               , test_h_init_lazy_pages) )
+       || (NULL == CU_add_test(suite_h_init_with_options
+                               , "no options"
+                               , test_h_init_without_options) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_stats SUITE ******************  //
+  suite_h_stats = CU_add_suite("Tests function h_stats()", NULL, NULL);
+  if (suite_h_stats == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_stats
+                            , "new heap"
+                            , test_h_stats_new_heap) )
+       || (NULL == CU_add_test(suite_h_stats
+                               , "counts copies"
+                               , test_h_stats_counts_copies) )
+       || (NULL == CU_add_test(suite_h_stats
+                               , "pinned pages and false roots"
+                               , test_h_stats_pinned_and_false_roots) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_trace SUITE ******************  //
+  suite_h_trace = CU_add_suite("Tests GC event tracing", NULL, NULL);
+  if (suite_h_trace == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_trace
+                            , "tracing off"
+                            , test_h_trace_off) )
+       || (NULL == CU_add_test(suite_h_trace
+                               , "gc phases"
+                               , test_h_trace_gc_phases) )
+       || (NULL == CU_add_test(suite_h_trace
+                               , "sampled slow allocations"
+                               , test_h_trace_alloc_samples) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_pauses SUITE ******************  //
+  suite_h_pauses = CU_add_suite("Tests pause histogram and allocation rate", NULL, NULL);
+  if (suite_h_pauses == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_pauses
+                            , "pauses recorded"
+                            , test_h_pauses_recorded) )
+       || (NULL == CU_add_test(suite_h_pauses
+                               , "allocated bytes"
+                               , test_h_allocated_counts_bump_paths) )
+       || (NULL == CU_add_test(suite_h_pauses
+                               , "allocation rate"
+                               , test_h_alloc_rate) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_publish SUITE ******************  //
+  suite_h_publish = CU_add_suite("Tests shared memory statistics", NULL, NULL);
+  if (suite_h_publish == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_publish
+                            , "not publishing"
+                            , test_h_publish_off) )
+       || (NULL == CU_add_test(suite_h_publish
+                               , "published after gc"
+                               , test_h_publish_after_gc) )
+       || (NULL == CU_add_test(suite_h_publish
+                               , "pages in use are not released"
+                               , test_h_publish_released_pages) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_snapshot SUITE ******************  //
+  suite_h_snapshot = CU_add_suite("Tests function h_snapshot()", NULL, NULL);
+  if (suite_h_snapshot == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_snapshot
+                            , "objects and roots"
+                            , test_h_snapshot_objects_and_roots) )
+       || (NULL == CU_add_test(suite_h_snapshot
+                               , "leaves out garbage"
+                               , test_h_snapshot_leaves_out_garbage) )
+       || (NULL == CU_add_test(suite_h_snapshot
+                               , "unwritable file"
+                               , test_h_snapshot_bad_fd) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  
+  // ********************* h_record SUITE ******************  //
+  suite_h_record = CU_add_suite("Tests function h_record_start() and h_record_stop()", NULL, NULL);
+  if (suite_h_record == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_record
+                            , "allocations, stores and roots"
+                            , test_h_record_allocations) )
+       || (NULL == CU_add_test(suite_h_record
+                               , "deaths and the fast path"
+                               , test_h_record_deaths) )
+       || (NULL == CU_add_test(suite_h_record
+                               , "unwritable file"
+                               , test_h_record_bad_fd) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+
+  // ********************* h_profile SUITE ******************  //
+  suite_h_profile = CU_add_suite("Tests the allocation site profiler", NULL, NULL);
+  if (suite_h_profile == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_profile
+                            , "sites and estimated bytes"
+                            , test_h_profile_sites) )
+       || (NULL == CU_add_test(suite_h_profile
+                               , "samples from the fast path"
+                               , test_h_profile_fast_path) )
+       || (NULL == CU_add_test(suite_h_profile
+                               , "pprof and folded export"
+                               , test_h_profile_export) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+
+  // ********************* h_census SUITE ******************  //
+  suite_h_census = CU_add_suite("Tests the live object census", NULL, NULL);
+  if (suite_h_census == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_census
+                            , "copied objects per layout"
+                            , test_h_census_live) )
+       || (NULL == CU_add_test(suite_h_census
+                               , "objects on pinned pages"
+                               , test_h_census_pinned) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+
+  // ********************* h_retention_report SUITE ******************  //
+  suite_h_retention = CU_add_suite("Tests the retained size report", NULL, NULL);
+  if (suite_h_retention == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_retention
+                            , "a list held by the stack"
+                            , test_h_retention_list) )
+       || (NULL == CU_add_test(suite_h_retention
+                               , "shared objects"
+                               , test_h_retention_shared) )
+       || (NULL == CU_add_test(suite_h_retention
+                               , "paths longer than the max"
+                               , test_h_retention_long_path) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+
+  // ********************* h_ref SUITE ******************  //
+  suite_h_ref = CU_add_suite("Tests weak and soft references", NULL, NULL);
+  if (suite_h_ref == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_h_ref
+                            , "weak reference to garbage"
+                            , test_h_weak_ref_cleared) )
+       || (NULL == CU_add_test(suite_h_ref
+                               , "weak reference to a moved object"
+                               , test_h_weak_ref_moved) )
+       || (NULL == CU_add_test(suite_h_ref
+                               , "weak reference to a pinned object"
+                               , test_h_weak_ref_pinned) )
+       || (NULL == CU_add_test(suite_h_ref
+                               , "weak reference to a reallocated object"
+                               , test_h_weak_ref_realloc) )
+       || (NULL == CU_add_test(suite_h_ref
+                               , "soft reference and the threshold"
+                               , test_h_soft_ref) )
+       || (NULL == CU_add_test(suite_h_ref
+                               , "invalid referents and deleting"
+                               , test_h_ref_invalid) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+  
   // ********************* Legacy  SUITE ******************  //
   suite1 = CU_add_suite("Legacy Test", NULL, NULL);
 
@@ -0,0 +1,153 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "gc_trace.h"
+
+
+struct trace_buffer
+{
+  size_t capacity;
+  size_t count;
+  size_t next;
+  trace_event_t events[];
+};
+
+
+static const char *kind_names[] =
+  {
+    "gc"
+    , "root_scan"
+    , "trace"
+    , "copy"
+    , "page_reset"
+    , "alloc_slow"
+    , "pin"
+  };
+
+
+trace_buffer_t *
+trace_buffer_create(size_t capacity)
+{
+  assert(capacity > 0);
+  if(capacity == 0) return NULL;
+
+  trace_buffer_t *buffer = malloc(sizeof(trace_buffer_t) + capacity * sizeof(trace_event_t));
+  if(buffer == NULL) return NULL;
+
+  buffer->capacity = capacity;
+  buffer->count = 0;
+  buffer->next = 0;
+  return buffer;
+}
+
+
+void
+trace_buffer_delete(trace_buffer_t *buffer)
+{
+  free(buffer);
+}
+
+
+void
+trace_record(trace_buffer_t *buffer, trace_kind_t kind, trace_phase_t phase,
+             uint64_t time_ns, uint64_t arg)
+{
+  trace_event_t *event = &buffer->events[buffer->next];
+  event->time_ns = time_ns;
+  event->kind = kind;
+  event->phase = phase;
+  event->arg = arg;
+
+  buffer->next = (buffer->next + 1) % buffer->capacity;
+  if(buffer->count < buffer->capacity)
+    {
+      buffer->count += 1;
+    }
+}
+
+
+size_t
+trace_buffer_count(trace_buffer_t *buffer)
+{
+  if(buffer == NULL) return 0;
+  return buffer->count;
+}
+
+
+trace_event_t *
+trace_buffer_get(trace_buffer_t *buffer, size_t index)
+{
+  if(buffer == NULL || index >= buffer->count) return NULL;
+  size_t oldest = (buffer->next + buffer->capacity - buffer->count) % buffer->capacity;
+  return &buffer->events[(oldest + index) % buffer->capacity];
+}
+
+
+const char *
+trace_kind_name(trace_kind_t kind)
+{
+  if(kind > TRACE_PIN) return "unknown";
+  return kind_names[kind];
+}
+
+
+/*============================================================================
+ *                             EXPORT FUNCTIONS
+ *===========================================================================*/
+
+bool
+trace_export_chrome(trace_buffer_t *buffer, FILE *out, long pid)
+{
+  if(buffer == NULL || out == NULL) return false;
+
+  bool ok = fprintf(out, "{\"traceEvents\":[") >= 0;
+  size_t count = trace_buffer_count(buffer);
+  for(size_t i = 0; i < count && ok; ++i)
+    {
+      trace_event_t *event = trace_buffer_get(buffer, i);
+      const char *ph = event->phase == TRACE_BEGIN ? "B"
+        : event->phase == TRACE_END ? "E" : "i";
+      // Chrome wants microseconds, the fraction keeps nanoseconds
+      ok = fprintf(out,
+                   "%s\n{\"name\":\"%s\",\"cat\":\"gc\",\"ph\":\"%s\","
+                   "\"ts\":%llu.%03llu,\"pid\":%ld,\"tid\":1%s"
+                   ",\"args\":{\"arg\":%llu}}",
+                   i == 0 ? "" : ",",
+                   trace_kind_name(event->kind),
+                   ph,
+                   (unsigned long long) (event->time_ns / 1000),
+                   (unsigned long long) (event->time_ns % 1000),
+                   pid,
+                   event->phase == TRACE_INSTANT ? ",\"s\":\"t\"" : "",
+                   (unsigned long long) event->arg) >= 0;
+    }
+  ok = ok && fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n") >= 0;
+  return ok;
+}
+
+
+bool
+trace_export_text(trace_buffer_t *buffer, FILE *out, long pid)
+{
+  if(buffer == NULL || out == NULL) return false;
+
+  bool ok = true;
+  size_t count = trace_buffer_count(buffer);
+  for(size_t i = 0; i < count && ok; ++i)
+    {
+      trace_event_t *event = trace_buffer_get(buffer, i);
+      const char *suffix = event->phase == TRACE_BEGIN ? "_begin"
+        : event->phase == TRACE_END ? "_end" : "";
+      ok = fprintf(out, "gc %ld [000] %llu.%06llu: gc:%s%s: arg=%llu\n",
+                   pid,
+                   (unsigned long long) (event->time_ns / 1000000000ULL),
+                   (unsigned long long) (event->time_ns % 1000000000ULL / 1000),
+                   trace_kind_name(event->kind),
+                   suffix,
+                   (unsigned long long) event->arg) >= 0;
+    }
+  return ok;
+}
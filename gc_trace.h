@@ -0,0 +1,149 @@
+/**
+ *  @file  gc_trace.h
+ *  @brief A ring buffer of timestamped garbage collector events.
+ *
+ *  The buffer keeps the latest events and overwrites the oldest when it
+ *  is full. The heap only records events when a buffer is attached, so
+ *  tracing costs one NULL test when it is turned off.
+ */
+
+#ifndef __gc_trace__
+#define __gc_trace__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+/**
+ *  @brief What an event is about.
+ */
+typedef enum trace_kind
+  {
+    TRACE_GC
+    , TRACE_ROOT_SCAN
+    , TRACE_TRACE
+    , TRACE_COPY
+    , TRACE_PAGE_RESET
+    , TRACE_ALLOC_SLOW
+    , TRACE_PIN
+  } trace_kind_t;
+
+/**
+ *  @brief If an event starts a span, ends a span or is a single point.
+ */
+typedef enum trace_phase
+  {
+    TRACE_BEGIN
+    , TRACE_END
+    , TRACE_INSTANT
+  } trace_phase_t;
+
+
+typedef struct trace_event trace_event_t;
+
+struct trace_event
+{
+  uint64_t time_ns;
+  uint32_t kind;
+  uint32_t phase;
+  uint64_t arg;
+};
+
+
+typedef struct trace_buffer trace_buffer_t;
+
+
+/**
+ *  @brief Creates a buffer for @p capacity events.
+ *
+ *  @param  capacity the number of events kept, at least 1
+ *  @return the new buffer or NULL if memory cannot be allocated
+ */
+trace_buffer_t *
+trace_buffer_create(size_t capacity);
+
+
+/**
+ *  @brief Deletes a buffer.
+ *
+ *  @param  buffer the buffer, may be NULL
+ */
+void
+trace_buffer_delete(trace_buffer_t *buffer);
+
+
+/**
+ *  @brief Records an event, overwriting the oldest if the buffer is full.
+ *
+ *  @param  buffer the buffer
+ *  @param  kind what the event is about
+ *  @param  phase begin, end or instant
+ *  @param  time_ns the time of the event from a monotonic clock
+ *  @param  arg a value shown with the event, such as a size in bytes
+ */
+void
+trace_record(trace_buffer_t *buffer, trace_kind_t kind, trace_phase_t phase,
+             uint64_t time_ns, uint64_t arg);
+
+
+/**
+ *  @brief Returns the number of events in a buffer.
+ */
+size_t
+trace_buffer_count(trace_buffer_t *buffer);
+
+
+/**
+ *  @brief Returns the @p index:th oldest event in a buffer.
+ *
+ *  @param  buffer the buffer
+ *  @param  index the index of the event, less than trace_buffer_count()
+ *  @return the event or NULL if @p index is out of range
+ */
+trace_event_t *
+trace_buffer_get(trace_buffer_t *buffer, size_t index);
+
+
+/**
+ *  @brief Returns the name of an event kind.
+ */
+const char *
+trace_kind_name(trace_kind_t kind);
+
+
+/**
+ *  @brief Writes the events as Chrome trace JSON.
+ *
+ *  The output can be loaded in chrome://tracing or Perfetto. Spans
+ *  are written as B/E events and instants as i events, all for process
+ *  @p pid on thread 1.
+ *
+ *  @param  buffer the buffer
+ *  @param  out the stream to write to
+ *  @param  pid the process id written with the events
+ *  @return true if everything was written
+ */
+bool
+trace_export_chrome(trace_buffer_t *buffer, FILE *out, long pid);
+
+
+/**
+ *  @brief Writes the events as text, one line per event.
+ *
+ *  The lines look like the output of `perf script`:
+ *  @code
+ *  gc 1234 [000] 12.000345: gc:copy_begin: arg=0
+ *  @endcode
+ *
+ *  @param  buffer the buffer
+ *  @param  out the stream to write to
+ *  @param  pid the process id written with the events
+ *  @return true if everything was written
+ */
+bool
+trace_export_text(trace_buffer_t *buffer, FILE *out, long pid);
+
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "gc_trace.h"
+
+
+/*============================================================================
+ *                             RING BUFFER TESTING SUITE
+ *===========================================================================*/
+
+void
+test_trace_buffer_empty()
+{
+  trace_buffer_t *buffer = trace_buffer_create(4);
+  CU_ASSERT(buffer != NULL);
+  CU_ASSERT(trace_buffer_count(buffer) == 0);
+  CU_ASSERT(trace_buffer_get(buffer, 0) == NULL);
+  CU_ASSERT(trace_buffer_count(NULL) == 0);
+  trace_buffer_delete(buffer);
+}
+
+void
+test_trace_buffer_in_order()
+{
+  trace_buffer_t *buffer = trace_buffer_create(4);
+  trace_record(buffer, TRACE_GC, TRACE_BEGIN, 100, 1);
+  trace_record(buffer, TRACE_COPY, TRACE_BEGIN, 200, 2);
+  trace_record(buffer, TRACE_COPY, TRACE_END, 300, 3);
+
+  CU_ASSERT(trace_buffer_count(buffer) == 3);
+  CU_ASSERT(trace_buffer_get(buffer, 0)->time_ns == 100);
+  CU_ASSERT(trace_buffer_get(buffer, 1)->kind == TRACE_COPY);
+  CU_ASSERT(trace_buffer_get(buffer, 2)->phase == TRACE_END);
+  CU_ASSERT(trace_buffer_get(buffer, 2)->arg == 3);
+  CU_ASSERT(trace_buffer_get(buffer, 3) == NULL);
+  trace_buffer_delete(buffer);
+}
+
+void
+test_trace_buffer_overwrites_oldest()
+{
+  trace_buffer_t *buffer = trace_buffer_create(3);
+  for(uint64_t i = 0; i < 10; ++i)
+    {
+      trace_record(buffer, TRACE_ALLOC_SLOW, TRACE_INSTANT, i, i);
+    }
+  CU_ASSERT(trace_buffer_count(buffer) == 3);
+  CU_ASSERT(trace_buffer_get(buffer, 0)->time_ns == 7);
+  CU_ASSERT(trace_buffer_get(buffer, 1)->time_ns == 8);
+  CU_ASSERT(trace_buffer_get(buffer, 2)->time_ns == 9);
+  trace_buffer_delete(buffer);
+}
+
+
+/*============================================================================
+ *                             EXPORT TESTING SUITE
+ *===========================================================================*/
+
+/**
+ *  @brief Exports @p buffer to a temporary file and reads it back
+ */
+char *
+export_to_string(trace_buffer_t *buffer, bool chrome)
+{
+  FILE *file = tmpfile();
+  if(chrome)
+    {
+      CU_ASSERT(trace_export_chrome(buffer, file, 42));
+    }
+  else
+    {
+      CU_ASSERT(trace_export_text(buffer, file, 42));
+    }
+  long size = ftell(file);
+  rewind(file);
+  char *text = calloc(size + 1, 1);
+  CU_ASSERT(fread(text, 1, size, file) == (size_t) size);
+  fclose(file);
+  return text;
+}
+
+void
+test_trace_export_chrome()
+{
+  trace_buffer_t *buffer = trace_buffer_create(8);
+  trace_record(buffer, TRACE_GC, TRACE_BEGIN, 1500, 0);
+  trace_record(buffer, TRACE_ALLOC_SLOW, TRACE_INSTANT, 2000, 64);
+  trace_record(buffer, TRACE_GC, TRACE_END, 3000250, 128);
+
+  char *text = export_to_string(buffer, true);
+  CU_ASSERT(strncmp(text, "{\"traceEvents\":[", 16) == 0);
+  CU_ASSERT(strstr(text, "\"name\":\"gc\",\"cat\":\"gc\",\"ph\":\"B\",\"ts\":1.500,\"pid\":42") != NULL);
+  CU_ASSERT(strstr(text, "\"name\":\"alloc_slow\",\"cat\":\"gc\",\"ph\":\"i\"") != NULL);
+  CU_ASSERT(strstr(text, "\"ph\":\"E\",\"ts\":3000.250") != NULL);
+  CU_ASSERT(strstr(text, "\"args\":{\"arg\":128}") != NULL);
+  CU_ASSERT(strstr(text, "]") != NULL);
+  free(text);
+  trace_buffer_delete(buffer);
+}
+
+void
+test_trace_export_text()
+{
+  trace_buffer_t *buffer = trace_buffer_create(8);
+  trace_record(buffer, TRACE_COPY, TRACE_BEGIN, 12000345000ULL, 0);
+  trace_record(buffer, TRACE_COPY, TRACE_END, 12000346000ULL, 96);
+
+  char *text = export_to_string(buffer, false);
+  CU_ASSERT(strcmp(text,
+                   "gc 42 [000] 12.000345: gc:copy_begin: arg=0\n"
+                   "gc 42 [000] 12.000346: gc:copy_end: arg=96\n") == 0);
+  free(text);
+  trace_buffer_delete(buffer);
+}
+
+void
+test_trace_export_invalid()
+{
+  CU_ASSERT_FALSE(trace_export_chrome(NULL, stdout, 1));
+  CU_ASSERT_FALSE(trace_export_text(NULL, stdout, 1));
+  CU_ASSERT(strcmp(trace_kind_name(TRACE_PAGE_RESET), "page_reset") == 0);
+  CU_ASSERT(strcmp(trace_kind_name(TRACE_PIN), "pin") == 0);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_buffer = NULL;
+  CU_pSuite suite_export = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_buffer = CU_add_suite("Tests the trace ring buffer", NULL, NULL);
+  if (suite_buffer == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_buffer
+                            , "empty buffer"
+                            , test_trace_buffer_empty) )
+       || (NULL == CU_add_test(suite_buffer
+                               , "events in order"
+                               , test_trace_buffer_in_order) )
+       || (NULL == CU_add_test(suite_buffer
+                               , "oldest events overwritten"
+                               , test_trace_buffer_overwrites_oldest) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_export = CU_add_suite("Tests trace export", NULL, NULL);
+  if (suite_export == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_export
+                            , "Chrome trace JSON"
+                            , test_trace_export_chrome) )
+       || (NULL == CU_add_test(suite_export
+                               , "perf style text"
+                               , test_trace_export_text) )
+       || (NULL == CU_add_test(suite_export
+                               , "invalid arguments"
+                               , test_trace_export_invalid) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
@@ -25,6 +26,7 @@ enum internal_ht
     , I_HT_FORWARDING_ADDR
     , I_HT_FORMAT_STR
     , I_HT_BIT_VECTOR
+    , I_HT_ARRAY
   };
 
 typedef enum internal_ht internal_ht;
@@ -148,6 +150,15 @@ format_str_contains_ptrs(char *form_str)
 #define BV_SMALL 2
 #define BV_LARGE 4
 
+// An array header is a bit vector header with ARRAY_FLAG set. The element
+// layout is a bit vector in the 48 highest bits and the element count is
+// kept in the 12 bits below it:
+//   [ element bit vector (48) | count (12) | 1 | found | 1 1 ]
+#define ARRAY_FLAG 8UL
+#define ARRAY_COUNT_SHIFT 4UL
+#define ARRAY_COUNT_MASK 0xFFFUL
+#define ARRAY_LAYOUT_MASK (~0xFFFFUL)
+
 size_t
 get_size_of_bit_type(unsigned long bits)
 {
@@ -158,6 +169,29 @@ get_size_of_bit_type(unsigned long bits)
   else return -1;
 }
 
+/**
+ *  @brief Gets the size of the data described by a bit vector
+ *
+ *  @param  bit_vector the bit vector, highest bits first
+ *  @return the size in bytes of the data, header not included
+ */
+size_t
+bit_vector_data_size(unsigned long bit_vector)
+{
+  unsigned long current_type;
+  size_t size = 0;
+  
+  do
+    {
+      current_type = bit_vector >> 62;
+      size += get_size_of_bit_type(current_type);
+      bit_vector = bit_vector << 2;
+    }
+  while(current_type != BV_STOP);
+
+  return size;
+}
+
 size_t
 get_bits_needed(char c)
 {
@@ -288,6 +322,38 @@ create_struct_header(heap_t *h, char *form_str, void *ptr)
     }
 }
 
+/**
+ *  @brief Creates the element bit vector of an array header
+ *
+ *  @param  element_layout format string of one element
+ *  @return the bit vector placed in the highest 48 bits, or 0 if
+ *          @p element_layout is invalid or too long for an array header
+ */
+unsigned long
+array_layout_create(char *element_layout)
+{
+  if(get_struct_size(element_layout) == INVALID) return 0;
+  unsigned long bit_vector = (unsigned long) bit_vector_create(element_layout);
+  if((bit_vector & ~ARRAY_LAYOUT_MASK) != 0) return 0;
+  return bit_vector;
+}
+
+
+void *
+create_array_header(char *element_layout, size_t count, void *ptr)
+{
+  if(element_layout == NULL || ptr == NULL) return NULL;
+  if(count == 0 || count > ARRAY_COUNT_MASK) return NULL;
+
+  unsigned long layout = array_layout_create(element_layout);
+  if(layout == 0) return NULL;
+
+  unsigned long *ptr_to_header = (unsigned long *) ptr;
+  *ptr_to_header = layout | (count << ARRAY_COUNT_SHIFT) | ARRAY_FLAG;
+  set_type_bits(ptr_to_header, I_HT_ARRAY);
+  return data_from_header(ptr);
+}
+
 /*============================================================================
  *                             TYPE FUNCTIONS
  *===========================================================================*/
@@ -310,6 +376,7 @@ get_internal_ht(void *data)
   unsigned long type_bits = header & 3UL;
   
   if(type_bits == B_FORMAT_STR) return I_HT_FORMAT_STR;
+  else if(type_bits == B_BIT_VECTOR && (header & ARRAY_FLAG)) return I_HT_ARRAY;
   else if(type_bits == B_BIT_VECTOR) return I_HT_BIT_VECTOR;
   else if(type_bits == B_RAW_DATA) return I_HT_RAW_DATA;
   else return I_HT_FORWARDING_ADDR;
@@ -319,7 +386,8 @@ header_type
 get_header_type(void *data)
 {
   internal_ht i_type = get_internal_ht(data);
-  if(i_type == I_HT_FORMAT_STR || i_type == I_HT_BIT_VECTOR) return STRUCT_REP;
+  if(i_type == I_HT_FORMAT_STR || i_type == I_HT_BIT_VECTOR
+     || i_type == I_HT_ARRAY) return STRUCT_REP;
   else if(i_type == I_HT_RAW_DATA) return RAW_DATA;
   else if(i_type == I_HT_FORWARDING_ADDR) return FORWARDING_ADDR;
   else return NOTHING;
@@ -407,19 +475,43 @@ size_t
 get_bit_vector_size(void *structure)
 {
   unsigned long bit_vector = *(unsigned long *) header_from_data(structure);
-  unsigned long current_type;
-  size_t size = 0;
-  
-  do
-    {
-      current_type = bit_vector >> 62;
-      size += get_size_of_bit_type(current_type);
-      bit_vector = bit_vector << 2;
-    }
-  while(current_type != BV_STOP);
+  return bit_vector_data_size(bit_vector) + HEADER_SIZE;
+}
 
-  return size + HEADER_SIZE;
+/** Get the element count of an existing array */
+size_t
+get_array_count(void *array)
+{
+  unsigned long header = *(unsigned long *) header_from_data(array);
+  return (header >> ARRAY_COUNT_SHIFT) & ARRAY_COUNT_MASK;
 }
+
+/** Get the element size of an existing array */
+size_t
+get_array_element_size(void *array)
+{
+  unsigned long header = *(unsigned long *) header_from_data(array);
+  return bit_vector_data_size(header & ARRAY_LAYOUT_MASK);
+}
+
+size_t
+get_array_size(char *element_layout, size_t count)
+{
+  if(element_layout == NULL) return INVALID;
+  if(count == 0 || count > ARRAY_COUNT_MASK) return INVALID;
+
+  unsigned long layout = array_layout_create(element_layout);
+  if(layout == 0) return INVALID;
+  return bit_vector_data_size(layout) * count + HEADER_SIZE;
+}
+
+size_t
+get_array_length(void *array)
+{
+  if(get_internal_ht(array) != I_HT_ARRAY) return 0;
+  return get_array_count(array);
+}
+
 size_t
 get_existing_size(void *ptr)
 {
@@ -430,6 +522,7 @@ get_existing_size(void *ptr)
   else if(type == I_HT_RAW_DATA) return get_raw_data_size(ptr);
   else if(type == I_HT_FORMAT_STR) return get_format_str_size(ptr);
   else if(type == I_HT_BIT_VECTOR) return get_bit_vector_size(ptr);
+  else if(type == I_HT_ARRAY) return get_array_element_size(ptr) * get_array_count(ptr) + HEADER_SIZE;
   return INVALID;
 }
 
@@ -497,7 +590,12 @@ get_number_of_pointers_in_struct(void *structure)
 
   void **header_ptr = header_from_data(structure);
 
-  if(get_internal_ht(structure) == I_HT_BIT_VECTOR)
+  if(get_internal_ht(structure) == I_HT_ARRAY)
+    {
+      unsigned long layout = *(unsigned long *) header_ptr & ARRAY_LAYOUT_MASK;
+      return get_number_of_pointers_in_bit_vector((void *) layout) * get_array_count(structure);
+    }
+  else if(get_internal_ht(structure) == I_HT_BIT_VECTOR)
     {
       return get_number_of_pointers_in_bit_vector(*header_ptr);
     }
@@ -578,14 +676,21 @@ get_pointers_from_format_string(void *structure, void **array[])
   return true;
 }
 
-bool
-get_pointers_from_bit_vector(void *structure, void **array[])
+/**
+ *  @brief Places pointers to the pointers in data described by a bit vector
+ *         in @p array
+ *
+ *  @param  bit_vector the bit vector describing @p data
+ *  @param  data the data to find pointers in
+ *  @param  array the array to place the found pointers in
+ *  @return the number of pointers placed in @p array
+ */
+size_t
+pointers_from_bit_vector(unsigned long bit_vector, void *data, void **array[])
 {
-  unsigned long bit_vector = *(unsigned long *) header_from_data(structure);
   size_t array_index = 0;
-  void *current_data = structure;
+  void *current_data = data;
   unsigned long current_type;
-  bool success = false;
   
   do
     {
@@ -594,7 +699,6 @@ get_pointers_from_bit_vector(void *structure, void **array[])
         {
           array[array_index] = current_data;
           ++array_index;
-          success = true;
         }
       bit_vector = bit_vector << 2;
       size_t offset = get_size_of_bit_type(current_type);
@@ -602,7 +706,42 @@ get_pointers_from_bit_vector(void *structure, void **array[])
     }
   while(current_type != BV_STOP);
 
-  return success;
+  return array_index;
+}
+
+bool
+get_pointers_from_bit_vector(void *structure, void **array[])
+{
+  unsigned long bit_vector = *(unsigned long *) header_from_data(structure);
+  return pointers_from_bit_vector(bit_vector, structure, array) > 0;
+}
+
+bool
+get_pointers_from_array(void *structure, void **array[])
+{
+  unsigned long header = *(unsigned long *) header_from_data(structure);
+  unsigned long layout = header & ARRAY_LAYOUT_MASK;
+  size_t count = get_array_count(structure);
+
+  if(layout == BV_PTR << 62)
+    {
+      void **element = structure;
+      for(size_t i = 0; i < count; ++i)
+        {
+          array[i] = &element[i];
+        }
+      return true;
+    }
+
+  size_t element_size = bit_vector_data_size(layout);
+  size_t array_index = 0;
+  char *element = structure;
+  for(size_t i = 0; i < count; ++i)
+    {
+      array_index += pointers_from_bit_vector(layout, element, &array[array_index]);
+      element += element_size;
+    }
+  return array_index > 0;
 }
 
 bool
@@ -612,7 +751,11 @@ get_pointers_in_struct(void *structure, void **array[])
   if(get_header_type(structure) != STRUCT_REP) return false;
   if(get_number_of_pointers_in_struct(structure) < 1) return false;
 
-  if(get_internal_ht(structure) == I_HT_BIT_VECTOR)
+  if(get_internal_ht(structure) == I_HT_ARRAY)
+    {
+      return get_pointers_from_array(structure, array);
+    }
+  else if(get_internal_ht(structure) == I_HT_BIT_VECTOR)
     {
       return get_pointers_from_bit_vector(structure, array);
     }
@@ -623,6 +766,119 @@ get_pointers_in_struct(void *structure, void **array[])
 }
 
 
+/*============================================================================
+ *                             RESIZE FUNCTIONS
+ *===========================================================================*/
+
+bool
+resize_header(void *data, size_t bytes)
+{
+  if(data == NULL || bytes == 0) return false;
+
+  unsigned long *header = header_from_data(data);
+  internal_ht type = get_internal_ht(data);
+  if(type == I_HT_RAW_DATA)
+    {
+      if(get_data_size(bytes) == INVALID) return false;
+      *header = bytes << 2UL;
+      set_type_bits(header, I_HT_RAW_DATA);
+      return true;
+    }
+  else if(type == I_HT_ARRAY)
+    {
+      size_t element_size = get_array_element_size(data);
+      if(bytes % element_size != 0) return false;
+      size_t count = bytes / element_size;
+      if(count > ARRAY_COUNT_MASK) return false;
+      *header &= ~(ARRAY_COUNT_MASK << ARRAY_COUNT_SHIFT);
+      *header |= count << ARRAY_COUNT_SHIFT;
+      return true;
+    }
+  return false;
+}
+
+
+/*============================================================================
+ *                             LAYOUT FUNCTIONS
+ *===========================================================================*/
+
+/**
+ *  @brief Writes a bit vector as a format string
+ *
+ *  Runs of the same type are written with a count, "***ii" becomes
+ *  "3*2i". Longs and doubles are stored as two ints and come back as "2i".
+ *
+ *  @param  bit_vector the bit vector, highest bits first
+ *  @param  buffer where the format string is written
+ *  @param  size the size of @p buffer
+ *  @return the length of the whole format string
+ */
+size_t
+bit_vector_layout(unsigned long bit_vector, char *buffer, size_t size)
+{
+  size_t length = 0;
+  unsigned long current_type = bit_vector >> 62;
+  while(current_type != BV_STOP)
+    {
+      size_t run = 0;
+      unsigned long run_type = current_type;
+      while(current_type == run_type)
+        {
+          ++run;
+          bit_vector = bit_vector << 2;
+          current_type = bit_vector >> 62;
+        }
+
+      char c = run_type == BV_PTR ? PTR : run_type == BV_INT ? INT : CHAR;
+      char part[24];
+      int part_length = run > 1 ? snprintf(part, sizeof(part), "%zu%c", run, c)
+        : snprintf(part, sizeof(part), "%c", c);
+      for(int i = 0; i < part_length; ++i, ++length)
+        {
+          if(length + 1 < size) buffer[length] = part[i];
+        }
+    }
+  if(size > 0) buffer[length < size ? length : size - 1] = '\0';
+  return length;
+}
+
+size_t
+get_layout(void *data, char *buffer, size_t size)
+{
+  if(buffer != NULL && size > 0) buffer[0] = '\0';
+  if(data == NULL || buffer == NULL) return 0;
+
+  internal_ht type = get_internal_ht(data);
+  unsigned long header = *(unsigned long *) header_from_data(data);
+  if(type == I_HT_FORMAT_STR)
+    {
+      char *format_str = format_str_ptr_from_data(data);
+      size_t length = strlen(format_str);
+      if(size > 0) snprintf(buffer, size, "%s", format_str);
+      return length;
+    }
+  else if(type == I_HT_BIT_VECTOR)
+    {
+      return bit_vector_layout(header, buffer, size);
+    }
+  else if(type == I_HT_ARRAY)
+    {
+      return bit_vector_layout(header & ARRAY_LAYOUT_MASK, buffer, size);
+    }
+  return 0;
+}
+
+enum h_layout_kind
+get_layout_kind(void *data)
+{
+  internal_ht type = get_internal_ht(data);
+  if(type == I_HT_FORMAT_STR) return H_LAYOUT_FORMAT_STRING;
+  else if(type == I_HT_BIT_VECTOR) return H_LAYOUT_BIT_VECTOR;
+  else if(type == I_HT_ARRAY) return H_LAYOUT_ARRAY;
+  else return H_LAYOUT_RAW;
+}
+
+
 /*============================================================================
  *                             Forwarding and copying
  *===========================================================================*/
@@ -65,6 +65,23 @@ void *create_struct_header(heap_t *h, char *format_string, void *heap_ptr);
  */
 void *create_data_header(size_t bytes, void *heap_ptr);
 
+/**
+ *  @brief Creates an array header and saves it on the heap
+ *
+ *  The header holds both the layout of one element and the number of
+ *  elements, so no format string has to be stored on the heap no matter
+ *  how many elements there are. The header type of the array is STRUCT_REP.
+ *
+ *  @param  element_layout the format string of one element, it has to fit
+ *          in 24 two-bit types ('l' and 'd' count as two)
+ *  @param  count the number of elements, at most 4095
+ *  @param  heap_ptr the place on the heap where the header will be saved
+ *  @return pointer to where the first element should be placed
+ *          NULL if @p element_layout is invalid or too long, @p count is
+ *          out of range or @p heap_ptr is NULL
+ */
+void *create_array_header(char *element_layout, size_t count, void *heap_ptr);
+
 /**
  *  @brief Gets the type of header belonging to the data.
  *
@@ -115,6 +132,25 @@ bool get_pointers_in_struct(void *structure, void **array[]);
  */
 size_t get_struct_size(char *format_string);
 
+/**
+ *  @brief Calculates the size needed to store an array of @p count elements
+ *         of @p element_layout, including a header.
+ *
+ *  @param  element_layout the format string of one element
+ *  @param  count the number of elements
+ *  @return the size needed for the array, 0 if the array cannot be
+ *          described by an array header
+ */
+size_t get_array_size(char *element_layout, size_t count);
+
+/**
+ *  @brief Get the number of elements of an array
+ *
+ *  @param  array pointer to the first element of the array
+ *  @return the number of elements, 0 if @p array doesn't have an array header
+ */
+size_t get_array_length(void *array);
+
 /**
  *  @brief Calculates the size needed to store data of size @p bytes
  *  with a header.
@@ -147,6 +183,44 @@ size_t get_existing_size(void *data);
  */
 size_t get_existing_data_size(void *data);
 
+/**
+ *  @brief Changes a header to describe @p bytes of data
+ *
+ *  Only headers of raw data and arrays can be resized. For arrays @p bytes
+ *  has to be a multiple of the element size and the element count is
+ *  changed. The data itself is not touched.
+ *
+ *  @param  data pointer to the data whose header is changed
+ *  @param  bytes the new size of the data, header not included
+ *  @return true if the header was changed, false if it cannot describe
+ *          @p bytes of data
+ */
+bool resize_header(void *data, size_t bytes);
+
+/**
+ *  @brief Writes the layout of existing data as a format string
+ *
+ *  Structs described by a format string get that string back. Structs
+ *  stored as bit vectors get an equivalent format string where longs
+ *  and doubles show up as two ints. Arrays get the layout of one
+ *  element. Raw data has no layout and gives an empty string.
+ *
+ *  @param  data pointer to the data
+ *  @param  buffer where the format string is written, truncated to fit
+ *  @param  size the size of @p buffer
+ *  @return the length of the whole format string, like snprintf
+ */
+size_t get_layout(void *data, char *buffer, size_t size);
+
+/**
+ *  @brief Gets how the header of existing data describes its layout
+ *
+ *  @param  data pointer to the data
+ *  @return H_LAYOUT_RAW, H_LAYOUT_BIT_VECTOR, H_LAYOUT_FORMAT_STRING
+ *          or H_LAYOUT_ARRAY, H_LAYOUT_RAW for anything else
+ */
+enum h_layout_kind get_layout_kind(void *data);
+
 /**
  *  @brief Creates a copy of a header and saves the copy on the heap
  *
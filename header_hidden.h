@@ -4,6 +4,9 @@
 int
 additional_if_format_str(void *data);
 
+void *
+bit_vector_create(char *format_str);
+
 #define HEADER_SIZE 8
 #define INVALID 0
 #define PTR_SIZE sizeof(void *)
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <string.h>
 #include "CUnit/Basic.h"
 #include "header.h"
 #include "header_hidden.h"
@@ -1264,6 +1265,148 @@ test_get_forwarding_address_forward()
 /*============================================================================
  *                             MAIN TESTING UNIT
  *===========================================================================*/
+/*============================================================================
+ *                             TESTS FOR array headers
+ *===========================================================================*/
+
+void
+test_create_array_header_invalid()
+{
+  size_t header[4];
+  CU_ASSERT(create_array_header(NULL, 1, header) == NULL);
+  CU_ASSERT(create_array_header("*", 1, NULL) == NULL);
+  CU_ASSERT(create_array_header("*", 0, header) == NULL);
+  CU_ASSERT(create_array_header("*", 4096, header) == NULL);
+  CU_ASSERT(create_array_header("x", 1, header) == NULL);
+  CU_ASSERT(create_array_header("25*", 1, header) == NULL);
+  CU_ASSERT(get_array_size("25*", 1) == INVALID);
+  CU_ASSERT(get_array_size("*", 0) == INVALID);
+}
+
+void
+test_create_array_header_ptr_array()
+{
+  void *ptr = calloc(1, get_array_size("*", 500));
+  CU_ASSERT(get_array_size("*", 500) == 500 * PTR_SIZE + HEADER_SIZE);
+  void *data = create_array_header("*", 500, ptr);
+  CU_ASSERT(data == (char *)ptr + HEADER_SIZE);
+  CU_ASSERT(get_header_type(data) == STRUCT_REP);
+  CU_ASSERT(get_array_length(data) == 500);
+  CU_ASSERT(get_existing_size(data) == 500 * PTR_SIZE + HEADER_SIZE);
+  CU_ASSERT(get_number_of_pointers_in_struct(data) == 500);
+
+  void **array[500];
+  CU_ASSERT_TRUE(get_pointers_in_struct(data, array));
+  for(int i = 0; i < 500; ++i)
+    {
+      CU_ASSERT(array[i] == (void **)data + i);
+    }
+  free(ptr);
+}
+
+void
+test_create_array_header_struct_array()
+{
+  size_t size = get_array_size("i*c", 3);
+  CU_ASSERT(size == 3 * (INT_SIZE + PTR_SIZE + CHAR_SIZE) + HEADER_SIZE);
+  void *ptr = calloc(1, size);
+  char *data = create_array_header("i*c", 3, ptr);
+  CU_ASSERT(get_array_length(data) == 3);
+  CU_ASSERT(get_number_of_pointers_in_struct(data) == 3);
+
+  void **array[3];
+  CU_ASSERT_TRUE(get_pointers_in_struct(data, array));
+  for(int i = 0; i < 3; ++i)
+    {
+      CU_ASSERT((char *)array[i] == data + i * 13 + INT_SIZE);
+    }
+  free(ptr);
+}
+
+void
+test_create_array_header_found_status()
+{
+  void *ptr = calloc(1, get_array_size("*", 7));
+  void *data = create_array_header("*", 7, ptr);
+  CU_ASSERT_FALSE(header_ptr_already_found(data));
+  CU_ASSERT_TRUE(header_set_ptr_to_found(data));
+  CU_ASSERT_TRUE(header_ptr_already_found(data));
+  CU_ASSERT(get_array_length(data) == 7);
+  CU_ASSERT(get_existing_size(data) == 7 * PTR_SIZE + HEADER_SIZE);
+  CU_ASSERT_TRUE(header_set_ptr_to_not_found(data));
+  CU_ASSERT_FALSE(header_ptr_already_found(data));
+  free(ptr);
+}
+
+void
+test_get_array_length_not_array()
+{
+  void *ptr = calloc(1, get_struct_size("**"));
+  void *data = create_struct_header(NULL, "**", ptr);
+  CU_ASSERT(get_array_length(data) == 0);
+  CU_ASSERT(get_array_length(NULL) == 0);
+  free(ptr);
+}
+
+void
+test_resize_header()
+{
+  size_t header[4];
+  void *data = create_data_header(12, header);
+  CU_ASSERT(resize_header(data, 100));
+  CU_ASSERT(get_existing_size(data) == 100 + HEADER_SIZE);
+  CU_ASSERT_FALSE(resize_header(data, 0));
+
+  data = create_array_header("ii", 3, header);
+  CU_ASSERT(resize_header(data, 10 * 8));
+  CU_ASSERT(get_array_length(data) == 10);
+  CU_ASSERT(get_existing_size(data) == 10 * 8 + HEADER_SIZE);
+  CU_ASSERT_FALSE(resize_header(data, 12));
+  CU_ASSERT_FALSE(resize_header(data, 4096 * 8));
+  CU_ASSERT(get_array_length(data) == 10);
+
+  data = create_struct_header(NULL, "**", header);
+  CU_ASSERT_FALSE(resize_header(data, 24));
+  CU_ASSERT_FALSE(resize_header(NULL, 24));
+}
+
+void
+test_get_layout()
+{
+  size_t header[8];
+  char layout[32];
+
+  void *data = create_struct_header(NULL, "**i", header);
+  CU_ASSERT(get_layout(data, layout, sizeof(layout)) == 3);
+  CU_ASSERT(strcmp(layout, "2*i") == 0);
+
+  data = create_struct_header(NULL, "*cc", header);
+  get_layout(data, layout, sizeof(layout));
+  CU_ASSERT(strcmp(layout, "*2c") == 0);
+
+  data = create_array_header("i*", 3, header);
+  get_layout(data, layout, sizeof(layout));
+  CU_ASSERT(strcmp(layout, "i*") == 0);
+
+  data = create_data_header(12, header);
+  CU_ASSERT(get_layout(data, layout, sizeof(layout)) == 0);
+  CU_ASSERT(strcmp(layout, "") == 0);
+
+  data = create_struct_header(NULL, "*", header);
+  CU_ASSERT(get_layout(data, layout, 1) == 1);
+  CU_ASSERT(strcmp(layout, "") == 0);
+  CU_ASSERT(get_layout(NULL, layout, sizeof(layout)) == 0);
+
+  heap_t *h = h_init(SMALLEST_HEAP_SIZE, SAFE_STACK, 0.75);
+  void *ptr = calloc(1, get_struct_size("40*"));
+  data = create_struct_header(h, "40*", ptr);
+  CU_ASSERT(get_layout(data, layout, sizeof(layout)) == 3);
+  CU_ASSERT(strcmp(layout, "40*") == 0);
+  free(ptr);
+  h_delete(h);
+}
+
+
 int
 main(void)
 {
@@ -1278,6 +1421,7 @@ main(void)
   CU_pSuite suite_copy_header = NULL;
   CU_pSuite suite_forward_header = NULL;
   CU_pSuite suite_get_forwarding_address = NULL;
+  CU_pSuite suite_array_header = NULL;
 
 
   if (CU_initialize_registry() != CUE_SUCCESS)
@@ -1777,6 +1921,41 @@ main(void)
       return CU_get_error();
     }
   
+  // ********************* array header SUITE ******************  //
+  suite_array_header = CU_add_suite("Tests array headers"
+                                    , NULL, NULL);
+  if (suite_array_header == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_array_header
+                            , "Invalid arrays"
+                            , test_create_array_header_invalid) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Pointer array"
+                               , test_create_array_header_ptr_array) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Struct array"
+                               , test_create_array_header_struct_array) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Found status"
+                               , test_create_array_header_found_status) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Length of non array"
+                               , test_get_array_length_not_array) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Resize headers"
+                               , test_resize_header) )
+       || (NULL == CU_add_test(suite_array_header
+                               , "Layouts"
+                               , test_get_layout) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+  
   // ******************** RUN TESTS ***************** //
   //CU_basic_set_mode(CU_BRM_VERBOSE);
   CU_basic_run_tests();
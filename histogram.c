@@ -0,0 +1,93 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "histogram.h"
+
+
+void
+histogram_clear(histogram_t *histogram)
+{
+  assert(histogram != NULL);
+  memset(histogram, 0, sizeof(histogram_t));
+}
+
+
+size_t
+histogram_bucket_index(uint64_t value)
+{
+  if(value > HISTOGRAM_MAX_VALUE) value = HISTOGRAM_MAX_VALUE;
+  if(value < 2 * HISTOGRAM_SUB_BUCKETS) return (size_t) value;
+
+  size_t top_bit = 0;
+  while((value >> (top_bit + 1)) != 0)
+    {
+      ++top_bit;
+    }
+  // The top HISTOGRAM_SUB_BUCKET_BITS + 1 bits pick the bucket
+  size_t shift = top_bit - HISTOGRAM_SUB_BUCKET_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS
+    + (size_t) (value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+
+uint64_t
+histogram_bucket_max(size_t index)
+{
+  assert(index < HISTOGRAM_BUCKETS);
+  if(index < 2 * HISTOGRAM_SUB_BUCKETS) return index;
+
+  size_t shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  uint64_t lowest = (uint64_t) (index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+  return lowest + (1ULL << shift) - 1;
+}
+
+
+void
+histogram_record(histogram_t *histogram, uint64_t value)
+{
+  assert(histogram != NULL);
+  if(value > HISTOGRAM_MAX_VALUE) value = HISTOGRAM_MAX_VALUE;
+
+  if(histogram->count == 0 || value < histogram->min) histogram->min = value;
+  if(value > histogram->max) histogram->max = value;
+  histogram->count += 1;
+  histogram->sum += value;
+  histogram->buckets[histogram_bucket_index(value)] += 1;
+}
+
+
+uint64_t
+histogram_percentile(histogram_t *histogram, double percentile)
+{
+  assert(histogram != NULL);
+  if(histogram->count == 0) return 0;
+  if(percentile < 0.0) percentile = 0.0;
+  if(percentile > 100.0) percentile = 100.0;
+
+  uint64_t wanted = (uint64_t) (percentile / 100.0 * (double) histogram->count + 0.5);
+  if(wanted == 0) wanted = 1;
+
+  uint64_t seen = 0;
+  for(size_t i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+      seen += histogram->buckets[i];
+      if(seen >= wanted)
+        {
+          uint64_t value = histogram_bucket_max(i);
+          return value < histogram->max ? value : histogram->max;
+        }
+    }
+  return histogram->max;
+}
+
+
+uint64_t
+histogram_mean(histogram_t *histogram)
+{
+  assert(histogram != NULL);
+  if(histogram->count == 0) return 0;
+  return histogram->sum / histogram->count;
+}
@@ -0,0 +1,95 @@
+/**
+ *  @file  histogram.h
+ *  @brief A fixed size histogram of durations with bounded relative error.
+ *
+ *  Values are counted in buckets in the style of HdrHistogram: every
+ *  power of two is split into HISTOGRAM_SUB_BUCKETS equally wide
+ *  buckets, so a value is never reported more than about 3% off no
+ *  matter how large it is. Values below 2 * HISTOGRAM_SUB_BUCKETS are
+ *  counted exactly and values above HISTOGRAM_MAX_VALUE are counted as
+ *  HISTOGRAM_MAX_VALUE.
+ */
+
+#ifndef __histogram__
+#define __histogram__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+#define HISTOGRAM_SUB_BUCKET_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1U << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_MAX_VALUE ((1ULL << HISTOGRAM_MAX_BITS) - 1)
+#define HISTOGRAM_BUCKETS                                               \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+
+typedef struct histogram histogram_t;
+
+struct histogram
+{
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+
+/**
+ *  @brief Empties a histogram.
+ *
+ *  @param  histogram the histogram
+ */
+void
+histogram_clear(histogram_t *histogram);
+
+
+/**
+ *  @brief Counts one value.
+ *
+ *  @param  histogram the histogram
+ *  @param  value the value, larger values than HISTOGRAM_MAX_VALUE are clamped
+ */
+void
+histogram_record(histogram_t *histogram, uint64_t value);
+
+
+/**
+ *  @brief Returns the value at a percentile.
+ *
+ *  The result is the largest value in the bucket where the percentile
+ *  is reached, but never more than the largest value recorded.
+ *
+ *  @param  histogram the histogram
+ *  @param  percentile the percentile, 0.0 to 100.0
+ *  @return the value at @p percentile or 0 if the histogram is empty
+ */
+uint64_t
+histogram_percentile(histogram_t *histogram, double percentile);
+
+
+/**
+ *  @brief Returns the mean of all values, 0 if the histogram is empty.
+ */
+uint64_t
+histogram_mean(histogram_t *histogram);
+
+
+/**
+ *  @brief Returns the index of the bucket that counts @p value.
+ */
+size_t
+histogram_bucket_index(uint64_t value);
+
+
+/**
+ *  @brief Returns the largest value counted in bucket @p index.
+ */
+uint64_t
+histogram_bucket_max(size_t index);
+
+
+#endif
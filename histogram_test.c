@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "histogram.h"
+
+
+/*============================================================================
+ *                             BUCKET TESTING SUITE
+ *===========================================================================*/
+
+void
+test_histogram_small_values_exact()
+{
+  for(uint64_t value = 0; value < 2 * HISTOGRAM_SUB_BUCKETS; ++value)
+    {
+      CU_ASSERT(histogram_bucket_index(value) == value);
+      CU_ASSERT(histogram_bucket_max(value) == value);
+    }
+}
+
+void
+test_histogram_buckets_contiguous()
+{
+  size_t previous = histogram_bucket_index(0);
+  for(uint64_t value = 1; value < 1 << 12; ++value)
+    {
+      size_t index = histogram_bucket_index(value);
+      CU_ASSERT(index == previous || index == previous + 1);
+      CU_ASSERT(value <= histogram_bucket_max(index));
+      previous = index;
+    }
+  CU_ASSERT(histogram_bucket_index(HISTOGRAM_MAX_VALUE) == HISTOGRAM_BUCKETS - 1);
+  CU_ASSERT(histogram_bucket_index(UINT64_MAX) == HISTOGRAM_BUCKETS - 1);
+  CU_ASSERT(histogram_bucket_max(HISTOGRAM_BUCKETS - 1) == HISTOGRAM_MAX_VALUE);
+}
+
+void
+test_histogram_relative_error()
+{
+  for(uint64_t value = 64; value < HISTOGRAM_MAX_VALUE; value = value * 3 + 7)
+    {
+      uint64_t reported = histogram_bucket_max(histogram_bucket_index(value));
+      CU_ASSERT(reported >= value);
+      CU_ASSERT(reported - value <= value / HISTOGRAM_SUB_BUCKETS);
+    }
+}
+
+
+/*============================================================================
+ *                             PERCENTILE TESTING SUITE
+ *===========================================================================*/
+
+void
+test_histogram_empty()
+{
+  histogram_t *histogram = malloc(sizeof(histogram_t));
+  histogram_clear(histogram);
+  CU_ASSERT(histogram->count == 0);
+  CU_ASSERT(histogram_percentile(histogram, 99.0) == 0);
+  CU_ASSERT(histogram_mean(histogram) == 0);
+  free(histogram);
+}
+
+void
+test_histogram_percentiles()
+{
+  histogram_t *histogram = malloc(sizeof(histogram_t));
+  histogram_clear(histogram);
+  for(uint64_t value = 1; value <= 1000; ++value)
+    {
+      histogram_record(histogram, value * 1000);
+    }
+
+  CU_ASSERT(histogram->count == 1000);
+  CU_ASSERT(histogram->min == 1000);
+  CU_ASSERT(histogram->max == 1000000);
+  CU_ASSERT(histogram_mean(histogram) == 500500);
+
+  uint64_t p50 = histogram_percentile(histogram, 50.0);
+  uint64_t p99 = histogram_percentile(histogram, 99.0);
+  uint64_t p999 = histogram_percentile(histogram, 99.9);
+  CU_ASSERT(p50 >= 500000 && p50 <= 500000 + 500000 / HISTOGRAM_SUB_BUCKETS);
+  CU_ASSERT(p99 >= 990000 && p99 <= 1000000);
+  CU_ASSERT(p999 >= 999000 && p999 <= 1000000);
+  CU_ASSERT(histogram_percentile(histogram, 100.0) == 1000000);
+  CU_ASSERT(histogram_percentile(histogram, 0.0) <= 1000 + 1000 / HISTOGRAM_SUB_BUCKETS);
+  free(histogram);
+}
+
+void
+test_histogram_tail()
+{
+  histogram_t *histogram = malloc(sizeof(histogram_t));
+  histogram_clear(histogram);
+  for(int i = 0; i < 999; ++i)
+    {
+      histogram_record(histogram, 100);
+    }
+  histogram_record(histogram, 50000000);
+
+  CU_ASSERT(histogram_percentile(histogram, 99.0) <= 100 + 100 / HISTOGRAM_SUB_BUCKETS);
+  CU_ASSERT(histogram_percentile(histogram, 99.95) == 50000000);
+  free(histogram);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_buckets = NULL;
+  CU_pSuite suite_percentiles = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_buckets = CU_add_suite("Tests histogram buckets", NULL, NULL);
+  if (suite_buckets == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_buckets
+                            , "small values are exact"
+                            , test_histogram_small_values_exact) )
+       || (NULL == CU_add_test(suite_buckets
+                               , "buckets are contiguous"
+                               , test_histogram_buckets_contiguous) )
+       || (NULL == CU_add_test(suite_buckets
+                               , "bounded relative error"
+                               , test_histogram_relative_error) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_percentiles = CU_add_suite("Tests histogram percentiles", NULL, NULL);
+  if (suite_percentiles == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_percentiles
+                            , "empty histogram"
+                            , test_histogram_empty) )
+       || (NULL == CU_add_test(suite_percentiles
+                               , "uniform values"
+                               , test_histogram_percentiles) )
+       || (NULL == CU_add_test(suite_percentiles
+                               , "one slow value"
+                               , test_histogram_tail) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
@@ -0,0 +1,62 @@
+/// The allocator and helpers shared by the benchmark programs.
+
+#define _DEFAULT_SOURCE // clock_gettime
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "../../gc.h"
+#include "bench.h"
+
+
+/*============================================================================
+ *                             ALLOCATOR
+ *===========================================================================*/
+
+void *
+bench_alloc_struct(allocator_t *allocator, char *layout, size_t bytes)
+{
+  if(allocator->h != NULL) return h_alloc_struct(allocator->h, layout);
+  return malloc(bytes);
+}
+
+void *
+bench_alloc_data(allocator_t *allocator, size_t bytes)
+{
+  if(allocator->h != NULL) return h_alloc_data(allocator->h, bytes);
+  return malloc(bytes);
+}
+
+void **
+bench_alloc_ptr_array(allocator_t *allocator, size_t count)
+{
+  if(allocator->h != NULL) return h_alloc_ptr_array(allocator->h, count);
+  return calloc(count, sizeof(void *));
+}
+
+void
+bench_free(allocator_t *allocator, void *ptr)
+{
+  if(allocator->h == NULL) free(ptr);
+}
+
+uint64_t
+bench_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+double
+bench_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
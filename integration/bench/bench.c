@@ -0,0 +1,261 @@
+/// Runs a matrix of allocation workloads with malloc/free and with the
+/// garbage collector at several heap sizes and gc thresholds, and writes
+/// one CSV line per run.
+///
+/// Every run is done in a child process so that the peak RSS of each run
+/// can be measured on its own. Options:
+///   --workload=NAME  only run one workload
+///   --scale=N        percent of the default number of operations
+///   --reps=N         repeat each configuration N times
+
+#define _DEFAULT_SOURCE // wait4
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../../gc.h"
+#include "bench.h"
+
+
+static const size_t heap_sizes[] = { 4UL << 20, 16UL << 20, 64UL << 20 };
+static const float thresholds[] = { 0.5f, 0.75f, 0.9f };
+
+#define Array_length(array) (sizeof(array) / sizeof(array[0]))
+
+
+/*============================================================================
+ *                             WORKLOADS
+ *===========================================================================*/
+
+typedef struct link link_t;
+
+struct link
+{
+  link_t *next;
+  int element;
+};
+
+/// Builds short lists and drops them, almost nothing survives a collection
+static bool
+workload_list(allocator_t *allocator, size_t ops)
+{
+  const size_t length = 1000;
+  long sum = 0;
+  for(size_t done = 0; done < ops; done += length)
+    {
+      link_t * volatile first = NULL;
+      for(size_t i = 0; i < length; ++i)
+        {
+          link_t *link = bench_alloc_struct(allocator, "*i", sizeof(link_t));
+          if(link == NULL) return false;
+          link->element = (int) i;
+          link->next = first;
+          first = link;
+        }
+
+      link_t *cursor = first;
+      while(cursor != NULL)
+        {
+          sum += cursor->element;
+          link_t *next = cursor->next;
+          bench_free(allocator, cursor);
+          cursor = next;
+        }
+    }
+  return sum > 0;
+}
+
+/// Keeps a window of live objects of mixed sizes and replaces a random
+/// one per operation, so a steady part of the heap survives collections
+static bool
+workload_window(allocator_t *allocator, size_t ops)
+{
+  const size_t chunks = 32;
+  const size_t chunk_length = 240;
+  uint64_t random = 88172645463325252ULL;
+
+  void ** volatile window = bench_alloc_ptr_array(allocator, chunks);
+  if(window == NULL) return false;
+  for(size_t i = 0; i < chunks; ++i)
+    {
+      window[i] = bench_alloc_ptr_array(allocator, chunk_length);
+      if(window[i] == NULL) return false;
+    }
+
+  for(size_t done = 0; done < ops; ++done)
+    {
+      uint64_t r = bench_random(&random);
+      size_t bytes = 16 + (r >> 32) % 113;
+      char *data = bench_alloc_data(allocator, bytes);
+      if(data == NULL) return false;
+      data[0] = (char) r;
+
+      void **chunk = window[r % chunks];
+      size_t slot = (r >> 8) % chunk_length;
+      bench_free(allocator, chunk[slot]);
+      chunk[slot] = data;
+    }
+
+  for(size_t i = 0; i < chunks; ++i)
+    {
+      void **chunk = window[i];
+      for(size_t slot = 0; slot < chunk_length; ++slot)
+        {
+          bench_free(allocator, chunk[slot]);
+        }
+      bench_free(allocator, chunk);
+    }
+  bench_free(allocator, window);
+  return true;
+}
+
+static const workload_t workloads[] =
+  {
+    { "list", 2000000, workload_list }
+    , { "window", 2000000, workload_window }
+  };
+
+
+/*============================================================================
+ *                             DRIVER
+ *===========================================================================*/
+
+typedef struct result result_t;
+
+struct result
+{
+  bool ok;
+  double seconds;
+  uint64_t collections;
+  uint64_t pause_total_ns;
+  uint64_t pause_max_ns;
+};
+
+/// Runs one configuration in this process, heap_bytes 0 means malloc
+static result_t
+run_here(const workload_t *workload, size_t ops, size_t heap_bytes, float threshold)
+{
+  result_t result;
+  memset(&result, 0, sizeof(result));
+
+  allocator_t allocator = { NULL };
+  if(heap_bytes > 0)
+    {
+      allocator.h = h_init(heap_bytes, true, threshold);
+      if(allocator.h == NULL) return result;
+    }
+
+  double start = bench_seconds();
+  result.ok = workload->run(&allocator, ops);
+  result.seconds = bench_seconds() - start;
+
+  if(allocator.h != NULL)
+    {
+      h_pauses_t pauses;
+      h_pauses(allocator.h, &pauses);
+      result.collections = pauses.count;
+      result.pause_total_ns = pauses.total_ns;
+      result.pause_max_ns = pauses.max_ns;
+      h_delete(allocator.h);
+    }
+  return result;
+}
+
+/// Runs one configuration in a child process and prints its CSV line
+static void
+run_child(const workload_t *workload, size_t ops, size_t heap_bytes, float threshold)
+{
+  int channel[2];
+  if(pipe(channel) != 0)
+    {
+      perror("pipe");
+      exit(1);
+    }
+
+  fflush(stdout);
+  pid_t child = fork();
+  if(child == 0)
+    {
+      close(channel[0]);
+      result_t result = run_here(workload, ops, heap_bytes, threshold);
+      ssize_t written = write(channel[1], &result, sizeof(result));
+      _exit(written == sizeof(result) ? 0 : 1);
+    }
+  close(channel[1]);
+
+  result_t result;
+  memset(&result, 0, sizeof(result));
+  if(read(channel[0], &result, sizeof(result)) != sizeof(result)) result.ok = false;
+  close(channel[0]);
+
+  int status;
+  struct rusage usage;
+  memset(&usage, 0, sizeof(usage));
+  wait4(child, &status, 0, &usage);
+
+  printf("%s,%s,%zu,%.2f,%zu,%s,%.4f,%.0f,%llu,%.3f,%.3f,%ld\n",
+         workload->name,
+         heap_bytes > 0 ? "gc" : "malloc",
+         heap_bytes,
+         heap_bytes > 0 ? threshold : 0.0,
+         ops,
+         result.ok ? "ok" : "failed",
+         result.seconds,
+         result.ok && result.seconds > 0 ? (double) ops / result.seconds : 0.0,
+         (unsigned long long) result.collections,
+         (double) result.pause_total_ns / 1e6,
+         (double) result.pause_max_ns / 1e6,
+         usage.ru_maxrss);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const char *only = NULL;
+  int scale = 100;
+  int reps = 1;
+  for(int i = 1; i < argc; ++i)
+    {
+      if(strncmp(argv[i], "--workload=", 11) == 0) only = argv[i] + 11;
+      else if(strncmp(argv[i], "--scale=", 8) == 0) scale = atoi(argv[i] + 8);
+      else if(strncmp(argv[i], "--reps=", 7) == 0) reps = atoi(argv[i] + 7);
+      else
+        {
+          fprintf(stderr, "usage: %s [--workload=NAME] [--scale=PERCENT] [--reps=N]\n", argv[0]);
+          return 1;
+        }
+    }
+  if(scale < 1) scale = 1;
+  if(reps < 1) reps = 1;
+
+  printf("workload,allocator,heap_bytes,threshold,ops,status,seconds,"
+         "ops_per_sec,gc_count,gc_total_ms,gc_max_ms,peak_rss_kb\n");
+  for(size_t w = 0; w < Array_length(workloads); ++w)
+    {
+      const workload_t *workload = &workloads[w];
+      if(only != NULL && strcmp(only, workload->name) != 0) continue;
+      size_t ops = workload->default_ops / 100 * (size_t) scale;
+
+      for(int rep = 0; rep < reps; ++rep)
+        {
+          run_child(workload, ops, 0, 0.0f);
+          for(size_t s = 0; s < Array_length(heap_sizes); ++s)
+            {
+              for(size_t t = 0; t < Array_length(thresholds); ++t)
+                {
+                  run_child(workload, ops, heap_sizes[s], thresholds[t]);
+                }
+            }
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,56 @@
+/// Shared parts of the benchmark programs: an allocator that is either
+/// malloc/free or a garbage collected heap, and the workload table entry.
+
+#ifndef __bench__
+#define __bench__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../../gc.h"
+
+
+typedef struct allocator allocator_t;
+
+/// h is NULL when malloc and free are used
+struct allocator
+{
+  heap_t *h;
+};
+
+typedef struct workload workload_t;
+
+struct workload
+{
+  const char *name;
+  size_t default_ops;
+  bool (*run)(allocator_t *allocator, size_t ops);
+};
+
+
+/// Allocates a struct, @p bytes is its size for malloc
+void *
+bench_alloc_struct(allocator_t *allocator, char *layout, size_t bytes);
+
+void *
+bench_alloc_data(allocator_t *allocator, size_t bytes);
+
+/// Allocates a zeroed array of pointers
+void **
+bench_alloc_ptr_array(allocator_t *allocator, size_t count);
+
+/// Frees @p ptr with malloc, does nothing with the garbage collector
+void
+bench_free(allocator_t *allocator, void *ptr);
+
+/// A xorshift random number generator, the same on every platform
+uint64_t
+bench_random(uint64_t *state);
+
+/// Reads a monotonic clock in seconds
+double
+bench_seconds(void);
+
+
+#endif
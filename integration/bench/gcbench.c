@@ -0,0 +1,319 @@
+/// A port of GCBench by John Ellis, Pete Kovac and Hans Boehm.
+///
+/// A long-lived binary tree and a large array of doubles are kept alive
+/// while short-lived binary trees of growing depth are built, first top
+/// down by filling in the children of an existing node and then bottom up
+/// by building the children before their parent. The time for each depth
+/// is printed together with the collections it caused. Options:
+///   --depth=N        the deepest short-lived tree, GCBench uses 16
+///   --heap=MB        size of the garbage collected heap
+///   --threshold=F    gc threshold of the heap
+///   --malloc         use malloc/free instead of the garbage collector
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../../gc.h"
+#include "bench.h"
+
+#define MIN_TREE_DEPTH 4
+#define DEFAULT_MAX_TREE_DEPTH 16
+#define DEFAULT_HEAP_MB 256
+#define DEFAULT_THRESHOLD 0.5f
+#define ARRAY_SIZE 500000
+/// An object has to fit on a page, so the long-lived array is made of
+/// chunks of doubles held by arrays of pointers
+#define ARRAY_CHUNK 240
+
+
+/*============================================================================
+ *                             TREES
+ *===========================================================================*/
+
+typedef struct node node_t;
+
+/// Layout "**i"
+struct node
+{
+  node_t *left;
+  node_t *right;
+  int i;
+};
+
+static node_t *
+node_new(allocator_t *allocator, node_t *left, node_t *right)
+{
+  node_t *node = bench_alloc_struct(allocator, "**i", sizeof(node_t));
+  if(node == NULL) return NULL;
+  node->left = left;
+  node->right = right;
+  node->i = 0;
+  return node;
+}
+
+/// Number of nodes in a tree of @p depth
+static long
+tree_size(int depth)
+{
+  return (1L << (depth + 1)) - 1;
+}
+
+/// Number of trees of @p depth built per phase, so that every depth
+/// allocates about as much as twice the stretch tree
+static long
+number_of_iterations(int depth, int stretch_depth)
+{
+  return 2 * tree_size(stretch_depth) / tree_size(depth);
+}
+
+/// Builds the children of @p node top down
+///
+/// The pointers are kept in volatile locals so that they are on the stack
+/// when a collection is started, which pins the nodes they point to.
+static bool
+populate(allocator_t *allocator, int depth, node_t *node)
+{
+  node_t * volatile parent = node;
+  if(depth <= 0) return true;
+
+  parent->left = node_new(allocator, NULL, NULL);
+  if(parent->left == NULL) return false;
+  parent->right = node_new(allocator, NULL, NULL);
+  if(parent->right == NULL) return false;
+  return populate(allocator, depth - 1, parent->left)
+    && populate(allocator, depth - 1, parent->right);
+}
+
+/// Builds a tree bottom up, children before their parent
+static node_t *
+make_tree(allocator_t *allocator, int depth)
+{
+  if(depth <= 0) return node_new(allocator, NULL, NULL);
+
+  node_t * volatile left = make_tree(allocator, depth - 1);
+  if(left == NULL) return NULL;
+  node_t * volatile right = make_tree(allocator, depth - 1);
+  if(right == NULL) return NULL;
+  return node_new(allocator, left, right);
+}
+
+/// Frees a tree with malloc, does nothing with the garbage collector
+static void
+free_tree(allocator_t *allocator, node_t *node)
+{
+  if(allocator->h != NULL || node == NULL) return;
+  free_tree(allocator, node->left);
+  free_tree(allocator, node->right);
+  free(node);
+}
+
+
+/*============================================================================
+ *                             LONG-LIVED ARRAY
+ *===========================================================================*/
+
+/// Allocates ARRAY_SIZE doubles as a spine of pointer arrays, each
+/// holding ARRAY_CHUNK chunks of ARRAY_CHUNK doubles
+static void **
+array_new(allocator_t *allocator)
+{
+  const size_t per_block = ARRAY_CHUNK * ARRAY_CHUNK;
+  const size_t blocks = (ARRAY_SIZE + per_block - 1) / per_block;
+
+  void ** volatile spine = bench_alloc_ptr_array(allocator, blocks);
+  if(spine == NULL) return NULL;
+  for(size_t b = 0; b < blocks; ++b)
+    {
+      spine[b] = bench_alloc_ptr_array(allocator, ARRAY_CHUNK);
+      if(spine[b] == NULL) return NULL;
+      for(size_t c = 0; c < ARRAY_CHUNK; ++c)
+        {
+          void *chunk = bench_alloc_data(allocator, ARRAY_CHUNK * sizeof(double));
+          if(chunk == NULL) return NULL;
+          ((void **) spine[b])[c] = chunk;
+        }
+    }
+  return (void **) spine;
+}
+
+static double *
+array_at(void **spine, size_t index)
+{
+  void **block = spine[index / (ARRAY_CHUNK * ARRAY_CHUNK)];
+  double *chunk = block[index / ARRAY_CHUNK % ARRAY_CHUNK];
+  return &chunk[index % ARRAY_CHUNK];
+}
+
+static void
+array_free(allocator_t *allocator, void **spine)
+{
+  if(allocator->h != NULL || spine == NULL) return;
+  const size_t per_block = ARRAY_CHUNK * ARRAY_CHUNK;
+  const size_t blocks = (ARRAY_SIZE + per_block - 1) / per_block;
+  for(size_t b = 0; b < blocks; ++b)
+    {
+      void **block = spine[b];
+      for(size_t c = 0; c < ARRAY_CHUNK; ++c)
+        {
+          free(block[c]);
+        }
+      free(block);
+    }
+  free(spine);
+}
+
+
+/*============================================================================
+ *                             DRIVER
+ *===========================================================================*/
+
+static uint64_t pause_count_before = 0;
+static uint64_t pause_total_before = 0;
+
+/// Prints the collections since the last call
+static void
+print_collections(allocator_t *allocator)
+{
+  if(allocator->h == NULL)
+    {
+      printf("\n");
+      return;
+    }
+  h_pauses_t pauses;
+  h_pauses(allocator->h, &pauses);
+  printf(" (%llu collections, %.3f msec paused)\n",
+         (unsigned long long) (pauses.count - pause_count_before),
+         (double) (pauses.total_ns - pause_total_before) / 1e6);
+  pause_count_before = pauses.count;
+  pause_total_before = pauses.total_ns;
+}
+
+static bool
+time_construction(allocator_t *allocator, int depth, int stretch_depth)
+{
+  long iterations = number_of_iterations(depth, stretch_depth);
+  printf("Creating %ld trees of depth %d\n", iterations, depth);
+
+  double start = bench_seconds();
+  for(long i = 0; i < iterations; ++i)
+    {
+      node_t * volatile root = node_new(allocator, NULL, NULL);
+      if(root == NULL) return false;
+      if(!populate(allocator, depth, root)) return false;
+      free_tree(allocator, root);
+    }
+  printf("\tTop down construction took %.0f msec",
+         (bench_seconds() - start) * 1000.0);
+  print_collections(allocator);
+
+  start = bench_seconds();
+  for(long i = 0; i < iterations; ++i)
+    {
+      node_t * volatile root = make_tree(allocator, depth);
+      if(root == NULL) return false;
+      free_tree(allocator, root);
+    }
+  printf("\tBottom up construction took %.0f msec",
+         (bench_seconds() - start) * 1000.0);
+  print_collections(allocator);
+  return true;
+}
+
+static bool
+run(allocator_t *allocator, int max_depth)
+{
+  const int stretch_depth = max_depth + 2;
+  const int long_lived_depth = max_depth;
+
+  printf("Garbage Collector Test\n");
+  printf(" Live storage will peak at %ld bytes.\n\n",
+         2 * (long) sizeof(node_t) * tree_size(long_lived_depth)
+         + (long) sizeof(double) * ARRAY_SIZE);
+  printf(" Stretching memory with a binary tree of depth %d\n", stretch_depth);
+  double start = bench_seconds();
+
+  node_t * volatile stretch = make_tree(allocator, stretch_depth);
+  if(stretch == NULL) return false;
+  free_tree(allocator, stretch);
+  stretch = NULL;
+
+  printf(" Creating a long-lived binary tree of depth %d\n", long_lived_depth);
+  node_t * volatile long_lived = node_new(allocator, NULL, NULL);
+  if(long_lived == NULL) return false;
+  if(!populate(allocator, long_lived_depth, long_lived)) return false;
+
+  printf(" Creating a long-lived array of %d doubles", ARRAY_SIZE);
+  void ** volatile array = array_new(allocator);
+  if(array == NULL) return false;
+  for(size_t i = 0; i < ARRAY_SIZE / 2; ++i)
+    {
+      *array_at(array, i) = 1.0 / (double) i;
+    }
+  print_collections(allocator);
+
+  for(int depth = MIN_TREE_DEPTH; depth <= max_depth; depth += 2)
+    {
+      if(!time_construction(allocator, depth, stretch_depth)) return false;
+    }
+
+  bool alive = long_lived != NULL && *array_at(array, 1000) == 1.0 / 1000.0;
+  printf("Completed in %.0f msec\n", (bench_seconds() - start) * 1000.0);
+
+  if(allocator->h != NULL)
+    {
+      h_pauses_t pauses;
+      h_pauses(allocator->h, &pauses);
+      printf("Completed %llu collections, %.3f msec paused, longest %.3f msec\n",
+             (unsigned long long) pauses.count,
+             (double) pauses.total_ns / 1e6,
+             (double) pauses.max_ns / 1e6);
+    }
+
+  free_tree(allocator, long_lived);
+  array_free(allocator, array);
+  if(!alive) fprintf(stderr, "Wrong result: the long-lived data was lost\n");
+  return alive;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int max_depth = DEFAULT_MAX_TREE_DEPTH;
+  size_t heap_mb = DEFAULT_HEAP_MB;
+  float threshold = DEFAULT_THRESHOLD;
+  bool use_malloc = false;
+  for(int i = 1; i < argc; ++i)
+    {
+      if(strncmp(argv[i], "--depth=", 8) == 0) max_depth = atoi(argv[i] + 8);
+      else if(strncmp(argv[i], "--heap=", 7) == 0) heap_mb = (size_t) atol(argv[i] + 7);
+      else if(strncmp(argv[i], "--threshold=", 12) == 0) threshold = (float) atof(argv[i] + 12);
+      else if(strcmp(argv[i], "--malloc") == 0) use_malloc = true;
+      else
+        {
+          fprintf(stderr, "usage: %s [--depth=N] [--heap=MB] [--threshold=F] [--malloc]\n",
+                  argv[0]);
+          return 1;
+        }
+    }
+  if(max_depth < MIN_TREE_DEPTH) max_depth = MIN_TREE_DEPTH;
+
+  allocator_t allocator = { NULL };
+  if(!use_malloc)
+    {
+      allocator.h = h_init(heap_mb << 20, true, threshold);
+      if(allocator.h == NULL)
+        {
+          fprintf(stderr, "Could not create a heap of %zu MB\n", heap_mb);
+          return 1;
+        }
+    }
+
+  bool ok = run(&allocator, max_depth);
+  if(allocator.h != NULL) h_delete(allocator.h);
+  return ok ? 0 : 1;
+}
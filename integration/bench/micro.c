@@ -0,0 +1,333 @@
+/// Microbenchmarks of the primitives a collection spends its time in:
+/// creating struct headers, finding the pointers of a struct, looking up
+/// the allocation map and scanning the stack.
+///
+/// Every case runs a fixed number of operations per repetition. One
+/// repetition is run first as a warm-up, then the fastest and the median
+/// repetition are printed in ns and in time stamp counter cycles per
+/// operation (cycles are 0 where there is no such counter). Options:
+///   --case=NAME        only run the cases whose name starts with NAME
+///   --iterations=N     operations per repetition
+///   --reps=N           repetitions after the warm-up
+
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../../gc.h"
+#include "../../header.h"
+#include "../../header_hidden.h"
+#include "../../alloc_map.h"
+#include "../../stack_search.h"
+#include "bench.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define DEFAULT_REPS 5
+#define MAX_REPS 100
+#define MAX_POINTERS 64
+#define ALLOC_MAP_BLOCK (1UL << 20)
+#define ALLOC_MAP_QUERIES 4096 /**< a power of two */
+#define FAKE_HEAP_SIZE (1UL << 20)
+
+#define Array_length(array) (sizeof(array) / sizeof(array[0]))
+
+typedef uint64_t (*micro_fn)(void *arg, size_t ops);
+
+static size_t iterations = DEFAULT_ITERATIONS;
+static int reps = DEFAULT_REPS;
+static const char *only_case = NULL;
+
+/// Everything a case computes ends up here so that it cannot be
+/// optimized away
+static volatile uint64_t sink;
+
+
+/*============================================================================
+ *                             MEASURING
+ *===========================================================================*/
+
+static uint64_t
+read_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/// Runs @p fn for a warm-up and @p reps repetitions and prints a line
+static void
+measure(const char *name, const char *variant, micro_fn fn, void *arg)
+{
+  if(only_case != NULL && strncmp(name, only_case, strlen(only_case)) != 0) return;
+
+  double ns[MAX_REPS];
+  double cycles[MAX_REPS];
+  sink += fn(arg, iterations);
+  for(int r = 0; r < reps; ++r)
+    {
+      double start = bench_seconds();
+      uint64_t start_cycles = read_cycles();
+      sink += fn(arg, iterations);
+      uint64_t end_cycles = read_cycles();
+      ns[r] = (bench_seconds() - start) * 1e9 / (double) iterations;
+      cycles[r] = (double) (end_cycles - start_cycles) / (double) iterations;
+    }
+  qsort(ns, (size_t) reps, sizeof(double), compare_doubles);
+  qsort(cycles, (size_t) reps, sizeof(double), compare_doubles);
+  printf("%-24s %-16s %10.2f %10.2f %10.1f %10.1f\n", name, variant,
+         ns[0], ns[reps / 2], cycles[0], cycles[reps / 2]);
+}
+
+
+/*============================================================================
+ *                             HEADERS
+ *===========================================================================*/
+
+/// Layouts from one pointer to one that does not fit in a bit vector
+static char *layouts[] = { "*", "*i", "**i", "ic*ld", "*i*i*i*i*i*i", "8*", "30*" };
+
+static uint64_t
+run_bit_vector_create(void *arg, size_t ops)
+{
+  char *layout = arg;
+  uint64_t sum = 0;
+  for(size_t i = 0; i < ops; ++i)
+    {
+      sum += (uintptr_t) bit_vector_create(layout);
+    }
+  return sum;
+}
+
+static uint64_t
+run_get_pointers_in_struct(void *arg, size_t ops)
+{
+  void **slots[MAX_POINTERS];
+  uint64_t sum = 0;
+  for(size_t i = 0; i < ops; ++i)
+    {
+      size_t count = get_number_of_pointers_in_struct(arg);
+      if(get_pointers_in_struct(arg, slots)) sum += (uintptr_t) slots[count - 1];
+    }
+  return sum;
+}
+
+static bool
+bench_headers(void)
+{
+  heap_t *h = h_init(1UL << 20, true, 1.0f);
+  if(h == NULL) return false;
+
+  for(size_t i = 0; i < Array_length(layouts); ++i)
+    {
+      measure("bit_vector_create", layouts[i], run_bit_vector_create, layouts[i]);
+    }
+  for(size_t i = 0; i < Array_length(layouts); ++i)
+    {
+      void *structure = h_alloc_struct(h, layouts[i]);
+      if(structure == NULL)
+        {
+          h_delete(h);
+          return false;
+        }
+      measure("get_pointers_in_struct", layouts[i], run_get_pointers_in_struct, structure);
+    }
+
+  h_delete(h);
+  return true;
+}
+
+
+/*============================================================================
+ *                             ALLOCATION MAP
+ *===========================================================================*/
+
+typedef struct alloc_map_case alloc_map_case_t;
+
+struct alloc_map_case
+{
+  alloc_map_t *alloc_map;
+  void *queries[ALLOC_MAP_QUERIES];
+};
+
+static uint64_t
+run_alloc_map_ptr_used(void *arg, size_t ops)
+{
+  alloc_map_case_t *c = arg;
+  uint64_t sum = 0;
+  for(size_t i = 0; i < ops; ++i)
+    {
+      sum += alloc_map_ptr_used(c->alloc_map, c->queries[i & (ALLOC_MAP_QUERIES - 1)]);
+    }
+  return sum;
+}
+
+/// Looks up objects, random words in the block and addresses outside it,
+/// with an object every fourth word of the block
+static bool
+bench_alloc_map(void)
+{
+  char *block = malloc(ALLOC_MAP_BLOCK);
+  alloc_map_case_t *c = malloc(sizeof(alloc_map_case_t));
+  if(block == NULL || c == NULL) goto fail;
+  c->alloc_map = malloc(alloc_map_mem_size_needed(sizeof(void *), ALLOC_MAP_BLOCK));
+  if(c->alloc_map == NULL) goto fail;
+  alloc_map_create_zeroed(c->alloc_map, block, sizeof(void *), ALLOC_MAP_BLOCK);
+  alloc_map_set_n(c->alloc_map, block, 4 * sizeof(void *),
+                  ALLOC_MAP_BLOCK / (4 * sizeof(void *)), true);
+
+  const char *variants[] = { "objects", "random", "outside" };
+  uint64_t state = 1;
+  for(size_t v = 0; v < Array_length(variants); ++v)
+    {
+      for(size_t i = 0; i < ALLOC_MAP_QUERIES; ++i)
+        {
+          size_t word = bench_random(&state) % (ALLOC_MAP_BLOCK / sizeof(void *));
+          if(v == 0) word &= ~(size_t) 3;
+          if(v == 2) word += ALLOC_MAP_BLOCK / sizeof(void *);
+          c->queries[i] = block + word * sizeof(void *);
+        }
+      measure("alloc_map_ptr_used", variants[v], run_alloc_map_ptr_used, c);
+    }
+
+  free(c->alloc_map);
+  free(c);
+  free(block);
+  return true;
+
+ fail:
+  if(c != NULL) free(c->alloc_map);
+  free(c);
+  free(block);
+  return false;
+}
+
+
+/*============================================================================
+ *                             STACK SCANNING
+ *===========================================================================*/
+
+typedef struct stack_case stack_case_t;
+
+/// A stack of random words, some of which point into a fake heap that is
+/// aligned to its own size
+struct stack_case
+{
+  void **words;
+  size_t depth;
+  char *heap_start;
+  bool masked;
+};
+
+/// One operation is one stack word, whole stacks are scanned until at
+/// least @p ops words have been looked at
+static uint64_t
+run_stack_find_next_ptr(void *arg, size_t ops)
+{
+  stack_case_t *c = arg;
+  uint64_t sum = 0;
+  for(size_t done = 0; done < ops; done += c->depth)
+    {
+      void *bottom = c->words + c->depth;
+      void **found;
+      if(c->masked)
+        {
+          while((found = stack_find_next_heap_ptr(&bottom, c->words, c->heap_start,
+                                                  ~(uintptr_t) (FAKE_HEAP_SIZE - 1))) != NULL)
+            {
+              sum += (uintptr_t) *found;
+            }
+        }
+      else
+        {
+          while((found = stack_find_next_ptr(&bottom, c->words, c->heap_start,
+                                             c->heap_start + FAKE_HEAP_SIZE - 1)) != NULL)
+            {
+              sum += (uintptr_t) *found;
+            }
+        }
+    }
+  return sum;
+}
+
+static bool
+bench_stack(void)
+{
+  static const size_t depths[] = { 256, 4096, 65536 };
+  static const unsigned densities[] = { 0, 10, 50 };
+
+  stack_case_t c;
+  c.heap_start = (char *) (uintptr_t) (1UL << 40);
+  c.words = malloc(depths[Array_length(depths) - 1] * sizeof(void *));
+  if(c.words == NULL) return false;
+
+  uint64_t state = 2;
+  for(size_t d = 0; d < Array_length(depths); ++d)
+    {
+      for(size_t p = 0; p < Array_length(densities); ++p)
+        {
+          c.depth = depths[d];
+          for(size_t i = 0; i < c.depth; ++i)
+            {
+              uint64_t random = bench_random(&state);
+              bool pointer = random % 100 < densities[p];
+              c.words[i] = pointer
+                ? c.heap_start + (random >> 8) % FAKE_HEAP_SIZE
+                : (void *) (uintptr_t) (random >> 24);
+            }
+
+          char variant[32];
+          snprintf(variant, sizeof(variant), "%zu words %u%%", c.depth, densities[p]);
+          c.masked = false;
+          measure("stack_find_next_ptr", variant, run_stack_find_next_ptr, &c);
+          c.masked = true;
+          measure("stack_find_next_heap_ptr", variant, run_stack_find_next_ptr, &c);
+        }
+    }
+
+  free(c.words);
+  return true;
+}
+
+
+/*============================================================================
+ *                             DRIVER
+ *===========================================================================*/
+
+int
+main(int argc, char *argv[])
+{
+  for(int i = 1; i < argc; ++i)
+    {
+      if(strncmp(argv[i], "--case=", 7) == 0) only_case = argv[i] + 7;
+      else if(strncmp(argv[i], "--iterations=", 13) == 0) iterations = (size_t) atol(argv[i] + 13);
+      else if(strncmp(argv[i], "--reps=", 7) == 0) reps = atoi(argv[i] + 7);
+      else
+        {
+          fprintf(stderr, "usage: %s [--case=NAME] [--iterations=N] [--reps=N]\n", argv[0]);
+          return 1;
+        }
+    }
+  if(iterations == 0) iterations = 1;
+  if(reps < 1) reps = 1;
+  if(reps > MAX_REPS) reps = MAX_REPS;
+
+  printf("%-24s %-16s %10s %10s %10s %10s\n", "case", "variant",
+         "min ns", "median ns", "min cyc", "median cyc");
+  bool ok = bench_headers() && bench_alloc_map() && bench_stack();
+  if(!ok) fprintf(stderr, "Could not allocate the benchmark data\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,321 @@
+/// Measures how the time of one collection grows with the size of the
+/// heap and with the share of it that is alive.
+///
+/// For every heap size and live fraction a child process fills half of a
+/// new heap with nodes of layout "**i", of which the live fraction are
+/// linked into a balanced binary tree held from the stack and the rest
+/// are garbage mixed in between them, and then runs h_gc once. A point
+/// that does not finish within the time budget stops the sweep of its
+/// live fraction. At the end the collection time is fitted to a power
+/// of the heap size for every live fraction and to a power of the live
+/// bytes over all points. Options:
+///   --min-heap=MB         the smallest heap, 1 by default
+///   --max-heap=MB         the largest heap, 4096 by default
+///   --budget=S            seconds a point may take, 10 by default
+///   --reps=N              run every point N times and keep the fastest
+///   --max-exponent=F      exit with 1 if a fitted exponent is above F
+
+#define _DEFAULT_SOURCE // fork, alarm
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../../gc.h"
+#include "bench.h"
+
+#define HEAP_STEP 2 /**< every heap is this many times larger than the last */
+#define FILL 0.5    /**< share of the heap that is allocated before h_gc */
+#define MIN_FIT_POINTS 3
+
+static const unsigned live_percents[] = { 1, 10, 25, 50, 75, 90 };
+
+#define Array_length(array) (sizeof(array) / sizeof(array[0]))
+
+
+/*============================================================================
+ *                             GRAPHS
+ *===========================================================================*/
+
+typedef struct node node_t;
+
+/// Layout "**i"
+struct node
+{
+  node_t *left;
+  node_t *right;
+  int i;
+};
+
+typedef struct result result_t;
+
+struct result
+{
+  bool ok;
+  uint64_t live_bytes;
+  uint64_t objects;
+  uint64_t gc_ns;
+  uint64_t trace_ns;
+  uint64_t copy_ns;
+};
+
+/// Fills half of @p h with nodes, @p live_percent of them linked into a
+/// tree whose root is returned
+///
+/// The nodes of the tree are numbered in breadth first order, node k has
+/// the children 2k + 1 and 2k + 2. Their addresses are kept in malloc
+/// memory, which the collector does not scan, until the tree is built.
+static node_t *
+build_graph(heap_t *h, unsigned live_percent, uint64_t *objects)
+{
+  size_t capacity = (size_t) ((double) h_size(h) * FILL) / sizeof(node_t) + 1;
+  node_t **live = malloc(capacity * sizeof(node_t *));
+  if(live == NULL) return NULL;
+
+  size_t count = 0;
+  unsigned share = 0;
+  *objects = 0;
+  while((double) h_used(h) < (double) h_size(h) * FILL && count < capacity)
+    {
+      node_t *node = h_alloc_struct(h, "**i");
+      if(node == NULL) break;
+      node->left = NULL;
+      node->right = NULL;
+      node->i = (int) *objects;
+      ++*objects;
+
+      // Spreads the live nodes evenly among the garbage
+      share += live_percent;
+      if(share < 100) continue;
+      share -= 100;
+      if(count > 0)
+        {
+          node_t *parent = live[(count - 1) / 2];
+          if(count % 2 == 1) parent->left = node;
+          else parent->right = node;
+        }
+      live[count++] = node;
+    }
+
+  node_t *root = count > 0 ? live[0] : NULL;
+  free(live);
+  return root;
+}
+
+/// Builds one graph and collects it in this process
+static result_t
+run_here(size_t heap_bytes, unsigned live_percent)
+{
+  result_t result;
+  memset(&result, 0, sizeof(result));
+
+  heap_t *h = h_init(heap_bytes, true, 1.0f);
+  if(h == NULL) return result;
+
+  node_t * volatile root = build_graph(h, live_percent, &result.objects);
+  if(root != NULL)
+    {
+      int value = root->i;
+      h_gc(h);
+      h_stats_t stats;
+      h_stats(h, &stats);
+      h_pauses_t pauses;
+      h_pauses(h, &pauses);
+      result.ok = pauses.count == 1 && root->i == value;
+      result.live_bytes = h_used(h);
+      result.gc_ns = pauses.total_ns;
+      result.trace_ns = stats.last.trace_ns + stats.last.root_scan_ns;
+      result.copy_ns = stats.last.copy_ns;
+    }
+  h_delete(h);
+  return result;
+}
+
+/// Runs one point in a child process that is killed after @p budget
+/// seconds, returns a description of why it failed or NULL
+static const char *
+run_child(size_t heap_bytes, unsigned live_percent, unsigned budget, result_t *result)
+{
+  memset(result, 0, sizeof(*result));
+  int channel[2];
+  if(pipe(channel) != 0)
+    {
+      perror("pipe");
+      exit(1);
+    }
+
+  fflush(stdout);
+  pid_t child = fork();
+  if(child == 0)
+    {
+      close(channel[0]);
+      alarm(budget);
+      result_t here = run_here(heap_bytes, live_percent);
+      ssize_t written = write(channel[1], &here, sizeof(here));
+      _exit(written == sizeof(here) ? 0 : 1);
+    }
+  close(channel[1]);
+
+  bool read_all = read(channel[0], result, sizeof(*result)) == sizeof(*result);
+  close(channel[0]);
+  int status;
+  waitpid(child, &status, 0);
+
+  if(WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM) return "timeout";
+  if(WIFSIGNALED(status)) return "crashed";
+  if(!read_all || !result->ok) return "failed";
+  return NULL;
+}
+
+
+/*============================================================================
+ *                             FITTING
+ *===========================================================================*/
+
+typedef struct fit fit_t;
+
+/// A least squares line through (log x, log y), y grows as x^exponent
+struct fit
+{
+  size_t n;
+  double sx, sy, sxx, sxy;
+};
+
+static void
+fit_add(fit_t *fit, double x, double y)
+{
+  if(x <= 0 || y <= 0) return;
+  double lx = log(x);
+  double ly = log(y);
+  fit->n += 1;
+  fit->sx += lx;
+  fit->sy += ly;
+  fit->sxx += lx * lx;
+  fit->sxy += lx * ly;
+}
+
+/// Returns the exponent or NAN if there are too few points
+static double
+fit_exponent(fit_t *fit)
+{
+  double n = (double) fit->n;
+  double denominator = n * fit->sxx - fit->sx * fit->sx;
+  if(fit->n < MIN_FIT_POINTS || denominator == 0) return NAN;
+  return (n * fit->sxy - fit->sx * fit->sy) / denominator;
+}
+
+static const char *
+complexity_name(double exponent)
+{
+  if(isnan(exponent)) return "too few points";
+  if(exponent < 1.2) return "linear";
+  if(exponent < 1.7) return "superlinear";
+  if(exponent < 2.3) return "quadratic";
+  return "worse than quadratic";
+}
+
+
+/*============================================================================
+ *                             DRIVER
+ *===========================================================================*/
+
+int
+main(int argc, char *argv[])
+{
+  size_t min_heap_mb = 1;
+  size_t max_heap_mb = 4096;
+  unsigned budget = 10;
+  int reps = 1;
+  double max_exponent = 0;
+  for(int i = 1; i < argc; ++i)
+    {
+      if(strncmp(argv[i], "--min-heap=", 11) == 0) min_heap_mb = (size_t) atol(argv[i] + 11);
+      else if(strncmp(argv[i], "--max-heap=", 11) == 0) max_heap_mb = (size_t) atol(argv[i] + 11);
+      else if(strncmp(argv[i], "--budget=", 9) == 0) budget = (unsigned) atoi(argv[i] + 9);
+      else if(strncmp(argv[i], "--reps=", 7) == 0) reps = atoi(argv[i] + 7);
+      else if(strncmp(argv[i], "--max-exponent=", 15) == 0) max_exponent = atof(argv[i] + 15);
+      else
+        {
+          fprintf(stderr, "usage: %s [--min-heap=MB] [--max-heap=MB] [--budget=S] [--reps=N]"
+                  " [--max-exponent=F]\n", argv[0]);
+          return 1;
+        }
+    }
+  if(min_heap_mb < 1) min_heap_mb = 1;
+  if(budget < 1) budget = 1;
+  if(reps < 1) reps = 1;
+
+  fit_t by_heap[Array_length(live_percents)];
+  fit_t by_live;
+  memset(by_heap, 0, sizeof(by_heap));
+  memset(&by_live, 0, sizeof(by_live));
+
+  printf("%8s %6s %10s %10s %10s %10s %10s %s\n", "heap_mb", "live%", "objects",
+         "live_kb", "gc_ms", "trace_ms", "copy_ms", "status");
+  for(size_t p = 0; p < Array_length(live_percents); ++p)
+    {
+      bool stopped = false;
+      for(size_t heap_mb = min_heap_mb; heap_mb <= max_heap_mb; heap_mb *= HEAP_STEP)
+        {
+          if(stopped)
+            {
+              printf("%8zu %6u %10s %10s %10s %10s %10s skipped\n", heap_mb,
+                     live_percents[p], "-", "-", "-", "-", "-");
+              continue;
+            }
+
+          result_t best;
+          memset(&best, 0, sizeof(best));
+          const char *failure = NULL;
+          for(int rep = 0; rep < reps && failure == NULL; ++rep)
+            {
+              result_t result;
+              failure = run_child(heap_mb << 20, live_percents[p], budget, &result);
+              if(rep == 0 || result.gc_ns < best.gc_ns) best = result;
+            }
+          if(failure != NULL)
+            {
+              printf("%8zu %6u %10s %10s %10s %10s %10s %s\n", heap_mb,
+                     live_percents[p], "-", "-", "-", "-", "-", failure);
+              stopped = true;
+              continue;
+            }
+
+          printf("%8zu %6u %10llu %10llu %10.3f %10.3f %10.3f ok\n", heap_mb,
+                 live_percents[p], (unsigned long long) best.objects,
+                 (unsigned long long) best.live_bytes >> 10,
+                 (double) best.gc_ns / 1e6, (double) best.trace_ns / 1e6,
+                 (double) best.copy_ns / 1e6);
+          fit_add(&by_heap[p], (double) heap_mb, (double) best.gc_ns);
+          fit_add(&by_live, (double) best.live_bytes, (double) best.gc_ns);
+        }
+    }
+
+  bool too_steep = false;
+  printf("\nFitted collection time\n");
+  for(size_t p = 0; p < Array_length(live_percents); ++p)
+    {
+      double exponent = fit_exponent(&by_heap[p]);
+      printf("  %3u%% live: time ~ heap^%.2f (%s, %zu points)\n", live_percents[p],
+             exponent, complexity_name(exponent), by_heap[p].n);
+      if(max_exponent > 0 && exponent > max_exponent) too_steep = true;
+    }
+  double exponent = fit_exponent(&by_live);
+  printf("  all points: time ~ live^%.2f (%s, %zu points)\n", exponent,
+         complexity_name(exponent), by_live.n);
+  if(max_exponent > 0 && exponent > max_exponent) too_steep = true;
+
+  if(too_steep)
+    {
+      fprintf(stderr, "A fitted exponent is above %.2f\n", max_exponent);
+      return 1;
+    }
+  return 0;
+}
@@ -34,7 +34,7 @@ struct db
 good *good_new(char *name, char *desc, int price, int amount)
 {
 #ifdef GC
-  good *result = h_alloc_data(heap, sizeof(*result));
+  good *result = h_alloc_struct(heap, "3*2i");
 #else
   good *result = malloc(sizeof(*result));
 #endif
@@ -120,6 +120,9 @@ static inline void db_internal_remove_good(db *db, char *name, bool undo)
 {
   good *g = tree_get(db->goods, name);
 
+  // Remove it from the tree first, name may belong to g
+  tree_remove(db->goods, name);
+
   if (undo)
     {
       // Push a corresponding add action
@@ -131,9 +134,6 @@ static inline void db_internal_remove_good(db *db, char *name, bool undo)
       /// If we are not undoing, we should destroy the old record
       good_delete(g);
     }
-
-  // Finally remove it from the tree
-  tree_remove(db->goods, name);
 }
 
 static inline void db_internal_add_good(db *db, good *g, bool undo)
@@ -170,17 +170,17 @@ bool db_undo_last_action(db *db)
     {
       switch (action->type)
         {
-        case add:
+        case action_add:
           {
             db_internal_add_good(db, action->good, false);
             break;
           }
-        case remove:
+        case action_remove:
           {
             db_internal_remove_good(db, action->good->name, false);
             break;
           }
-        case edit:
+        case action_edit:
           {
             db_internal_replace_good(db, tree_get(db->goods, action->name), action->good, false);
             break;
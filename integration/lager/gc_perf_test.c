@@ -18,7 +18,34 @@ struct int_cell
 #ifdef GC
 #include "../../gc.h"
 heap_t *heap; 
-#endif
+
+/// Cells are allocated in batches of this many
+#define Batch 64
+
+/// Puts up to Batch new cells in random lists, returns how many.
+/// list_append allocates and may collect, so the cells of a batch wait
+/// in an array on the stack, where the collector finds them, and all of
+/// them are initialised before the first one is appended.
+static inline uint populate_lists_batch(list **lists, uint no_lists, uint list_max,
+                                        uint count, int_cell **ids)
+{
+  int_cell *cells[Batch];
+  list *targets[Batch];
+  uint n = h_alloc_data_n(heap, sizeof(int_cell), count < Batch ? count : Batch,
+                          (void **) cells);
+  for (uint i = 0; i < n; ++i)
+    {
+      targets[i] = lists[rand() % no_lists];
+      cells[i]->value = rand() % list_max;
+    }
+  for (uint i = 0; i < n; ++i)
+    {
+      list_append(targets[i], cells[i]);
+      ids[i] = cells[i];
+    }
+  return n;
+}
+#else
 
 static inline int_cell *populate_lists(list **lists, uint no_lists, uint list_max)
 {
@@ -26,11 +53,7 @@ static inline int_cell *populate_lists(list **lists, uint no_lists, uint list_ma
   list *l = lists[rand() % no_lists];
 
   // Build an int cell (deviation from spec)
-#ifdef GC
-  int_cell *c = h_alloc_data(heap, sizeof(int_cell));
-#else
   int_cell *c = malloc(sizeof(int_cell));
-#endif
   c->value = rand() % list_max;
 
   // Insert cell in the list
@@ -38,6 +61,7 @@ static inline int_cell *populate_lists(list **lists, uint no_lists, uint list_ma
 
   return c;
 }
+#endif
 
 /// What happens to performance if we search based on 
 /// a == b rather than a->value == b->value? 
@@ -91,11 +115,26 @@ int main(int argc, char *argv[])
   /// Keeping track of all int cells not needed
   int_cell **ids = malloc(M * sizeof(int_cell *));
   int_cell **cursor = ids;
+#ifdef GC
+  for (uint i = 0; i < M; )
+    {
+      printf("M = %i\n", i);
+      uint added = populate_lists_batch(lists, Lists, M * Lists, M - i, cursor);
+      if (added == 0)
+        {
+          printf("Out of memory\n");
+          break;
+        }
+      cursor += added;
+      i += added;
+    }
+#else
   for (int i = 0; i < M; ++i)
     {
       printf("M = %i\n", i);
       *cursor++ = populate_lists(lists, Lists, M * Lists);
     }
+#endif
 
 #ifdef GC
   size_t cleaned = h_gc(heap);
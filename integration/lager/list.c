@@ -53,7 +53,10 @@ void list_visit(list *l, list_visitor_func f, void *ptr)
 list *list_new()
 {
 #ifdef GC
-  return h_alloc_struct(heap, "**i");
+  /// The heap does not clear what it allocates
+  list *result = h_alloc_struct(heap, "**i");
+  *result = (struct list) { .size = 0 };
+  return result;
 #else
   return calloc(1, sizeof(struct list));
 #endif
@@ -0,0 +1,228 @@
+#define _DEFAULT_SOURCE // strdup, clock_gettime
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "db.h"
+
+#ifdef GC
+#include "../../gc.h"
+heap_t *heap;
+#endif
+
+/// A load generator for the warehouse database, it runs a scripted
+/// sequence of add, edit, remove and undo operations through db.c
+/// without the tui. Every operation picks a random item name: an item
+/// that is missing is added, one that exists is edited or removed, and
+/// a share of the operations undo the last action instead. Options:
+///   --ops=N        number of operations
+///   --items=N      number of different item names
+///   --undo=P       percent of the operations that undo
+///   --seed=N       seed of the script
+///   --heap=KB      size of the heap in the GC build
+
+#define Name_length 32
+#define Desc_length 64
+/// db.c does not check its allocations, an operation is only started
+/// when this much more can be allocated before the heap is past its
+/// collection threshold, which is when allocations start to fail
+#define Heap_reserve 4096
+#define Gc_threshold 0.5
+
+typedef struct counts counts_t;
+
+struct counts
+{
+  unsigned long adds;
+  unsigned long edits;
+  unsigned long removes;
+  unsigned long undos;
+  unsigned long empty_undos;
+  unsigned long done;
+};
+
+/// The same xorshift sequence on every platform and in both builds
+static uint64_t next_random(uint64_t *state)
+{
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static double seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+/// True if the next operation is sure to find room on the heap
+static bool room_for_operation()
+{
+#ifdef GC
+  double limit = (double) h_size(heap) * Gc_threshold;
+  if ((double) (h_used(heap) + Heap_reserve) <= limit) return true;
+  h_gc(heap);
+  return (double) (h_used(heap) + Heap_reserve) <= limit;
+#else
+  return true;
+#endif
+}
+
+/// Copies a string to where the database expects its strings
+static char *copy_string(char *str)
+{
+#ifdef GC
+  return h_strdup(heap, str);
+#else
+  return strdup(str);
+#endif
+}
+
+static void add_item(db *db, char *name, uint64_t r)
+{
+  char desc[Desc_length];
+  snprintf(desc, Desc_length, "Description %llu of %s", (unsigned long long) (r % 1000), name);
+  good *g = good_new(copy_string(name), copy_string(desc), (int) (r % 100000), 1);
+  db_add_good(db, g);
+}
+
+/// Edits like the tui does, on a copy that replaces the original
+static void edit_item(db *db, good *g, uint64_t r)
+{
+  good *copy = good_deep_copy(g);
+  good_set_price(copy, (int) (r % 100000));
+  if (r & 1)
+    {
+      char desc[Desc_length];
+      snprintf(desc, Desc_length, "Edited %llu", (unsigned long long) (r % 1000));
+#ifndef GC
+      free(good_desc(copy));
+#endif
+      good_set_desc(copy, copy_string(desc));
+    }
+  db_replace_good(db, g, copy);
+}
+
+/// Counts the items left by looking them up, which allocates nothing
+static unsigned long count_items(db *db, unsigned long items)
+{
+  char name[Name_length];
+  unsigned long found = 0;
+  for (unsigned long i = 0; i < items; ++i)
+    {
+      snprintf(name, Name_length, "item%06lu", i);
+      if (db_get_good(db, name) != NULL) ++found;
+    }
+  return found;
+}
+
+static void run_script(db *db, unsigned long ops, unsigned long items, unsigned undo_percent,
+                       uint64_t seed, counts_t *counts)
+{
+  uint64_t state = seed;
+  char name[Name_length];
+  for (unsigned long i = 0; i < ops && room_for_operation(); ++i)
+    {
+      counts->done = i + 1;
+      uint64_t r = next_random(&state);
+      if (r % 100 < undo_percent)
+        {
+          if (db_undo_last_action(db)) ++counts->undos;
+          else ++counts->empty_undos;
+          continue;
+        }
+
+      r = next_random(&state);
+      snprintf(name, Name_length, "item%06lu", (unsigned long) (r % items));
+      good *g = db_get_good(db, name);
+      if (g == NULL)
+        {
+          add_item(db, name, r >> 20);
+          ++counts->adds;
+        }
+      else if ((r >> 40) % 3 == 0)
+        {
+          db_remove_good(db, name);
+          ++counts->removes;
+        }
+      else
+        {
+          edit_item(db, g, r >> 20);
+          ++counts->edits;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned long ops = 20000;
+  unsigned long items = 1000;
+  unsigned undo_percent = 30;
+  uint64_t seed = 88172645463325252ULL;
+  size_t heap_kb = 4096;
+  for (int i = 1; i < argc; ++i)
+    {
+      if (strncmp(argv[i], "--ops=", 6) == 0) ops = strtoul(argv[i] + 6, NULL, 10);
+      else if (strncmp(argv[i], "--items=", 8) == 0) items = strtoul(argv[i] + 8, NULL, 10);
+      else if (strncmp(argv[i], "--undo=", 7) == 0) undo_percent = (unsigned) atoi(argv[i] + 7);
+      else if (strncmp(argv[i], "--seed=", 7) == 0) seed = strtoull(argv[i] + 7, NULL, 10);
+      else if (strncmp(argv[i], "--heap=", 7) == 0) heap_kb = strtoul(argv[i] + 7, NULL, 10);
+      else
+        {
+          fprintf(stderr, "usage: %s [--ops=N] [--items=N] [--undo=PERCENT] [--seed=N]"
+                  " [--heap=KB]\n", argv[0]);
+          return 1;
+        }
+    }
+  if (items == 0) items = 1;
+  if (seed == 0) seed = 1;
+
+#ifdef GC
+  heap = h_init(heap_kb << 10, false, Gc_threshold);
+  if (heap == NULL)
+    {
+      fprintf(stderr, "Could not create a heap of %zu KB\n", heap_kb);
+      return 1;
+    }
+#endif
+
+  counts_t counts = { 0 };
+  double start = seconds();
+  db *db = db_new();
+  run_script(db, ops, items, undo_percent, seed, &counts);
+  unsigned long remaining = count_items(db, items);
+  double elapsed = seconds() - start;
+
+#ifdef GC
+  printf("Allocator: gc (%zu KB heap)\n", heap_kb);
+#else
+  (void) heap_kb;
+  printf("Allocator: malloc\n");
+#endif
+  printf("Operations: %lu in %.3f s, %.0f ops/s\n", counts.done, elapsed,
+         elapsed > 0 ? (double) counts.done / elapsed : 0.0);
+  if (counts.done < ops) printf("Heap full, stopped after %lu of %lu operations\n", counts.done, ops);
+  printf("Adds: %lu, edits: %lu, removes: %lu, undos: %lu (%lu with nothing to undo)\n",
+         counts.adds, counts.edits, counts.removes, counts.undos, counts.empty_undos);
+  printf("Items left: %lu\n", remaining);
+
+#ifdef GC
+  h_pauses_t pauses;
+  h_pauses(heap, &pauses);
+  printf("Collections: %llu, %.3f ms paused, longest %.3f ms\n",
+         (unsigned long long) pauses.count, (double) pauses.total_ns / 1e6,
+         (double) pauses.max_ns / 1e6);
+  h_delete(heap);
+#else
+  db_delete(db);
+#endif
+  return 0;
+}
@@ -289,7 +289,15 @@ void *tree_insert(tree *t, void *key, void *value)
     }
   else
     {
+#ifdef GC
+      /// n points into a node or the tree, which the collection that
+      /// the allocation may run can move, so the slot is found again
+      node *new_node = tree_internal_node_new(key, value);
+      n = tree_internal_find(t, key);
+      *n = new_node;
+#else
       *n = tree_internal_node_new(key, value);
+#endif
     }
   return old_value;
 }
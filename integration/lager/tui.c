@@ -8,6 +8,8 @@
 #include "list.h"
 
 #ifdef GC
+#include <fcntl.h>
+#include <unistd.h>
 #include "../../gc.h"
 heap_t *heap;
 #endif
@@ -430,12 +432,24 @@ int main(int argc, char *argv[])
 {
 #ifdef GC
   heap = h_init(102400, false, 0.5);
+  // GC_RECORD=file records the session so that tools/gcreplay can replay it
+  int record_fd = -1;
+  if(getenv("GC_RECORD") != NULL)
+    {
+      record_fd = open(getenv("GC_RECORD"), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+      if(record_fd >= 0) h_record_start(heap, record_fd);
+    }
 #endif
 
   db *db = db_new();
   event_loop(db);
 
 #ifdef GC
+  if(record_fd >= 0)
+    {
+      h_record_stop(heap);
+      close(record_fd);
+    }
   h_delete(heap);
 #else
   db_delete(db);
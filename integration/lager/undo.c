@@ -6,6 +6,9 @@
 #ifdef GC
 #include "../../gc.h"
 extern heap_t *heap;
+
+/// The enum and the int are padded to the size of a pointer
+#define ACTION_LAYOUT "l**l*"
 #endif 
 
 void undo_store_action(undo_t *undo, action_t *action)
@@ -36,12 +39,12 @@ void undo_action_delete(action_t *a)
 {
   switch (a->type)
     {
-    case remove: // item is in DB so will be deleted from db_delete
+    case action_remove: // item is in DB so will be deleted from db_delete
       {
         break;
       }
-    case add:  // action has master copy -- should be deleted
-    case edit: // action has master copy -- should be deleted
+    case action_add:  // action has master copy -- should be deleted
+    case action_edit: // action has master copy -- should be deleted
       {
         good_delete(a->good);
         break;
@@ -52,11 +55,11 @@ void undo_action_delete(action_t *a)
 action_t *undo_new_add_action(good *g)
 {
 #ifdef GC
-  action_t *action = h_alloc_data(heap, sizeof(action_t));
+  action_t *action = h_alloc_struct(heap, ACTION_LAYOUT);
 #else
   action_t *action = calloc(1, sizeof(action_t));
 #endif
-  action->type = add;
+  action->type = action_add;
   action->name = good_name(g);
   action->good = g;
   return action;
@@ -65,11 +68,11 @@ action_t *undo_new_add_action(good *g)
 action_t *undo_new_remove_action(good *g)
 {
 #ifdef GC
-  action_t *action = h_alloc_data(heap, sizeof(action_t));
+  action_t *action = h_alloc_struct(heap, ACTION_LAYOUT);
 #else
   action_t *action = calloc(1, sizeof(action_t));
 #endif
-  action->type = remove;
+  action->type = action_remove;
   action->name = good_name(g);
   action->good = g;
   return action;
@@ -78,11 +81,11 @@ action_t *undo_new_remove_action(good *g)
 action_t *undo_new_edit_action(char *original_key, good *g)
 {
 #ifdef GC
-  action_t *action = h_alloc_data(heap, sizeof(action_t));
+  action_t *action = h_alloc_struct(heap, ACTION_LAYOUT);
 #else
   action_t *action = calloc(1, sizeof(action_t));
 #endif
-  action->type = edit;
+  action->type = action_edit;
   action->name = original_key;
   action->good = g;
   return action;
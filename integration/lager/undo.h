@@ -3,7 +3,7 @@
 #include "list.h"
 #include "db.h"
 
-enum action_type { add, remove, edit };
+enum action_type { action_add, action_remove, action_edit };
 
 struct action
 {
@@ -0,0 +1,326 @@
+#define _DEFAULT_SOURCE // backtrace_symbols
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <execinfo.h>
+
+#include "profiler.h"
+
+#define MIN_CAPACITY 256
+#define FRAME_NAME_MAX 256
+#define MAPS_BUFFER_SIZE 4096
+
+
+struct profiler
+{
+  uint64_t interval;
+  uint64_t next;
+  size_t count;
+  size_t capacity;       /**< sites that fit in @p sites */
+  profile_site_t *sites;
+  size_t index_capacity; /**< always a power of two */
+  size_t *index;         /**< the site number + 1 of every slot, 0 if free */
+};
+
+
+/*============================================================================
+ *                             SITE TABLE
+ *===========================================================================*/
+
+static uint64_t
+hash_site(void *frames[], size_t depth, const char *layout)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for(size_t i = 0; i < depth; ++i)
+    {
+      hash = (hash ^ (uint64_t) (uintptr_t) frames[i]) * 0x100000001b3ULL;
+    }
+  for(const char *c = layout; *c != '\0'; ++c)
+    {
+      hash = (hash ^ (uint64_t) (unsigned char) *c) * 0x100000001b3ULL;
+    }
+  return hash * 0x9E3779B97F4A7C15ULL;
+}
+
+
+static bool
+same_site(profile_site_t *site, void *frames[], size_t depth, const char *layout)
+{
+  return site->depth == depth
+    && memcmp(site->frames, frames, depth * sizeof(void *)) == 0
+    && strcmp(site->layout, layout) == 0;
+}
+
+
+/// The index uses linear probing, the slot of a site that is not in the
+/// table is the free slot it would be put in
+static size_t
+find_slot(profiler_t *profiler, void *frames[], size_t depth, const char *layout)
+{
+  size_t mask = profiler->index_capacity - 1;
+  size_t slot = (size_t) (hash_site(frames, depth, layout) >> 32) & mask;
+  while(profiler->index[slot] != 0
+        && !same_site(&profiler->sites[profiler->index[slot] - 1], frames, depth, layout))
+    {
+      slot = (slot + 1) & mask;
+    }
+  return slot;
+}
+
+
+static bool
+grow_index(profiler_t *profiler)
+{
+  size_t *old_index = profiler->index;
+  size_t *index = calloc(profiler->index_capacity * 2, sizeof(size_t));
+  if(index == NULL) return false;
+
+  profiler->index = index;
+  profiler->index_capacity *= 2;
+  for(size_t i = 0; i < profiler->count; ++i)
+    {
+      profile_site_t *site = &profiler->sites[i];
+      profiler->index[find_slot(profiler, site->frames, site->depth, site->layout)] = i + 1;
+    }
+  free(old_index);
+  return true;
+}
+
+
+static profile_site_t *
+find_or_insert(profiler_t *profiler, void *frames[], size_t depth, const char *layout)
+{
+  size_t slot = find_slot(profiler, frames, depth, layout);
+  if(profiler->index[slot] != 0) return &profiler->sites[profiler->index[slot] - 1];
+
+  if(profiler->count == profiler->capacity)
+    {
+      profile_site_t *sites = realloc(profiler->sites,
+                                      profiler->capacity * 2 * sizeof(profile_site_t));
+      if(sites == NULL) return NULL;
+      profiler->sites = sites;
+      profiler->capacity *= 2;
+    }
+  if((profiler->count + 1) * 2 > profiler->index_capacity)
+    {
+      if(!grow_index(profiler)) return NULL;
+      slot = find_slot(profiler, frames, depth, layout);
+    }
+
+  profile_site_t *site = &profiler->sites[profiler->count];
+  memset(site, 0, sizeof(profile_site_t));
+  site->depth = depth;
+  memcpy(site->frames, frames, depth * sizeof(void *));
+  strncpy(site->layout, layout, PROFILER_LAYOUT_MAX - 1);
+  profiler->index[slot] = ++profiler->count;
+  return site;
+}
+
+
+/*============================================================================
+ *                             SAMPLING
+ *===========================================================================*/
+
+profiler_t *
+profiler_create(size_t interval, uint64_t allocated)
+{
+  if(interval == 0) return NULL;
+
+  profiler_t *profiler = malloc(sizeof(profiler_t));
+  if(profiler == NULL) return NULL;
+  profiler->sites = malloc(MIN_CAPACITY * sizeof(profile_site_t));
+  profiler->index = calloc(MIN_CAPACITY * 2, sizeof(size_t));
+  if(profiler->sites == NULL || profiler->index == NULL)
+    {
+      profiler_delete(profiler);
+      return NULL;
+    }
+  profiler->interval = interval;
+  profiler->next = allocated + interval;
+  profiler->count = 0;
+  profiler->capacity = MIN_CAPACITY;
+  profiler->index_capacity = MIN_CAPACITY * 2;
+  return profiler;
+}
+
+
+void
+profiler_delete(profiler_t *profiler)
+{
+  if(profiler == NULL) return;
+  free(profiler->sites);
+  free(profiler->index);
+  free(profiler);
+}
+
+
+uint64_t
+profiler_next(profiler_t *profiler)
+{
+  assert(profiler != NULL);
+  return profiler->next;
+}
+
+
+bool
+profiler_sample(profiler_t *profiler, uint64_t allocated, size_t bytes,
+                const char *layout, void *frames[], size_t depth)
+{
+  assert(profiler != NULL);
+  assert(layout != NULL);
+  if(allocated < profiler->next || bytes == 0) return false;
+
+  uint64_t points = (allocated - profiler->next) / profiler->interval + 1;
+  profiler->next += points * profiler->interval;
+  if(depth > PROFILER_MAX_DEPTH) depth = PROFILER_MAX_DEPTH;
+
+  profile_site_t *site = find_or_insert(profiler, frames, depth, layout);
+  if(site == NULL) return false;
+  uint64_t weight = points * profiler->interval;
+  uint64_t objects = (weight + bytes / 2) / bytes;
+  site->samples += 1;
+  site->sampled_bytes += bytes;
+  site->estimated_bytes += weight;
+  site->estimated_count += objects > 0 ? objects : 1;
+  return true;
+}
+
+
+/*============================================================================
+ *                             SITES
+ *===========================================================================*/
+
+size_t
+profiler_sites(profiler_t *profiler)
+{
+  assert(profiler != NULL);
+  return profiler->count;
+}
+
+
+const profile_site_t *
+profiler_site(profiler_t *profiler, size_t index)
+{
+  assert(profiler != NULL);
+  return index < profiler->count ? &profiler->sites[index] : NULL;
+}
+
+
+/*============================================================================
+ *                             EXPORT
+ *===========================================================================*/
+
+/// Copies the mappings of the process, pprof finds the binaries in them
+static void
+write_mappings(FILE *out)
+{
+  fputs("\nMAPPED_LIBRARIES:\n", out);
+  FILE *maps = fopen("/proc/self/maps", "r");
+  if(maps == NULL) return;
+  char buffer[MAPS_BUFFER_SIZE];
+  size_t length;
+  while((length = fread(buffer, 1, sizeof(buffer), maps)) > 0)
+    {
+      fwrite(buffer, 1, length, out);
+    }
+  fclose(maps);
+}
+
+
+bool
+profiler_export_pprof(profiler_t *profiler, FILE *out)
+{
+  assert(profiler != NULL);
+  assert(out != NULL);
+  if(profiler == NULL || out == NULL) return false;
+
+  // Nothing is known about which objects are still alive, so the in use
+  // columns are 0 and pprof is read with -sample_index=alloc_space
+  uint64_t count = 0, bytes = 0;
+  for(size_t i = 0; i < profiler->count; ++i)
+    {
+      count += profiler->sites[i].estimated_count;
+      bytes += profiler->sites[i].estimated_bytes;
+    }
+  fprintf(out, "heap profile: 0: 0 [%" PRIu64 ": %" PRIu64 "] @ heapprofile\n", count, bytes);
+  for(size_t i = 0; i < profiler->count; ++i)
+    {
+      profile_site_t *site = &profiler->sites[i];
+      fprintf(out, "0: 0 [%" PRIu64 ": %" PRIu64 "] @", site->estimated_count,
+              site->estimated_bytes);
+      for(size_t f = 0; f < site->depth; ++f)
+        {
+          fprintf(out, " 0x%" PRIxPTR, (uintptr_t) site->frames[f]);
+        }
+      fputc('\n', out);
+    }
+  write_mappings(out);
+  return !ferror(out);
+}
+
+
+/// Names a frame from what backtrace_symbols() made of it, which is
+/// "module(function+0x1f) [0x...]" or "module(+0x1f) [0x...]" on glibc
+static void
+frame_name(const char *symbol, void *address, char *buffer, size_t size)
+{
+  const char *open = symbol != NULL ? strchr(symbol, '(') : NULL;
+  const char *plus = open != NULL ? strchr(open, '+') : NULL;
+  const char *close = plus != NULL ? strchr(plus, ')') : NULL;
+  if(close == NULL)
+    {
+      snprintf(buffer, size, "0x%" PRIxPTR, (uintptr_t) address);
+    }
+  else if(plus > open + 1)
+    {
+      snprintf(buffer, size, "%.*s", (int) (plus - open - 1), open + 1);
+    }
+  else
+    {
+      const char *module = symbol;
+      for(const char *c = symbol; c < open; ++c)
+        {
+          if(*c == '/') module = c + 1;
+        }
+      snprintf(buffer, size, "%.*s%.*s", (int) (open - module), module,
+               (int) (close - plus), plus);
+    }
+
+  // Spaces and semicolons separate the fields of a folded stack
+  for(char *c = buffer; *c != '\0'; ++c)
+    {
+      if(*c == ' ' || *c == ';') *c = '_';
+    }
+}
+
+
+bool
+profiler_export_folded(profiler_t *profiler, FILE *out)
+{
+  assert(profiler != NULL);
+  assert(out != NULL);
+  if(profiler == NULL || out == NULL) return false;
+
+  char name[FRAME_NAME_MAX];
+  for(size_t i = 0; i < profiler->count; ++i)
+    {
+      profile_site_t *site = &profiler->sites[i];
+      char **symbols = site->depth > 0
+        ? backtrace_symbols(site->frames, (int) site->depth) : NULL;
+      for(size_t f = site->depth; f > 0; --f)
+        {
+          frame_name(symbols != NULL ? symbols[f - 1] : NULL, site->frames[f - 1],
+                     name, sizeof(name));
+          fprintf(out, "%s;", name);
+        }
+      free(symbols);
+      fprintf(out, "[%s] %" PRIu64 "\n", site->layout[0] != '\0' ? site->layout : "data",
+              site->estimated_bytes);
+    }
+  return !ferror(out);
+}
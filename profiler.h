@@ -0,0 +1,170 @@
+/**
+ *  @file  profiler.h
+ *  @brief The allocation site profiles taken by h_profile_start().
+ *
+ *  The profiler samples one allocation every time another @p interval
+ *  bytes have been allocated on the heap. Each sample is attributed to
+ *  its site, the backtrace of the allocation together with the layout of
+ *  the allocated object, and is weighed by the bytes it stands for, so
+ *  that the estimated bytes of all sites add up to about the bytes
+ *  allocated on the heap. Allocations that happen with a fixed period
+ *  can line up with the interval and are then over- or undercounted.
+ *
+ *  Sites are exported either as a legacy pprof heap profile, which
+ *  `pprof` symbolizes from the addresses and the mappings written after
+ *  them, or as folded stacks, one line per site with the frames from the
+ *  outermost caller to the layout and the estimated bytes last, which
+ *  is what flamegraph.pl and speedscope read.
+ */
+
+#ifndef __profiler__
+#define __profiler__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define PROFILER_MAX_DEPTH 32  /**< deeper backtraces lose their outermost frames */
+#define PROFILER_LAYOUT_MAX 64 /**< longer layouts are cut to 63 chars */
+
+
+typedef struct profile_site profile_site_t;
+
+/**
+ *  @brief Everything sampled at one allocation site.
+ *
+ *  gc.h packs the structs declared after it, so this struct has no
+ *  padding to look the same with and without packing.
+ */
+struct profile_site
+{
+  uint64_t samples;          /**< the number of samples taken here */
+  uint64_t sampled_bytes;    /**< the sizes of the sampled objects */
+  uint64_t estimated_bytes;  /**< the bytes the samples stand for */
+  uint64_t estimated_count;  /**< the objects the samples stand for */
+  uint64_t depth;
+  void *frames[PROFILER_MAX_DEPTH]; /**< innermost frame first */
+  char layout[PROFILER_LAYOUT_MAX]; /**< empty for raw data */
+};
+
+
+typedef struct profiler profiler_t;
+
+
+/*============================================================================
+ *                             SAMPLING
+ *===========================================================================*/
+
+/**
+ *  @brief Creates a profiler that samples every @p interval bytes.
+ *
+ *  @param  interval the bytes allocated between two samples
+ *  @param  allocated the bytes allocated on the heap so far, the first
+ *          sample is taken @p interval bytes later
+ *  @return the new profiler or NULL if @p interval is 0 or memory cannot
+ *          be allocated
+ */
+profiler_t *
+profiler_create(size_t interval, uint64_t allocated);
+
+
+/**
+ *  @brief Deletes a profiler and its sites.
+ *
+ *  @param  profiler the profiler, may be NULL
+ */
+void
+profiler_delete(profiler_t *profiler);
+
+
+/**
+ *  @brief Gets the bytes allocated on the heap at which the next sample
+ *         is taken.
+ */
+uint64_t
+profiler_next(profiler_t *profiler);
+
+
+/**
+ *  @brief Samples an allocation if it reached the next sample.
+ *
+ *  The sample stands for one interval for every sample point passed
+ *  since the last sample, so an allocation that is found late or that
+ *  is larger than the interval is weighed by all of them.
+ *
+ *  @param  profiler the profiler
+ *  @param  allocated the bytes allocated on the heap, this allocation
+ *          included
+ *  @param  bytes the size of the allocation
+ *  @param  layout the layout of the allocated object, empty for raw data
+ *  @param  frames the backtrace of the allocation, innermost frame first
+ *  @param  depth the number of frames
+ *  @return true if the allocation was sampled
+ */
+bool
+profiler_sample(profiler_t *profiler, uint64_t allocated, size_t bytes,
+                const char *layout, void *frames[], size_t depth);
+
+
+/*============================================================================
+ *                             SITES
+ *===========================================================================*/
+
+/**
+ *  @brief Gets the number of sites that have been sampled.
+ */
+size_t
+profiler_sites(profiler_t *profiler);
+
+
+/**
+ *  @brief Gets a site, sites are numbered in the order they were found.
+ *
+ *  @param  profiler the profiler
+ *  @param  index the number of the site
+ *  @return the site or NULL if there is no such site
+ */
+const profile_site_t *
+profiler_site(profiler_t *profiler, size_t index);
+
+
+/*============================================================================
+ *                             EXPORT
+ *===========================================================================*/
+
+/**
+ *  @brief Writes the sites as a legacy pprof heap profile.
+ *
+ *  Every site is a line with its estimated objects and bytes followed by
+ *  the addresses of its frames. The mappings of the process are written
+ *  after the sites so that `pprof <program> <profile>` can find the
+ *  functions. The layout of a site is not part of the format, sites that
+ *  only differ in layout are merged by pprof.
+ *
+ *  @param  profiler the profiler
+ *  @param  out the stream to write to
+ *  @return true if everything was written
+ */
+bool
+profiler_export_pprof(profiler_t *profiler, FILE *out);
+
+
+/**
+ *  @brief Writes the sites as folded stacks.
+ *
+ *  Frames are named by their function when the program exports its
+ *  symbols (link with -rdynamic) and by their module and offset
+ *  otherwise. The last frame of every stack is the layout in brackets,
+ *  "[data]" for raw data.
+ *
+ *  @param  profiler the profiler
+ *  @param  out the stream to write to
+ *  @return true if everything was written
+ */
+bool
+profiler_export_folded(profiler_t *profiler, FILE *out);
+
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "profiler.h"
+
+#define INTERVAL 1024
+
+
+/**
+ *  @brief Makes a backtrace of made up return addresses
+ */
+void
+test_profiler_frames(void *frames[], size_t depth, uintptr_t first)
+{
+  for(size_t i = 0; i < depth; ++i)
+    {
+      frames[i] = (void *) (first + i);
+    }
+}
+
+/**
+ *  @brief Reads everything written to a temporary file
+ */
+char *
+test_profiler_read(FILE *file)
+{
+  long length = ftell(file);
+  char *text = calloc((size_t) length + 1, 1);
+  rewind(file);
+  CU_ASSERT(fread(text, 1, (size_t) length, file) == (size_t) length);
+  return text;
+}
+
+
+/*============================================================================
+ *                             SAMPLING TESTING SUITE
+ *===========================================================================*/
+
+void
+test_profiler_create()
+{
+  CU_ASSERT(profiler_create(0, 0) == NULL);
+
+  profiler_t *profiler = profiler_create(INTERVAL, 100);
+  CU_ASSERT(profiler != NULL);
+  CU_ASSERT(profiler_next(profiler) == 100 + INTERVAL);
+  CU_ASSERT(profiler_sites(profiler) == 0);
+  CU_ASSERT(profiler_site(profiler, 0) == NULL);
+  profiler_delete(profiler);
+  profiler_delete(NULL);
+}
+
+void
+test_profiler_interval()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[2];
+  test_profiler_frames(frames, 2, 0x1000);
+
+  CU_ASSERT_FALSE(profiler_sample(profiler, INTERVAL - 1, 16, "**i", frames, 2));
+  CU_ASSERT(profiler_sample(profiler, INTERVAL, 16, "**i", frames, 2));
+  CU_ASSERT(profiler_next(profiler) == 2 * INTERVAL);
+  CU_ASSERT_FALSE(profiler_sample(profiler, INTERVAL + 16, 16, "**i", frames, 2));
+
+  const profile_site_t *site = profiler_site(profiler, 0);
+  CU_ASSERT(site->samples == 1);
+  CU_ASSERT(site->sampled_bytes == 16);
+  CU_ASSERT(site->estimated_bytes == INTERVAL);
+  CU_ASSERT(site->estimated_count == INTERVAL / 16);
+  CU_ASSERT(site->depth == 2);
+  CU_ASSERT(site->frames[1] == (void *) 0x1001);
+  CU_ASSERT(strcmp(site->layout, "**i") == 0);
+  profiler_delete(profiler);
+}
+
+void
+test_profiler_late_sample()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[1];
+  test_profiler_frames(frames, 1, 0x1000);
+
+  // Passed three sample points, the last one half an interval ago
+  CU_ASSERT(profiler_sample(profiler, 3 * INTERVAL + INTERVAL / 2, 2048, "", frames, 1));
+  CU_ASSERT(profiler_next(profiler) == 4 * INTERVAL);
+
+  const profile_site_t *site = profiler_site(profiler, 0);
+  CU_ASSERT(site->samples == 1);
+  CU_ASSERT(site->estimated_bytes == 3 * INTERVAL);
+  CU_ASSERT(site->estimated_count == 2);
+  profiler_delete(profiler);
+}
+
+
+/*============================================================================
+ *                             SITES TESTING SUITE
+ *===========================================================================*/
+
+void
+test_profiler_same_site()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[3];
+  test_profiler_frames(frames, 3, 0x1000);
+
+  for(uint64_t i = 1; i <= 10; ++i)
+    {
+      CU_ASSERT(profiler_sample(profiler, i * INTERVAL, 32, "*i", frames, 3));
+    }
+  CU_ASSERT(profiler_sites(profiler) == 1);
+  CU_ASSERT(profiler_site(profiler, 0)->samples == 10);
+  CU_ASSERT(profiler_site(profiler, 0)->estimated_bytes == 10 * INTERVAL);
+
+  // Another layout or a shorter backtrace is another site
+  CU_ASSERT(profiler_sample(profiler, 11 * INTERVAL, 32, "i*", frames, 3));
+  CU_ASSERT(profiler_sample(profiler, 12 * INTERVAL, 32, "*i", frames, 2));
+  CU_ASSERT(profiler_sites(profiler) == 3);
+  CU_ASSERT(profiler_site(profiler, 0)->samples == 10);
+  profiler_delete(profiler);
+}
+
+void
+test_profiler_many_sites()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  const size_t count = 5000;
+  void *frames[4];
+
+  for(size_t round = 0; round < 2; ++round)
+    {
+      for(size_t i = 0; i < count; ++i)
+        {
+          test_profiler_frames(frames, 4, 0x1000 + 16 * i);
+          uint64_t allocated = (round * count + i + 1) * INTERVAL;
+          CU_ASSERT(profiler_sample(profiler, allocated, 64, "8*", frames, 4));
+        }
+    }
+  CU_ASSERT(profiler_sites(profiler) == count);
+
+  bool found = true;
+  for(size_t i = 0; i < count; ++i)
+    {
+      const profile_site_t *site = profiler_site(profiler, i);
+      found = found && site->samples == 2 && site->frames[0] == (void *) (0x1000 + 16 * i);
+    }
+  CU_ASSERT(found);
+  profiler_delete(profiler);
+}
+
+void
+test_profiler_deep_backtrace()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[PROFILER_MAX_DEPTH + 8];
+  test_profiler_frames(frames, PROFILER_MAX_DEPTH + 8, 0x1000);
+
+  CU_ASSERT(profiler_sample(profiler, INTERVAL, 16, "", frames, PROFILER_MAX_DEPTH + 8));
+  CU_ASSERT(profiler_site(profiler, 0)->depth == PROFILER_MAX_DEPTH);
+  CU_ASSERT(profiler_site(profiler, 0)->frames[0] == (void *) 0x1000);
+  profiler_delete(profiler);
+}
+
+
+/*============================================================================
+ *                             EXPORT TESTING SUITE
+ *===========================================================================*/
+
+void
+test_profiler_pprof()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[2];
+  test_profiler_frames(frames, 2, 0x1000);
+  profiler_sample(profiler, INTERVAL, 64, "**i", frames, 2);
+  profiler_sample(profiler, 3 * INTERVAL, 64, "**i", frames, 2);
+
+  FILE *file = tmpfile();
+  CU_ASSERT(profiler_export_pprof(profiler, file));
+  char *text = test_profiler_read(file);
+  const char *header = "heap profile: 0: 0 [48: 3072] @ heapprofile\n";
+  CU_ASSERT(strncmp(text, header, strlen(header)) == 0);
+  CU_ASSERT(strstr(text, "\n0: 0 [48: 3072] @ 0x1000 0x1001\n") != NULL);
+  CU_ASSERT(strstr(text, "\nMAPPED_LIBRARIES:\n") != NULL);
+
+  free(text);
+  fclose(file);
+  profiler_delete(profiler);
+}
+
+void
+test_profiler_folded()
+{
+  profiler_t *profiler = profiler_create(INTERVAL, 0);
+  void *frames[2];
+  test_profiler_frames(frames, 2, 0x1000);
+  profiler_sample(profiler, INTERVAL, 64, "**i", frames, 2);
+  profiler_sample(profiler, 2 * INTERVAL, 64, "", frames, 2);
+
+  FILE *file = tmpfile();
+  CU_ASSERT(profiler_export_folded(profiler, file));
+  char *text = test_profiler_read(file);
+
+  // Made up addresses have no symbols and keep their address, the
+  // outermost frame comes first
+  CU_ASSERT(strcmp(text, "0x1001;0x1000;[**i] 1024\n0x1001;0x1000;[data] 1024\n") == 0);
+
+  free(text);
+  fclose(file);
+  profiler_delete(profiler);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_sampling = NULL;
+  CU_pSuite suite_sites = NULL;
+  CU_pSuite suite_export = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_sampling = CU_add_suite("Tests sampling allocations", NULL, NULL);
+  if (suite_sampling == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_sampling
+                            , "create and delete"
+                            , test_profiler_create) )
+       || (NULL == CU_add_test(suite_sampling
+                               , "one sample per interval"
+                               , test_profiler_interval) )
+       || (NULL == CU_add_test(suite_sampling
+                               , "late samples weigh more"
+                               , test_profiler_late_sample) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_sites = CU_add_suite("Tests allocation sites", NULL, NULL);
+  if (suite_sites == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_sites
+                            , "samples of the same site"
+                            , test_profiler_same_site) )
+       || (NULL == CU_add_test(suite_sites
+                               , "many sites"
+                               , test_profiler_many_sites) )
+       || (NULL == CU_add_test(suite_sites
+                               , "deep backtraces"
+                               , test_profiler_deep_backtrace) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_export = CU_add_suite("Tests exporting profiles", NULL, NULL);
+  if (suite_export == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_export
+                            , "pprof heap profile"
+                            , test_profiler_pprof) )
+       || (NULL == CU_add_test(suite_export
+                               , "folded stacks"
+                               , test_profiler_folded) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
@@ -0,0 +1,527 @@
+#define _DEFAULT_SOURCE // strnlen
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "recorder.h"
+
+#define BUFFER_SIZE 65536
+#define MIN_CAPACITY 1024
+#define VARINT_MAX 10
+
+
+typedef struct recorder_entry recorder_entry_t;
+
+/**
+ *  @brief What the recorder knows about an object on the heap.
+ *
+ *  @p targets holds the ids last recorded for the pointer fields of the
+ *  object, in the order get_pointers_in_struct() returns them.
+ */
+struct recorder_entry
+{
+  void *address;
+  uint64_t id;
+  uint64_t seen;      /**< the last collection the object survived */
+  uint64_t rooted;    /**< the last collection it was found from the stack */
+  bool root;          /**< if it was recorded as a root */
+  size_t slots;
+  uint64_t *targets;
+};
+
+struct recorder
+{
+  int fd;
+  bool ok;
+  size_t used;
+  uint64_t next_id;
+  uint64_t collection;
+  size_t count;
+  size_t capacity; /**< always a power of two */
+  recorder_entry_t *entries;
+  unsigned char buffer[BUFFER_SIZE];
+};
+
+
+/*============================================================================
+ *                             OUTPUT
+ *===========================================================================*/
+
+static void
+flush(recorder_t *recorder)
+{
+  size_t written = 0;
+  while(recorder->ok && written < recorder->used)
+    {
+      ssize_t result = write(recorder->fd, recorder->buffer + written,
+                             recorder->used - written);
+      if(result < 0 && errno == EINTR) continue;
+      if(result <= 0)
+        {
+          recorder->ok = false;
+        }
+      else
+        {
+          written += (size_t) result;
+        }
+    }
+  recorder->used = 0;
+}
+
+
+static void
+put_bytes(recorder_t *recorder, const void *data, size_t bytes)
+{
+  const unsigned char *from = data;
+  while(bytes > 0 && recorder->ok)
+    {
+      if(recorder->used == BUFFER_SIZE) flush(recorder);
+      size_t room = BUFFER_SIZE - recorder->used;
+      size_t chunk = bytes < room ? bytes : room;
+      memcpy(recorder->buffer + recorder->used, from, chunk);
+      recorder->used += chunk;
+      from += chunk;
+      bytes -= chunk;
+    }
+}
+
+
+static void
+put_varint(recorder_t *recorder, uint64_t value)
+{
+  unsigned char bytes[VARINT_MAX];
+  size_t length = 0;
+  do
+    {
+      unsigned char byte = value & 0x7f;
+      value >>= 7;
+      bytes[length++] = value != 0 ? byte | 0x80 : byte;
+    }
+  while(value != 0);
+  put_bytes(recorder, bytes, length);
+}
+
+
+recorder_t *
+recorder_create(int fd, recording_header_t *header)
+{
+  assert(header != NULL);
+  if(fd < 0 || header == NULL) return NULL;
+
+  recorder_t *recorder = malloc(sizeof(recorder_t));
+  if(recorder == NULL) return NULL;
+  recorder->entries = calloc(MIN_CAPACITY, sizeof(recorder_entry_t));
+  if(recorder->entries == NULL)
+    {
+      free(recorder);
+      return NULL;
+    }
+  recorder->fd = fd;
+  recorder->ok = true;
+  recorder->used = 0;
+  recorder->next_id = 1;
+  recorder->collection = 0;
+  recorder->count = 0;
+  recorder->capacity = MIN_CAPACITY;
+
+  memcpy(header->magic, RECORDING_MAGIC, RECORDING_MAGIC_SIZE);
+  header->version = RECORDING_VERSION;
+  put_bytes(recorder, header, sizeof(recording_header_t));
+  return recorder;
+}
+
+
+bool
+recorder_finish(recorder_t *recorder)
+{
+  if(recorder == NULL) return false;
+
+  record_t end = { .tag = RECORD_END };
+  recorder_write(recorder, &end);
+  flush(recorder);
+  bool ok = recorder->ok;
+
+  for(size_t i = 0; i < recorder->capacity; ++i)
+    {
+      free(recorder->entries[i].targets);
+    }
+  free(recorder->entries);
+  free(recorder);
+  return ok;
+}
+
+
+void
+recorder_write(recorder_t *recorder, record_t *record)
+{
+  uint8_t tag = (uint8_t) record->tag;
+  put_bytes(recorder, &tag, 1);
+  switch(record->tag)
+    {
+    case RECORD_ALLOC:
+      {
+        size_t length = strnlen(record->layout, RECORDING_LAYOUT_MAX - 1);
+        put_varint(recorder, record->id);
+        put_varint(recorder, record->kind);
+        put_varint(recorder, record->size);
+        put_varint(recorder, length);
+        put_bytes(recorder, record->layout, length);
+        break;
+      }
+    case RECORD_RESIZE:
+      put_varint(recorder, record->id);
+      put_varint(recorder, record->size);
+      break;
+    case RECORD_STORE:
+      put_varint(recorder, record->id);
+      put_varint(recorder, record->offset);
+      put_varint(recorder, record->target);
+      break;
+    case RECORD_ROOT:
+    case RECORD_UNROOT:
+    case RECORD_DEATH:
+    case RECORD_COLLECTION:
+      put_varint(recorder, record->id);
+      break;
+    default:
+      break;
+    }
+}
+
+
+/*============================================================================
+ *                             OBJECT TABLE
+ *===========================================================================*/
+
+/// The table uses linear probing, a NULL address marks a free entry
+static size_t
+slot_of(recorder_t *recorder, void *address)
+{
+  uint64_t hash = ((uint64_t) (uintptr_t) address >> 3) * 0x9E3779B97F4A7C15ULL;
+  return (size_t) (hash >> 32) & (recorder->capacity - 1);
+}
+
+
+static size_t
+find_slot(recorder_t *recorder, void *address)
+{
+  size_t slot = slot_of(recorder, address);
+  while(recorder->entries[slot].address != NULL
+        && recorder->entries[slot].address != address)
+    {
+      slot = (slot + 1) & (recorder->capacity - 1);
+    }
+  return slot;
+}
+
+
+static bool
+grow(recorder_t *recorder)
+{
+  size_t old_capacity = recorder->capacity;
+  recorder_entry_t *old_entries = recorder->entries;
+  recorder_entry_t *entries = calloc(old_capacity * 2, sizeof(recorder_entry_t));
+  if(entries == NULL) return false;
+
+  recorder->entries = entries;
+  recorder->capacity = old_capacity * 2;
+  for(size_t i = 0; i < old_capacity; ++i)
+    {
+      if(old_entries[i].address == NULL) continue;
+      recorder->entries[find_slot(recorder, old_entries[i].address)] = old_entries[i];
+    }
+  free(old_entries);
+  return true;
+}
+
+
+static recorder_entry_t *
+insert(recorder_t *recorder, recorder_entry_t *entry)
+{
+  if((recorder->count + 1) * 2 > recorder->capacity && !grow(recorder)) return NULL;
+  size_t slot = find_slot(recorder, entry->address);
+  if(recorder->entries[slot].address == NULL) ++recorder->count;
+  recorder->entries[slot] = *entry;
+  return &recorder->entries[slot];
+}
+
+
+/// Empties a slot and moves the entries after it back so that every
+/// entry can still be reached from its home slot
+static void
+erase_slot(recorder_t *recorder, size_t slot)
+{
+  size_t mask = recorder->capacity - 1;
+  size_t hole = slot;
+  size_t next = (hole + 1) & mask;
+  while(recorder->entries[next].address != NULL)
+    {
+      size_t home = slot_of(recorder, recorder->entries[next].address);
+      if(((next - home) & mask) >= ((next - hole) & mask))
+        {
+          recorder->entries[hole] = recorder->entries[next];
+          hole = next;
+        }
+      next = (next + 1) & mask;
+    }
+  memset(&recorder->entries[hole], 0, sizeof(recorder_entry_t));
+  --recorder->count;
+}
+
+
+static recorder_entry_t *
+find(recorder_t *recorder, void *address)
+{
+  if(recorder == NULL || address == NULL) return NULL;
+  size_t slot = find_slot(recorder, address);
+  return recorder->entries[slot].address == NULL ? NULL : &recorder->entries[slot];
+}
+
+
+uint64_t
+recorder_add(recorder_t *recorder, void *address, size_t slots)
+{
+  assert(recorder != NULL);
+  assert(address != NULL);
+
+  recorder_entry_t entry;
+  memset(&entry, 0, sizeof(entry));
+  entry.address = address;
+  entry.id = recorder->next_id;
+  entry.seen = recorder->collection;
+  entry.slots = slots;
+  if(slots > 0)
+    {
+      entry.targets = calloc(slots, sizeof(uint64_t));
+      if(entry.targets == NULL) return 0;
+    }
+
+  recorder_entry_t *stale = find(recorder, address);
+  if(stale != NULL)
+    {
+      record_t death = { .tag = RECORD_DEATH, .id = stale->id };
+      recorder_write(recorder, &death);
+      recorder_remove(recorder, address);
+    }
+  if(insert(recorder, &entry) == NULL)
+    {
+      free(entry.targets);
+      return 0;
+    }
+  return recorder->next_id++;
+}
+
+
+uint64_t
+recorder_id(recorder_t *recorder, void *address)
+{
+  recorder_entry_t *entry = find(recorder, address);
+  return entry == NULL ? 0 : entry->id;
+}
+
+
+bool
+recorder_set_target(recorder_t *recorder, void *address, size_t slot, uint64_t target)
+{
+  recorder_entry_t *entry = find(recorder, address);
+  if(entry == NULL || slot >= entry->slots || entry->targets[slot] == target) return false;
+  entry->targets[slot] = target;
+  return true;
+}
+
+
+void
+recorder_move(recorder_t *recorder, void *from, void *to)
+{
+  if(from == to) return;
+  size_t slot = find_slot(recorder, from);
+  if(recorder->entries[slot].address == NULL) return;
+
+  recorder_entry_t moved = recorder->entries[slot];
+  erase_slot(recorder, slot);
+
+  recorder_entry_t *stale = find(recorder, to);
+  if(stale != NULL)
+    {
+      record_t death = { .tag = RECORD_DEATH, .id = stale->id };
+      recorder_write(recorder, &death);
+      recorder_remove(recorder, to);
+    }
+
+  moved.address = to;
+  if(insert(recorder, &moved) == NULL) free(moved.targets);
+}
+
+
+void
+recorder_remove(recorder_t *recorder, void *address)
+{
+  size_t slot = find_slot(recorder, address);
+  if(recorder->entries[slot].address == NULL) return;
+  free(recorder->entries[slot].targets);
+  erase_slot(recorder, slot);
+}
+
+
+size_t
+recorder_size(recorder_t *recorder)
+{
+  return recorder == NULL ? 0 : recorder->count;
+}
+
+
+/*============================================================================
+ *                             COLLECTIONS
+ *===========================================================================*/
+
+void
+recorder_begin_collection(recorder_t *recorder)
+{
+  ++recorder->collection;
+}
+
+
+void
+recorder_mark_root(recorder_t *recorder, void *address)
+{
+  recorder_entry_t *entry = find(recorder, address);
+  if(entry != NULL) entry->rooted = recorder->collection;
+}
+
+
+bool
+recorder_mark_live(recorder_t *recorder, void *address)
+{
+  recorder_entry_t *entry = find(recorder, address);
+  if(entry == NULL) return false;
+  entry->seen = recorder->collection;
+  return true;
+}
+
+
+void
+recorder_end_collection(recorder_t *recorder, uint64_t collections)
+{
+  size_t dead = 0;
+  for(size_t i = 0; i < recorder->capacity; ++i)
+    {
+      recorder_entry_t *entry = &recorder->entries[i];
+      if(entry->address == NULL) continue;
+
+      record_t record = { .id = entry->id };
+      if(entry->seen != recorder->collection)
+        {
+          record.tag = RECORD_DEATH;
+          recorder_write(recorder, &record);
+          ++dead;
+        }
+      else if(entry->rooted == recorder->collection && !entry->root)
+        {
+          record.tag = RECORD_ROOT;
+          recorder_write(recorder, &record);
+          entry->root = true;
+        }
+      else if(entry->rooted != recorder->collection && entry->root)
+        {
+          record.tag = RECORD_UNROOT;
+          recorder_write(recorder, &record);
+          entry->root = false;
+        }
+    }
+
+  // Removing an entry can move a later one into its slot, so the slot is
+  // looked at again
+  for(size_t i = 0; dead > 0 && i < recorder->capacity; ++i)
+    {
+      recorder_entry_t *entry = &recorder->entries[i];
+      if(entry->address != NULL && entry->seen != recorder->collection)
+        {
+          free(entry->targets);
+          erase_slot(recorder, i);
+          --dead;
+          --i;
+        }
+    }
+
+  record_t collection = { .tag = RECORD_COLLECTION, .id = collections };
+  recorder_write(recorder, &collection);
+}
+
+
+/*============================================================================
+ *                             READING
+ *===========================================================================*/
+
+static bool
+get_varint(FILE *in, uint64_t *value)
+{
+  *value = 0;
+  for(int shift = 0; shift < 64; shift += 7)
+    {
+      int byte = fgetc(in);
+      if(byte == EOF) return false;
+      *value |= (uint64_t) (byte & 0x7f) << shift;
+      if((byte & 0x80) == 0) return true;
+    }
+  return false;
+}
+
+
+bool
+recording_read_header(FILE *in, recording_header_t *header)
+{
+  assert(in != NULL);
+  assert(header != NULL);
+  if(fread(header, sizeof(recording_header_t), 1, in) != 1) return false;
+  return memcmp(header->magic, RECORDING_MAGIC, RECORDING_MAGIC_SIZE) == 0
+    && header->version == RECORDING_VERSION;
+}
+
+
+bool
+recording_read(FILE *in, record_t *record)
+{
+  assert(in != NULL);
+  assert(record != NULL);
+  int tag = fgetc(in);
+  if(tag == EOF) return false;
+  memset(record, 0, sizeof(*record));
+  record->tag = (uint32_t) tag;
+
+  uint64_t kind = 0;
+  uint64_t length = 0;
+  switch(tag)
+    {
+    case RECORD_ALLOC:
+      if(!get_varint(in, &record->id) || !get_varint(in, &kind)
+         || !get_varint(in, &record->size) || !get_varint(in, &length)
+         || length >= RECORDING_LAYOUT_MAX)
+        {
+          return false;
+        }
+      record->kind = (uint32_t) kind;
+      if(fread(record->layout, 1, length, in) != length) return false;
+      record->layout[length] = '\0';
+      return true;
+    case RECORD_RESIZE:
+      return get_varint(in, &record->id) && get_varint(in, &record->size);
+    case RECORD_STORE:
+      return get_varint(in, &record->id) && get_varint(in, &record->offset)
+        && get_varint(in, &record->target);
+    case RECORD_ROOT:
+    case RECORD_UNROOT:
+    case RECORD_DEATH:
+    case RECORD_COLLECTION:
+      return get_varint(in, &record->id);
+    case RECORD_END:
+      return true;
+    default:
+      return false;
+    }
+}
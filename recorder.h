@@ -0,0 +1,284 @@
+/**
+ *  @file  recorder.h
+ *  @brief The allocation recordings written by h_record_start().
+ *
+ *  A recording starts with a recording_header_t and is followed by
+ *  records that each start with a one byte tag. Every number after the
+ *  tag is an unsigned LEB128 varint, the layout is written as its length
+ *  followed by its characters.
+ *
+ *  @code
+ *  'A' id kind size layout_length layout    an object was allocated
+ *  'Z' id size                              an object was resized
+ *  'S' id offset target                     a pointer field has a new value
+ *  'R' id                                   an object became a root
+ *  'U' id                                   an object is no longer a root
+ *  'D' id                                   an object died
+ *  'C' collections                          a collection was run
+ *  'E'                                      end of the recording
+ *  @endcode
+ *
+ *  Objects are named by ids that start at 1, the target 0 is NULL. The
+ *  size of a raw object is its number of bytes, the size of an array is
+ *  its number of elements and a struct has size 0. The offset of a
+ *  store is the byte offset of the field in the object.
+ *
+ *  The collector has no write barrier, so stores, roots and deaths are
+ *  found by looking at the heap after each collection and are written
+ *  just before its 'C' record. Between two collections only allocations
+ *  are recorded as they happen.
+ */
+
+#ifndef __recorder__
+#define __recorder__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define RECORDING_MAGIC "GCREC\0\0"
+#define RECORDING_MAGIC_SIZE 8
+#define RECORDING_VERSION 1
+#define RECORDING_LAYOUT_MAX 256 /**< longer layouts are cut to 255 chars */
+
+#define RECORD_ALLOC 'A'
+#define RECORD_RESIZE 'Z'
+#define RECORD_STORE 'S'
+#define RECORD_ROOT 'R'
+#define RECORD_UNROOT 'U'
+#define RECORD_DEATH 'D'
+#define RECORD_COLLECTION 'C'
+#define RECORD_END 'E'
+
+
+/**
+ *  @brief What kind of object an allocation record describes.
+ */
+enum record_kind
+  {
+    RECORD_RAW
+    , RECORD_STRUCT
+    , RECORD_ARRAY
+  };
+
+
+typedef struct recording_header recording_header_t;
+
+/**
+ *  @brief The configuration of the recorded heap, used as the default
+ *         configuration when the recording is replayed.
+ */
+struct recording_header
+{
+  char magic[RECORDING_MAGIC_SIZE];
+  uint32_t version;
+  uint32_t page_size;
+  uint64_t heap_size;
+  float gc_threshold;
+  uint32_t unsafe_stack;
+};
+
+
+typedef struct record record_t;
+
+/**
+ *  @brief One decoded record, only the fields of its tag are used.
+ *
+ *  gc.h packs the structs declared after it, so this struct has no
+ *  padding to look the same with and without packing.
+ */
+struct record
+{
+  uint64_t id;
+  uint64_t size;
+  uint64_t offset;
+  uint64_t target;
+  uint32_t tag;
+  uint32_t kind;
+  char layout[RECORDING_LAYOUT_MAX];
+};
+
+
+typedef struct recorder recorder_t;
+
+
+/*============================================================================
+ *                             WRITING
+ *===========================================================================*/
+
+/**
+ *  @brief Creates a recorder that writes to @p fd and writes the header.
+ *
+ *  @param  fd an open file descriptor to write to
+ *  @param  header the header of the recording, magic and version are set
+ *  @return the new recorder or NULL if memory cannot be allocated
+ */
+recorder_t *
+recorder_create(int fd, recording_header_t *header);
+
+
+/**
+ *  @brief Writes the end record and deletes a recorder.
+ *
+ *  The file descriptor is not closed.
+ *
+ *  @param  recorder the recorder, may be NULL
+ *  @return true if every record was written
+ */
+bool
+recorder_finish(recorder_t *recorder);
+
+
+/**
+ *  @brief Writes a record.
+ *
+ *  @param  recorder the recorder
+ *  @param  record the record, the fields of its tag are written
+ */
+void
+recorder_write(recorder_t *recorder, record_t *record);
+
+
+/*============================================================================
+ *                             OBJECTS
+ *===========================================================================*/
+
+/**
+ *  @brief Gives the object at @p address a new id.
+ *
+ *  Nothing is written for the new object, the caller writes the
+ *  allocation record. An object already known at @p address is recorded
+ *  as dead.
+ *
+ *  @param  recorder the recorder
+ *  @param  address the address of the object
+ *  @param  slots the number of pointer fields of the object
+ *  @return the id of the object or 0 if memory cannot be allocated
+ */
+uint64_t
+recorder_add(recorder_t *recorder, void *address, size_t slots);
+
+
+/**
+ *  @brief Gets the id of the object at @p address.
+ *
+ *  @return the id or 0 if the address is unknown
+ */
+uint64_t
+recorder_id(recorder_t *recorder, void *address);
+
+
+/**
+ *  @brief Remembers the id a pointer field of an object points at.
+ *
+ *  @param  recorder the recorder
+ *  @param  address the address of the object
+ *  @param  slot the index of the pointer field
+ *  @param  target the id the field points at, 0 for NULL
+ *  @return true if the field pointed at something else before
+ */
+bool
+recorder_set_target(recorder_t *recorder, void *address, size_t slot, uint64_t target);
+
+
+/**
+ *  @brief Tells the recorder that an object has been copied.
+ *
+ *  An object still known at @p to was left on a page that has since been
+ *  evacuated and reused, so it is recorded as dead.
+ *
+ *  @param  recorder the recorder
+ *  @param  from the old address
+ *  @param  to the new address
+ */
+void
+recorder_move(recorder_t *recorder, void *from, void *to);
+
+
+/**
+ *  @brief Forgets an object without recording anything.
+ */
+void
+recorder_remove(recorder_t *recorder, void *address);
+
+
+/**
+ *  @brief Gets the number of objects the recorder knows.
+ */
+size_t
+recorder_size(recorder_t *recorder);
+
+
+/*============================================================================
+ *                             COLLECTIONS
+ *===========================================================================*/
+
+/**
+ *  @brief Starts recording a collection.
+ *
+ *  Between this call and recorder_end_collection() the collector marks
+ *  the objects found from the stack and the objects that survived.
+ */
+void
+recorder_begin_collection(recorder_t *recorder);
+
+
+/**
+ *  @brief Marks the object at @p address as found from the stack.
+ */
+void
+recorder_mark_root(recorder_t *recorder, void *address);
+
+
+/**
+ *  @brief Marks the object at @p address as alive.
+ *
+ *  @return false if the address is unknown
+ */
+bool
+recorder_mark_live(recorder_t *recorder, void *address);
+
+
+/**
+ *  @brief Ends recording a collection.
+ *
+ *  Writes a death record for every object that was not marked alive,
+ *  root and unroot records for the objects whose root status changed and
+ *  the collection record.
+ *
+ *  @param  recorder the recorder
+ *  @param  collections the number of collections run on the heap
+ */
+void
+recorder_end_collection(recorder_t *recorder, uint64_t collections);
+
+
+/*============================================================================
+ *                             READING
+ *===========================================================================*/
+
+/**
+ *  @brief Reads and checks the header of a recording.
+ *
+ *  @param  in the recording
+ *  @param  header where to put the header
+ *  @return true if the header is from a recording of this version
+ */
+bool
+recording_read_header(FILE *in, recording_header_t *header);
+
+
+/**
+ *  @brief Reads the next record of a recording.
+ *
+ *  @param  in the recording
+ *  @param  record where to put the record
+ *  @return true if a whole record was read
+ */
+bool
+recording_read(FILE *in, record_t *record);
+
+
+#endif
@@ -0,0 +1,371 @@
+#define _DEFAULT_SOURCE // fileno
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "recorder.h"
+
+
+/**
+ *  @brief Creates a recorder that writes to a temporary file
+ */
+recorder_t *
+test_recorder_create(FILE **file)
+{
+  *file = tmpfile();
+  recording_header_t header = { .page_size = 2048
+                                , .heap_size = 1 << 20
+                                , .gc_threshold = 0.5f };
+  return recorder_create(fileno(*file), &header);
+}
+
+/**
+ *  @brief Finishes a recorder and reads back the header of its file
+ */
+void
+test_recorder_reopen(recorder_t *recorder, FILE *file)
+{
+  CU_ASSERT(recorder_finish(recorder));
+  rewind(file);
+  recording_header_t header;
+  CU_ASSERT(recording_read_header(file, &header));
+}
+
+/**
+ *  @brief Reads the next record and checks its tag and id
+ */
+void
+test_recorder_expect(FILE *file, char tag, uint64_t id)
+{
+  record_t record;
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == (uint32_t) tag);
+  CU_ASSERT(record.id == id);
+}
+
+
+/*============================================================================
+ *                             FORMAT TESTING SUITE
+ *===========================================================================*/
+
+void
+test_recorder_header()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  CU_ASSERT(recorder != NULL);
+  CU_ASSERT(recorder_finish(recorder));
+  rewind(file);
+
+  recording_header_t header;
+  CU_ASSERT(recording_read_header(file, &header));
+  CU_ASSERT(memcmp(header.magic, RECORDING_MAGIC, RECORDING_MAGIC_SIZE) == 0);
+  CU_ASSERT(header.version == RECORDING_VERSION);
+  CU_ASSERT(header.page_size == 2048);
+  CU_ASSERT(header.heap_size == 1 << 20);
+  CU_ASSERT(header.gc_threshold == 0.5f);
+  test_recorder_expect(file, RECORD_END, 0);
+
+  record_t record;
+  CU_ASSERT_FALSE(recording_read(file, &record));
+  fclose(file);
+}
+
+void
+test_recorder_bad_header()
+{
+  FILE *file = tmpfile();
+  fputs("not a recording of anything", file);
+  rewind(file);
+  recording_header_t header;
+  CU_ASSERT_FALSE(recording_read_header(file, &header));
+  fclose(file);
+}
+
+void
+test_recorder_round_trip()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+
+  record_t alloc = { .tag = RECORD_ALLOC, .id = 1, .kind = RECORD_STRUCT };
+  strcpy(alloc.layout, "**i");
+  recorder_write(recorder, &alloc);
+  record_t resize = { .tag = RECORD_RESIZE, .id = 300, .size = UINT64_MAX };
+  recorder_write(recorder, &resize);
+  record_t store = { .tag = RECORD_STORE, .id = 1, .offset = 8, .target = 1ULL << 40 };
+  recorder_write(recorder, &store);
+  record_t collection = { .tag = RECORD_COLLECTION, .id = 127 };
+  recorder_write(recorder, &collection);
+  test_recorder_reopen(recorder, file);
+
+  record_t record;
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_ALLOC);
+  CU_ASSERT(record.kind == RECORD_STRUCT);
+  CU_ASSERT(strcmp(record.layout, "**i") == 0);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_RESIZE);
+  CU_ASSERT(record.id == 300);
+  CU_ASSERT(record.size == UINT64_MAX);
+  CU_ASSERT(recording_read(file, &record));
+  CU_ASSERT(record.tag == RECORD_STORE);
+  CU_ASSERT(record.offset == 8);
+  CU_ASSERT(record.target == 1ULL << 40);
+  test_recorder_expect(file, RECORD_COLLECTION, 127);
+  test_recorder_expect(file, RECORD_END, 0);
+  fclose(file);
+}
+
+
+/*============================================================================
+ *                             OBJECTS TESTING SUITE
+ *===========================================================================*/
+
+void
+test_recorder_ids()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  int objects[3];
+
+  CU_ASSERT(recorder_add(recorder, &objects[0], 0) == 1);
+  CU_ASSERT(recorder_add(recorder, &objects[1], 2) == 2);
+  CU_ASSERT(recorder_id(recorder, &objects[1]) == 2);
+  CU_ASSERT(recorder_id(recorder, &objects[2]) == 0);
+  CU_ASSERT(recorder_size(recorder) == 2);
+
+  recorder_move(recorder, &objects[1], &objects[2]);
+  CU_ASSERT(recorder_id(recorder, &objects[1]) == 0);
+  CU_ASSERT(recorder_id(recorder, &objects[2]) == 2);
+
+  recorder_remove(recorder, &objects[0]);
+  CU_ASSERT(recorder_id(recorder, &objects[0]) == 0);
+  CU_ASSERT(recorder_size(recorder) == 1);
+
+  // Nothing has been written for the objects
+  test_recorder_reopen(recorder, file);
+  test_recorder_expect(file, RECORD_END, 0);
+  fclose(file);
+}
+
+void
+test_recorder_stale_objects()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  int objects[2];
+
+  recorder_add(recorder, &objects[0], 0);
+  recorder_add(recorder, &objects[1], 0);
+  recorder_move(recorder, &objects[0], &objects[1]);
+  CU_ASSERT(recorder_id(recorder, &objects[1]) == 1);
+  CU_ASSERT(recorder_add(recorder, &objects[1], 0) == 3);
+  CU_ASSERT(recorder_size(recorder) == 1);
+
+  test_recorder_reopen(recorder, file);
+  test_recorder_expect(file, RECORD_DEATH, 2);
+  test_recorder_expect(file, RECORD_DEATH, 1);
+  test_recorder_expect(file, RECORD_END, 0);
+  fclose(file);
+}
+
+void
+test_recorder_targets()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  int object;
+
+  recorder_add(recorder, &object, 2);
+  CU_ASSERT_FALSE(recorder_set_target(recorder, &object, 0, 0));
+  CU_ASSERT(recorder_set_target(recorder, &object, 1, 7));
+  CU_ASSERT_FALSE(recorder_set_target(recorder, &object, 1, 7));
+  CU_ASSERT(recorder_set_target(recorder, &object, 1, 0));
+
+  // The targets follow the object when it moves
+  int moved;
+  recorder_set_target(recorder, &object, 0, 5);
+  recorder_move(recorder, &object, &moved);
+  CU_ASSERT_FALSE(recorder_set_target(recorder, &moved, 0, 5));
+  CU_ASSERT_FALSE(recorder_set_target(recorder, &object, 0, 5));
+
+  recorder_finish(recorder);
+  fclose(file);
+}
+
+void
+test_recorder_many_objects()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  const size_t count = 10000;
+  char *objects = calloc(2 * count, 1);
+
+  for(size_t i = 0; i < count; ++i)
+    {
+      CU_ASSERT(recorder_add(recorder, &objects[i], 0) == i + 1);
+    }
+  for(size_t i = 0; i < count; i += 2)
+    {
+      recorder_move(recorder, &objects[i], &objects[count + i]);
+    }
+  for(size_t i = 1; i < count; i += 2)
+    {
+      recorder_remove(recorder, &objects[i]);
+    }
+  CU_ASSERT(recorder_size(recorder) == count / 2);
+
+  bool found = true;
+  for(size_t i = 0; i < count; i += 2)
+    {
+      found = found
+        && recorder_id(recorder, &objects[count + i]) == i + 1
+        && recorder_id(recorder, &objects[i]) == 0
+        && recorder_id(recorder, &objects[i + 1]) == 0;
+    }
+  CU_ASSERT(found);
+
+  recorder_finish(recorder);
+  fclose(file);
+  free(objects);
+}
+
+
+/*============================================================================
+ *                             COLLECTIONS TESTING SUITE
+ *===========================================================================*/
+
+void
+test_recorder_collection()
+{
+  FILE *file;
+  recorder_t *recorder = test_recorder_create(&file);
+  int objects[3];
+  for(int i = 0; i < 3; ++i)
+    {
+      recorder_add(recorder, &objects[i], 0);
+    }
+
+  recorder_begin_collection(recorder);
+  recorder_mark_root(recorder, &objects[0]);
+  CU_ASSERT(recorder_mark_live(recorder, &objects[0]));
+  CU_ASSERT(recorder_mark_live(recorder, &objects[1]));
+  CU_ASSERT_FALSE(recorder_mark_live(recorder, &objects[2] + 1));
+  recorder_end_collection(recorder, 1);
+  CU_ASSERT(recorder_size(recorder) == 2);
+  CU_ASSERT(recorder_id(recorder, &objects[2]) == 0);
+
+  recorder_begin_collection(recorder);
+  recorder_mark_root(recorder, &objects[1]);
+  recorder_mark_live(recorder, &objects[0]);
+  recorder_mark_live(recorder, &objects[1]);
+  recorder_end_collection(recorder, 2);
+
+  test_recorder_reopen(recorder, file);
+  int deaths = 0, roots = 0;
+  record_t record;
+  while(recording_read(file, &record) && record.tag != RECORD_COLLECTION)
+    {
+      if(record.tag == RECORD_DEATH && record.id == 3) ++deaths;
+      if(record.tag == RECORD_ROOT && record.id == 1) ++roots;
+    }
+  CU_ASSERT(deaths == 1);
+  CU_ASSERT(roots == 1);
+  CU_ASSERT(record.id == 1);
+
+  int unroots = 0;
+  roots = 0;
+  while(recording_read(file, &record) && record.tag != RECORD_COLLECTION)
+    {
+      if(record.tag == RECORD_UNROOT && record.id == 1) ++unroots;
+      if(record.tag == RECORD_ROOT && record.id == 2) ++roots;
+      CU_ASSERT(record.tag != RECORD_DEATH);
+    }
+  CU_ASSERT(unroots == 1);
+  CU_ASSERT(roots == 1);
+  CU_ASSERT(record.id == 2);
+  test_recorder_expect(file, RECORD_END, 0);
+  fclose(file);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_format = NULL;
+  CU_pSuite suite_objects = NULL;
+  CU_pSuite suite_collections = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_format = CU_add_suite("Tests the recording format", NULL, NULL);
+  if (suite_format == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_format
+                            , "header and end"
+                            , test_recorder_header) )
+       || (NULL == CU_add_test(suite_format
+                               , "bad header"
+                               , test_recorder_bad_header) )
+       || (NULL == CU_add_test(suite_format
+                               , "records round trip"
+                               , test_recorder_round_trip) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_objects = CU_add_suite("Tests recorded objects", NULL, NULL);
+  if (suite_objects == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_objects
+                            , "ids, moves and removes"
+                            , test_recorder_ids) )
+       || (NULL == CU_add_test(suite_objects
+                               , "stale objects die"
+                               , test_recorder_stale_objects) )
+       || (NULL == CU_add_test(suite_objects
+                               , "pointer targets"
+                               , test_recorder_targets) )
+       || (NULL == CU_add_test(suite_objects
+                               , "many objects"
+                               , test_recorder_many_objects) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_collections = CU_add_suite("Tests recorded collections", NULL, NULL);
+  if (suite_collections == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_collections
+                            , "deaths, roots and unroots"
+                            , test_recorder_collection) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
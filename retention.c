@@ -0,0 +1,281 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "retention.h"
+
+
+typedef struct walk walk_t;
+
+/**
+ *  @brief The depth first walk from the virtual root, which is node
+ *         graph->nodes.
+ */
+struct walk
+{
+  size_t count;        /**< the nodes reached, the virtual root included */
+  size_t *order;       /**< the reached nodes in postorder */
+  size_t *number;      /**< the postorder number of every node */
+  size_t *pred_first;  /**< the predecessors of node i are preds[pred_first[i]] on */
+  size_t *preds;
+  size_t *idom;
+};
+
+
+/*============================================================================
+ *                             EDGES
+ *===========================================================================*/
+
+static size_t
+edge_count(const retention_graph_t *graph, size_t node)
+{
+  if(node == graph->nodes) return graph->root_count;
+  return graph->first[node + 1] - graph->first[node];
+}
+
+
+/// Returns the target of an edge, RETENTION_NONE if it is not a node
+static size_t
+edge_target(const retention_graph_t *graph, size_t node, size_t edge)
+{
+  size_t target = node == graph->nodes ? graph->roots[edge]
+    : graph->targets[graph->first[node] + edge];
+  return target < graph->nodes ? target : RETENTION_NONE;
+}
+
+
+/*============================================================================
+ *                             DOMINATORS
+ *===========================================================================*/
+
+/// Numbers the nodes reached from the virtual root in postorder, the
+/// virtual root gets the last number
+static bool
+number_nodes(const retention_graph_t *graph, walk_t *walk)
+{
+  size_t nodes = graph->nodes + 1;
+  size_t *stack = malloc(nodes * sizeof(size_t));
+  size_t *next_edge = malloc(nodes * sizeof(size_t));
+  if(stack == NULL || next_edge == NULL)
+    {
+      free(stack);
+      free(next_edge);
+      return false;
+    }
+
+  for(size_t i = 0; i < nodes; ++i)
+    {
+      next_edge[i] = RETENTION_NONE;
+      walk->number[i] = RETENTION_NONE;
+    }
+  size_t depth = 0;
+  stack[depth++] = graph->nodes;
+  next_edge[graph->nodes] = 0;
+  walk->count = 0;
+  while(depth > 0)
+    {
+      size_t node = stack[depth - 1];
+      if(next_edge[node] < edge_count(graph, node))
+        {
+          size_t target = edge_target(graph, node, next_edge[node]++);
+          if(target != RETENTION_NONE && next_edge[target] == RETENTION_NONE)
+            {
+              next_edge[target] = 0;
+              stack[depth++] = target;
+            }
+        }
+      else
+        {
+          walk->number[node] = walk->count;
+          walk->order[walk->count++] = node;
+          --depth;
+        }
+    }
+
+  free(stack);
+  free(next_edge);
+  return true;
+}
+
+
+/// Finds the edges backwards between the nodes that were reached
+static bool
+find_predecessors(const retention_graph_t *graph, walk_t *walk)
+{
+  size_t edges = graph->first[graph->nodes] + graph->root_count;
+  walk->pred_first = calloc(graph->nodes + 2, sizeof(size_t));
+  walk->preds = malloc((edges > 0 ? edges : 1) * sizeof(size_t));
+  if(walk->pred_first == NULL || walk->preds == NULL) return false;
+
+  for(size_t i = 0; i < walk->count; ++i)
+    {
+      size_t node = walk->order[i];
+      for(size_t e = 0; e < edge_count(graph, node); ++e)
+        {
+          size_t target = edge_target(graph, node, e);
+          if(target != RETENTION_NONE) ++walk->pred_first[target + 1];
+        }
+    }
+  for(size_t i = 0; i <= graph->nodes; ++i)
+    {
+      walk->pred_first[i + 1] += walk->pred_first[i];
+    }
+
+  // Filled from the end of every range, pred_first ends up at its start
+  size_t *fill = malloc((graph->nodes + 1) * sizeof(size_t));
+  if(fill == NULL) return false;
+  memcpy(fill, walk->pred_first + 1, (graph->nodes + 1) * sizeof(size_t));
+  for(size_t i = 0; i < walk->count; ++i)
+    {
+      size_t node = walk->order[i];
+      for(size_t e = 0; e < edge_count(graph, node); ++e)
+        {
+          size_t target = edge_target(graph, node, e);
+          if(target != RETENTION_NONE) walk->preds[--fill[target]] = node;
+        }
+    }
+  free(fill);
+  return true;
+}
+
+
+static size_t
+intersect(walk_t *walk, size_t a, size_t b)
+{
+  while(a != b)
+    {
+      while(walk->number[a] < walk->number[b]) a = walk->idom[a];
+      while(walk->number[b] < walk->number[a]) b = walk->idom[b];
+    }
+  return a;
+}
+
+
+static void
+find_dominators(const retention_graph_t *graph, walk_t *walk)
+{
+  for(size_t i = 0; i <= graph->nodes; ++i)
+    {
+      walk->idom[i] = RETENTION_NONE;
+    }
+  walk->idom[graph->nodes] = graph->nodes;
+
+  bool changed = true;
+  while(changed)
+    {
+      changed = false;
+      // Reverse postorder, the virtual root is left out
+      for(size_t i = walk->count - 1; i-- > 0;)
+        {
+          size_t node = walk->order[i];
+          size_t idom = RETENTION_NONE;
+          for(size_t p = walk->pred_first[node]; p < walk->pred_first[node + 1]; ++p)
+            {
+              size_t pred = walk->preds[p];
+              if(walk->idom[pred] == RETENTION_NONE) continue;
+              idom = idom == RETENTION_NONE ? pred : intersect(walk, pred, idom);
+            }
+          if(walk->idom[node] != idom)
+            {
+              walk->idom[node] = idom;
+              changed = true;
+            }
+        }
+    }
+}
+
+
+/*============================================================================
+ *                             RESULTS
+ *===========================================================================*/
+
+/// Adds up the dominator tree, a node is dominated only by nodes that
+/// come after it in postorder
+static void
+sum_retained(const retention_graph_t *graph, walk_t *walk, retention_t *result)
+{
+  for(size_t i = 0; i < graph->nodes; ++i)
+    {
+      bool reached = walk->number[i] != RETENTION_NONE;
+      result->retained[i] = reached ? graph->sizes[i] : 0;
+      result->retained_objects[i] = reached ? 1 : 0;
+      result->idom[i] = !reached ? RETENTION_NONE
+        : walk->idom[i] == graph->nodes ? RETENTION_ROOT : walk->idom[i];
+    }
+  for(size_t i = 0; i + 1 < walk->count; ++i)
+    {
+      size_t node = walk->order[i];
+      size_t idom = result->idom[node];
+      if(idom == RETENTION_ROOT) continue;
+      result->retained[idom] += result->retained[node];
+      result->retained_objects[idom] += result->retained_objects[node];
+    }
+}
+
+
+/// Breadth first from all roots at once
+static bool
+find_root_paths(const retention_graph_t *graph, retention_t *result)
+{
+  size_t *queue = malloc((graph->nodes > 0 ? graph->nodes : 1) * sizeof(size_t));
+  if(queue == NULL) return false;
+
+  for(size_t i = 0; i < graph->nodes; ++i)
+    {
+      result->parent[i] = RETENTION_NONE;
+    }
+  size_t head = 0, tail = 0;
+  for(size_t r = 0; r < graph->root_count; ++r)
+    {
+      size_t root = edge_target(graph, graph->nodes, r);
+      if(root == RETENTION_NONE || result->parent[root] != RETENTION_NONE) continue;
+      result->parent[root] = RETENTION_ROOT;
+      queue[tail++] = root;
+    }
+  while(head < tail)
+    {
+      size_t node = queue[head++];
+      for(size_t e = 0; e < edge_count(graph, node); ++e)
+        {
+          size_t target = edge_target(graph, node, e);
+          if(target == RETENTION_NONE || result->parent[target] != RETENTION_NONE) continue;
+          result->parent[target] = node;
+          queue[tail++] = target;
+        }
+    }
+  free(queue);
+  return true;
+}
+
+
+bool
+retention_compute(const retention_graph_t *graph, retention_t *result)
+{
+  assert(graph != NULL);
+  assert(result != NULL);
+  if(graph == NULL || result == NULL) return false;
+
+  walk_t walk;
+  memset(&walk, 0, sizeof(walk));
+  walk.order = malloc((graph->nodes + 1) * sizeof(size_t));
+  walk.number = malloc((graph->nodes + 1) * sizeof(size_t));
+  walk.idom = malloc((graph->nodes + 1) * sizeof(size_t));
+  bool ok = walk.order != NULL && walk.number != NULL && walk.idom != NULL
+    && number_nodes(graph, &walk)
+    && find_predecessors(graph, &walk);
+  if(ok)
+    {
+      find_dominators(graph, &walk);
+      sum_retained(graph, &walk, result);
+      ok = find_root_paths(graph, result);
+    }
+
+  free(walk.order);
+  free(walk.number);
+  free(walk.idom);
+  free(walk.pred_first);
+  free(walk.preds);
+  return ok;
+}
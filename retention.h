@@ -0,0 +1,78 @@
+/**
+ *  @file  retention.h
+ *  @brief Dominators and retained sizes of an object graph, used by
+ *         h_retention_report().
+ *
+ *  The graph is given with its nodes numbered from 0 and the edges of
+ *  every node in one array, the edges of node i are
+ *  targets[first[i]] to targets[first[i + 1] - 1]. All roots hang from
+ *  a virtual root, so an object is dominated by another object if every
+ *  path from any root to it goes through that object, and the retained
+ *  size of an object is what would die with it.
+ *
+ *  Dominators are found with the iterative algorithm of Cooper, Harvey
+ *  and Kennedy, "A Simple, Fast Dominance Algorithm", which visits the
+ *  nodes in reverse postorder until nothing changes.
+ */
+
+#ifndef __retention__
+#define __retention__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+#define RETENTION_NONE SIZE_MAX      /**< a node that cannot be reached */
+#define RETENTION_ROOT (SIZE_MAX - 1) /**< only dominated by the virtual root */
+
+
+typedef struct retention_graph retention_graph_t;
+
+/**
+ *  @brief An object graph.
+ *
+ *  gc.h packs the structs declared after it, so this struct has no
+ *  padding to look the same with and without packing.
+ */
+struct retention_graph
+{
+  size_t nodes;
+  const size_t *first;     /**< nodes + 1 entries */
+  const size_t *targets;
+  const uint64_t *sizes;   /**< the size of every node */
+  size_t root_count;
+  const size_t *roots;
+};
+
+
+typedef struct retention retention_t;
+
+/**
+ *  @brief What retention_compute() finds for every node.
+ */
+struct retention
+{
+  size_t *idom;               /**< the immediate dominator of every node */
+  size_t *parent;             /**< the node before it on a shortest path
+                                   from a root, RETENTION_ROOT for roots */
+  uint64_t *retained;         /**< the bytes that only it keeps alive */
+  uint64_t *retained_objects; /**< the nodes that only it keeps alive */
+};
+
+
+/**
+ *  @brief Finds the dominators, shortest root paths and retained sizes.
+ *
+ *  Unreachable nodes get RETENTION_NONE as dominator and parent and
+ *  retain nothing.
+ *
+ *  @param  graph the graph
+ *  @param  result arrays of @p graph->nodes entries to fill in
+ *  @return false if memory cannot be allocated
+ */
+bool
+retention_compute(const retention_graph_t *graph, retention_t *result);
+
+
+#endif
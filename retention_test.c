@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "retention.h"
+
+#define MAX_NODES 1100
+
+
+size_t idom[MAX_NODES];
+size_t parent[MAX_NODES];
+uint64_t retained[MAX_NODES];
+uint64_t retained_objects[MAX_NODES];
+
+
+/// Computes with every node sized 10 times its number + 1
+static bool
+compute(size_t nodes, const size_t *first, const size_t *targets,
+        size_t root_count, const size_t *roots)
+{
+  static uint64_t sizes[MAX_NODES];
+  for(size_t i = 0; i < nodes; ++i)
+    {
+      sizes[i] = 10 * (i + 1);
+    }
+  retention_graph_t graph = { nodes, first, targets, sizes, root_count, roots };
+  retention_t result = { idom, parent, retained, retained_objects };
+  return retention_compute(&graph, &result);
+}
+
+
+/*============================================================================
+ *                             DOMINATORS TESTING SUITE
+ *===========================================================================*/
+
+void
+test_retention_chain()
+{
+  // 0 -> 1 -> 2
+  size_t first[] = { 0, 1, 2, 2 };
+  size_t targets[] = { 1, 2 };
+  size_t roots[] = { 0 };
+  CU_ASSERT(compute(3, first, targets, 1, roots));
+  CU_ASSERT(idom[0] == RETENTION_ROOT);
+  CU_ASSERT(idom[1] == 0);
+  CU_ASSERT(idom[2] == 1);
+  CU_ASSERT(retained[0] == 60);
+  CU_ASSERT(retained[1] == 50);
+  CU_ASSERT(retained[2] == 30);
+  CU_ASSERT(retained_objects[0] == 3);
+}
+
+void
+test_retention_diamond()
+{
+  // 0 -> 1, 0 -> 2, 1 -> 3, 2 -> 3
+  size_t first[] = { 0, 2, 3, 4, 4 };
+  size_t targets[] = { 1, 2, 3, 3 };
+  size_t roots[] = { 0 };
+  CU_ASSERT(compute(4, first, targets, 1, roots));
+  CU_ASSERT(idom[1] == 0);
+  CU_ASSERT(idom[2] == 0);
+  CU_ASSERT(idom[3] == 0);
+  CU_ASSERT(retained[1] == 20);
+  CU_ASSERT(retained[2] == 30);
+  CU_ASSERT(retained[3] == 40);
+  CU_ASSERT(retained[0] == 100);
+  CU_ASSERT(retained_objects[0] == 4);
+}
+
+void
+test_retention_cycle()
+{
+  // 0 -> 1 -> 2 -> 1, 2 -> 0
+  size_t first[] = { 0, 1, 2, 4 };
+  size_t targets[] = { 1, 2, 1, 0 };
+  size_t roots[] = { 0 };
+  CU_ASSERT(compute(3, first, targets, 1, roots));
+  CU_ASSERT(idom[0] == RETENTION_ROOT);
+  CU_ASSERT(idom[1] == 0);
+  CU_ASSERT(idom[2] == 1);
+  CU_ASSERT(retained[0] == 60);
+}
+
+void
+test_retention_unreachable()
+{
+  // 1 points at 0 but nothing points at 1
+  size_t first[] = { 0, 0, 1 };
+  size_t targets[] = { 0 };
+  size_t roots[] = { 0 };
+  CU_ASSERT(compute(2, first, targets, 1, roots));
+  CU_ASSERT(idom[0] == RETENTION_ROOT);
+  CU_ASSERT(idom[1] == RETENTION_NONE);
+  CU_ASSERT(parent[1] == RETENTION_NONE);
+  CU_ASSERT(retained[0] == 10);
+  CU_ASSERT(retained[1] == 0);
+  CU_ASSERT(retained_objects[1] == 0);
+}
+
+
+/*============================================================================
+ *                             ROOTS TESTING SUITE
+ *===========================================================================*/
+
+void
+test_retention_shared()
+{
+  // Both roots reach 2, so only the virtual root dominates it
+  size_t first[] = { 0, 1, 2, 2 };
+  size_t targets[] = { 2, 2 };
+  size_t roots[] = { 0, 1, 1 };
+  CU_ASSERT(compute(3, first, targets, 3, roots));
+  CU_ASSERT(idom[0] == RETENTION_ROOT);
+  CU_ASSERT(idom[1] == RETENTION_ROOT);
+  CU_ASSERT(idom[2] == RETENTION_ROOT);
+  CU_ASSERT(retained[0] == 10);
+  CU_ASSERT(retained[2] == 30);
+  CU_ASSERT(parent[0] == RETENTION_ROOT);
+  CU_ASSERT(parent[1] == RETENTION_ROOT);
+  CU_ASSERT(parent[2] == 0);
+}
+
+void
+test_retention_paths()
+{
+  // 0 -> 1 -> 2 -> 3 and 0 -> 3, the shortest path skips 1 and 2
+  size_t first[] = { 0, 2, 3, 4, 4 };
+  size_t targets[] = { 1, 3, 2, 3 };
+  size_t roots[] = { 0, 7 };
+  CU_ASSERT(compute(4, first, targets, 2, roots));
+  CU_ASSERT(parent[3] == 0);
+  CU_ASSERT(parent[2] == 1);
+  CU_ASSERT(idom[3] == 0);
+  CU_ASSERT(retained[1] == 50);
+}
+
+void
+test_retention_long_list()
+{
+  // Deep enough to need the walk to be iterative
+  const size_t nodes = MAX_NODES;
+  size_t *first = malloc((nodes + 1) * sizeof(size_t));
+  size_t *targets = malloc(nodes * sizeof(size_t));
+  for(size_t i = 0; i < nodes; ++i)
+    {
+      first[i] = i;
+      targets[i] = i + 1;
+    }
+  first[nodes] = nodes - 1;
+  size_t roots[] = { 0 };
+  CU_ASSERT(compute(nodes, first, targets, 1, roots));
+  CU_ASSERT(retained_objects[0] == nodes);
+  CU_ASSERT(retained_objects[nodes - 1] == 1);
+  CU_ASSERT(idom[nodes - 1] == nodes - 2);
+  CU_ASSERT(parent[nodes - 1] == nodes - 2);
+  free(first);
+  free(targets);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_dominators = NULL;
+  CU_pSuite suite_roots = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_dominators = CU_add_suite("Tests dominators", NULL, NULL);
+  if (suite_dominators == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_dominators
+                            , "chain"
+                            , test_retention_chain) )
+       || (NULL == CU_add_test(suite_dominators
+                               , "diamond"
+                               , test_retention_diamond) )
+       || (NULL == CU_add_test(suite_dominators
+                               , "cycle"
+                               , test_retention_cycle) )
+       || (NULL == CU_add_test(suite_dominators
+                               , "unreachable node"
+                               , test_retention_unreachable) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_roots = CU_add_suite("Tests roots and paths", NULL, NULL);
+  if (suite_roots == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_roots
+                            , "objects shared by roots"
+                            , test_retention_shared) )
+       || (NULL == CU_add_test(suite_roots
+                               , "shortest root paths"
+                               , test_retention_paths) )
+       || (NULL == CU_add_test(suite_roots
+                               , "long list"
+                               , test_retention_long_list) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
@@ -0,0 +1,136 @@
+#define _DEFAULT_SOURCE // shm_open, ftruncate
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shared_stats.h"
+
+#define READ_ATTEMPTS 100
+
+
+shared_stats_t *
+shared_stats_create(const char *name)
+{
+  assert(name != NULL);
+  if(name == NULL) return NULL;
+
+  int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  if(fd < 0) return NULL;
+  if(ftruncate(fd, sizeof(shared_stats_t)) != 0)
+    {
+      close(fd);
+      shm_unlink(name);
+      return NULL;
+    }
+
+  void *mapping = mmap(NULL, sizeof(shared_stats_t), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED)
+    {
+      shm_unlink(name);
+      return NULL;
+    }
+
+  shared_stats_t *stats = mapping;
+  memset(stats, 0, sizeof(shared_stats_t));
+  stats->version = SHARED_STATS_VERSION;
+  stats->pid = (int64_t) getpid();
+  atomic_thread_fence(memory_order_release);
+  // Readers ignore the segment until the magic is in place
+  stats->magic = SHARED_STATS_MAGIC;
+  return stats;
+}
+
+
+void
+shared_stats_delete(shared_stats_t *stats, const char *name)
+{
+  if(stats == NULL) return;
+  munmap(stats, sizeof(shared_stats_t));
+  shm_unlink(name);
+}
+
+
+shared_stats_t *
+shared_stats_open(const char *name)
+{
+  assert(name != NULL);
+  if(name == NULL) return NULL;
+
+  int fd = shm_open(name, O_RDONLY, 0);
+  if(fd < 0) return NULL;
+
+  struct stat info;
+  if(fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(shared_stats_t))
+    {
+      close(fd);
+      return NULL;
+    }
+
+  void *mapping = mmap(NULL, sizeof(shared_stats_t), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping == MAP_FAILED) return NULL;
+
+  shared_stats_t *stats = mapping;
+  if(stats->magic != SHARED_STATS_MAGIC || stats->version != SHARED_STATS_VERSION)
+    {
+      munmap(mapping, sizeof(shared_stats_t));
+      return NULL;
+    }
+  return stats;
+}
+
+
+void
+shared_stats_close(shared_stats_t *stats)
+{
+  if(stats == NULL) return;
+  munmap(stats, sizeof(shared_stats_t));
+}
+
+
+void
+shared_stats_begin_write(shared_stats_t *stats)
+{
+  volatile uint64_t *sequence = &stats->sequence;
+  *sequence += 1;
+  atomic_thread_fence(memory_order_release);
+}
+
+
+void
+shared_stats_end_write(shared_stats_t *stats)
+{
+  volatile uint64_t *sequence = &stats->sequence;
+  atomic_thread_fence(memory_order_release);
+  *sequence += 1;
+}
+
+
+bool
+shared_stats_read(shared_stats_t *stats, shared_stats_t *copy)
+{
+  assert(stats != NULL);
+  assert(copy != NULL);
+  volatile uint64_t *sequence = &stats->sequence;
+
+  for(int attempt = 0; attempt < READ_ATTEMPTS; ++attempt)
+    {
+      uint64_t before = *sequence;
+      if(before % 2 == 1) continue;
+      atomic_thread_fence(memory_order_acquire);
+      memcpy(copy, stats, sizeof(shared_stats_t));
+      atomic_thread_fence(memory_order_acquire);
+      if(*sequence == before) return true;
+    }
+  return false;
+}
@@ -0,0 +1,117 @@
+/**
+ *  @file  shared_stats.h
+ *  @brief Heap statistics published in a shared memory segment.
+ *
+ *  A heap that publishes its statistics owns one POSIX shared memory
+ *  segment named SHARED_STATS_PREFIX followed by the process id and a
+ *  number. Monitors such as gctop open the segment read-only and copy
+ *  the statistics out with shared_stats_read(), which retries until it
+ *  gets a copy that was not written to meanwhile.
+ */
+
+#ifndef __shared_stats__
+#define __shared_stats__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+#define SHARED_STATS_MAGIC 0x54534347U /* "GCST" */
+#define SHARED_STATS_VERSION 1
+#define SHARED_STATS_PREFIX "gc-"
+#define SHARED_STATS_NAME_LENGTH 64
+
+
+typedef struct shared_stats shared_stats_t;
+
+struct shared_stats
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sequence;         /**< odd while the writer is updating */
+  int64_t pid;
+  uint64_t updated_ns;       /**< CLOCK_MONOTONIC time of the update */
+  uint64_t size;
+  uint64_t used;
+  uint64_t avail;
+  uint64_t pages;
+  uint64_t passive_pages;    /**< including pages not yet created */
+  uint64_t active_pages;
+  uint64_t unsafe_pages;
+  uint64_t released_pages;   /**< passive pages given back to the os */
+  uint64_t collections;
+  uint64_t bytes_copied;
+  uint64_t gc_ns;            /**< total time spent collecting */
+  uint64_t last_pause_ns;
+  uint64_t p99_pause_ns;
+  uint64_t max_pause_ns;
+  uint64_t allocated;
+  double alloc_rate;         /**< bytes per second */
+};
+
+
+/**
+ *  @brief Creates and maps a segment for writing.
+ *
+ *  @param  name the segment name, starting with '/'
+ *  @return the mapped statistics or NULL if the segment cannot be created
+ */
+shared_stats_t *
+shared_stats_create(const char *name);
+
+
+/**
+ *  @brief Unmaps and removes a segment made by shared_stats_create().
+ *
+ *  @param  stats the mapped statistics, may be NULL
+ *  @param  name the segment name
+ */
+void
+shared_stats_delete(shared_stats_t *stats, const char *name);
+
+
+/**
+ *  @brief Maps an existing segment for reading.
+ *
+ *  @param  name the segment name, starting with '/'
+ *  @return the mapped statistics or NULL if there is no valid segment
+ */
+shared_stats_t *
+shared_stats_open(const char *name);
+
+
+/**
+ *  @brief Unmaps a segment mapped by shared_stats_open().
+ */
+void
+shared_stats_close(shared_stats_t *stats);
+
+
+/**
+ *  @brief Marks the start of an update, readers retry until it ends.
+ */
+void
+shared_stats_begin_write(shared_stats_t *stats);
+
+
+/**
+ *  @brief Marks the end of an update.
+ */
+void
+shared_stats_end_write(shared_stats_t *stats);
+
+
+/**
+ *  @brief Copies consistent statistics out of a segment.
+ *
+ *  @param  stats the mapped statistics
+ *  @param  copy where the statistics are copied
+ *  @return true if a consistent copy was made, false if the writer kept
+ *          updating the segment
+ */
+bool
+shared_stats_read(shared_stats_t *stats, shared_stats_t *copy);
+
+
+#endif
@@ -0,0 +1,157 @@
+#define _DEFAULT_SOURCE // getpid
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+
+#include "shared_stats.h"
+
+
+/**
+ *  @brief Makes a segment name that no other test run uses
+ */
+void
+test_segment_name(char *name, const char *test)
+{
+  snprintf(name, SHARED_STATS_NAME_LENGTH, "/%stest-%ld-%s",
+           SHARED_STATS_PREFIX, (long) getpid(), test);
+}
+
+
+/*============================================================================
+ *                             SEGMENT TESTING SUITE
+ *===========================================================================*/
+
+void
+test_shared_stats_create_open()
+{
+  char name[SHARED_STATS_NAME_LENGTH];
+  test_segment_name(name, "create");
+  shared_stats_t *writer = shared_stats_create(name);
+  CU_ASSERT(writer != NULL);
+  CU_ASSERT(writer->magic == SHARED_STATS_MAGIC);
+  CU_ASSERT(writer->pid == (int64_t) getpid());
+
+  shared_stats_t *reader = shared_stats_open(name);
+  CU_ASSERT(reader != NULL);
+  CU_ASSERT(reader != writer);
+  CU_ASSERT(reader->version == SHARED_STATS_VERSION);
+  shared_stats_close(reader);
+
+  shared_stats_delete(writer, name);
+  CU_ASSERT(shared_stats_open(name) == NULL);
+}
+
+void
+test_shared_stats_open_missing()
+{
+  char name[SHARED_STATS_NAME_LENGTH];
+  test_segment_name(name, "missing");
+  CU_ASSERT(shared_stats_open(name) == NULL);
+  shared_stats_close(NULL);
+  shared_stats_delete(NULL, name);
+}
+
+
+/*============================================================================
+ *                             READ TESTING SUITE
+ *===========================================================================*/
+
+void
+test_shared_stats_read_write()
+{
+  char name[SHARED_STATS_NAME_LENGTH];
+  test_segment_name(name, "read");
+  shared_stats_t *writer = shared_stats_create(name);
+  shared_stats_t *reader = shared_stats_open(name);
+
+  shared_stats_begin_write(writer);
+  writer->used = 4096;
+  writer->collections = 3;
+  writer->alloc_rate = 1.5;
+  shared_stats_end_write(writer);
+
+  shared_stats_t copy;
+  CU_ASSERT(shared_stats_read(reader, &copy));
+  CU_ASSERT(copy.used == 4096);
+  CU_ASSERT(copy.collections == 3);
+  CU_ASSERT(copy.alloc_rate == 1.5);
+  CU_ASSERT(copy.sequence == 2);
+
+  shared_stats_close(reader);
+  shared_stats_delete(writer, name);
+}
+
+void
+test_shared_stats_read_during_write()
+{
+  char name[SHARED_STATS_NAME_LENGTH];
+  test_segment_name(name, "busy");
+  shared_stats_t *writer = shared_stats_create(name);
+  shared_stats_t *reader = shared_stats_open(name);
+
+  shared_stats_t copy;
+  shared_stats_begin_write(writer);
+  CU_ASSERT_FALSE(shared_stats_read(reader, &copy));
+  shared_stats_end_write(writer);
+  CU_ASSERT(shared_stats_read(reader, &copy));
+
+  shared_stats_close(reader);
+  shared_stats_delete(writer, name);
+}
+
+
+int
+main(void)
+{
+  CU_pSuite suite_segment = NULL;
+  CU_pSuite suite_read = NULL;
+
+  if (CUE_SUCCESS != CU_initialize_registry())
+    return CU_get_error();
+
+  suite_segment = CU_add_suite("Tests shared stats segments", NULL, NULL);
+  if (suite_segment == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_segment
+                            , "create and open"
+                            , test_shared_stats_create_open) )
+       || (NULL == CU_add_test(suite_segment
+                               , "open missing segment"
+                               , test_shared_stats_open_missing) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  suite_read = CU_add_suite("Tests reading shared stats", NULL, NULL);
+  if (suite_read == NULL) {
+    CU_cleanup_registry();
+    return CU_get_error();
+  }
+
+  if ( (NULL == CU_add_test(suite_read
+                            , "read what was written"
+                            , test_shared_stats_read_write) )
+       || (NULL == CU_add_test(suite_read
+                               , "read during write"
+                               , test_shared_stats_read_during_write) )
+    )
+    {
+      CU_cleanup_registry();
+      return CU_get_error();
+    }
+
+  CU_basic_run_tests();
+  CU_cleanup_registry();
+  return CU_get_error();
+}
@@ -0,0 +1,65 @@
+/**
+ *  @file  snapshot.h
+ *  @brief The binary format written by h_snapshot().
+ *
+ *  A snapshot starts with a snapshot_header_t and is followed by records
+ *  that each start with a one byte tag. All numbers are in the byte order
+ *  of the machine that wrote the snapshot.
+ *
+ *  @code
+ *  'O' address:u64 size:u64 kind:u8 layout_length:u16 layout:char[]
+ *      pointer_count:u32 pointers:u64[]
+ *  'R' address:u64
+ *  'E'
+ *  @endcode
+ *
+ *  An object record is written for every object that a collection would
+ *  keep, found by tracing from the roots the way the collector does. The
+ *  address is the address of the data, the size includes the header, and
+ *  the pointers are the non-NULL values of the pointer fields. A root
+ *  record is written for every word on the stack that points at an
+ *  object and for every soft reference that is followed. The snapshot
+ *  ends with an end record.
+ */
+
+#ifndef __snapshot__
+#define __snapshot__
+
+#include <stdint.h>
+
+
+#define SNAPSHOT_MAGIC "GCSNAP\0"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 2
+#define SNAPSHOT_LAYOUT_MAX 256 /**< longer layouts are cut to 255 chars */
+
+#define SNAPSHOT_OBJECT 'O'
+#define SNAPSHOT_ROOT 'R'
+#define SNAPSHOT_END 'E'
+
+
+/**
+ *  @brief What kind of object a record describes.
+ */
+enum snapshot_kind
+  {
+    SNAPSHOT_RAW
+    , SNAPSHOT_STRUCT
+    , SNAPSHOT_ARRAY
+  };
+
+
+typedef struct snapshot_header snapshot_header_t;
+
+struct snapshot_header
+{
+  char magic[SNAPSHOT_MAGIC_SIZE];
+  uint32_t version;
+  uint32_t pointer_size;
+  uint64_t heap_start;
+  uint64_t heap_size;
+  uint64_t collections;
+};
+
+
+#endif
@@ -1,6 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "stack_search.h"
 
 
 void **stack_find_next_ptr(void **stack_bottom, void *stack_top, void *heap_start, void *heap_end)
@@ -32,3 +35,17 @@ void **stack_find_next_ptr(void **stack_bottom, void *stack_top, void *heap_star
 }
 
 
+void **stack_find_next_heap_ptr(void **stack_bottom, void *stack_top, void *heap_start, uintptr_t heap_mask)
+{
+  *stack_bottom = (void *)((uintptr_t)*stack_bottom & ~(uintptr_t)7);
+  while(*stack_bottom > stack_top)
+    {
+      *stack_bottom = (void *)(((uintptr_t)*stack_bottom) - sizeof(void *));
+      void **result = *stack_bottom;
+      if((*(uintptr_t *)result & heap_mask) == (uintptr_t)heap_start)
+        {
+          return result;
+        }
+    }
+  return NULL;
+}
@@ -13,6 +13,8 @@
 #ifndef __stack_search__
 #define __stack_search__
 
+#include <stdint.h>
+
 /**
  *  @brief Finds a possible pointer on the stack.
  *
@@ -49,5 +51,23 @@
 void **stack_find_next_ptr(void **stack_bottom, void *stack_top,
                            void *heap_start, void *heap_end);
 
+/**
+ *  @brief Finds a possible pointer on the stack into a heap that is
+ *         aligned to its own power of two size.
+ *
+ *  Works like stack_find_next_ptr() but tests heap membership with one
+ *  mask instead of two compares. A word is a possible pointer if it
+ *  equals @p heap_start when masked with @p heap_mask.
+ *
+ *  @param  stack_bottom the bottom of the stack to seach
+ *  @param  stack_top the top of the stack to seach
+ *  @param  heap_start the start of the heap, a multiple of its size
+ *  @param  heap_mask the complement of the heap size minus one
+ *  @return a pointer to a location in the stack that contains a possible
+ *          address into the heap, or NULL if search is finished
+ */
+void **stack_find_next_heap_ptr(void **stack_bottom, void *stack_top,
+                                void *heap_start, uintptr_t heap_mask);
+
 
 #endif
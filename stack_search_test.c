@@ -1,6 +1,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "CUnit/Basic.h"
 #include "stack_search.h"
 
@@ -198,6 +199,48 @@ void test_stack_edges()
 }
 
 
+void test_stack_find_heap_ptr()
+{
+  /**
+   *  Tests stack_find_next_heap_ptr() with a fake heap of 64 bytes at an
+   *  address that is a multiple of 64. Only words masking to the start of
+   *  the heap are returned.
+   */
+  char *memory = malloc(256);
+  char *heap_start = (char *)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+  uintptr_t heap_mask = ~(uintptr_t)63;
+
+  char *inside_first = heap_start;
+  char *inside_last = heap_start + 63;
+  char *below = heap_start - 1;
+  char *above = heap_start + 64;
+
+  void *stack_top = get_stack_top();
+  void *stack_bottom = (void *)*environ;
+
+  bool found_first = false;
+  bool found_last = false;
+  bool found_below = false;
+  bool found_above = false;
+
+  void **pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+  while(pointer != NULL)
+    {
+      if(*pointer == inside_first) found_first = true;
+      else if(*pointer == inside_last) found_last = true;
+      else if(*pointer == below) found_below = true;
+      else if(*pointer == above) found_above = true;
+      pointer = stack_find_next_heap_ptr(&stack_bottom, stack_top, heap_start, heap_mask);
+    }
+
+  CU_ASSERT_TRUE(found_first);
+  CU_ASSERT_TRUE(found_last);
+  CU_ASSERT_FALSE(found_below);
+  CU_ASSERT_FALSE(found_above);
+  free(memory);
+}
+
+
 
 int main(int argc, char *argv[]){
 
@@ -208,6 +251,7 @@ int main(int argc, char *argv[]){
   CU_pSuite stack_test = CU_add_suite("Test stack search", NULL, NULL);
   CU_add_test(stack_test, "Test_stack_find_ptr", test_stack_find_ptr);
   CU_add_test(stack_test, "Test_stack_edges", test_stack_edges);
+  CU_add_test(stack_test, "Test_stack_find_heap_ptr", test_stack_find_heap_ptr);
 
   //Actually run tests
   CU_basic_run_tests();
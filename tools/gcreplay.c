@@ -0,0 +1,448 @@
+/**
+ *  @file  gcreplay.c
+ *  @brief Replays an allocation recording written by h_record_start().
+ *
+ *  @code
+ *  gcreplay [-s MB] [-g MB] [-t threshold] [-p] [-f] recording
+ *  @endcode
+ *
+ *  The objects of the recording are allocated with the same layouts and
+ *  sizes on a new heap, pointer fields are set as recorded and dead
+ *  objects are let go, so the heap sees the same object graph as the
+ *  recorded program. The heap is configured as the recorded one unless
+ *  -s (size), -g (growable up to a size), -t (gc threshold) or -p (pin
+ *  the pages the stack points at) say otherwise.
+ *
+ *  By default the heap decides when to collect. With -f a collection is
+ *  also run wherever the recorded program collected, with the recorded
+ *  roots on the stack.
+ *
+ *  The replayer keeps every live object in a table of pointer arrays on
+ *  the heap, so the heap holds a little more than the recorded program
+ *  did: about one pointer per live object.
+ */
+
+#define _DEFAULT_SOURCE // getopt
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../gc.h"
+#include "../recorder.h"
+
+#define TABLE_WIDTH 240
+#define TABLE_SPINE 64
+#define TABLE_SLOTS ((size_t) TABLE_SPINE * TABLE_WIDTH * TABLE_WIDTH)
+#define MAX_STACK_ROOTS 65536
+
+
+typedef struct replay replay_t;
+
+struct replay
+{
+  heap_t *h;
+  bool forced;
+  bool unsafe_stack;
+  void **spine;          /**< on the stack of replay_recording() */
+
+  uint32_t *slot_of_id;  /**< slot + 1 of every id, 0 if it has none */
+  size_t ids;
+  bool *rooted;          /**< per slot */
+  size_t number_of_roots;
+  uint32_t *free_slots;
+  size_t number_of_free_slots;
+  size_t next_slot;
+  size_t live;
+  size_t peak_live;
+
+  uint64_t records;
+  uint64_t allocations;
+  uint64_t resizes;
+  uint64_t stores;
+  uint64_t deaths;
+  uint64_t recorded_collections;
+};
+
+
+static double
+seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+
+
+/*============================================================================
+ *                             OBJECT TABLE
+ *===========================================================================*/
+
+/**
+ *  @brief Finds the pointer array that holds @p slot
+ *
+ *  The arrays are made when @p create is set, which can collect, so
+ *  nothing on the heap may be held in a register across the call.
+ */
+static void **
+table_block(replay_t *replay, size_t slot, bool create)
+{
+  size_t top = slot / (TABLE_WIDTH * TABLE_WIDTH);
+  size_t middle = slot / TABLE_WIDTH % TABLE_WIDTH;
+  if(replay->spine[top] == NULL)
+    {
+      if(!create) return NULL;
+      void **made = h_alloc_ptr_array(replay->h, TABLE_WIDTH);
+      if(made == NULL) return NULL;
+      replay->spine[top] = made;
+    }
+  void **blocks = replay->spine[top];
+  if(blocks[middle] == NULL)
+    {
+      if(!create) return NULL;
+      void **made = h_alloc_ptr_array(replay->h, TABLE_WIDTH);
+      if(made == NULL) return NULL;
+      // The collection h_alloc_ptr_array() may have run can move blocks
+      blocks = replay->spine[top];
+      blocks[middle] = made;
+    }
+  return blocks[middle];
+}
+
+
+static void *
+table_get(replay_t *replay, uint64_t id)
+{
+  if(id == 0 || id >= replay->ids || replay->slot_of_id[id] == 0) return NULL;
+  size_t slot = replay->slot_of_id[id] - 1;
+  void **block = table_block(replay, slot, false);
+  return block == NULL ? NULL : block[slot % TABLE_WIDTH];
+}
+
+
+static void
+table_set(replay_t *replay, size_t slot, void *object)
+{
+  void **block = table_block(replay, slot, false);
+  if(block != NULL) block[slot % TABLE_WIDTH] = object;
+}
+
+
+/// Gives @p id a slot and makes sure that the slot has a block
+static bool
+table_reserve(replay_t *replay, uint64_t id, size_t *slot)
+{
+  if(id >= replay->ids)
+    {
+      size_t ids = replay->ids * 2;
+      while(ids <= id) ids *= 2;
+      uint32_t *grown = realloc(replay->slot_of_id, ids * sizeof(uint32_t));
+      if(grown == NULL) return false;
+      memset(grown + replay->ids, 0, (ids - replay->ids) * sizeof(uint32_t));
+      replay->slot_of_id = grown;
+      replay->ids = ids;
+    }
+
+  if(replay->number_of_free_slots > 0)
+    {
+      *slot = replay->free_slots[--replay->number_of_free_slots];
+    }
+  else
+    {
+      if(replay->next_slot == TABLE_SLOTS) return false;
+      *slot = replay->next_slot++;
+    }
+  if(table_block(replay, *slot, true) == NULL) return false;
+  replay->slot_of_id[id] = (uint32_t) *slot + 1;
+  return true;
+}
+
+
+static void
+table_release(replay_t *replay, uint64_t id)
+{
+  if(id == 0 || id >= replay->ids || replay->slot_of_id[id] == 0) return;
+  size_t slot = replay->slot_of_id[id] - 1;
+  table_set(replay, slot, NULL);
+  if(replay->rooted[slot])
+    {
+      replay->rooted[slot] = false;
+      --replay->number_of_roots;
+    }
+  replay->free_slots[replay->number_of_free_slots++] = (uint32_t) slot;
+  replay->slot_of_id[id] = 0;
+  --replay->live;
+}
+
+
+/*============================================================================
+ *                             REPLAY
+ *===========================================================================*/
+
+static bool
+replay_alloc(replay_t *replay, record_t *record)
+{
+  size_t slot = 0;
+  if(!table_reserve(replay, record->id, &slot)) return false;
+
+  void *object = NULL;
+  switch(record->kind)
+    {
+    case RECORD_RAW:
+      object = h_alloc_data(replay->h, record->size > 0 ? record->size : 1);
+      break;
+    case RECORD_STRUCT:
+      object = h_alloc_struct(replay->h, record->layout);
+      break;
+    case RECORD_ARRAY:
+      object = h_alloc_array(replay->h, record->layout, record->size);
+      break;
+    default:
+      break;
+    }
+  if(object == NULL) return false;
+
+  table_set(replay, slot, object);
+  ++replay->allocations;
+  ++replay->live;
+  if(replay->live > replay->peak_live) replay->peak_live = replay->live;
+  return true;
+}
+
+
+static bool
+replay_resize(replay_t *replay, record_t *record)
+{
+  void *object = table_get(replay, record->id);
+  if(object == NULL) return true;
+  object = h_realloc(replay->h, object, record->size);
+  if(object == NULL) return false;
+  table_set(replay, replay->slot_of_id[record->id] - 1, object);
+  ++replay->resizes;
+  return true;
+}
+
+
+static void
+replay_store(replay_t *replay, record_t *record)
+{
+  char *object = table_get(replay, record->id);
+  if(object == NULL) return;
+  *(void **) (object + record->offset) = table_get(replay, record->target);
+  ++replay->stores;
+}
+
+
+static void
+replay_root(replay_t *replay, uint64_t id, bool root)
+{
+  if(id == 0 || id >= replay->ids || replay->slot_of_id[id] == 0) return;
+  size_t slot = replay->slot_of_id[id] - 1;
+  if(replay->rooted[slot] == root) return;
+  replay->rooted[slot] = root;
+  replay->number_of_roots += root ? 1 : -1;
+}
+
+
+/// Runs a collection with the recorded roots on the stack
+static void
+replay_collection(replay_t *replay)
+{
+  size_t count = replay->number_of_roots < MAX_STACK_ROOTS
+    ? replay->number_of_roots : MAX_STACK_ROOTS;
+  void * volatile roots[count > 0 ? count : 1];
+  size_t filled = 0;
+  for(size_t slot = 0; slot < replay->next_slot && filled < count; ++slot)
+    {
+      if(!replay->rooted[slot]) continue;
+      void **block = table_block(replay, slot, false);
+      roots[filled++] = block == NULL ? NULL : block[slot % TABLE_WIDTH];
+    }
+  h_gc_dbg(replay->h, replay->unsafe_stack);
+  // Read after the collection so that the roots are kept until then
+  (void) roots[0];
+}
+
+
+/**
+ *  @brief Replays every record of a recording
+ *
+ *  @return true if the whole recording was replayed
+ */
+static bool
+replay_recording(replay_t *replay, FILE *in)
+{
+  void * volatile spine[TABLE_SPINE];
+  for(size_t i = 0; i < TABLE_SPINE; ++i) spine[i] = NULL;
+  replay->spine = (void **) spine;
+
+  record_t record;
+  while(recording_read(in, &record))
+    {
+      ++replay->records;
+      switch(record.tag)
+        {
+        case RECORD_ALLOC:
+          if(!replay_alloc(replay, &record))
+            {
+              fprintf(stderr, "gcreplay: allocation %llu failed, the table of live objects"
+                      " needs room too, try a bigger heap with -s or -g\n",
+                      (unsigned long long) record.id);
+              return false;
+            }
+          break;
+        case RECORD_RESIZE:
+          if(!replay_resize(replay, &record))
+            {
+              fprintf(stderr, "gcreplay: resize of %llu failed\n",
+                      (unsigned long long) record.id);
+              return false;
+            }
+          break;
+        case RECORD_STORE:
+          replay_store(replay, &record);
+          break;
+        case RECORD_ROOT:
+        case RECORD_UNROOT:
+          replay_root(replay, record.id, record.tag == RECORD_ROOT);
+          break;
+        case RECORD_DEATH:
+          table_release(replay, record.id);
+          ++replay->deaths;
+          break;
+        case RECORD_COLLECTION:
+          ++replay->recorded_collections;
+          if(replay->forced) replay_collection(replay);
+          break;
+        case RECORD_END:
+          return true;
+        }
+    }
+  fprintf(stderr, "gcreplay: recording is truncated\n");
+  return false;
+}
+
+
+static void
+usage(char *name)
+{
+  fprintf(stderr, "usage: %s [-s MB] [-g MB] [-t threshold] [-p] [-f] recording\n", name);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  size_t size_mb = 0;
+  size_t max_mb = 0;
+  float threshold = 0.0f;
+  bool pin = false;
+  bool forced = false;
+
+  int option;
+  while((option = getopt(argc, argv, "s:g:t:pf")) != -1)
+    {
+      switch(option)
+        {
+        case 's':
+          size_mb = (size_t) atol(optarg);
+          break;
+        case 'g':
+          max_mb = (size_t) atol(optarg);
+          break;
+        case 't':
+          threshold = (float) atof(optarg);
+          break;
+        case 'p':
+          pin = true;
+          break;
+        case 'f':
+          forced = true;
+          break;
+        default:
+          usage(argv[0]);
+          return 1;
+        }
+    }
+  if(optind >= argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+  FILE *in = fopen(argv[optind], "rb");
+  if(in == NULL)
+    {
+      perror(argv[optind]);
+      return 1;
+    }
+  recording_header_t header;
+  if(!recording_read_header(in, &header))
+    {
+      fprintf(stderr, "gcreplay: not an allocation recording\n");
+      fclose(in);
+      return 1;
+    }
+  if(header.page_size != H_PAGE_SIZE)
+    {
+      fprintf(stderr, "gcreplay: recorded with %u byte pages, replaying with %d\n",
+              header.page_size, H_PAGE_SIZE);
+    }
+
+  size_t bytes = size_mb > 0 ? size_mb << 20 : header.heap_size;
+  if(threshold <= 0.0f) threshold = header.gc_threshold;
+  bool unsafe_stack = pin || header.unsafe_stack;
+  heap_t *h = max_mb > 0
+    ? h_init_growable(bytes, max_mb << 20, unsafe_stack, threshold)
+    : h_init(bytes, unsafe_stack, threshold);
+
+  replay_t replay;
+  memset(&replay, 0, sizeof(replay));
+  replay.h = h;
+  replay.forced = forced;
+  replay.unsafe_stack = unsafe_stack;
+  replay.ids = 1024;
+  replay.slot_of_id = calloc(replay.ids, sizeof(uint32_t));
+  replay.rooted = calloc(TABLE_SLOTS, sizeof(bool));
+  replay.free_slots = malloc(TABLE_SLOTS * sizeof(uint32_t));
+  if(h == NULL || replay.slot_of_id == NULL || replay.rooted == NULL || replay.free_slots == NULL)
+    {
+      fprintf(stderr, "gcreplay: cannot create a heap of %zu bytes\n", bytes);
+      fclose(in);
+      return 1;
+    }
+
+  double start = seconds();
+  bool ok = replay_recording(&replay, in);
+  double elapsed = seconds() - start;
+  fclose(in);
+
+  h_pauses_t pauses;
+  h_pauses(h, &pauses);
+  printf("Heap:         %zu bytes, threshold %.2f%s\n", h_size(h), threshold,
+         unsafe_stack ? ", pinning" : "");
+  printf("Replayed:     %llu records in %.3f s%s\n",
+         (unsigned long long) replay.records, elapsed, ok ? "" : " (failed)");
+  printf("Allocations:  %llu (%zu bytes)\n",
+         (unsigned long long) replay.allocations, h_allocated(h));
+  printf("Stores:       %llu\n", (unsigned long long) replay.stores);
+  printf("Resizes:      %llu\n", (unsigned long long) replay.resizes);
+  printf("Deaths:       %llu\n", (unsigned long long) replay.deaths);
+  printf("Peak live:    %zu objects\n", replay.peak_live);
+  printf("Recorded gcs: %llu\n", (unsigned long long) replay.recorded_collections);
+  printf("Collections:  %llu, %.3f ms paused, p99 %.3f ms, longest %.3f ms\n",
+         (unsigned long long) pauses.count,
+         (double) pauses.total_ns / 1e6,
+         (double) pauses.p99_ns / 1e6,
+         (double) pauses.max_ns / 1e6);
+
+  free(replay.slot_of_id);
+  free(replay.rooted);
+  free(replay.free_slots);
+  h_delete(h);
+  return ok ? 0 : 1;
+}
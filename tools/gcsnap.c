@@ -0,0 +1,410 @@
+/**
+ *  @file  gcsnap.c
+ *  @brief Summarizes a heap snapshot written by h_snapshot().
+ *
+ *  @code
+ *  gcsnap [-n count] snapshot
+ *  @endcode
+ *
+ *  Prints the number of objects and bytes, how many of them can be
+ *  reached from the roots, a histogram of the reachable objects per
+ *  kind and layout, and the objects that retain the most bytes.
+ *
+ *  Retained bytes are computed over the tree that a breadth first
+ *  search from the roots builds: each object is counted once, under
+ *  the object it was first reached from. An object shared by two
+ *  parents is counted under one of them only.
+ */
+
+#define _DEFAULT_SOURCE // getopt
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../snapshot.h"
+
+#define NO_OBJECT SIZE_MAX
+
+
+typedef struct object object_t;
+
+struct object
+{
+  uint64_t address;
+  uint64_t size;
+  uint8_t kind;
+  char *layout;
+  uint32_t pointer_count;
+  uint64_t *pointers;
+  size_t parent;
+  bool reached;
+  uint64_t retained_bytes;
+  uint64_t retained_objects;
+};
+
+typedef struct snapshot snapshot_t;
+
+struct snapshot
+{
+  snapshot_header_t header;
+  object_t *objects;
+  size_t number_of_objects;
+  uint64_t *roots;
+  size_t number_of_roots;
+};
+
+typedef struct layout_count layout_count_t;
+
+struct layout_count
+{
+  uint8_t kind;
+  const char *layout;
+  uint64_t objects;
+  uint64_t bytes;
+};
+
+
+static const char *kind_names[] = { "raw", "struct", "array" };
+
+
+static bool
+read_exactly(FILE *in, void *data, size_t bytes)
+{
+  return fread(data, 1, bytes, in) == bytes;
+}
+
+
+static void *
+grow(void *array, size_t *capacity, size_t needed, size_t element_size)
+{
+  if(needed <= *capacity) return array;
+  size_t new_capacity = *capacity == 0 ? 1024 : *capacity * 2;
+  while(new_capacity < needed) new_capacity *= 2;
+  void *grown = realloc(array, new_capacity * element_size);
+  if(grown == NULL)
+    {
+      fprintf(stderr, "gcsnap: out of memory\n");
+      exit(1);
+    }
+  *capacity = new_capacity;
+  return grown;
+}
+
+
+static bool
+read_object(FILE *in, object_t *object)
+{
+  uint16_t layout_length;
+  memset(object, 0, sizeof(object_t));
+  if(!read_exactly(in, &object->address, sizeof(object->address))
+     || !read_exactly(in, &object->size, sizeof(object->size))
+     || !read_exactly(in, &object->kind, sizeof(object->kind))
+     || !read_exactly(in, &layout_length, sizeof(layout_length)))
+    {
+      return false;
+    }
+
+  object->layout = calloc(layout_length + 1, 1);
+  if(!read_exactly(in, object->layout, layout_length)
+     || !read_exactly(in, &object->pointer_count, sizeof(object->pointer_count)))
+    {
+      return false;
+    }
+
+  object->pointers = malloc((object->pointer_count + 1) * sizeof(uint64_t));
+  if(!read_exactly(in, object->pointers, object->pointer_count * sizeof(uint64_t)))
+    {
+      return false;
+    }
+  if(object->kind > SNAPSHOT_ARRAY) object->kind = SNAPSHOT_RAW;
+  object->parent = NO_OBJECT;
+  return true;
+}
+
+
+/**
+ *  @brief Reads a whole snapshot, NULL if it is not a valid snapshot
+ */
+static snapshot_t *
+read_snapshot(FILE *in)
+{
+  snapshot_t *snapshot = calloc(1, sizeof(snapshot_t));
+  if(!read_exactly(in, &snapshot->header, sizeof(snapshot_header_t))
+     || memcmp(snapshot->header.magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0
+     || snapshot->header.version != SNAPSHOT_VERSION)
+    {
+      fprintf(stderr, "gcsnap: not a heap snapshot\n");
+      return NULL;
+    }
+
+  size_t object_capacity = 0;
+  size_t root_capacity = 0;
+  uint8_t tag;
+  while(read_exactly(in, &tag, sizeof(tag)) && tag != SNAPSHOT_END)
+    {
+      if(tag == SNAPSHOT_OBJECT)
+        {
+          snapshot->objects = grow(snapshot->objects, &object_capacity,
+                                   snapshot->number_of_objects + 1, sizeof(object_t));
+          if(!read_object(in, &snapshot->objects[snapshot->number_of_objects])) break;
+          snapshot->number_of_objects += 1;
+        }
+      else if(tag == SNAPSHOT_ROOT)
+        {
+          snapshot->roots = grow(snapshot->roots, &root_capacity,
+                                 snapshot->number_of_roots + 1, sizeof(uint64_t));
+          if(!read_exactly(in, &snapshot->roots[snapshot->number_of_roots], sizeof(uint64_t))) break;
+          snapshot->number_of_roots += 1;
+        }
+      else
+        {
+          break;
+        }
+    }
+  if(tag != SNAPSHOT_END)
+    {
+      fprintf(stderr, "gcsnap: snapshot is truncated\n");
+      return NULL;
+    }
+  return snapshot;
+}
+
+
+static int
+compare_address(const void *a, const void *b)
+{
+  const object_t *first = a;
+  const object_t *second = b;
+  return first->address < second->address ? -1 : first->address > second->address;
+}
+
+
+/**
+ *  @brief Finds the object at @p address, NO_OBJECT if there is none
+ */
+static size_t
+find_object(snapshot_t *snapshot, uint64_t address)
+{
+  size_t low = 0;
+  size_t high = snapshot->number_of_objects;
+  while(low < high)
+    {
+      size_t middle = low + (high - low) / 2;
+      uint64_t found = snapshot->objects[middle].address;
+      if(found == address) return middle;
+      if(found < address) low = middle + 1;
+      else high = middle;
+    }
+  return NO_OBJECT;
+}
+
+
+/**
+ *  @brief Marks what the roots reach and sums retained bytes bottom up
+ *
+ *  @return the objects in the order they were reached
+ */
+static size_t *
+trace(snapshot_t *snapshot, size_t *number_reached)
+{
+  size_t *queue = malloc((snapshot->number_of_objects + 1) * sizeof(size_t));
+  size_t tail = 0;
+
+  for(size_t i = 0; i < snapshot->number_of_roots; ++i)
+    {
+      size_t index = find_object(snapshot, snapshot->roots[i]);
+      if(index == NO_OBJECT || snapshot->objects[index].reached) continue;
+      snapshot->objects[index].reached = true;
+      queue[tail++] = index;
+    }
+
+  for(size_t head = 0; head < tail; ++head)
+    {
+      object_t *object = &snapshot->objects[queue[head]];
+      for(uint32_t i = 0; i < object->pointer_count; ++i)
+        {
+          size_t index = find_object(snapshot, object->pointers[i]);
+          if(index == NO_OBJECT || snapshot->objects[index].reached) continue;
+          snapshot->objects[index].reached = true;
+          snapshot->objects[index].parent = queue[head];
+          queue[tail++] = index;
+        }
+    }
+
+  for(size_t i = tail; i > 0; --i)
+    {
+      object_t *object = &snapshot->objects[queue[i - 1]];
+      object->retained_bytes += object->size;
+      object->retained_objects += 1;
+      if(object->parent != NO_OBJECT)
+        {
+          snapshot->objects[object->parent].retained_bytes += object->retained_bytes;
+          snapshot->objects[object->parent].retained_objects += object->retained_objects;
+        }
+    }
+
+  *number_reached = tail;
+  return queue;
+}
+
+
+static int
+compare_layout_bytes(const void *a, const void *b)
+{
+  const layout_count_t *first = a;
+  const layout_count_t *second = b;
+  return first->bytes > second->bytes ? -1 : first->bytes < second->bytes;
+}
+
+
+static void
+print_layouts(snapshot_t *snapshot)
+{
+  layout_count_t *counts = NULL;
+  size_t capacity = 0;
+  size_t number_of_counts = 0;
+
+  for(size_t i = 0; i < snapshot->number_of_objects; ++i)
+    {
+      object_t *object = &snapshot->objects[i];
+      if(!object->reached) continue;
+
+      size_t found = 0;
+      while(found < number_of_counts
+            && (counts[found].kind != object->kind
+                || strcmp(counts[found].layout, object->layout) != 0))
+        {
+          ++found;
+        }
+      if(found == number_of_counts)
+        {
+          counts = grow(counts, &capacity, number_of_counts + 1, sizeof(layout_count_t));
+          counts[found].kind = object->kind;
+          counts[found].layout = object->layout;
+          counts[found].objects = 0;
+          counts[found].bytes = 0;
+          ++number_of_counts;
+        }
+      counts[found].objects += 1;
+      counts[found].bytes += object->size;
+    }
+
+  qsort(counts, number_of_counts, sizeof(layout_count_t), compare_layout_bytes);
+  printf("\nReachable objects per layout:\n");
+  printf("%-8s %-24s %12s %14s\n", "KIND", "LAYOUT", "OBJECTS", "BYTES");
+  for(size_t i = 0; i < number_of_counts; ++i)
+    {
+      printf("%-8s %-24s %12llu %14llu\n",
+             kind_names[counts[i].kind],
+             counts[i].layout[0] == '\0' ? "-" : counts[i].layout,
+             (unsigned long long) counts[i].objects,
+             (unsigned long long) counts[i].bytes);
+    }
+  free(counts);
+}
+
+
+static snapshot_t *sorting_snapshot;
+
+static int
+compare_retained(const void *a, const void *b)
+{
+  const object_t *first = &sorting_snapshot->objects[*(const size_t *) a];
+  const object_t *second = &sorting_snapshot->objects[*(const size_t *) b];
+  return first->retained_bytes > second->retained_bytes ? -1
+    : first->retained_bytes < second->retained_bytes;
+}
+
+
+static void
+print_retainers(snapshot_t *snapshot, size_t *reached, size_t number_reached, size_t top)
+{
+  size_t *order = malloc((number_reached + 1) * sizeof(size_t));
+  memcpy(order, reached, number_reached * sizeof(size_t));
+  sorting_snapshot = snapshot;
+  qsort(order, number_reached, sizeof(size_t), compare_retained);
+
+  printf("\nBiggest retainers:\n");
+  printf("%-18s %-8s %-24s %10s %14s %10s\n",
+         "ADDRESS", "KIND", "LAYOUT", "SIZE", "RETAINED", "OBJECTS");
+  for(size_t i = 0; i < number_reached && i < top; ++i)
+    {
+      object_t *object = &snapshot->objects[order[i]];
+      printf("0x%016llx %-8s %-24s %10llu %14llu %10llu\n",
+             (unsigned long long) object->address,
+             kind_names[object->kind],
+             object->layout[0] == '\0' ? "-" : object->layout,
+             (unsigned long long) object->size,
+             (unsigned long long) object->retained_bytes,
+             (unsigned long long) object->retained_objects);
+    }
+  free(order);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  size_t top = 10;
+  int option;
+  while((option = getopt(argc, argv, "n:")) != -1)
+    {
+      if(option == 'n')
+        {
+          top = (size_t) atol(optarg);
+        }
+      else
+        {
+          fprintf(stderr, "usage: %s [-n count] snapshot\n", argv[0]);
+          return 1;
+        }
+    }
+  if(optind >= argc)
+    {
+      fprintf(stderr, "usage: %s [-n count] snapshot\n", argv[0]);
+      return 1;
+    }
+
+  FILE *in = fopen(argv[optind], "rb");
+  if(in == NULL)
+    {
+      perror(argv[optind]);
+      return 1;
+    }
+  snapshot_t *snapshot = read_snapshot(in);
+  fclose(in);
+  if(snapshot == NULL) return 1;
+
+  qsort(snapshot->objects, snapshot->number_of_objects, sizeof(object_t), compare_address);
+  size_t number_reached = 0;
+  size_t *reached = trace(snapshot, &number_reached);
+
+  uint64_t total_bytes = 0;
+  uint64_t reached_bytes = 0;
+  for(size_t i = 0; i < snapshot->number_of_objects; ++i)
+    {
+      total_bytes += snapshot->objects[i].size;
+      if(snapshot->objects[i].reached) reached_bytes += snapshot->objects[i].size;
+    }
+
+  printf("Heap at 0x%llx, %llu bytes, %llu collections\n",
+         (unsigned long long) snapshot->header.heap_start,
+         (unsigned long long) snapshot->header.heap_size,
+         (unsigned long long) snapshot->header.collections);
+  printf("Objects:     %zu (%llu bytes)\n",
+         snapshot->number_of_objects, (unsigned long long) total_bytes);
+  printf("Roots:       %zu\n", snapshot->number_of_roots);
+  printf("Reachable:   %zu (%llu bytes)\n",
+         number_reached, (unsigned long long) reached_bytes);
+  printf("Unreachable: %zu (%llu bytes)\n",
+         snapshot->number_of_objects - number_reached,
+         (unsigned long long) (total_bytes - reached_bytes));
+
+  print_layouts(snapshot);
+  print_retainers(snapshot, reached, number_reached, top);
+  return 0;
+}
@@ -0,0 +1,226 @@
+/**
+ *  @file  gctop.c
+ *  @brief Shows the statistics published by garbage collected heaps.
+ *
+ *  Every heap that has called h_publish_start() owns a shared memory
+ *  segment. gctop finds them in /dev/shm, or takes segment names as
+ *  arguments, and prints one line per heap:
+ *
+ *  @code
+ *  gctop [-n seconds] [-1] [segment ...]
+ *  @endcode
+ *
+ *  -n sets the refresh interval (default 1 second) and -1 prints the
+ *  table once and exits. Rates are computed between two refreshes.
+ */
+
+#define _DEFAULT_SOURCE // getopt, nanosleep, kill
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../shared_stats.h"
+
+#define SHM_DIRECTORY "/dev/shm"
+#define MAX_HEAPS 256
+
+
+typedef struct heap_view heap_view_t;
+
+struct heap_view
+{
+  char name[SHARED_STATS_NAME_LENGTH];
+  shared_stats_t now;
+  shared_stats_t before;
+  bool has_before;
+  bool seen;
+};
+
+static heap_view_t views[MAX_HEAPS];
+static size_t number_of_views = 0;
+
+
+/**
+ *  @brief Finds the view of a segment, creating it if it is new
+ */
+static heap_view_t *
+view_for(const char *name)
+{
+  for(size_t i = 0; i < number_of_views; ++i)
+    {
+      if(strcmp(views[i].name, name) == 0) return &views[i];
+    }
+  if(number_of_views == MAX_HEAPS) return NULL;
+
+  heap_view_t *view = &views[number_of_views++];
+  memset(view, 0, sizeof(heap_view_t));
+  snprintf(view->name, SHARED_STATS_NAME_LENGTH, "%s", name);
+  return view;
+}
+
+
+/**
+ *  @brief Reads one segment into its view
+ */
+static void
+refresh_segment(const char *name)
+{
+  shared_stats_t *stats = shared_stats_open(name);
+  if(stats == NULL) return;
+
+  shared_stats_t copy;
+  bool read = shared_stats_read(stats, &copy);
+  shared_stats_close(stats);
+  if(!read) return;
+  // Segments left behind by processes that died are not shown
+  if(kill((pid_t) copy.pid, 0) != 0 && errno == ESRCH) return;
+
+  heap_view_t *view = view_for(name);
+  if(view == NULL) return;
+  if(view->now.magic == SHARED_STATS_MAGIC)
+    {
+      view->before = view->now;
+      view->has_before = true;
+    }
+  view->now = copy;
+  view->seen = true;
+}
+
+
+/**
+ *  @brief Reads every segment in /dev/shm that a heap published
+ */
+static void
+refresh_all(void)
+{
+  DIR *directory = opendir(SHM_DIRECTORY);
+  if(directory == NULL) return;
+
+  struct dirent *entry;
+  while((entry = readdir(directory)) != NULL)
+    {
+      if(strncmp(entry->d_name, SHARED_STATS_PREFIX, strlen(SHARED_STATS_PREFIX)) != 0)
+        {
+          continue;
+        }
+      size_t length = strlen(entry->d_name);
+      char name[SHARED_STATS_NAME_LENGTH];
+      if(length + 2 > sizeof(name)) continue;
+      name[0] = '/';
+      memcpy(name + 1, entry->d_name, length + 1);
+      refresh_segment(name);
+    }
+  closedir(directory);
+}
+
+
+static double
+megabytes(uint64_t bytes)
+{
+  return (double) bytes / (1024.0 * 1024.0);
+}
+
+
+static double
+milliseconds(uint64_t ns)
+{
+  return (double) ns / 1e6;
+}
+
+
+static void
+print_views(bool clear)
+{
+  if(clear) printf("\033[H\033[2J");
+  printf("%-20s %8s %9s %9s %6s %6s %6s %6s %7s %6s %8s %8s %8s %9s\n",
+         "HEAP", "PID", "SIZE MB", "USED MB", "ACT", "PAS", "UNS", "REL",
+         "GCS", "GC/s", "LAST ms", "P99 ms", "MAX ms", "ALLOC MB/s");
+
+  for(size_t i = 0; i < number_of_views; ++i)
+    {
+      heap_view_t *view = &views[i];
+      if(!view->seen) continue;
+      shared_stats_t *now = &view->now;
+
+      double collections_per_second = 0.0;
+      if(view->has_before && now->updated_ns > view->before.updated_ns)
+        {
+          collections_per_second = (double) (now->collections - view->before.collections)
+            * 1e9 / (double) (now->updated_ns - view->before.updated_ns);
+        }
+
+      printf("%-20s %8lld %9.1f %9.1f %6llu %6llu %6llu %6llu %7llu %6.1f %8.3f %8.3f %8.3f %9.1f\n",
+             view->name + 1,
+             (long long) now->pid,
+             megabytes(now->size),
+             megabytes(now->used),
+             (unsigned long long) now->active_pages,
+             (unsigned long long) now->passive_pages,
+             (unsigned long long) now->unsafe_pages,
+             (unsigned long long) now->released_pages,
+             (unsigned long long) now->collections,
+             collections_per_second,
+             milliseconds(now->last_pause_ns),
+             milliseconds(now->p99_pause_ns),
+             milliseconds(now->max_pause_ns),
+             now->alloc_rate / (1024.0 * 1024.0));
+      view->seen = false;
+    }
+  fflush(stdout);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+  double interval = 1.0;
+  bool once = false;
+
+  int option;
+  while((option = getopt(argc, argv, "n:1")) != -1)
+    {
+      switch(option)
+        {
+        case 'n':
+          interval = atof(optarg);
+          break;
+        case '1':
+          once = true;
+          break;
+        default:
+          fprintf(stderr, "usage: %s [-n seconds] [-1] [segment ...]\n", argv[0]);
+          return 1;
+        }
+    }
+  if(interval <= 0.0) interval = 1.0;
+
+  struct timespec pause;
+  pause.tv_sec = (time_t) interval;
+  pause.tv_nsec = (long) ((interval - (double) pause.tv_sec) * 1e9);
+
+  while(true)
+    {
+      if(optind < argc)
+        {
+          for(int i = optind; i < argc; ++i)
+            {
+              refresh_segment(argv[i]);
+            }
+        }
+      else
+        {
+          refresh_all();
+        }
+      print_views(!once);
+      if(once) return 0;
+      nanosleep(&pause, NULL);
+    }
+}